@@ -0,0 +1,312 @@
+// Measures RGBA -> YUV conversion of one full frame on a single thread, swscale against every RgbaToYuv kernel
+// this CPU can run, and checks the output.
+//
+// The SIMD kernels must match the scalar kernel bit for bit. Against swscale, whose rounding and chroma siting
+// differ slightly, the largest per-sample difference must stay within --luma-tolerance and --chroma-tolerance
+// (in 8-bit code values; 10-bit formats are compared at 10 bits with the tolerance scaled by 4).
+
+#include "RgbaToYuv.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+namespace {
+    struct ConvertOptions {
+        std::string jsonPath;
+        int iterations = 20;
+        int lumaTolerance = 2;
+        int chromaTolerance = 3;
+    };
+
+    void printUsage() {
+        std::cerr << "Usage: bench_convert [options]\n"
+                     "  --iterations <n>          conversions timed per case (default: 20)\n"
+                     "  --luma-tolerance <n>      max luma difference from swscale, 8-bit codes (default: 2)\n"
+                     "  --chroma-tolerance <n>    max chroma difference from swscale, 8-bit codes (default: 3)\n"
+                     "  --json <file>             also write the result JSON to this file\n";
+    }
+
+    bool parseOptions(int argc, char** argv, ConvertOptions& options) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            const auto next = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument("missing value for " + arg);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--iterations") {
+                options.iterations = std::stoi(next());
+            } else if (arg == "--luma-tolerance") {
+                options.lumaTolerance = std::stoi(next());
+            } else if (arg == "--chroma-tolerance") {
+                options.chromaTolerance = std::stoi(next());
+            } else if (arg == "--json") {
+                options.jsonPath = next();
+            } else if (arg == "--help" || arg == "-h") {
+                return false;
+            } else {
+                throw std::invalid_argument("unknown option " + arg);
+            }
+        }
+
+        if (options.iterations < 1) {
+            throw std::invalid_argument("--iterations must be at least 1");
+        }
+        return true;
+    }
+
+    // A destination frame with row padding, so kernels that write past the row end would show up as differences.
+    struct Picture {
+        AVPixelFormat format = AV_PIX_FMT_NONE;
+        int width = 0;
+        int height = 0;
+        int planes = 0;
+        int rowBytes[4] = {};
+        int planeHeights[4] = {};
+        int linesizes[4] = {};
+        std::vector<uint8_t> storage[4];
+        uint8_t* data[4] = {};
+
+        Picture(AVPixelFormat format, int width, int height)
+            : format(format), width(width), height(height) {
+            const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(format);
+            av_image_fill_linesizes(rowBytes, format, width);
+            planes = av_pix_fmt_count_planes(format);
+            for (int plane = 0; plane < planes; ++plane) {
+                planeHeights[plane] = (plane == 1 || plane == 2) ? -((-height) >> descriptor->log2_chroma_h) : height;
+                linesizes[plane] = (rowBytes[plane] + 64 + 63) / 64 * 64;
+                storage[plane].assign(static_cast<size_t>(linesizes[plane]) * planeHeights[plane], 0);
+                data[plane] = storage[plane].data();
+            }
+        }
+    };
+
+    struct Difference {
+        int maxLuma = 0;
+        int maxChroma = 0;
+        double meanLuma = 0.0;
+        double meanChroma = 0.0;
+    };
+
+    // Differences per sample, read back at the format's bit depth.
+    Difference compare(const Picture& a, const Picture& b) {
+        const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(a.format);
+        const bool wide = descriptor->comp[0].depth > 8;
+        const int shift = descriptor->comp[0].shift;
+
+        Difference difference;
+        uint64_t lumaSum = 0;
+        uint64_t chromaSum = 0;
+        uint64_t lumaCount = 0;
+        uint64_t chromaCount = 0;
+        for (int plane = 0; plane < a.planes; ++plane) {
+            const int samples = wide ? a.rowBytes[plane] / 2 : a.rowBytes[plane];
+            for (int y = 0; y < a.planeHeights[plane]; ++y) {
+                const uint8_t* rowA = a.data[plane] + static_cast<size_t>(y) * a.linesizes[plane];
+                const uint8_t* rowB = b.data[plane] + static_cast<size_t>(y) * b.linesizes[plane];
+                for (int x = 0; x < samples; ++x) {
+                    int valueA = rowA[x];
+                    int valueB = rowB[x];
+                    if (wide) {
+                        valueA = (rowA[x * 2] | rowA[x * 2 + 1] << 8) >> shift;
+                        valueB = (rowB[x * 2] | rowB[x * 2 + 1] << 8) >> shift;
+                    }
+                    const int delta = std::abs(valueA - valueB);
+                    if (plane == 0) {
+                        difference.maxLuma = (std::max)(difference.maxLuma, delta);
+                        lumaSum += delta;
+                        ++lumaCount;
+                    } else {
+                        difference.maxChroma = (std::max)(difference.maxChroma, delta);
+                        chromaSum += delta;
+                        ++chromaCount;
+                    }
+                }
+            }
+        }
+        difference.meanLuma = lumaCount ? static_cast<double>(lumaSum) / lumaCount : 0.0;
+        difference.meanChroma = chromaCount ? static_cast<double>(chromaSum) / chromaCount : 0.0;
+        return difference;
+    }
+
+    bool identical(const Picture& a, const Picture& b) {
+        for (int plane = 0; plane < a.planes; ++plane) {
+            if (a.storage[plane] != b.storage[plane]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Smooth gradients with a gentle ripple, like rendered game frames rather than noise.
+    std::vector<uint8_t> buildSource(int width, int height) {
+        std::vector<uint8_t> source(static_cast<size_t>(width) * height * 4);
+        for (int y = 0; y < height; ++y) {
+            uint8_t* row = source.data() + static_cast<size_t>(y) * width * 4;
+            for (int x = 0; x < width; ++x) {
+                const double ripple = 24.0 * std::sin(x * 0.013) * std::cos(y * 0.017);
+                row[x * 4 + 0] = static_cast<uint8_t>(std::clamp(x * 255.0 / width + ripple, 0.0, 255.0));
+                row[x * 4 + 1] = static_cast<uint8_t>(std::clamp(y * 255.0 / height - ripple, 0.0, 255.0));
+                row[x * 4 + 2] = static_cast<uint8_t>(std::clamp(128.0 + ripple * 4.0, 0.0, 255.0));
+                row[x * 4 + 3] = 0xFF;
+            }
+        }
+        return source;
+    }
+
+    template <typename Convert>
+    double timeConversion(int iterations, Convert&& convert) {
+        convert();
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            convert();
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+    }
+}
+
+int main(int argc, char** argv) {
+    ConvertOptions options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            printUsage();
+            return 2;
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "bench_convert: " << ex.what() << "\n";
+        printUsage();
+        return 2;
+    }
+
+    struct Size {
+        int width;
+        int height;
+    };
+    const Size sizes[] = {{1920, 1080}, {2560, 1440}, {3840, 2160}};
+    const AVPixelFormat formats[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_P010LE, AV_PIX_FMT_YUV422P10LE};
+    const Encoder::RgbaToYuvKernel kernels[] = {Encoder::RgbaToYuvKernel::Scalar, Encoder::RgbaToYuvKernel::Sse41,
+                                                Encoder::RgbaToYuvKernel::Avx2, Encoder::RgbaToYuvKernel::Avx512};
+    const int colorSpace = AVCOL_SPC_BT709;
+
+    bool ok = true;
+    nlohmann::json cases = nlohmann::json::array();
+    for (const Size& size : sizes) {
+        const std::vector<uint8_t> source = buildSource(size.width, size.height);
+        const uint8_t* const sourceData[4] = {source.data(), nullptr, nullptr, nullptr};
+        const int sourceLinesize[4] = {size.width * 4, 0, 0, 0};
+
+        for (const AVPixelFormat format : formats) {
+            const int depthScale = av_pix_fmt_desc_get(format)->comp[0].depth > 8 ? 4 : 1;
+
+            for (const bool fullRange : {false, true}) {
+                nlohmann::json result = {
+                    {"width", size.width},
+                    {"height", size.height},
+                    {"format", av_get_pix_fmt_name(format)},
+                    {"range", fullRange ? "full" : "limited"},
+                };
+
+                Picture reference(format, size.width, size.height);
+                SwsContext* context = sws_getContext(size.width, size.height, AV_PIX_FMT_RGBA,
+                                                     size.width, size.height, format,
+                                                     SWS_BILINEAR, nullptr, nullptr, nullptr);
+                if (context == nullptr) {
+                    std::cerr << "bench_convert: swscale cannot convert to " << av_get_pix_fmt_name(format) << "\n";
+                    ok = false;
+                    continue;
+                }
+                sws_setColorspaceDetails(context, sws_getCoefficients(SWS_CS_DEFAULT), 1,
+                                         sws_getCoefficients(colorSpace), fullRange ? 1 : 0, 0, 1 << 16, 1 << 16);
+                const double swscaleMs = timeConversion(options.iterations, [&]() {
+                    sws_scale(context, sourceData, sourceLinesize, 0, size.height, reference.data, reference.linesizes);
+                });
+                sws_freeContext(context);
+                result["swscaleMs"] = swscaleMs;
+
+                Picture scalar(format, size.width, size.height);
+                nlohmann::json kernelResults = nlohmann::json::object();
+                for (const Encoder::RgbaToYuvKernel kernel : kernels) {
+                    if (!Encoder::isRgbaToYuvKernelAvailable(kernel)) {
+                        continue;
+                    }
+
+                    Encoder::RgbaToYuvConverter converter;
+                    if (!converter.initialize(AV_PIX_FMT_RGBA, format, colorSpace, fullRange, Encoder::ColorAdjustment(), kernel)) {
+                        std::cerr << "bench_convert: " << Encoder::getRgbaToYuvKernelName(kernel) << " rejected "
+                                  << av_get_pix_fmt_name(format) << "\n";
+                        ok = false;
+                        continue;
+                    }
+
+                    Picture output(format, size.width, size.height);
+                    const double kernelMs = timeConversion(options.iterations, [&]() {
+                        converter.convert(source.data(), sourceLinesize[0], size.width, size.height,
+                                          output.data, output.linesizes);
+                    });
+
+                    const Difference difference = compare(output, reference);
+                    bool matchesScalar = true;
+                    if (kernel == Encoder::RgbaToYuvKernel::Scalar) {
+                        for (int plane = 0; plane < output.planes; ++plane) {
+                            scalar.storage[plane] = output.storage[plane];
+                        }
+                    } else {
+                        matchesScalar = identical(output, scalar);
+                    }
+                    const bool withinTolerance = difference.maxLuma <= options.lumaTolerance * depthScale &&
+                                                 difference.maxChroma <= options.chromaTolerance * depthScale;
+                    ok = ok && matchesScalar && withinTolerance;
+
+                    kernelResults[Encoder::getRgbaToYuvKernelName(kernel)] = {
+                        {"ms", kernelMs},
+                        {"speedup", kernelMs > 0.0 ? swscaleMs / kernelMs : 0.0},
+                        {"matchesScalar", matchesScalar},
+                        {"maxLumaDiff", difference.maxLuma},
+                        {"maxChromaDiff", difference.maxChroma},
+                        {"meanLumaDiff", difference.meanLuma},
+                        {"meanChromaDiff", difference.meanChroma},
+                        {"withinTolerance", withinTolerance},
+                    };
+                }
+                result["kernels"] = kernelResults;
+                cases.push_back(result);
+            }
+        }
+    }
+
+    const nlohmann::json report = {
+        {"ok", ok},
+        {"detectedKernel", Encoder::getRgbaToYuvKernelName(Encoder::getRgbaToYuvKernel())},
+        {"iterations", options.iterations},
+        {"lumaTolerance", options.lumaTolerance},
+        {"chromaTolerance", options.chromaTolerance},
+        {"cases", cases},
+    };
+
+    const std::string text = report.dump(2);
+    std::cout << text << std::endl;
+    if (!options.jsonPath.empty()) {
+        std::ofstream(options.jsonPath) << text << "\n";
+    }
+
+    return ok ? 0 : 1;
+}
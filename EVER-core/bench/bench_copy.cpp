@@ -0,0 +1,264 @@
+// Measures copying one captured frame out of its source buffer, std::memcpy against the streamingCopy kernel
+// and the multi-lane StreamingCopier, and checks that every copy is exact.
+//
+// The source buffer comes in three kinds: "cached", copied over and over so whatever fits stays in the cache;
+// "cold", flushed from the cache before every copy, like a frame the GPU just wrote; and, on Windows,
+// "writeCombined", allocated with PAGE_WRITECOMBINE like a mapped staging texture, where only non-temporal loads
+// read at full speed.
+
+#include "StreamingCopy.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#define EVER_BENCH_CLFLUSH 1
+#endif
+
+namespace {
+    struct CopyOptions {
+        std::string jsonPath;
+        int iterations = 20;
+        size_t lanes = 4;
+    };
+
+    void printUsage() {
+        std::cerr << "Usage: bench_copy [options]\n"
+                     "  --iterations <n>    copies timed per case (default: 20)\n"
+                     "  --lanes <n>         lanes of the StreamingCopier case, calling thread included (default: 4)\n"
+                     "  --json <file>       also write the result JSON to this file\n";
+    }
+
+    bool parseOptions(int argc, char** argv, CopyOptions& options) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            const auto next = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument("missing value for " + arg);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--iterations") {
+                options.iterations = std::stoi(next());
+            } else if (arg == "--lanes") {
+                options.lanes = std::stoul(next());
+            } else if (arg == "--json") {
+                options.jsonPath = next();
+            } else if (arg == "--help" || arg == "-h") {
+                return false;
+            } else {
+                throw std::invalid_argument("unknown option " + arg);
+            }
+        }
+
+        if (options.iterations < 1 || options.lanes < 1) {
+            throw std::invalid_argument("--iterations and --lanes must be at least 1");
+        }
+        return true;
+    }
+
+    enum class SourceKind {
+        Cached,
+        Cold,
+        WriteCombined,
+    };
+
+    const char* getSourceKindName(SourceKind kind) {
+        switch (kind) {
+        case SourceKind::Cold:
+            return "cold";
+        case SourceKind::WriteCombined:
+            return "writeCombined";
+        default:
+            return "cached";
+        }
+    }
+
+    // A page-aligned buffer, write-combined where the platform can allocate one.
+    class Buffer {
+    public:
+        Buffer(size_t bytes, bool writeCombined) : bytes_(bytes) {
+#ifdef _WIN32
+            if (writeCombined) {
+                data_ = static_cast<uint8_t*>(VirtualAlloc(nullptr, bytes, MEM_COMMIT | MEM_RESERVE,
+                                                           PAGE_READWRITE | PAGE_WRITECOMBINE));
+                virtualAlloc_ = data_ != nullptr;
+                return;
+            }
+#else
+            if (writeCombined) {
+                return;
+            }
+#endif
+            storage_.resize(bytes + kAlignment);
+            const uintptr_t address = reinterpret_cast<uintptr_t>(storage_.data());
+            data_ = storage_.data() + ((kAlignment - (address & (kAlignment - 1))) & (kAlignment - 1));
+        }
+
+        ~Buffer() {
+#ifdef _WIN32
+            if (virtualAlloc_) {
+                VirtualFree(data_, 0, MEM_RELEASE);
+            }
+#endif
+        }
+
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        uint8_t* data() const { return data_; }
+        size_t size() const { return bytes_; }
+
+    private:
+        static constexpr size_t kAlignment = 4096;
+
+        size_t bytes_ = 0;
+        uint8_t* data_ = nullptr;
+        std::vector<uint8_t> storage_;
+        bool virtualAlloc_ = false;
+    };
+
+    // Evicts the buffer from every cache level, so the next read comes from memory.
+    void flushFromCache(const Buffer& buffer, std::vector<uint8_t>& evictionScratch) {
+#ifdef EVER_BENCH_CLFLUSH
+        for (size_t offset = 0; offset < buffer.size(); offset += 64) {
+            _mm_clflush(buffer.data() + offset);
+        }
+        _mm_mfence();
+#else
+        // Without CLFLUSH, walk a buffer larger than the last-level cache instead.
+        for (size_t offset = 0; offset < evictionScratch.size(); offset += 64) {
+            evictionScratch[offset]++;
+        }
+#endif
+        (void)evictionScratch;
+    }
+
+    double timeCopies(int iterations, const std::function<void()>& prepare, const std::function<void()>& copy) {
+        prepare();
+        copy();
+        double totalMs = 0.0;
+        for (int i = 0; i < iterations; ++i) {
+            prepare();
+            const auto start = std::chrono::steady_clock::now();
+            copy();
+            totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        return totalMs / iterations;
+    }
+}
+
+int main(int argc, char** argv) {
+    CopyOptions options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            printUsage();
+            return 2;
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "bench_copy: " << ex.what() << "\n";
+        printUsage();
+        return 2;
+    }
+
+    struct Size {
+        int width;
+        int height;
+    };
+    const Size sizes[] = {{1920, 1080}, {2560, 1440}, {3840, 2160}};
+    const SourceKind kinds[] = {SourceKind::Cached, SourceKind::Cold, SourceKind::WriteCombined};
+
+    Encoder::StreamingCopier copier;
+    copier.initialize(options.lanes);
+    const size_t lanes = copier.getLaneCount();
+    std::vector<uint8_t> evictionScratch(64 * 1024 * 1024);
+
+    bool ok = true;
+    nlohmann::json cases = nlohmann::json::array();
+    for (const Size& size : sizes) {
+        const size_t bytes = static_cast<size_t>(size.width) * size.height * 4;
+        Buffer destination(bytes, false);
+
+        for (const SourceKind kind : kinds) {
+            Buffer source(bytes, kind == SourceKind::WriteCombined);
+            if (source.data() == nullptr) {
+                continue;
+            }
+            for (size_t i = 0; i < bytes; ++i) {
+                source.data()[i] = static_cast<uint8_t>(i * 131 + (i >> 12));
+            }
+
+            const std::function<void()> prepare = [&]() {
+                if (kind == SourceKind::Cold) {
+                    flushFromCache(source, evictionScratch);
+                }
+            };
+            const std::function<void()> copies[] = {
+                [&]() { std::memcpy(destination.data(), source.data(), bytes); },
+                [&]() { Encoder::streamingCopy(destination.data(), source.data(), bytes); },
+                [&]() { copier.copy(destination.data(), source.data(), bytes); },
+            };
+            const char* names[] = {"memcpy", "streamingCopy", "streamingCopier"};
+
+            nlohmann::json results = nlohmann::json::object();
+            double memcpyMs = 0.0;
+            for (size_t method = 0; method < std::size(copies); ++method) {
+                std::memset(destination.data(), 0, bytes);
+                const double ms = timeCopies(options.iterations, prepare, copies[method]);
+                const bool exact = std::memcmp(destination.data(), source.data(), bytes) == 0;
+                ok = ok && exact;
+                if (method == 0) {
+                    memcpyMs = ms;
+                }
+                results[names[method]] = {
+                    {"ms", ms},
+                    {"gbPerSecond", ms > 0.0 ? static_cast<double>(bytes) / (ms * 1e6) : 0.0},
+                    {"speedup", ms > 0.0 ? memcpyMs / ms : 0.0},
+                    {"exact", exact},
+                };
+            }
+
+            cases.push_back({
+                {"width", size.width},
+                {"height", size.height},
+                {"source", getSourceKindName(kind)},
+                {"copies", results},
+            });
+        }
+    }
+    copier.shutdown();
+
+    const nlohmann::json report = {
+        {"ok", ok},
+        {"kernel", Encoder::getStreamingCopyKernelName(Encoder::getStreamingCopyKernel())},
+        {"iterations", options.iterations},
+        {"lanes", lanes},
+        {"cases", cases},
+    };
+
+    const std::string text = report.dump(2);
+    std::cout << text << std::endl;
+    if (!options.jsonPath.empty()) {
+        std::ofstream(options.jsonPath) << text << "\n";
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,408 @@
+// Headless end-to-end encoder benchmark.
+//
+// Drives EncoderSession exactly like the game hooks do (createContext, one enqueueVideoFrame per rendered
+// frame, WriteSample-sized audio chunks, then finishAudio/finishVideo/endSession) with generated RGBA frames
+// and PCM audio, and prints a JSON summary so presets and builds can be compared without launching the game.
+
+#include "EncoderSession.h"
+#include "EncoderThreading.h"
+#include "JsonPresetReader.h"
+#include "LatencyHistogram.h"
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+    struct BenchOptions {
+        uint32_t width = 1920;
+        uint32_t height = 1080;
+        uint32_t fpsNumerator = 60;
+        uint32_t fpsDenominator = 1;
+        uint32_t frames = 600;
+        uint32_t motionBlurSamples = 0;
+        uint32_t sampleRate = 48000;
+        uint32_t channels = 2;
+        uint32_t videoQueueBudgetMb = 0;
+        bool spillVideoQueue = false;
+        Encoder::EncoderThreadingPolicy threading;
+        uint32_t outputBufferMb = 8;
+        std::string preset;
+        std::vector<std::string> teePresets;
+        std::string proxyPreset;
+        uint32_t proxyHeight = 540;
+        std::string output = "bench_output";
+        std::string jsonPath;
+        bool keepOutput = false;
+    };
+
+    void printUsage() {
+        std::cerr << "Usage: bench_encoder [options]\n"
+                     "  --preset <file.json>     encoder preset (deploy/EVER/presets/*.json); built-in default if omitted\n"
+                     "  --width <px>             frame width (default 1920)\n"
+                     "  --height <px>            frame height (default 1080)\n"
+                     "  --fps <num[/den]>        frame rate (default 60)\n"
+                     "  --frames <n>             frames to encode (default 600)\n"
+                     "  --motion-blur-samples <n> game frames accumulated per encoded frame, minus one (default 0)\n"
+                     "  --sample-rate <hz>       audio sample rate (default 48000)\n"
+                     "  --channels <1|2|6>       audio channels (default 2)\n"
+                     "  --queue-budget-mb <mb>   video_queue_budget_mb (default 0 = automatic)\n"
+                     "  --spill                  enable video_queue_spill\n"
+                     "  --threading <auto|off>   auto_encoder_threads (default auto)\n"
+                     "  --reserved-cores <n>     reserved_cores (default 2)\n"
+                     "  --parallel-encoders <n>  parallel_encoders (default 0 = one encoder)\n"
+                     "  --chunk-seconds <s>      parallel_chunk_seconds (default 2)\n"
+                     "  --output-buffer-mb <mb>  output_buffer_mb (default 8, 0 = write from the muxer)\n"
+                     "  --tee <file.json>        also encode to this preset in the same pass; may be repeated\n"
+                     "  --proxy <file.json>      also write a proxy with this preset\n"
+                     "  --proxy-height <px>      proxy_height (default 540)\n"
+                     "  --output <path>          output file without extension (default bench_output)\n"
+                     "  --json <file>            also write the result JSON to this file\n"
+                     "  --keep-output            keep the encoded file after measuring its size\n";
+    }
+
+    bool parseOptions(int argc, char** argv, BenchOptions& options) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            const auto next = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument("missing value for " + arg);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--preset") {
+                options.preset = next();
+            } else if (arg == "--width") {
+                options.width = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--height") {
+                options.height = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--fps") {
+                const std::string value = next();
+                const size_t slash = value.find('/');
+                options.fpsNumerator = static_cast<uint32_t>(std::stoul(value.substr(0, slash)));
+                options.fpsDenominator = slash == std::string::npos ? 1 : static_cast<uint32_t>(std::stoul(value.substr(slash + 1)));
+            } else if (arg == "--frames") {
+                options.frames = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--motion-blur-samples") {
+                options.motionBlurSamples = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--sample-rate") {
+                options.sampleRate = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--channels") {
+                options.channels = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--queue-budget-mb") {
+                options.videoQueueBudgetMb = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--spill") {
+                options.spillVideoQueue = true;
+            } else if (arg == "--threading") {
+                const std::string value = next();
+                if (value != "auto" && value != "off") {
+                    throw std::invalid_argument("--threading must be auto or off");
+                }
+                options.threading.automatic = value == "auto";
+            } else if (arg == "--reserved-cores") {
+                options.threading.reservedCores = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--parallel-encoders") {
+                options.threading.parallelEncoders = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--chunk-seconds") {
+                options.threading.chunkSeconds = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--output-buffer-mb") {
+                options.outputBufferMb = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--tee") {
+                options.teePresets.push_back(next());
+            } else if (arg == "--proxy") {
+                options.proxyPreset = next();
+            } else if (arg == "--proxy-height") {
+                options.proxyHeight = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--output") {
+                options.output = next();
+            } else if (arg == "--json") {
+                options.jsonPath = next();
+            } else if (arg == "--keep-output") {
+                options.keepOutput = true;
+            } else if (arg == "--help" || arg == "-h") {
+                return false;
+            } else {
+                throw std::invalid_argument("unknown option " + arg);
+            }
+        }
+
+        if (options.width == 0 || options.height == 0 || options.fpsNumerator == 0 || options.fpsDenominator == 0 ||
+            options.frames == 0) {
+            throw std::invalid_argument("width, height, fps and frames must be positive");
+        }
+        return true;
+    }
+
+    // Rows of texture scrolled past the frame, so consecutive frames differ like a slow camera pan
+    // without generating a new image per frame.
+    constexpr uint32_t kScrollRows = 256;
+    constexpr uint32_t kScrollStep = 4;
+
+    std::vector<uint8_t> buildCanvas(uint32_t width, uint32_t height) {
+        const uint32_t canvasHeight = height + kScrollRows;
+        std::vector<uint8_t> canvas(static_cast<size_t>(width) * 4u * canvasHeight);
+
+        uint32_t noise = 0x12345678u;
+        for (uint32_t y = 0; y < canvasHeight; ++y) {
+            uint8_t* row = canvas.data() + static_cast<size_t>(y) * width * 4u;
+            for (uint32_t x = 0; x < width; ++x) {
+                // Smooth gradients plus low-amplitude noise: compressible, but not trivially so.
+                noise = noise * 1664525u + 1013904223u;
+                const uint8_t grain = static_cast<uint8_t>((noise >> 24) & 0x0F);
+                row[x * 4 + 0] = static_cast<uint8_t>((x * 255u / width + grain) & 0xFF);
+                row[x * 4 + 1] = static_cast<uint8_t>((y * 255u / canvasHeight + grain) & 0xFF);
+                row[x * 4 + 2] = static_cast<uint8_t>(((x ^ y) & 0x7F) + grain);
+                row[x * 4 + 3] = 0xFF;
+            }
+        }
+        return canvas;
+    }
+
+    uint64_t getPeakResidentBytes() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters{};
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return counters.PeakWorkingSetSize;
+        }
+        return 0;
+#else
+        rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+            return static_cast<uint64_t>(usage.ru_maxrss) * 1024u;
+        }
+        return 0;
+#endif
+    }
+
+    nlohmann::json summarize(const LatencyHistogram& histogram) {
+        const LatencyHistogram::Summary summary = histogram.summarize();
+        return {
+            {"count", summary.count},
+            {"meanMs", summary.meanMs},
+            {"p50Ms", summary.p50Ms},
+            {"p95Ms", summary.p95Ms},
+            {"p99Ms", summary.p99Ms},
+            {"maxMs", summary.maxMs},
+        };
+    }
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            printUsage();
+            return 0;
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "bench_encoder: " << ex.what() << "\n";
+        printUsage();
+        return 2;
+    }
+
+    const FFmpeg::FFENCODERCONFIG config = JsonPresetReader(options.preset).readEncoderConfig();
+    const std::string outputPath = options.output + "." + std::string(config.format.container);
+    const uint32_t blockAlign = options.channels * 2u;
+
+    Encoder::EncoderSessionOptions sessionOptions;
+    sessionOptions.videoQueueBudgetMb = options.videoQueueBudgetMb;
+    sessionOptions.spillVideoQueue = options.spillVideoQueue;
+    sessionOptions.threading = options.threading;
+    sessionOptions.outputBufferMb = options.outputBufferMb;
+
+    // Tee outputs are written next to the main one as <output>_<preset>.<container>.
+    std::vector<Encoder::EncoderOutput>& teeOutputs = sessionOptions.teeOutputs;
+    std::vector<std::string> teePaths;
+    for (const std::string& teePreset : options.teePresets) {
+        const FFmpeg::FFENCODERCONFIG teeConfig = JsonPresetReader(teePreset).readEncoderConfig();
+        teePaths.push_back(options.output + "_" + std::filesystem::path(teePreset).stem().string() + "." +
+                           std::string(teeConfig.format.container));
+        teeOutputs.push_back(Encoder::EncoderOutput{teeConfig, std::wstring(teePaths.back().begin(), teePaths.back().end())});
+    }
+
+    Encoder::ProxyOutput& proxy = sessionOptions.proxy;
+    std::string proxyPath;
+    if (!options.proxyPreset.empty()) {
+        proxy.enabled = true;
+        proxy.config = JsonPresetReader(options.proxyPreset).readEncoderConfig();
+        proxy.height = options.proxyHeight;
+        proxyPath = options.output + "_proxy." + std::string(proxy.config.format.container);
+        proxy.filename = std::wstring(proxyPath.begin(), proxyPath.end());
+    }
+
+    const std::vector<uint8_t> canvas = buildCanvas(options.width, options.height);
+    const int rowPitch = static_cast<int>(options.width * 4u);
+
+    LatencyHistogram videoBlocked("bench.enqueue_video");
+    LatencyHistogram audioBlocked("bench.write_audio");
+    std::vector<int16_t> audioChunk;
+    double phase = 0.0;
+    uint64_t audioSamplesSent = 0;
+    bool ok = true;
+    std::string error;
+
+    const auto start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration finalizeElapsed{};
+
+    try {
+        Encoder::EncoderSession session;
+        const std::wstring filename(outputPath.begin(), outputPath.end());
+        if (FAILED(session.createContext(config, filename, options.width, options.height, "rgba",
+                                         options.fpsNumerator, options.fpsDenominator, options.channels,
+                                         options.sampleRate, "s16", blockAlign, false, 0, 0, sessionOptions))) {
+            throw std::runtime_error("createContext failed");
+        }
+
+        // With motion blur the game renders motionBlurSamples + 1 frames per encoded frame; each of them delivers
+        // its own audio chunk, and only the last one hands the accumulated image to the encoder.
+        const uint64_t subFrames = static_cast<uint64_t>(options.motionBlurSamples) + 1;
+        const uint64_t gameFrames = static_cast<uint64_t>(options.frames) * subFrames;
+        for (uint64_t gameFrame = 0; gameFrame < gameFrames; ++gameFrame) {
+            if (gameFrame % subFrames == subFrames - 1) {
+                const uint64_t frame = gameFrame / subFrames;
+                const uint32_t scroll = static_cast<uint32_t>((frame * kScrollStep) % kScrollRows);
+                const uint8_t* pixels = canvas.data() + static_cast<size_t>(scroll) * static_cast<size_t>(rowPitch);
+
+                const auto videoStart = std::chrono::steady_clock::now();
+                const HRESULT videoHr = session.enqueueVideoFrame(pixels, rowPitch);
+                videoBlocked.record(std::chrono::steady_clock::now() - videoStart);
+                if (FAILED(videoHr)) {
+                    throw std::runtime_error("enqueueVideoFrame failed at frame " + std::to_string(frame));
+                }
+            }
+
+            // One WriteSample-sized chunk per game frame, carrying the fractional remainder forward.
+            const uint64_t targetSamples = (gameFrame + 1) * options.sampleRate * options.fpsDenominator /
+                                           (static_cast<uint64_t>(options.fpsNumerator) * subFrames);
+            const uint32_t samples = static_cast<uint32_t>(targetSamples - audioSamplesSent);
+            if (samples == 0) {
+                continue;
+            }
+            audioChunk.resize(static_cast<size_t>(samples) * options.channels);
+            for (uint32_t s = 0; s < samples; ++s) {
+                const int16_t value = static_cast<int16_t>(std::sin(phase) * 8000.0);
+                phase += 2.0 * 3.14159265358979323846 * 440.0 / options.sampleRate;
+                for (uint32_t c = 0; c < options.channels; ++c) {
+                    audioChunk[static_cast<size_t>(s) * options.channels + c] = value;
+                }
+            }
+
+            // Media Foundation sample times are in 100 ns units.
+            const LONGLONG sampleTime = static_cast<LONGLONG>(audioSamplesSent * 10000000ull / options.sampleRate);
+            const auto audioStart = std::chrono::steady_clock::now();
+            const HRESULT audioHr = session.writeAudioFrame(reinterpret_cast<BYTE*>(audioChunk.data()),
+                                                            static_cast<int32_t>(samples * blockAlign), sampleTime);
+            audioBlocked.record(std::chrono::steady_clock::now() - audioStart);
+            if (FAILED(audioHr)) {
+                throw std::runtime_error("writeAudioFrame failed at game frame " + std::to_string(gameFrame));
+            }
+            audioSamplesSent = targetSamples;
+        }
+
+        const auto finalizeStart = std::chrono::steady_clock::now();
+        if (FAILED(session.finishAudio()) || FAILED(session.finishVideo()) || FAILED(session.endSession())) {
+            throw std::runtime_error("finalize failed");
+        }
+        finalizeElapsed = std::chrono::steady_clock::now() - finalizeStart;
+    } catch (const std::exception& ex) {
+        ok = false;
+        error = ex.what();
+    }
+
+    const double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::error_code sizeError;
+    const uintmax_t outputBytes = std::filesystem::file_size(outputPath, sizeError);
+    if (!options.keepOutput) {
+        std::filesystem::remove(outputPath, sizeError);
+    }
+
+    nlohmann::json teeResults = nlohmann::json::array();
+    for (size_t i = 0; i < teeOutputs.size(); ++i) {
+        std::error_code teeError;
+        const uintmax_t teeBytes = std::filesystem::file_size(teePaths[i], teeError);
+        teeResults.push_back({
+            {"preset", std::filesystem::path(options.teePresets[i]).filename().string()},
+            {"videoEncoder", std::string(teeOutputs[i].config.video.encoder)},
+            {"outputBytes", teeError ? 0 : static_cast<uint64_t>(teeBytes)},
+        });
+        if (!options.keepOutput) {
+            std::filesystem::remove(teePaths[i], teeError);
+        }
+    }
+
+    nlohmann::json proxyResult = nullptr;
+    if (proxy.enabled) {
+        std::error_code proxyError;
+        const uintmax_t proxyBytes = std::filesystem::file_size(proxyPath, proxyError);
+        proxyResult = {
+            {"preset", std::filesystem::path(options.proxyPreset).filename().string()},
+            {"videoEncoder", std::string(proxy.config.video.encoder)},
+            {"outputBytes", proxyError ? 0 : static_cast<uint64_t>(proxyBytes)},
+        };
+        if (!options.keepOutput) {
+            std::filesystem::remove(proxyPath, proxyError);
+        }
+    }
+
+    // Total time the capture hooks spent inside the session, spread over the encoded frames.
+    // Same plan FFmpegEncoder logs, so runs with --threading auto and off can be told apart in the results.
+    const Encoder::EncoderThreadingPlan threadingPlan =
+        Encoder::planEncoderThreading(config.video.encoder, static_cast<int>(options.width),
+                                      static_cast<int>(options.height), options.threading,
+                                      std::thread::hardware_concurrency());
+    const LatencyHistogram::Summary videoSummary = videoBlocked.summarize();
+    const LatencyHistogram::Summary audioSummary = audioBlocked.summarize();
+    const double blockedMsPerFrame =
+        (videoSummary.meanMs * videoSummary.count + audioSummary.meanMs * audioSummary.count) / options.frames;
+    nlohmann::json result = {
+        {"ok", ok},
+        {"preset", options.preset.empty() ? "default" : std::filesystem::path(options.preset).filename().string()},
+        {"videoEncoder", std::string(config.video.encoder)},
+        {"audioEncoder", std::string(config.audio.encoder)},
+        {"width", options.width},
+        {"height", options.height},
+        {"fps", static_cast<double>(options.fpsNumerator) / options.fpsDenominator},
+        {"frames", options.frames},
+        {"motionBlurSamples", options.motionBlurSamples},
+        {"threading", threadingPlan.toString()},
+        {"elapsedSeconds", elapsedSeconds},
+        {"framesPerSecond", ok && elapsedSeconds > 0.0 ? options.frames / elapsedSeconds : 0.0},
+        {"finalizeSeconds", std::chrono::duration<double>(finalizeElapsed).count()},
+        {"renderThreadBlockedMsPerFrame", blockedMsPerFrame},
+        {"enqueueVideo", summarize(videoBlocked)},
+        {"writeAudio", summarize(audioBlocked)},
+        {"peakRssBytes", getPeakResidentBytes()},
+        {"outputBytes", sizeError ? 0 : static_cast<uint64_t>(outputBytes)},
+        {"teeOutputs", teeResults},
+        {"proxy", proxyResult},
+    };
+    if (!ok) {
+        result["error"] = error;
+    }
+
+    const std::string text = result.dump(2);
+    std::cout << text << std::endl;
+    if (!options.jsonPath.empty()) {
+        std::ofstream(options.jsonPath) << text << "\n";
+    }
+
+    return ok ? 0 : 1;
+}
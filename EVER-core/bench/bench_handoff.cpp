@@ -0,0 +1,212 @@
+// Measures the capture -> worker queue handoff on its own: SpscRingBuffer, which the video queue uses, against
+// SafeQueue, the mutex + condition variable queue it replaced.
+//
+// "stream" pushes items back to back and reports the cost per item. "paced" pushes one timestamped item every
+// --gap-us, like frames arriving from the game, and reports how long each one took to reach the consumer: the
+// ring's consumer is then found spinning (short gaps) or parked (long gaps), so the spin-then-park wake-up is
+// what is being timed.
+
+#include "LatencyHistogram.h"
+#include "SafeQueue.h"
+#include "SpscRingBuffer.h"
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct HandoffOptions {
+        uint64_t items = 2000000;
+        uint32_t capacity = 8;
+        uint64_t pacedItems = 20000;
+        uint32_t gapUs = 50;
+        std::string jsonPath;
+    };
+
+    void printUsage() {
+        std::cerr << "Usage: bench_handoff [options]\n"
+                     "  --items <n>          items pushed back to back in the stream case (default 2000000)\n"
+                     "  --capacity <n>       queue slots (default 8)\n"
+                     "  --paced-items <n>    items pushed in the paced case (default 20000)\n"
+                     "  --gap-us <us>        time between paced pushes (default 50)\n"
+                     "  --json <file>        also write the result JSON to this file\n";
+    }
+
+    bool parseOptions(int argc, char** argv, HandoffOptions& options) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            const auto next = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument("missing value for " + arg);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--items") {
+                options.items = std::stoull(next());
+            } else if (arg == "--capacity") {
+                options.capacity = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--paced-items") {
+                options.pacedItems = std::stoull(next());
+            } else if (arg == "--gap-us") {
+                options.gapUs = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--json") {
+                options.jsonPath = next();
+            } else if (arg == "--help" || arg == "-h") {
+                return false;
+            } else {
+                throw std::invalid_argument("unknown option " + arg);
+            }
+        }
+
+        if (options.items == 0 || options.capacity == 0 || options.pacedItems == 0) {
+            throw std::invalid_argument("items, capacity and paced items must be positive");
+        }
+        return true;
+    }
+
+    // Both queues behind the same push/pop; a pop of kStop ends the consumer.
+    constexpr uint64_t kStop = ~uint64_t{0};
+
+    struct RingQueue {
+        explicit RingQueue(uint32_t capacity) : ring(capacity) {}
+
+        void push(uint64_t value) {
+            ring.push(value);
+        }
+
+        uint64_t pop() {
+            uint64_t value = kStop;
+            ring.pop(value);
+            return value;
+        }
+
+        SpscRingBuffer<uint64_t> ring;
+    };
+
+    struct MutexQueue {
+        explicit MutexQueue(uint32_t capacity) : queue(capacity) {}
+
+        void push(uint64_t value) {
+            queue.enqueue(value);
+        }
+
+        uint64_t pop() {
+            return queue.dequeue();
+        }
+
+        SafeQueue<uint64_t> queue;
+    };
+
+    int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    template <class Queue>
+    nlohmann::json runStream(const HandoffOptions& options) {
+        Queue queue(options.capacity);
+        uint64_t sum = 0;
+        bool inOrder = true;
+
+        const auto start = Clock::now();
+        std::thread consumer([&] {
+            uint64_t expected = 0;
+            for (uint64_t value = queue.pop(); value != kStop; value = queue.pop()) {
+                inOrder = inOrder && value == expected++;
+                sum += value;
+            }
+        });
+        for (uint64_t i = 0; i < options.items; ++i) {
+            queue.push(i);
+        }
+        queue.push(kStop);
+        consumer.join();
+        const double elapsedNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+        return {
+            {"nsPerItem", elapsedNs / static_cast<double>(options.items)},
+            {"itemsPerSecond", static_cast<double>(options.items) * 1e9 / elapsedNs},
+            {"ok", inOrder && sum == options.items * (options.items - 1) / 2},
+        };
+    }
+
+    template <class Queue>
+    nlohmann::json runPaced(const HandoffOptions& options) {
+        Queue queue(options.capacity);
+        LatencyHistogram latency("handoff.paced");
+
+        std::thread consumer([&] {
+            for (uint64_t sent = queue.pop(); sent != kStop; sent = queue.pop()) {
+                latency.record(nowNs() - static_cast<int64_t>(sent));
+            }
+        });
+        const auto gap = std::chrono::microseconds(options.gapUs);
+        auto due = Clock::now();
+        for (uint64_t i = 0; i < options.pacedItems; ++i) {
+            // Busy-wait rather than sleep, so the producer's own wake-up jitter stays out of the numbers.
+            due += gap;
+            while (Clock::now() < due) {
+            }
+            queue.push(static_cast<uint64_t>(nowNs()));
+        }
+        queue.push(kStop);
+        consumer.join();
+
+        const LatencyHistogram::Summary summary = latency.summarize();
+        return {
+            {"count", summary.count},
+            {"meanUs", summary.meanMs * 1000.0},
+            {"p50Us", summary.p50Ms * 1000.0},
+            {"p99Us", summary.p99Ms * 1000.0},
+            {"maxUs", summary.maxMs * 1000.0},
+        };
+    }
+}
+
+int main(int argc, char** argv) {
+    HandoffOptions options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            printUsage();
+            return 2;
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "bench_handoff: " << ex.what() << "\n";
+        printUsage();
+        return 2;
+    }
+
+    const nlohmann::json ringStream = runStream<RingQueue>(options);
+    const nlohmann::json mutexStream = runStream<MutexQueue>(options);
+    const nlohmann::json ringPaced = runPaced<RingQueue>(options);
+    const nlohmann::json mutexPaced = runPaced<MutexQueue>(options);
+    const bool ok = ringStream["ok"].get<bool>() && mutexStream["ok"].get<bool>();
+
+    const nlohmann::json report = {
+        {"ok", ok},
+        {"items", options.items},
+        {"capacity", options.capacity},
+        {"pacedItems", options.pacedItems},
+        {"gapUs", options.gapUs},
+        {"hardwareThreads", std::thread::hardware_concurrency()},
+        {"stream", {{"spscRing", ringStream}, {"mutexQueue", mutexStream}}},
+        {"paced", {{"spscRing", ringPaced}, {"mutexQueue", mutexPaced}}},
+    };
+
+    const std::string text = report.dump(2);
+    std::cout << text << std::endl;
+    if (!options.jsonPath.empty()) {
+        std::ofstream(options.jsonPath) << text << "\n";
+    }
+
+    return ok ? 0 : 1;
+}
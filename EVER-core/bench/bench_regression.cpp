@@ -0,0 +1,262 @@
+// Performance regression gate for the encoder core.
+//
+// Runs bench_encoder over the resolution x preset matrix described in the baseline file, one process per case so
+// peak memory is measured per case, and fails when throughput drops or peak memory grows beyond the baseline's
+// tolerances, or when a case has no recorded result to compare with. --update records the current results as the
+// new baseline.
+//
+// Motion blur is not part of the matrix: its accumulation runs on the GPU in the game hooks, so in bench_encoder
+// it would only change how often frames are handed over, not the work being measured.
+
+#include <nlohmann/json.hpp>
+
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    struct GateOptions {
+        std::filesystem::path benchPath;
+        std::filesystem::path baselinePath;
+        std::filesystem::path presetDir;
+        std::filesystem::path workDir = std::filesystem::temp_directory_path() / "ever_bench";
+        std::string filter;
+        bool update = false;
+    };
+
+    struct Case {
+        std::string key;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::string preset;
+    };
+
+    void printUsage() {
+        std::cerr << "Usage: bench_regression --bench <bench_encoder> --baseline <baseline.json> --presets <dir> [options]\n"
+                     "  --work-dir <dir>   scratch directory for encoded output (default: temp/ever_bench)\n"
+                     "  --filter <text>    only run cases whose key contains text\n"
+                     "  --update           write the measured results into the baseline instead of comparing\n";
+    }
+
+    bool parseOptions(int argc, char** argv, GateOptions& options) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            const auto next = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument("missing value for " + arg);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--bench") {
+                options.benchPath = next();
+            } else if (arg == "--baseline") {
+                options.baselinePath = next();
+            } else if (arg == "--presets") {
+                options.presetDir = next();
+            } else if (arg == "--work-dir") {
+                options.workDir = next();
+            } else if (arg == "--filter") {
+                options.filter = next();
+            } else if (arg == "--update") {
+                options.update = true;
+            } else if (arg == "--help" || arg == "-h") {
+                return false;
+            } else {
+                throw std::invalid_argument("unknown option " + arg);
+            }
+        }
+
+        if (options.benchPath.empty() || options.baselinePath.empty() || options.presetDir.empty()) {
+            throw std::invalid_argument("--bench, --baseline and --presets are required");
+        }
+        return true;
+    }
+
+    std::vector<Case> buildMatrix(const nlohmann::json& baseline) {
+        std::vector<Case> cases;
+        for (const std::string& resolution : baseline.at("resolutions").get<std::vector<std::string>>()) {
+            const size_t separator = resolution.find('x');
+            if (separator == std::string::npos) {
+                throw std::invalid_argument("bad resolution " + resolution);
+            }
+
+            for (const std::string& preset : baseline.at("presets").get<std::vector<std::string>>()) {
+                Case entry;
+                entry.width = static_cast<uint32_t>(std::stoul(resolution.substr(0, separator)));
+                entry.height = static_cast<uint32_t>(std::stoul(resolution.substr(separator + 1)));
+                entry.preset = preset;
+                entry.key = resolution + "/" + std::filesystem::path(preset).stem().string();
+                cases.push_back(entry);
+            }
+        }
+        return cases;
+    }
+
+    std::string quote(const std::filesystem::path& path) {
+        return "\"" + path.string() + "\"";
+    }
+
+    bool runCase(const GateOptions& options, const nlohmann::json& baseline, const Case& entry,
+                 nlohmann::json& result) {
+        std::string name = entry.key;
+        for (char& c : name) {
+            if (c == '/') {
+                c = '_';
+            }
+        }
+        const std::filesystem::path jsonPath = options.workDir / (name + ".json");
+        std::filesystem::remove(jsonPath);
+
+        std::ostringstream command;
+        command << quote(options.benchPath)
+                << " --preset " << quote(options.presetDir / entry.preset)
+                << " --width " << entry.width
+                << " --height " << entry.height
+                << " --fps " << baseline.value("fps", std::string("60"))
+                << " --frames " << baseline.value("frames", 300)
+                << " --output " << quote(options.workDir / name)
+                << " --json " << quote(jsonPath);
+
+#ifdef _WIN32
+        // cmd.exe strips the outer pair of quotes when the command line starts with one.
+        const std::string commandLine = "\"" + command.str() + " >NUL\"";
+#else
+        const std::string commandLine = command.str() + " >/dev/null";
+#endif
+        const int exitCode = std::system(commandLine.c_str());
+
+        std::ifstream file(jsonPath);
+        if (!file.is_open()) {
+            std::cerr << entry.key << ": bench_encoder exited with " << exitCode << " and wrote no result\n";
+            return false;
+        }
+        result = nlohmann::json::parse(file, nullptr, false);
+        if (result.is_discarded()) {
+            std::cerr << entry.key << ": unreadable result " << jsonPath.string() << "\n";
+            return false;
+        }
+        if (exitCode != 0 || !result.value("ok", false)) {
+            std::cerr << entry.key << ": " << result.value("error", std::string("bench_encoder failed")) << "\n";
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    GateOptions options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            printUsage();
+            return 0;
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "bench_regression: " << ex.what() << "\n";
+        printUsage();
+        return 2;
+    }
+
+    nlohmann::json baseline;
+    std::vector<Case> cases;
+    try {
+        std::ifstream file(options.baselinePath);
+        if (!file.is_open()) {
+            throw std::runtime_error("cannot open " + options.baselinePath.string());
+        }
+        baseline = nlohmann::json::parse(file);
+        cases = buildMatrix(baseline);
+        std::filesystem::create_directories(options.workDir);
+    } catch (const std::exception& ex) {
+        std::cerr << "bench_regression: " << ex.what() << "\n";
+        return 2;
+    }
+
+    const nlohmann::json tolerance = baseline.value("tolerance", nlohmann::json::object());
+    const double throughputTolerance = tolerance.value("throughput", 0.10);
+    const double memoryTolerance = tolerance.value("peakRss", 0.15);
+    nlohmann::json& recorded = baseline["results"];
+    if (!recorded.is_object()) {
+        recorded = nlohmann::json::object();
+    }
+    if (!options.update && recorded.empty()) {
+        std::cerr << "bench_regression: " << options.baselinePath.string()
+                  << " has no recorded results; record them on this machine with --update first\n";
+        return 2;
+    }
+
+    size_t failures = 0;
+    size_t casesRun = 0;
+    std::cout << std::left << std::setw(44) << "case" << std::right << std::setw(10) << "fps" << std::setw(10)
+              << "base" << std::setw(12) << "rss MB" << std::setw(10) << "base" << "  status\n";
+
+    for (const Case& entry : cases) {
+        if (!options.filter.empty() && entry.key.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        ++casesRun;
+
+        nlohmann::json result;
+        if (!runCase(options, baseline, entry, result)) {
+            ++failures;
+            continue;
+        }
+
+        const double fps = result.value("framesPerSecond", 0.0);
+        const double rssMb = result.value("peakRssBytes", 0.0) / (1024.0 * 1024.0);
+
+        std::string status;
+        double baseFps = 0.0;
+        double baseRssMb = 0.0;
+        if (options.update) {
+            recorded[entry.key] = {
+                {"framesPerSecond", fps},
+                {"peakRssBytes", result.value("peakRssBytes", uint64_t{0})},
+                {"renderThreadBlockedMsPerFrame", result.value("renderThreadBlockedMsPerFrame", 0.0)},
+            };
+            status = "recorded";
+        } else if (!recorded.contains(entry.key)) {
+            status = "NO BASELINE";
+            ++failures;
+        } else {
+            const nlohmann::json& expected = recorded[entry.key];
+            baseFps = expected.value("framesPerSecond", 0.0);
+            baseRssMb = expected.value("peakRssBytes", 0.0) / (1024.0 * 1024.0);
+
+            status = "ok";
+            if (fps < baseFps * (1.0 - throughputTolerance)) {
+                status = "THROUGHPUT REGRESSION";
+                ++failures;
+            } else if (baseRssMb > 0.0 && rssMb > baseRssMb * (1.0 + memoryTolerance)) {
+                status = "MEMORY REGRESSION";
+                ++failures;
+            }
+        }
+
+        std::cout << std::left << std::setw(44) << entry.key << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << fps << std::setw(10) << baseFps << std::setw(12) << rssMb << std::setw(10)
+                  << baseRssMb << "  " << status << std::endl;
+    }
+
+    if (options.update) {
+        std::ofstream(options.baselinePath) << baseline.dump(2) << "\n";
+        std::cout << "Baseline written to " << options.baselinePath.string() << "\n";
+    }
+
+    if (casesRun == 0) {
+        std::cerr << "bench_regression: no case matches --filter " << options.filter << "\n";
+        return 2;
+    }
+    if (failures != 0) {
+        std::cout << failures << " case(s) failed\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,301 @@
+// Replays a session trace (session_trace = true in EVER.ini) into a fresh EncoderSession.
+//
+// Frames and audio chunks are submitted with the recorded sizes and order, either as fast as the session accepts
+// them or on the recorded timeline, and the time each call blocked is reported next to what the game saw.
+// Frames recorded with session_trace_pixel_step are upscaled back to full size; otherwise a scrolling
+// test pattern stands in for the picture.
+
+#include "EncoderSession.h"
+#include "JsonPresetReader.h"
+#include "LatencyHistogram.h"
+#include "SessionTrace.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    struct ReplayOptions {
+        std::string tracePath;
+        std::string preset;
+        std::string output;
+        std::string jsonPath;
+        bool recordedSpeed = false;
+        bool keepOutput = false;
+    };
+
+    void printUsage() {
+        std::cerr << "Usage: replay_trace <file.evertrace> [options]\n"
+                     "  --speed <max|recorded>  submit as fast as possible (default) or on the recorded timeline\n"
+                     "  --preset <file.json>    encode with this preset instead of the recorded configuration\n"
+                     "  --output <path>         output file without extension (default: trace path + .replay)\n"
+                     "  --json <file>           also write the result JSON to this file\n"
+                     "  --keep-output           keep the encoded file after measuring its size\n";
+    }
+
+    bool parseOptions(int argc, char** argv, ReplayOptions& options) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            const auto next = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument("missing value for " + arg);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--speed") {
+                const std::string speed = next();
+                if (speed != "max" && speed != "recorded") {
+                    throw std::invalid_argument("--speed must be max or recorded");
+                }
+                options.recordedSpeed = speed == "recorded";
+            } else if (arg == "--preset") {
+                options.preset = next();
+            } else if (arg == "--output") {
+                options.output = next();
+            } else if (arg == "--json") {
+                options.jsonPath = next();
+            } else if (arg == "--keep-output") {
+                options.keepOutput = true;
+            } else if (arg == "--help" || arg == "-h") {
+                return false;
+            } else if (!arg.empty() && arg[0] != '-' && options.tracePath.empty()) {
+                options.tracePath = arg;
+            } else {
+                throw std::invalid_argument("unknown option " + arg);
+            }
+        }
+
+        if (options.tracePath.empty()) {
+            throw std::invalid_argument("no trace file given");
+        }
+        if (options.output.empty()) {
+            options.output = options.tracePath + ".replay";
+        }
+        return true;
+    }
+
+    constexpr uint32_t kScrollRows = 256;
+    constexpr uint32_t kScrollStep = 4;
+
+    // Stand-in picture for traces without pixels, laid out with the recorded row pitch.
+    std::vector<uint8_t> buildCanvas(uint32_t width, int32_t height, int32_t rowPitch) {
+        const uint32_t canvasHeight = static_cast<uint32_t>(height) + kScrollRows;
+        std::vector<uint8_t> canvas(static_cast<size_t>(rowPitch) * canvasHeight);
+        for (uint32_t y = 0; y < canvasHeight; ++y) {
+            uint8_t* row = canvas.data() + static_cast<size_t>(y) * rowPitch;
+            for (uint32_t x = 0; x < width; ++x) {
+                row[x * 4 + 0] = static_cast<uint8_t>(x * 255u / width);
+                row[x * 4 + 1] = static_cast<uint8_t>(y * 255u / canvasHeight);
+                row[x * 4 + 2] = static_cast<uint8_t>((x ^ y) & 0xFF);
+                row[x * 4 + 3] = 0xFF;
+            }
+        }
+        return canvas;
+    }
+
+    // Nearest-neighbour upscale of a subsampled trace frame back to the recorded geometry.
+    void expandPixels(const Encoder::SessionTraceRecord& record, uint32_t width, uint32_t pixelStep,
+                      std::vector<uint8_t>& frame) {
+        frame.resize(static_cast<size_t>(record.rowPitch) * static_cast<size_t>(record.height));
+        for (int32_t y = 0; y < record.height; ++y) {
+            const uint32_t sourceY = (std::min)(static_cast<uint32_t>(y) / pixelStep, record.pixelHeight - 1);
+            const uint8_t* source = record.pixels.data() + static_cast<size_t>(sourceY) * record.pixelWidth * 4u;
+            uint8_t* row = frame.data() + static_cast<size_t>(y) * record.rowPitch;
+            for (uint32_t x = 0; x < width; ++x) {
+                const uint32_t sourceX = (std::min)(x / pixelStep, record.pixelWidth - 1);
+                std::memcpy(row + static_cast<size_t>(x) * 4u, source + static_cast<size_t>(sourceX) * 4u, 4);
+            }
+        }
+    }
+
+    nlohmann::json summarize(const LatencyHistogram& histogram) {
+        const LatencyHistogram::Summary summary = histogram.summarize();
+        return {
+            {"count", summary.count},
+            {"meanMs", summary.meanMs},
+            {"p50Ms", summary.p50Ms},
+            {"p95Ms", summary.p95Ms},
+            {"p99Ms", summary.p99Ms},
+            {"maxMs", summary.maxMs},
+        };
+    }
+}
+
+int main(int argc, char** argv) {
+    ReplayOptions options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            printUsage();
+            return 0;
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "replay_trace: " << ex.what() << "\n";
+        printUsage();
+        return 2;
+    }
+
+    Encoder::SessionTraceReader reader;
+    if (FAILED(reader.open(options.tracePath))) {
+        std::cerr << "replay_trace: cannot read trace " << options.tracePath << "\n";
+        return 2;
+    }
+    const Encoder::SessionTraceInfo& info = reader.getInfo();
+
+    const FFmpeg::FFENCODERCONFIG config =
+        options.preset.empty() ? info.config : JsonPresetReader(options.preset).readEncoderConfig();
+    const std::string outputPath = options.output + "." + std::string(config.format.container);
+
+    LatencyHistogram recordedVideo("trace.enqueue_video");
+    LatencyHistogram recordedAudio("trace.write_audio");
+    LatencyHistogram replayVideo("replay.enqueue_video");
+    LatencyHistogram replayAudio("replay.write_audio");
+    std::vector<uint8_t> canvas;
+    std::vector<uint8_t> frame;
+    std::vector<uint8_t> silence;
+    uint64_t videoFrames = 0;
+    uint64_t audioChunks = 0;
+    int64_t recordedSpanNs = 0;
+    bool ok = true;
+    std::string error;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    try {
+        Encoder::EncoderSession session;
+        const std::wstring filename(outputPath.begin(), outputPath.end());
+        Encoder::EncoderSessionOptions sessionOptions;
+        sessionOptions.videoQueueBudgetMb = info.videoQueueBudgetMb;
+        sessionOptions.spillVideoQueue = info.spillVideoQueue;
+        if (FAILED(session.createContext(config, filename, info.width, info.height, info.inputPixelFormat,
+                                         info.fpsNumerator, info.fpsDenominator, info.inputChannels,
+                                         info.inputSampleRate, info.inputSampleFormat, info.inputAlign, false, 0, 0,
+                                         sessionOptions))) {
+            throw std::runtime_error("createContext failed");
+        }
+
+        Encoder::SessionTraceRecord record;
+        bool ended = false;
+        while (!ended && reader.next(record)) {
+            recordedSpanNs = (std::max)(recordedSpanNs, record.timestampNs + record.durationNs);
+            if (options.recordedSpeed) {
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(record.timestampNs));
+            }
+
+            HRESULT hr = S_OK;
+            switch (record.event) {
+            case Encoder::SessionTraceEvent::VideoFrame: {
+                if (record.rowPitch <= 0 || record.height <= 0) {
+                    continue;
+                }
+
+                const uint8_t* pixels = nullptr;
+                if (!record.pixels.empty() && info.pixelStep > 0) {
+                    expandPixels(record, info.width, info.pixelStep, frame);
+                    pixels = frame.data();
+                } else {
+                    if (canvas.size() < static_cast<size_t>(record.rowPitch) * (record.height + kScrollRows)) {
+                        canvas = buildCanvas(info.width, record.height, record.rowPitch);
+                    }
+                    const uint32_t scroll = static_cast<uint32_t>((videoFrames * kScrollStep) % kScrollRows);
+                    pixels = canvas.data() + static_cast<size_t>(scroll) * record.rowPitch;
+                }
+
+                recordedVideo.record(record.durationNs);
+                const auto callStart = std::chrono::steady_clock::now();
+                hr = session.enqueueVideoFrame(pixels, record.rowPitch);
+                replayVideo.record(std::chrono::steady_clock::now() - callStart);
+                ++videoFrames;
+                break;
+            }
+            case Encoder::SessionTraceEvent::AudioChunk: {
+                if (record.length <= 0) {
+                    continue;
+                }
+                if (silence.size() < static_cast<size_t>(record.length)) {
+                    silence.resize(static_cast<size_t>(record.length));
+                }
+
+                recordedAudio.record(record.durationNs);
+                const auto callStart = std::chrono::steady_clock::now();
+                hr = session.writeAudioFrame(silence.data(), record.length, record.presentationTime);
+                replayAudio.record(std::chrono::steady_clock::now() - callStart);
+                ++audioChunks;
+                break;
+            }
+            case Encoder::SessionTraceEvent::FinishAudio:
+                hr = session.finishAudio();
+                break;
+            case Encoder::SessionTraceEvent::FinishVideo:
+                hr = session.finishVideo();
+                break;
+            case Encoder::SessionTraceEvent::EndSession:
+                hr = session.endSession();
+                ended = true;
+                break;
+            }
+
+            // Calls the game saw fail are expected to fail again; only new failures abort the replay.
+            if (FAILED(hr) && SUCCEEDED(record.result)) {
+                throw std::runtime_error("replayed call failed at " + std::to_string(record.timestampNs) + " ns");
+            }
+        }
+
+        // Traces cut short by a crash still get a finished file.
+        if (!ended) {
+            session.finishAudio();
+            session.finishVideo();
+            session.endSession();
+        }
+    } catch (const std::exception& ex) {
+        ok = false;
+        error = ex.what();
+    }
+
+    const double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::error_code sizeError;
+    const uintmax_t outputBytes = std::filesystem::file_size(outputPath, sizeError);
+    if (!options.keepOutput) {
+        std::filesystem::remove(outputPath, sizeError);
+    }
+
+    nlohmann::json result = {
+        {"ok", ok},
+        {"trace", options.tracePath},
+        {"speed", options.recordedSpeed ? "recorded" : "max"},
+        {"videoEncoder", std::string(config.video.encoder)},
+        {"width", info.width},
+        {"height", info.height},
+        {"videoFrames", videoFrames},
+        {"audioChunks", audioChunks},
+        {"recordedSeconds", static_cast<double>(recordedSpanNs) / 1e9},
+        {"elapsedSeconds", elapsedSeconds},
+        {"framesPerSecond", elapsedSeconds > 0.0 ? videoFrames / elapsedSeconds : 0.0},
+        {"recorded", {{"enqueueVideo", summarize(recordedVideo)}, {"writeAudio", summarize(recordedAudio)}}},
+        {"replay", {{"enqueueVideo", summarize(replayVideo)}, {"writeAudio", summarize(replayAudio)}}},
+        {"outputBytes", sizeError ? 0 : static_cast<uint64_t>(outputBytes)},
+    };
+    if (!ok) {
+        result["error"] = error;
+    }
+
+    const std::string text = result.dump(2);
+    std::cout << text << std::endl;
+    if (!options.jsonPath.empty()) {
+        std::ofstream(options.jsonPath) << text << "\n";
+    }
+
+    return ok ? 0 : 1;
+}
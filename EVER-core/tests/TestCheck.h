@@ -0,0 +1,27 @@
+#pragma once
+
+// Minimal assertions for the CTest executables: a failed CHECK reports the expression and makes
+// testResult() non-zero, so main can return it.
+
+#include <iostream>
+
+inline int& testFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+inline int testResult() {
+    if (testFailures() > 0) {
+        std::cerr << testFailures() << " check(s) failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+#define CHECK(condition)                                                                                               \
+    do {                                                                                                               \
+        if (!(condition)) {                                                                                            \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #condition "\n";                        \
+            ++testFailures();                                                                                          \
+        }                                                                                                              \
+    } while (0)
@@ -0,0 +1,252 @@
+// Checks how a preset's colour settings are taken off a filter chain, and that applying them to already
+// converted YUV frames gives what the fused RGBA -> YUV conversion gives: the same luma, and chroma within the
+// rounding of scaling the chroma weights instead of the chroma codes. Frames a filter ahead of the adjustment
+// only releases when the graph is drained are adjusted too, without touching the buffers they came from.
+
+#include "ColorAdjust.h"
+#include "RgbaToYuv.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+}
+
+namespace {
+    void checkSplit() {
+        std::string rest;
+        Encoder::ColorAdjustment adjustment;
+
+        // What JsonPresetReader emits for h264_high_quality_filters.json.
+        CHECK(Encoder::splitTrailingColorAdjustFilter(
+            "yadif=mode=field,hqdn3d=3:3:6:6,deband,deshake,deflicker,dejudder,"
+            "eq=brightness=-0.31:contrast=1.22:saturation=1.5:gamma=1.2",
+            rest, adjustment));
+        CHECK(rest == "yadif=mode=field,hqdn3d=3:3:6:6,deband,deshake,deflicker,dejudder");
+        CHECK(adjustment.brightness == -0.31);
+        CHECK(adjustment.contrast == 1.22);
+        CHECK(adjustment.saturation == 1.5);
+        CHECK(adjustment.gamma == 1.2);
+
+        CHECK(Encoder::splitTrailingColorAdjustFilter("scale=1280:720 , eq=gamma=1.1", rest, adjustment));
+        CHECK(rest == "scale=1280:720");
+
+        // A lone eq is parseColorAdjustFilter's case, not a split.
+        CHECK(!Encoder::splitTrailingColorAdjustFilter("eq=contrast=2", rest, adjustment));
+        // eq before other filters, expressions, other eq options and labelled graphs stay in the graph.
+        CHECK(!Encoder::splitTrailingColorAdjustFilter("eq=contrast=2,hqdn3d", rest, adjustment));
+        CHECK(!Encoder::splitTrailingColorAdjustFilter("hqdn3d,eq=contrast=1+t", rest, adjustment));
+        CHECK(!Encoder::splitTrailingColorAdjustFilter("hqdn3d,eq=gamma_r=1.2", rest, adjustment));
+        CHECK(!Encoder::splitTrailingColorAdjustFilter("[in]hqdn3d[a];[a]eq=contrast=2", rest, adjustment));
+        // A comma inside a quoted or escaped option value does not separate filters.
+        CHECK(!Encoder::splitTrailingColorAdjustFilter("drawtext=text='a,eq=contrast=2'", rest, adjustment));
+        CHECK(!Encoder::splitTrailingColorAdjustFilter("drawtext=text=a\\,eq=contrast=2", rest, adjustment));
+    }
+
+    struct Planes {
+        std::vector<uint8_t> storage[3];
+        uint8_t* data[3] = {};
+        int linesize[3] = {};
+    };
+
+    // Planar or semi-planar 4:2:0 planes for the given sample size, with row padding.
+    Planes allocatePlanes(int width, int height, int bytesPerSample, bool semiPlanar) {
+        Planes planes;
+        const int chromaWidth = (width + 1) / 2;
+        const int chromaHeight = (height + 1) / 2;
+        planes.linesize[0] = width * bytesPerSample + 32;
+        planes.linesize[1] = (semiPlanar ? chromaWidth * 2 : chromaWidth) * bytesPerSample + 32;
+        planes.linesize[2] = semiPlanar ? 0 : planes.linesize[1];
+        planes.storage[0].assign(static_cast<size_t>(planes.linesize[0]) * height, 0);
+        planes.storage[1].assign(static_cast<size_t>(planes.linesize[1]) * chromaHeight, 0);
+        planes.storage[2].assign(static_cast<size_t>(planes.linesize[2]) * chromaHeight, 0);
+        for (int i = 0; i < 3; ++i) {
+            planes.data[i] = planes.storage[i].data();
+        }
+        return planes;
+    }
+
+    int maxDifference(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, int bytesPerSample) {
+        int largest = 0;
+        for (size_t i = 0; i + bytesPerSample <= a.size(); i += bytesPerSample) {
+            const int valueA = bytesPerSample == 1 ? a[i] : (a[i] | a[i + 1] << 8);
+            const int valueB = bytesPerSample == 1 ? b[i] : (b[i] | b[i + 1] << 8);
+            largest = (std::max)(largest, std::abs(valueA - valueB));
+        }
+        return largest;
+    }
+
+    void checkMatchesFused(AVPixelFormat format, int bytesPerSample, bool semiPlanar, int chromaTolerance) {
+        constexpr int kWidth = 64;
+        constexpr int kHeight = 32;
+        std::vector<uint8_t> rgba(static_cast<size_t>(kWidth) * kHeight * 4);
+        for (int y = 0; y < kHeight; ++y) {
+            for (int x = 0; x < kWidth; ++x) {
+                uint8_t* pixel = rgba.data() + (static_cast<size_t>(y) * kWidth + x) * 4;
+                pixel[0] = static_cast<uint8_t>(x * 4);
+                pixel[1] = static_cast<uint8_t>(y * 8);
+                pixel[2] = static_cast<uint8_t>(255 - x * 2 - y * 2);
+                pixel[3] = 0xFF;
+            }
+        }
+
+        Encoder::ColorAdjustment adjustment;
+        adjustment.brightness = -0.31;
+        adjustment.contrast = 1.22;
+        adjustment.saturation = 1.5;
+        adjustment.gamma = 1.2;
+
+        Encoder::RgbaToYuvConverter fused;
+        Encoder::RgbaToYuvConverter plain;
+        CHECK(fused.initialize(AV_PIX_FMT_RGBA, format, AVCOL_SPC_BT709, false, adjustment,
+                               Encoder::RgbaToYuvKernel::Scalar));
+        CHECK(plain.initialize(AV_PIX_FMT_RGBA, format, AVCOL_SPC_BT709, false, Encoder::ColorAdjustment(),
+                               Encoder::RgbaToYuvKernel::Scalar));
+
+        Planes expected = allocatePlanes(kWidth, kHeight, bytesPerSample, semiPlanar);
+        Planes actual = allocatePlanes(kWidth, kHeight, bytesPerSample, semiPlanar);
+        fused.convert(rgba.data(), kWidth * 4, kWidth, kHeight, expected.data, expected.linesize);
+        plain.convert(rgba.data(), kWidth * 4, kWidth, kHeight, actual.data, actual.linesize);
+
+        Encoder::YuvColorAdjuster adjuster;
+        CHECK(adjuster.initialize(adjustment, format));
+        adjuster.apply(actual.data, actual.linesize, kWidth, kHeight);
+
+        CHECK(maxDifference(actual.storage[0], expected.storage[0], bytesPerSample) == 0);
+        CHECK(maxDifference(actual.storage[1], expected.storage[1], bytesPerSample) <= chromaTolerance);
+        CHECK(maxDifference(actual.storage[2], expected.storage[2], bytesPerSample) <= chromaTolerance);
+    }
+
+    uint8_t framePattern(int index, int plane, int x, int y) {
+        return static_cast<uint8_t>(index * 16 + plane * 64 + x * 3 + y * 5);
+    }
+
+    void fillFrame(int index, uint8_t* const data[], const int linesize[], int width, int height) {
+        for (int plane = 0; plane < 3; ++plane) {
+            const int planeWidth = plane == 0 ? width : (width + 1) / 2;
+            const int planeHeight = plane == 0 ? height : (height + 1) / 2;
+            for (int y = 0; y < planeHeight; ++y) {
+                for (int x = 0; x < planeWidth; ++x) {
+                    data[plane][static_cast<ptrdiff_t>(y) * linesize[plane] + x] = framePattern(index, plane, x, y);
+                }
+            }
+        }
+    }
+
+    bool framePlanesEqual(const AVFrame* frame, const uint8_t* const data[], const int linesize[]) {
+        for (int plane = 0; plane < 3; ++plane) {
+            const int planeWidth = plane == 0 ? frame->width : (frame->width + 1) / 2;
+            const int planeHeight = plane == 0 ? frame->height : (frame->height + 1) / 2;
+            for (int y = 0; y < planeHeight; ++y) {
+                if (!std::equal(data[plane] + static_cast<ptrdiff_t>(y) * linesize[plane],
+                                data[plane] + static_cast<ptrdiff_t>(y) * linesize[plane] + planeWidth,
+                                frame->data[plane] + static_cast<ptrdiff_t>(y) * frame->linesize[plane])) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // reverse holds every frame until the end of the stream, as FFmpegEncoder::Close sees it when draining a
+    // graph whose trailing eq was taken off.
+    void checkDrainedFramesAdjusted() {
+        constexpr int kWidth = 48;
+        constexpr int kHeight = 16;
+        constexpr int kFrames = 4;
+
+        Encoder::ColorAdjustment adjustment;
+        adjustment.contrast = 1.5;
+        adjustment.saturation = 0.5;
+        Encoder::YuvColorAdjuster adjuster;
+        CHECK(adjuster.initialize(adjustment, AV_PIX_FMT_YUV420P));
+
+        AVFilterGraph* graph = avfilter_graph_alloc();
+        AVFilterContext* source = nullptr;
+        AVFilterContext* delay = nullptr;
+        AVFilterContext* sink = nullptr;
+        char args[128];
+        std::snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=1/60:pixel_aspect=1/1", kWidth,
+                      kHeight, static_cast<int>(AV_PIX_FMT_YUV420P));
+        const bool configured = graph &&
+            avfilter_graph_create_filter(&source, avfilter_get_by_name("buffer"), "in", args, nullptr, graph) >= 0 &&
+            avfilter_graph_create_filter(&delay, avfilter_get_by_name("reverse"), "delay", nullptr, nullptr, graph) >= 0 &&
+            avfilter_graph_create_filter(&sink, avfilter_get_by_name("buffersink"), "out", nullptr, nullptr, graph) >= 0 &&
+            avfilter_link(source, 0, delay, 0) >= 0 && avfilter_link(delay, 0, sink, 0) >= 0 &&
+            avfilter_graph_config(graph, nullptr) >= 0;
+        CHECK(configured);
+        if (!configured) {
+            avfilter_graph_free(&graph);
+            return;
+        }
+
+        std::vector<AVFrame*> inputs;
+        for (int i = 0; i < kFrames; ++i) {
+            AVFrame* input = av_frame_alloc();
+            input->format = AV_PIX_FMT_YUV420P;
+            input->width = kWidth;
+            input->height = kHeight;
+            input->pts = i;
+            CHECK(av_frame_get_buffer(input, 0) >= 0);
+            fillFrame(i, input->data, input->linesize, kWidth, kHeight);
+            // Keeping a reference leaves the graph's frame shared with it.
+            CHECK(av_buffersrc_add_frame_flags(source, input, AV_BUFFERSRC_FLAG_KEEP_REF) >= 0);
+            inputs.push_back(input);
+        }
+
+        AVFrame* output = av_frame_alloc();
+        CHECK(av_buffersink_get_frame(sink, output) == AVERROR(EAGAIN));
+        CHECK(av_buffersrc_add_frame_flags(source, nullptr, 0) >= 0);
+
+        int drained = 0;
+        while (av_buffersink_get_frame(sink, output) >= 0) {
+            CHECK(adjuster.applyToFrame(output) == 0);
+
+            const int index = kFrames - 1 - drained;
+            Planes expected = allocatePlanes(kWidth, kHeight, 1, false);
+            fillFrame(index, expected.data, expected.linesize, kWidth, kHeight);
+            adjuster.apply(expected.data, expected.linesize, kWidth, kHeight);
+            CHECK(framePlanesEqual(output, expected.data, expected.linesize));
+
+            Planes original = allocatePlanes(kWidth, kHeight, 1, false);
+            fillFrame(index, original.data, original.linesize, kWidth, kHeight);
+            CHECK(framePlanesEqual(inputs[index], original.data, original.linesize));
+
+            av_frame_unref(output);
+            ++drained;
+        }
+        CHECK(drained == kFrames);
+
+        av_frame_free(&output);
+        for (AVFrame* input : inputs) {
+            av_frame_free(&input);
+        }
+        avfilter_graph_free(&graph);
+    }
+}
+
+int main() {
+    checkSplit();
+
+    checkMatchesFused(AV_PIX_FMT_YUV420P, 1, false, 2);
+    checkMatchesFused(AV_PIX_FMT_NV12, 1, true, 2);
+    // 10-bit codes stored in the top bits of 16 are compared as stored, so one code apart is 64 apart.
+    checkMatchesFused(AV_PIX_FMT_P010LE, 2, true, 2 << 6);
+    checkDrainedFramesAdjusted();
+
+    Encoder::YuvColorAdjuster adjuster;
+    CHECK(!adjuster.initialize(Encoder::ColorAdjustment(), AV_PIX_FMT_RGBA));
+    CHECK(!adjuster.isInitialized());
+
+    return testResult();
+}
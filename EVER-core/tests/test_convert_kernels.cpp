@@ -0,0 +1,156 @@
+// Checks the RGBA -> YUV kernels this CPU can run: every SIMD kernel matches the scalar kernel bit for bit,
+// including the scalar tail of rows that are not a multiple of the vector width and odd frame sizes, and the
+// scalar kernel stays within two 8-bit codes of swscale in luma and three in chroma (10-bit formats at 10 bits,
+// with the tolerance scaled by 4). bench_convert reports the same differences along with timings.
+
+#include "RgbaToYuv.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+namespace {
+    constexpr int kLumaTolerance = 2;
+    constexpr int kChromaTolerance = 3;
+
+    // A destination frame with row padding, so kernels that write past the row end show up as differences.
+    struct Picture {
+        AVPixelFormat format = AV_PIX_FMT_NONE;
+        int planes = 0;
+        int rowBytes[4] = {};
+        int planeHeights[4] = {};
+        int linesizes[4] = {};
+        std::vector<uint8_t> storage[4];
+        uint8_t* data[4] = {};
+
+        Picture(AVPixelFormat format, int width, int height) : format(format) {
+            const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(format);
+            av_image_fill_linesizes(rowBytes, format, width);
+            planes = av_pix_fmt_count_planes(format);
+            for (int plane = 0; plane < planes; ++plane) {
+                planeHeights[plane] = (plane == 1 || plane == 2) ? -((-height) >> descriptor->log2_chroma_h) : height;
+                linesizes[plane] = (rowBytes[plane] + 64 + 63) / 64 * 64;
+                storage[plane].assign(static_cast<size_t>(linesizes[plane]) * planeHeights[plane], 0);
+                data[plane] = storage[plane].data();
+            }
+        }
+
+        bool operator==(const Picture& other) const {
+            return std::equal(std::begin(storage), std::end(storage), std::begin(other.storage));
+        }
+    };
+
+    // Largest per-sample difference of luma (first) and chroma (second), read back at the format's bit depth.
+    std::pair<int, int> maxDifference(const Picture& a, const Picture& b) {
+        const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(a.format);
+        const bool wide = descriptor->comp[0].depth > 8;
+        const int shift = descriptor->comp[0].shift;
+
+        std::pair<int, int> largest;
+        for (int plane = 0; plane < a.planes; ++plane) {
+            const int samples = wide ? a.rowBytes[plane] / 2 : a.rowBytes[plane];
+            for (int y = 0; y < a.planeHeights[plane]; ++y) {
+                const uint8_t* rowA = a.data[plane] + static_cast<size_t>(y) * a.linesizes[plane];
+                const uint8_t* rowB = b.data[plane] + static_cast<size_t>(y) * b.linesizes[plane];
+                for (int x = 0; x < samples; ++x) {
+                    int valueA = rowA[x];
+                    int valueB = rowB[x];
+                    if (wide) {
+                        valueA = (rowA[x * 2] | rowA[x * 2 + 1] << 8) >> shift;
+                        valueB = (rowB[x * 2] | rowB[x * 2 + 1] << 8) >> shift;
+                    }
+                    int& component = plane == 0 ? largest.first : largest.second;
+                    component = (std::max)(component, std::abs(valueA - valueB));
+                }
+            }
+        }
+        return largest;
+    }
+
+    // Smooth gradients with a gentle ripple, like rendered game frames rather than noise.
+    std::vector<uint8_t> buildSource(int width, int height) {
+        std::vector<uint8_t> source(static_cast<size_t>(width) * height * 4);
+        for (int y = 0; y < height; ++y) {
+            uint8_t* row = source.data() + static_cast<size_t>(y) * width * 4;
+            for (int x = 0; x < width; ++x) {
+                const double ripple = 24.0 * std::sin(x * 0.013) * std::cos(y * 0.017);
+                row[x * 4 + 0] = static_cast<uint8_t>(std::clamp(x * 255.0 / width + ripple, 0.0, 255.0));
+                row[x * 4 + 1] = static_cast<uint8_t>(std::clamp(y * 255.0 / height - ripple, 0.0, 255.0));
+                row[x * 4 + 2] = static_cast<uint8_t>(std::clamp(128.0 + ripple * 4.0, 0.0, 255.0));
+                row[x * 4 + 3] = 0xFF;
+            }
+        }
+        return source;
+    }
+
+    Picture convert(const std::vector<uint8_t>& source, int width, int height, AVPixelFormat format, bool fullRange,
+                    Encoder::RgbaToYuvKernel kernel) {
+        Picture output(format, width, height);
+        Encoder::RgbaToYuvConverter converter;
+        CHECK(converter.initialize(AV_PIX_FMT_RGBA, format, AVCOL_SPC_BT709, fullRange, Encoder::ColorAdjustment(),
+                                   kernel));
+        converter.convert(source.data(), width * 4, width, height, output.data, output.linesizes);
+        return output;
+    }
+
+    void checkKernels(int width, int height, bool againstSwscale) {
+        const AVPixelFormat formats[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_P010LE,
+                                         AV_PIX_FMT_YUV422P10LE};
+        const Encoder::RgbaToYuvKernel kernels[] = {Encoder::RgbaToYuvKernel::Sse41, Encoder::RgbaToYuvKernel::Avx2,
+                                                    Encoder::RgbaToYuvKernel::Avx512};
+        const std::vector<uint8_t> source = buildSource(width, height);
+
+        for (const AVPixelFormat format : formats) {
+            for (const bool fullRange : {false, true}) {
+                const Picture scalar = convert(source, width, height, format, fullRange, Encoder::RgbaToYuvKernel::Scalar);
+                for (const Encoder::RgbaToYuvKernel kernel : kernels) {
+                    if (Encoder::isRgbaToYuvKernelAvailable(kernel)) {
+                        CHECK(convert(source, width, height, format, fullRange, kernel) == scalar);
+                    }
+                }
+                if (!againstSwscale) {
+                    continue;
+                }
+
+                Picture reference(format, width, height);
+                SwsContext* context = sws_getContext(width, height, AV_PIX_FMT_RGBA, width, height, format,
+                                                     SWS_BILINEAR, nullptr, nullptr, nullptr);
+                CHECK(context != nullptr);
+                if (context == nullptr) {
+                    continue;
+                }
+                sws_setColorspaceDetails(context, sws_getCoefficients(SWS_CS_DEFAULT), 1,
+                                         sws_getCoefficients(AVCOL_SPC_BT709), fullRange ? 1 : 0, 0, 1 << 16, 1 << 16);
+                const uint8_t* const sourceData[4] = {source.data(), nullptr, nullptr, nullptr};
+                const int sourceLinesize[4] = {width * 4, 0, 0, 0};
+                sws_scale(context, sourceData, sourceLinesize, 0, height, reference.data, reference.linesizes);
+                sws_freeContext(context);
+
+                const int depthScale = av_pix_fmt_desc_get(format)->comp[0].depth > 8 ? 4 : 1;
+                const std::pair<int, int> difference = maxDifference(scalar, reference);
+                CHECK(difference.first <= kLumaTolerance * depthScale);
+                CHECK(difference.second <= kChromaTolerance * depthScale);
+            }
+        }
+    }
+}
+
+int main() {
+    checkKernels(1920, 1080, true);
+    // Rows that leave a scalar tail after every vector width, and an odd size whose last column and row have no
+    // partner for chroma.
+    checkKernels(1366, 768, false);
+    checkKernels(637, 359, false);
+    return testResult();
+}
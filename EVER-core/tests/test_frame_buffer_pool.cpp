@@ -0,0 +1,81 @@
+// Pushes synthetic frames through FrameBufferPool and the SPSC video queue the way EncoderSession does: the
+// capture side acquires, fills and pushes, the worker pops and releases. With the pool sized like the session
+// sizes it (queue depth plus the frame being captured and the one being encoded), steady state must not allocate.
+
+#include "FrameBufferPool.h"
+#include "SpscRingBuffer.h"
+#include "TestCheck.h"
+
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+    struct Frame {
+        std::vector<uint8_t> data;
+        int64_t index = 0;
+    };
+
+    constexpr size_t kFrameBytes = 1920 * 1080 * 4;
+    constexpr size_t kQueueDepth = 4;
+    constexpr int64_t kWarmupFrames = 16;
+    constexpr int64_t kFrames = 512;
+
+    void runCapture(size_t queueDepth, size_t preallocated) {
+        Encoder::FrameBufferPool pool;
+        pool.reset(kFrameBytes, preallocated);
+        SpscRingBuffer<Frame> queue(queueDepth);
+
+        Encoder::FrameBufferPool::Stats afterWarmup;
+        int64_t consumed = 0;
+        bool inOrder = true;
+        std::thread worker([&] {
+            Frame frame;
+            while (queue.pop(frame)) {
+                inOrder = inOrder && frame.index == consumed && frame.data.size() == kFrameBytes &&
+                          frame.data[0] == static_cast<uint8_t>(frame.index);
+                ++consumed;
+                pool.release(std::move(frame.data));
+            }
+        });
+
+        for (int64_t i = 0; i < kFrames; ++i) {
+            if (i == kWarmupFrames) {
+                afterWarmup = pool.getStats();
+            }
+            Frame frame;
+            frame.index = i;
+            frame.data = pool.acquire(kFrameBytes);
+            std::memset(frame.data.data(), static_cast<int>(i & 0xFF), 64);
+            CHECK(queue.push(frame));
+        }
+        queue.requestStop();
+        worker.join();
+
+        const Encoder::FrameBufferPool::Stats stats = pool.getStats();
+        CHECK(consumed == kFrames);
+        CHECK(inOrder);
+        CHECK(stats.hits + stats.misses == static_cast<uint64_t>(kFrames));
+        CHECK(stats.highWater <= queueDepth + 2);
+        CHECK(stats.pooledBuffers == preallocated + stats.misses);
+        if (preallocated >= queueDepth + 2) {
+            // The preallocation covers warm-up, and steady state never allocates.
+            CHECK(afterWarmup.misses == 0);
+            CHECK(stats.misses == afterWarmup.misses);
+        } else {
+            // An undersized pool grows until it covers the frames in flight, then only recycles.
+            CHECK(stats.misses <= queueDepth + 2 - preallocated);
+        }
+    }
+}
+
+int main() {
+    // Preallocated like EncoderSession::createContext: no allocation at all, warm-up included.
+    runCapture(kQueueDepth, kQueueDepth + 2);
+
+    // One buffer short of that: the pool grows by at most the shortfall, then only recycles.
+    runCapture(kQueueDepth, kQueueDepth + 1);
+
+    return testResult();
+}
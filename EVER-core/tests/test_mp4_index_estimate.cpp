@@ -0,0 +1,65 @@
+// Checks the MP4 index estimate the reserved moov space is sized from: runs are counted the way the stts and ctts
+// tables store them, and a minute of 60 fps video with AAC stays near the sizes the mp4 muxer actually writes.
+
+#include "Mp4IndexEstimate.h"
+#include "TestCheck.h"
+
+#include <cstdint>
+
+namespace {
+    // 60 fps video in a 1/15360 time base, 48 kHz AAC in 1024-sample packets, interleaved by time.
+    Encoder::Mp4IndexCounts countMinute(bool reordered) {
+        Encoder::Mp4IndexCounter counter;
+        const int64_t videoStep = 15360 / 60;
+        int64_t audio = 0;
+        for (int64_t frame = 0; frame < 60 * 60; ++frame) {
+            const int64_t dts = frame * videoStep;
+            // Reordered frames give every third frame a longer wait between decode and display.
+            const int64_t pts = reordered ? dts + (frame % 3 == 0 ? 3 : 1) * videoStep : dts;
+            counter.add(true, frame % 250 == 0, pts, dts, 40000);
+            while (audio * 15360 < (dts + videoStep) * 48000) {
+                counter.add(false, true, audio, audio, 400);
+                audio += 1024;
+            }
+        }
+        return counter.counts();
+    }
+
+    void checkRuns() {
+        const Encoder::Mp4IndexCounts plain = countMinute(false);
+        CHECK(plain.videoSamples == 3600);
+        CHECK(plain.audioSamples == 2813);
+        CHECK(plain.keyframes == 15);
+        // One duration per track and one offset for the video.
+        CHECK(plain.durationRuns == 2);
+        CHECK(plain.offsetRuns == 1);
+
+        const Encoder::Mp4IndexCounts reordered = countMinute(true);
+        CHECK(reordered.durationRuns == 2);
+        CHECK(reordered.offsetRuns >= 3600 / 2);
+    }
+
+    void checkSize() {
+        const Encoder::Mp4IndexCounts plain = countMinute(false);
+        const int64_t plainBytes = Encoder::estimateMp4IndexBytes(plain) - Encoder::kMp4IndexFixedBytes;
+        // stsz alone takes 4 B per sample; interleaving with AAC keeps the rest to about 20 B per sample.
+        CHECK(plainBytes > 4 * (plain.videoSamples + plain.audioSamples));
+        CHECK(plainBytes < 200 * 1024);
+
+        const Encoder::Mp4IndexCounts reordered = countMinute(true);
+        CHECK(Encoder::estimateMp4IndexBytes(reordered) > Encoder::estimateMp4IndexBytes(plain));
+
+        // A track on its own is one chunk per sample at most.
+        Encoder::Mp4IndexCounts videoOnly;
+        videoOnly.videoSamples = 3600;
+        videoOnly.keyframes = 15;
+        videoOnly.bytes = 3600 * Encoder::kMp4MaxChunkBytes;
+        CHECK(Encoder::estimateMp4IndexBytes(videoOnly) == Encoder::kMp4IndexFixedBytes + 3600 * 25 + 15 * 4 + 2 * 8);
+    }
+}
+
+int main() {
+    checkRuns();
+    checkSize();
+    return testResult();
+}
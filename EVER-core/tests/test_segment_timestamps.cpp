@@ -0,0 +1,102 @@
+// Checks where packets go around a segment cut: audio that starts before the cut keyframe stays in the previous
+// segment even when it reaches the muxer after the keyframe, so no segment gets negative timestamps.
+
+#include "SegmentTimestamps.h"
+#include "TestCheck.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace {
+    constexpr AVRational kVideoTimeBase{1, 15360};
+    constexpr AVRational kAudioTimeBase{1, 48000};
+    constexpr int64_t kAudioPacketSamples = 1024;
+
+    void checkBoundary() {
+        // A cut at 10 s.
+        const int64_t cutDts = 10 * 15360;
+        const int64_t cutInAudio = 10 * 48000;
+
+        CHECK(Encoder::isBeforeSegmentCut(cutInAudio - 1, cutInAudio - 1, kAudioTimeBase, cutDts, kVideoTimeBase));
+        CHECK(!Encoder::isBeforeSegmentCut(cutInAudio, cutInAudio, kAudioTimeBase, cutDts, kVideoTimeBase));
+        // Without a pts the dts decides; without either the packet goes with the new segment.
+        CHECK(Encoder::isBeforeSegmentCut(AV_NOPTS_VALUE, cutInAudio - 1, kAudioTimeBase, cutDts, kVideoTimeBase));
+        CHECK(!Encoder::isBeforeSegmentCut(AV_NOPTS_VALUE, AV_NOPTS_VALUE, kAudioTimeBase, cutDts, kVideoTimeBase));
+
+        CHECK(Encoder::shiftIntoSegment(cutInAudio, kAudioTimeBase, cutDts, kVideoTimeBase) == 0);
+        CHECK(Encoder::shiftIntoSegment(AV_NOPTS_VALUE, kAudioTimeBase, cutDts, kVideoTimeBase) == AV_NOPTS_VALUE);
+        // What shifting a packet from just before the cut into the new segment would have given.
+        CHECK(Encoder::shiftIntoSegment(cutInAudio - kAudioPacketSamples, kAudioTimeBase, cutDts, kVideoTimeBase) < 0);
+    }
+
+    struct Packet {
+        bool video = false;
+        int64_t ts = 0;
+    };
+
+    // Routes a stream the way the muxer does, with audio reaching it lagPackets packets behind the video.
+    void checkLateAudioStaysInPreviousSegment(int lagPackets) {
+        const int64_t cutDts = 10 * 15360;
+        std::vector<Packet> arrivals;
+        // 60 fps video for 20 s, one keyframe at the cut.
+        const int64_t videoStep = 15360 / 60;
+        int64_t nextAudio = 0;
+        std::vector<int64_t> heldAudio;
+        for (int64_t dts = 0; dts < 20 * 15360; dts += videoStep) {
+            arrivals.push_back({true, dts});
+            while (av_compare_ts(nextAudio, kAudioTimeBase, dts + videoStep, kVideoTimeBase) < 0) {
+                heldAudio.push_back(nextAudio);
+                nextAudio += kAudioPacketSamples;
+            }
+            while (static_cast<int>(heldAudio.size()) > lagPackets) {
+                arrivals.push_back({false, heldAudio.front()});
+                heldAudio.erase(heldAudio.begin());
+            }
+        }
+        for (int64_t ts : heldAudio) {
+            arrivals.push_back({false, ts});
+        }
+
+        std::vector<int64_t> segments[2];
+        int segment = 0;
+        bool closing = false;
+        size_t audioPackets = 0;
+        for (const Packet& packet : arrivals) {
+            if (packet.video) {
+                if (segment == 0 && packet.ts == cutDts) {
+                    segment = 1;
+                    closing = true;
+                }
+                continue;
+            }
+            ++audioPackets;
+            if (closing && Encoder::isBeforeSegmentCut(packet.ts, packet.ts, kAudioTimeBase, cutDts, kVideoTimeBase)) {
+                segments[0].push_back(packet.ts);
+                continue;
+            }
+            closing = false;
+            const int64_t offset = segment == 0 ? 0 : cutDts;
+            segments[segment].push_back(Encoder::shiftIntoSegment(packet.ts, kAudioTimeBase, offset, kVideoTimeBase));
+        }
+
+        CHECK(segments[0].size() + segments[1].size() == audioPackets);
+        for (const std::vector<int64_t>& timestamps : segments) {
+            CHECK(!timestamps.empty());
+            for (size_t i = 0; i < timestamps.size(); ++i) {
+                CHECK(timestamps[i] >= 0);
+                CHECK(i == 0 || timestamps[i] > timestamps[i - 1]);
+            }
+        }
+        // Every packet starting before the cut ended up in the first segment.
+        CHECK(av_compare_ts(segments[0].back(), kAudioTimeBase, cutDts, kVideoTimeBase) < 0);
+        CHECK(segments[1].front() < kAudioPacketSamples);
+    }
+}
+
+int main() {
+    checkBoundary();
+    checkLateAudioStaysInPreviousSegment(0);
+    checkLateAudioStaysInPreviousSegment(3);
+    checkLateAudioStaysInPreviousSegment(20);
+    return testResult();
+}
@@ -0,0 +1,138 @@
+// Stresses SpscRingBuffer across capacities and limits with random stalls on either side, so both the spin and
+// the park paths of push and pop are taken: every item must arrive once, in order. Also checks that stop refuses
+// the producer while the consumer still drains what was published before it.
+
+#include "SpscRingBuffer.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <thread>
+
+namespace {
+    using Item = std::unique_ptr<uint64_t>;
+
+    // Roughly one item in stallEvery sleeps for long enough that the other side gives up spinning and parks.
+    void maybeStall(std::mt19937& random, uint32_t stallEvery) {
+        if (stallEvery > 0 && random() % stallEvery == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(random() % 200));
+        }
+    }
+
+    void runStress(size_t capacity, size_t limit, uint64_t items, uint32_t producerStallEvery,
+                   uint32_t consumerStallEvery) {
+        SpscRingBuffer<Item> ring(capacity);
+        ring.setLimit(limit);
+
+        uint64_t received = 0;
+        bool inOrder = true;
+        std::thread consumer([&] {
+            std::mt19937 random(static_cast<uint32_t>(capacity * 31 + limit));
+            Item item;
+            while (ring.pop(item)) {
+                inOrder = inOrder && item && *item == received;
+                ++received;
+                maybeStall(random, consumerStallEvery);
+            }
+        });
+
+        std::mt19937 random(static_cast<uint32_t>(capacity * 17 + limit));
+        bool limitKept = true;
+        for (uint64_t i = 0; i < items; ++i) {
+            // The session lowers the limit while running when frames get larger; moving it must not lose items.
+            if (i == items / 2) {
+                ring.setLimit(limit > 1 ? limit - 1 : capacity);
+            }
+            Item item = std::make_unique<uint64_t>(i);
+            CHECK(ring.push(item));
+            CHECK(!item);
+            // Only the consumer shrinks the ring, so what the producer sees is an upper bound.
+            limitKept = limitKept && ring.size() <= (std::max)(limit, ring.getLimit());
+            maybeStall(random, producerStallEvery);
+        }
+        ring.requestStop();
+        consumer.join();
+
+        CHECK(received == items);
+        CHECK(inOrder);
+        CHECK(limitKept);
+        CHECK(ring.size() == 0);
+    }
+
+    void checkStopDrains() {
+        SpscRingBuffer<Item> ring(4);
+        for (uint64_t i = 0; i < 3; ++i) {
+            Item item = std::make_unique<uint64_t>(i);
+            CHECK(ring.push(item));
+        }
+        ring.requestStop();
+
+        // Refused after stop, and the item stays with the caller.
+        Item late = std::make_unique<uint64_t>(99);
+        CHECK(!ring.push(late));
+        CHECK(late && *late == 99);
+
+        Item item;
+        for (uint64_t i = 0; i < 3; ++i) {
+            CHECK(ring.pop(item));
+            CHECK(item && *item == i);
+        }
+        CHECK(!ring.pop(item));
+        CHECK(!ring.tryPop(item));
+
+        // reset makes the ring usable again.
+        ring.reset();
+        Item again = std::make_unique<uint64_t>(7);
+        CHECK(ring.push(again));
+        CHECK(ring.tryPop(item));
+        CHECK(item && *item == 7);
+    }
+
+    void checkStopWakesParkedSides() {
+        // A consumer parked on an empty ring returns once stop is requested.
+        SpscRingBuffer<Item> empty(2);
+        std::thread consumer([&] {
+            Item item;
+            CHECK(!empty.pop(item));
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        empty.requestStop();
+        consumer.join();
+
+        // A producer parked on a full ring returns false once stop is requested.
+        SpscRingBuffer<Item> full(1);
+        Item first = std::make_unique<uint64_t>(0);
+        CHECK(full.push(first));
+        std::thread producer([&] {
+            Item second = std::make_unique<uint64_t>(1);
+            CHECK(!full.push(second));
+            CHECK(second);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        full.requestStop();
+        producer.join();
+    }
+}
+
+int main() {
+    constexpr uint64_t kItems = 200000;
+    constexpr uint64_t kStalledItems = 5000;
+
+    // Unpaced: mostly the spin path.
+    runStress(1, 1, kItems, 0, 0);
+    runStress(8, 8, kItems, 0, 0);
+    runStress(128, 3, kItems, 0, 0);
+
+    // One side stalls now and then, so the other parks.
+    runStress(2, 2, kStalledItems, 0, 64);
+    runStress(8, 4, kStalledItems, 64, 0);
+    runStress(16, 16, kStalledItems, 32, 32);
+
+    checkStopDrains();
+    checkStopWakesParkedSides();
+
+    return testResult();
+}
@@ -3,6 +3,7 @@
 // Configuration file names
 #define INI_FILE_NAME "EVER\\" TARGET_NAME ".ini"
 #define PRESET_FILE_NAME "EVER\\preset.json"
+#define PRESETS_DIR_NAME "EVER\\presets"
 
 // Main section keys
 #define CFG_AUTO_RELOAD_CONFIG "auto_reload_config"
@@ -17,6 +18,23 @@
 #define CFG_EXPORT_FPS "fps"
 #define CFG_EXPORT_OPENEXR "export_openexr"
 #define CFG_DISABLE_WATERMARK "disable_watermark"
+#define CFG_EXPORT_VIDEO_QUEUE_BUDGET_MB "video_queue_budget_mb"
+#define CFG_EXPORT_VIDEO_QUEUE_SPILL "video_queue_spill"
+#define CFG_EXPORT_SESSION_TRACE "session_trace"
+#define CFG_EXPORT_SESSION_TRACE_PIXEL_STEP "session_trace_pixel_step"
+#define CFG_EXPORT_AUTO_ENCODER_THREADS "auto_encoder_threads"
+#define CFG_EXPORT_RESERVED_CORES "reserved_cores"
+#define CFG_EXPORT_PARALLEL_ENCODERS "parallel_encoders"
+#define CFG_EXPORT_PARALLEL_CHUNK_SECONDS "parallel_chunk_seconds"
+#define CFG_EXPORT_OUTPUT_BUFFER_MB "output_buffer_mb"
+#define CFG_EXPORT_FASTSTART_MODE "faststart_mode"
+#define CFG_EXPORT_FASTSTART_RESERVE_MINUTES "faststart_reserve_minutes"
+#define CFG_EXPORT_SEGMENT_MINUTES "segment_minutes"
+#define CFG_EXPORT_SEGMENT_SIZE_MB "segment_size_mb"
+#define CFG_EXPORT_SEGMENT_MANIFEST "segment_manifest"
+#define CFG_EXPORT_TEE_PRESETS "tee_presets"
+#define CFG_EXPORT_PROXY_PRESET "proxy_preset"
+#define CFG_EXPORT_PROXY_HEIGHT "proxy_height"
 
 // Format section
 #define CFG_FORMAT_SECTION "FORMAT"
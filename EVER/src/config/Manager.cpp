@@ -6,6 +6,7 @@
 
 #include <fstream>
 #include <cmath>
+#include <sstream>
 
 using std::string;
 using std::ofstream;
@@ -19,9 +20,44 @@ namespace Config {
     pair<uint32_t, uint32_t> Manager::fps;
     uint8_t Manager::motion_blur_samples;
     float Manager::motion_blur_strength;
+    uint32_t Manager::video_queue_budget_mb;
+    bool Manager::video_queue_spill;
+    bool Manager::session_trace;
+    uint32_t Manager::session_trace_pixel_step;
+    bool Manager::auto_encoder_threads;
+    uint32_t Manager::reserved_cores;
+    uint32_t Manager::parallel_encoders;
+    uint32_t Manager::parallel_chunk_seconds;
+    uint32_t Manager::output_buffer_mb;
+    FFmpeg::FaststartMode Manager::faststart_mode;
+    uint32_t Manager::faststart_reserve_minutes;
+    uint32_t Manager::segment_minutes;
+    uint32_t Manager::segment_size_mb;
+    bool Manager::segment_manifest;
+    string Manager::tee_presets;
+    string Manager::proxy_preset;
+    uint32_t Manager::proxy_height;
     bool Manager::export_openexr;
     bool Manager::disable_watermark;
     FFmpeg::FFENCODERCONFIG Manager::encoder_config;
+    std::vector<pair<string, FFmpeg::FFENCODERCONFIG>> Manager::tee_encoder_configs;
+    bool Manager::proxy_enabled;
+    FFmpeg::FFENCODERCONFIG Manager::proxy_encoder_config;
+
+    // A preset name as written in the INI, with or without .json, without the extension.
+    static string presetName(string name) {
+        name = ConfigValueParser::trim(name);
+        if (name.size() > 5 && name.compare(name.size() - 5, 5, ".json") == 0) {
+            name.resize(name.size() - 5);
+        }
+        return name;
+    }
+
+    // The preset's file in the presets folder. Empty when the name is.
+    static string presetPath(const string& preset) {
+        const string name = presetName(preset);
+        return name.empty() ? string() : AsiPath() + "\\" PRESETS_DIR_NAME "\\" + name + ".json";
+    }
 
     static string logLevelToString(LogLevel level) {
         switch (level) {
@@ -34,6 +70,14 @@ namespace Config {
         }
     }
 
+    static string faststartModeToString(FFmpeg::FaststartMode mode) {
+        switch (mode) {
+            case FFmpeg::FaststartRewrite: return "rewrite";
+            case FFmpeg::FaststartFragmented: return "fragmented";
+            default: return "reserve";
+        }
+    }
+
     void Manager::reload() {
         const string ini_path = AsiPath() + "\\" INI_FILE_NAME;
         IniConfigReader reader(ini_path);
@@ -47,8 +91,27 @@ namespace Config {
         motion_blur_strength = reader.readFloat(CFG_EXPORT_SECTION, CFG_EXPORT_MB_STRENGTH, 0.5f, 0.0f, 1.0f);
         export_openexr = reader.readBool(CFG_EXPORT_SECTION, CFG_EXPORT_OPENEXR, false);
         disable_watermark = reader.readBool(CFG_EXPORT_SECTION, CFG_DISABLE_WATERMARK, false);
+        video_queue_budget_mb = reader.readInt<uint32_t>(CFG_EXPORT_SECTION, CFG_EXPORT_VIDEO_QUEUE_BUDGET_MB, 0, 0, 65536);
+        video_queue_spill = reader.readBool(CFG_EXPORT_SECTION, CFG_EXPORT_VIDEO_QUEUE_SPILL, false);
+        session_trace = reader.readBool(CFG_EXPORT_SECTION, CFG_EXPORT_SESSION_TRACE, false);
+        session_trace_pixel_step = reader.readInt<uint32_t>(CFG_EXPORT_SECTION, CFG_EXPORT_SESSION_TRACE_PIXEL_STEP, 0, 0, 64);
+        auto_encoder_threads = reader.readBool(CFG_EXPORT_SECTION, CFG_EXPORT_AUTO_ENCODER_THREADS, true);
+        reserved_cores = reader.readInt<uint32_t>(CFG_EXPORT_SECTION, CFG_EXPORT_RESERVED_CORES, 2, 0, 256);
+        parallel_encoders = reader.readInt<uint32_t>(CFG_EXPORT_SECTION, CFG_EXPORT_PARALLEL_ENCODERS, 0, 0, 64);
+        parallel_chunk_seconds = reader.readInt<uint32_t>(CFG_EXPORT_SECTION, CFG_EXPORT_PARALLEL_CHUNK_SECONDS, 2, 1, 60);
+        output_buffer_mb = reader.readInt<uint32_t>(CFG_EXPORT_SECTION, CFG_EXPORT_OUTPUT_BUFFER_MB, 8, 0, 1024);
+        faststart_mode = reader.readFaststartMode(CFG_EXPORT_SECTION, CFG_EXPORT_FASTSTART_MODE, FFmpeg::FaststartReserve);
+        faststart_reserve_minutes = reader.readInt<uint32_t>(CFG_EXPORT_SECTION, CFG_EXPORT_FASTSTART_RESERVE_MINUTES, 30, 1, 1440);
+        segment_minutes = reader.readInt<uint32_t>(CFG_EXPORT_SECTION, CFG_EXPORT_SEGMENT_MINUTES, 0, 0, 1440);
+        segment_size_mb = reader.readInt<uint32_t>(CFG_EXPORT_SECTION, CFG_EXPORT_SEGMENT_SIZE_MB, 0, 0, 1048576);
+        segment_manifest = reader.readBool(CFG_EXPORT_SECTION, CFG_EXPORT_SEGMENT_MANIFEST, true);
+        tee_presets = reader.readString(CFG_EXPORT_SECTION, CFG_EXPORT_TEE_PRESETS, "");
+        proxy_preset = reader.readString(CFG_EXPORT_SECTION, CFG_EXPORT_PROXY_PRESET, "");
+        proxy_height = reader.readInt<uint32_t>(CFG_EXPORT_SECTION, CFG_EXPORT_PROXY_HEIGHT, 540, 144, 2160);
         
         readEncoderConfig();
+        readTeeEncoderConfigs();
+        readProxyEncoderConfig();
     }
 
     void Manager::save() {
@@ -80,7 +143,24 @@ namespace Config {
             file << "motion_blur_samples = " << static_cast<int>(motion_blur_samples) << "\n"
                 << "motion_blur_strength = " << motion_blur_strength << "\n"
                 << "export_openexr = " << (export_openexr ? "true" : "false") << "\n"
-                << "disable_watermark = " << (disable_watermark ? "true" : "false") << "\n";
+                << "disable_watermark = " << (disable_watermark ? "true" : "false") << "\n"
+                << "video_queue_budget_mb = " << video_queue_budget_mb << "\n"
+                << "video_queue_spill = " << (video_queue_spill ? "true" : "false") << "\n"
+                << "session_trace = " << (session_trace ? "true" : "false") << "\n"
+                << "session_trace_pixel_step = " << session_trace_pixel_step << "\n"
+                << "auto_encoder_threads = " << (auto_encoder_threads ? "true" : "false") << "\n"
+                << "reserved_cores = " << reserved_cores << "\n"
+                << "parallel_encoders = " << parallel_encoders << "\n"
+                << "parallel_chunk_seconds = " << parallel_chunk_seconds << "\n"
+                << "output_buffer_mb = " << output_buffer_mb << "\n"
+                << "faststart_mode = " << faststartModeToString(faststart_mode) << "\n"
+                << "faststart_reserve_minutes = " << faststart_reserve_minutes << "\n"
+                << "segment_minutes = " << segment_minutes << "\n"
+                << "segment_size_mb = " << segment_size_mb << "\n"
+                << "segment_manifest = " << (segment_manifest ? "true" : "false") << "\n"
+                << "tee_presets = " << tee_presets << "\n"
+                << "proxy_preset = " << proxy_preset << "\n"
+                << "proxy_height = " << proxy_height << "\n";
             
             LOG(LL_NFO, "Saved configuration");
         } catch (const std::exception& ex) {
@@ -93,6 +173,43 @@ namespace Config {
         encoder_config = reader.readEncoderConfig();
     }
 
+    void Manager::readTeeEncoderConfigs() {
+        tee_encoder_configs.clear();
+
+        // A comma separated list of files in the presets folder, with or without .json.
+        std::istringstream names(tee_presets);
+        string name;
+        while (std::getline(names, name, ',')) {
+            name = presetName(name);
+            if (name.empty()) {
+                continue;
+            }
+            const string path = presetPath(name);
+            if (!std::ifstream(path)) {
+                LOG(LL_WRN, "Tee preset not found, skipping it: ", path);
+                continue;
+            }
+            JsonPresetReader reader(path);
+            tee_encoder_configs.emplace_back(name, reader.readEncoderConfig());
+        }
+    }
+
+    void Manager::readProxyEncoderConfig() {
+        proxy_enabled = false;
+
+        const string path = presetPath(proxy_preset);
+        if (path.empty()) {
+            return;
+        }
+        if (!std::ifstream(path)) {
+            LOG(LL_WRN, "Proxy preset not found, exporting without a proxy: ", path);
+            return;
+        }
+        JsonPresetReader reader(path);
+        proxy_encoder_config = reader.readEncoderConfig();
+        proxy_enabled = true;
+    }
+
     void Manager::writeEncoderConfig() {
         JsonPresetReader reader(AsiPath() + "\\" PRESET_FILE_NAME);
         reader.writeEncoderConfig(encoder_config);
@@ -6,6 +6,7 @@
 
 #include <string>
 #include <utility>
+#include <vector>
 
 using std::string;
 using std::pair;
@@ -22,11 +23,35 @@ namespace Config {
         static pair<uint32_t, uint32_t> fps;
         static uint8_t motion_blur_samples;
         static float motion_blur_strength;
+        static uint32_t video_queue_budget_mb;
+        static bool video_queue_spill;
+        static bool session_trace;
+        static uint32_t session_trace_pixel_step;
+        static bool auto_encoder_threads;
+        static uint32_t reserved_cores;
+        static uint32_t parallel_encoders;
+        static uint32_t parallel_chunk_seconds;
+        static uint32_t output_buffer_mb;
+        static FFmpeg::FaststartMode faststart_mode;
+        static uint32_t faststart_reserve_minutes;
+        static uint32_t segment_minutes;
+        static uint32_t segment_size_mb;
+        static bool segment_manifest;
+        static string tee_presets;
+        static string proxy_preset;
+        static uint32_t proxy_height;
         static FFmpeg::FFENCODERCONFIG encoder_config;
+        // The presets named in tee_presets that could be loaded, by name.
+        static std::vector<pair<string, FFmpeg::FFENCODERCONFIG>> tee_encoder_configs;
+        // Set when proxy_preset names a preset that could be loaded.
+        static bool proxy_enabled;
+        static FFmpeg::FFENCODERCONFIG proxy_encoder_config;
 
         static void reload();
         static void save();
         static void readEncoderConfig();
+        static void readTeeEncoderConfigs();
+        static void readProxyEncoderConfig();
         static void writeEncoderConfig();
     };
 }
@@ -2458,10 +2458,44 @@ HRESULT IMFSinkWriterHooks::SetInputMediaType::Implementation(IMFSinkWriter* pTh
 
                     CreateMotionBlurBuffers(::exportContext->p_device, motionBlurBufferDesc);
 
+                    Encoder::EncoderSessionOptions sessionOptions;
+                    sessionOptions.videoQueueBudgetMb = Config::Manager::video_queue_budget_mb;
+                    sessionOptions.spillVideoQueue = Config::Manager::video_queue_spill;
+                    sessionOptions.traceSession = Config::Manager::session_trace;
+                    sessionOptions.tracePixelStep = Config::Manager::session_trace_pixel_step;
+                    sessionOptions.threading = Encoder::EncoderThreadingPolicy{Config::Manager::auto_encoder_threads,
+                                                                               Config::Manager::reserved_cores,
+                                                                               Config::Manager::parallel_encoders,
+                                                                               Config::Manager::parallel_chunk_seconds};
+                    sessionOptions.outputBufferMb = Config::Manager::output_buffer_mb;
+                    sessionOptions.faststartMode = Config::Manager::faststart_mode;
+                    sessionOptions.faststartReserveMinutes = Config::Manager::faststart_reserve_minutes;
+                    sessionOptions.segments = Encoder::OutputSegmentPolicy{Config::Manager::segment_minutes,
+                                                                           Config::Manager::segment_size_mb,
+                                                                           Config::Manager::segment_manifest};
+
+                    // Every tee preset writes <output>_<preset>.<container> from the same captured frames.
+                    const std::string outputStem = filename.substr(0, filename.find_last_of('.'));
+                    for (const auto& [presetName, presetConfig] : Config::Manager::tee_encoder_configs) {
+                        const std::string teeFilename = outputStem + "_" + presetName + "." + presetConfig.format.container;
+                        LOG(LL_NFO, "Tee output file: ", teeFilename);
+                        sessionOptions.teeOutputs.push_back(Encoder::EncoderOutput{presetConfig, std::wstring(teeFilename.begin(), teeFilename.end())});
+                    }
+
+                    // The proxy, if configured, is <output>_proxy.<container>.
+                    if (Config::Manager::proxy_enabled) {
+                        const std::string proxyFilename = outputStem + "_proxy." + Config::Manager::proxy_encoder_config.format.container;
+                        LOG(LL_NFO, "Proxy output file: ", proxyFilename);
+                        sessionOptions.proxy.enabled = true;
+                        sessionOptions.proxy.config = Config::Manager::proxy_encoder_config;
+                        sessionOptions.proxy.filename = std::wstring(proxyFilename.begin(), proxyFilename.end());
+                        sessionOptions.proxy.height = Config::Manager::proxy_height;
+                    }
+
                     REQUIRE(encodingSession->createContext(
                                 Config::Manager::encoder_config, std::wstring(filename.begin(), filename.end()), exportWidth,
                                 exportHeight, "rgba", fps_num, fps_den, numChannels, sampleRate, "s16", blockAlignment,
-                                Config::Manager::export_openexr, openExrWidth, openExrHeight),
+                                Config::Manager::export_openexr, openExrWidth, openExrHeight, sessionOptions),
                             "Failed to create encoding context.");
                 }
             } catch (std::exception& ex) {
@@ -3,6 +3,7 @@
 #include "logger.h"
 #include "util.h"
 #include "ConfigValueParser.h"
+#include "FFmpegTypes.h"
 
 #include <INIReader.h>
 #include <ShlObj.h>
@@ -141,6 +142,25 @@ public:
         return default_value;
     }
     
+    FFmpeg::FaststartMode readFaststartMode(const std::string& section, const std::string& key, FFmpeg::FaststartMode default_value) {
+        const std::string str_value = ConfigValueParser::toLower(ConfigValueParser::trim(reader_->GetString(section, key, "")));
+
+        if (str_value == "rewrite") {
+            LOG(LL_NON, "Loaded value for \"", key, "\": rewrite");
+            return FFmpeg::FaststartRewrite;
+        } else if (str_value == "reserve") {
+            LOG(LL_NON, "Loaded value for \"", key, "\": reserve");
+            return FFmpeg::FaststartReserve;
+        } else if (str_value == "fragmented") {
+            LOG(LL_NON, "Loaded value for \"", key, "\": fragmented");
+            return FFmpeg::FaststartFragmented;
+        }
+
+        LOG(LL_NON, "Failed to parse value for \"", key, "\": ", str_value);
+        LOG(LL_NON, "Using default value for \"", key, "\"");
+        return default_value;
+    }
+    
     // Get output directory with fallback to Videos folder
     std::string getOutputDirectory(const std::string& section, const std::string& key) {
         std::string str_value = reader_->GetString(section, key, "");
@@ -40,6 +40,10 @@ public:
                 copyJsonString(vid.value("codec", "libx264"), config.video.encoder, sizeof(config.video.encoder));
                 
                 std::string videoOptions = buildVideoOptionsString(vid);
+                const std::string filterThreads = buildFilterThreadsOption(j);
+                if (!filterThreads.empty()) {
+                    videoOptions += (videoOptions.empty() ? "" : "|") + filterThreads;
+                }
                 copyJsonString(videoOptions, config.video.options, sizeof(config.video.options));
                 
                 std::string videoFilters = buildVideoFiltersString(j);
@@ -428,6 +432,22 @@ private:
         return oss.str();
     }
     
+    // filter.threads: threads the video filter graph slices frames over; "auto" or 0 uses one per core.
+    static std::string buildFilterThreadsOption(const nlohmann::json& root) {
+        if (!root.contains("filter") || !root["filter"].contains("threads")) {
+            return "";
+        }
+
+        auto& threads = root["filter"]["threads"];
+        if (threads.is_number_integer()) {
+            return "_filterThreads=" + std::to_string(threads.get<int>());
+        }
+        if (threads.is_string() && threads != "auto") {
+            return "_filterThreads=" + threads.get<std::string>();
+        }
+        return "";
+    }
+    
     static std::string buildVideoFiltersString(const nlohmann::json& root) {
         if (!root.contains("filter")) {
             return "";
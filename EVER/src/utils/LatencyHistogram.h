@@ -0,0 +1,147 @@
+#pragma once
+
+#include "logger.h"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Always-on latency histogram for one pipeline stage.
+// Buckets are log2-spaced with eight linear sub-buckets each, so any reported percentile is within
+// 12.5% of the true value. Recording is two relaxed atomic adds and a rarely-taken max update,
+// which keeps it cheap enough to leave on for every frame and safe to feed from any thread.
+class LatencyHistogram {
+public:
+    struct Summary {
+        uint64_t count = 0;
+        double meanMs = 0.0;
+        double p50Ms = 0.0;
+        double p95Ms = 0.0;
+        double p99Ms = 0.0;
+        double maxMs = 0.0;
+    };
+
+    explicit LatencyHistogram(const char* name)
+        : name_(name)
+    {}
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(int64_t nanoseconds) {
+        const uint64_t value = nanoseconds > 0 ? static_cast<uint64_t>(nanoseconds) : 0;
+        buckets_[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        sumNs_.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t currentMax = maxNs_.load(std::memory_order_relaxed);
+        while (value > currentMax && !maxNs_.compare_exchange_weak(currentMax, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    void record(std::chrono::steady_clock::duration elapsed) {
+        record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    // Not synchronized against concurrent record(); call between sessions.
+    void reset() {
+        for (std::atomic<uint64_t>& bucket : buckets_) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        sumNs_.store(0, std::memory_order_relaxed);
+        maxNs_.store(0, std::memory_order_relaxed);
+    }
+
+    Summary summarize() const {
+        std::array<uint64_t, kBucketCount> counts{};
+        Summary summary;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            counts[i] = buckets_[i].load(std::memory_order_relaxed);
+            summary.count += counts[i];
+        }
+
+        if (summary.count == 0) {
+            return summary;
+        }
+
+        const uint64_t maxNs = maxNs_.load(std::memory_order_relaxed);
+        summary.meanMs = toMs(sumNs_.load(std::memory_order_relaxed)) / static_cast<double>(summary.count);
+        summary.p50Ms = toMs(percentile(counts, summary.count, 0.50, maxNs));
+        summary.p95Ms = toMs(percentile(counts, summary.count, 0.95, maxNs));
+        summary.p99Ms = toMs(percentile(counts, summary.count, 0.99, maxNs));
+        summary.maxMs = toMs(maxNs);
+        return summary;
+    }
+
+    void log() const {
+        const Summary summary = summarize();
+        if (summary.count == 0) {
+            return;
+        }
+
+        LOG(LL_NFO, "Stage latency ", name_, ": count=", summary.count,
+            " meanMs=", summary.meanMs,
+            " p50Ms=", summary.p50Ms,
+            " p95Ms=", summary.p95Ms,
+            " p99Ms=", summary.p99Ms,
+            " maxMs=", summary.maxMs);
+    }
+
+    const char* getName() const {
+        return name_;
+    }
+
+private:
+    static constexpr size_t kSubBucketBits = 3;
+    static constexpr size_t kSubBuckets = size_t{1} << kSubBucketBits;
+    // 2^42 ns is over an hour; anything slower lands in the last bucket.
+    static constexpr size_t kMaxExponent = 42;
+    static constexpr size_t kBucketCount = (kMaxExponent - kSubBucketBits + 2) * kSubBuckets;
+
+    static size_t bucketIndex(uint64_t value) {
+        if (value < kSubBuckets) {
+            return static_cast<size_t>(value);
+        }
+
+        const size_t exponent = static_cast<size_t>(std::bit_width(value)) - 1;
+        const size_t subBucket = static_cast<size_t>(value >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+        const size_t index = (exponent - kSubBucketBits + 1) * kSubBuckets + subBucket;
+        return index < kBucketCount ? index : kBucketCount - 1;
+    }
+
+    static uint64_t bucketUpperBound(size_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+
+        const size_t exponent = index / kSubBuckets + kSubBucketBits - 1;
+        const uint64_t subBucket = index % kSubBuckets;
+        const uint64_t width = uint64_t{1} << (exponent - kSubBucketBits);
+        return ((kSubBuckets + subBucket) << (exponent - kSubBucketBits)) + width - 1;
+    }
+
+    static uint64_t percentile(const std::array<uint64_t, kBucketCount>& counts, uint64_t total,
+                               double quantile, uint64_t maxNs) {
+        const uint64_t rank = static_cast<uint64_t>(quantile * static_cast<double>(total - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                const uint64_t bound = bucketUpperBound(i);
+                return bound < maxNs ? bound : maxNs;
+            }
+        }
+        return maxNs;
+    }
+
+    static double toMs(uint64_t nanoseconds) {
+        return static_cast<double>(nanoseconds) / 1000000.0;
+    }
+
+    const char* name_;
+    std::array<std::atomic<uint64_t>, kBucketCount> buckets_{};
+    std::atomic<uint64_t> sumNs_{0};
+    std::atomic<uint64_t> maxNs_{0};
+};
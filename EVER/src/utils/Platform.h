@@ -0,0 +1,75 @@
+#pragma once
+
+// Thin platform layer for the encoder core. On Windows this is just <Windows.h>; elsewhere it supplies the
+// few Win32 types, HRESULT codes and CRT helpers the portable sources use, so they build unchanged on Linux.
+
+#ifdef _WIN32
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <malloc.h>
+
+#else
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+typedef int32_t HRESULT;
+typedef int INT;
+typedef unsigned int UINT;
+typedef char CHAR;
+typedef int BOOL;
+typedef uint8_t BYTE;
+typedef uint8_t byte;
+typedef wchar_t WCHAR;
+typedef uint32_t DWORD;
+typedef int64_t LONGLONG;
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define E_NOTIMPL ((HRESULT)0x80004001L)
+#define E_POINTER ((HRESULT)0x80004003L)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000EL)
+#define E_INVALIDARG ((HRESULT)0x80070057L)
+
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+#define __FUNCSIG__ __PRETTY_FUNCTION__
+
+#define _TRUNCATE ((size_t)-1)
+
+// Only the truncating form is used by the presets code: copy what fits and always terminate.
+inline int strncpy_s(char* destination, size_t destinationSize, const char* source, size_t count) {
+    if (destination == nullptr || destinationSize == 0) {
+        return 22;
+    }
+    const size_t limit = count == _TRUNCATE ? destinationSize - 1 : (count < destinationSize - 1 ? count : destinationSize - 1);
+    const size_t length = strnlen(source, limit);
+    std::memcpy(destination, source, length);
+    destination[length] = '\0';
+    return 0;
+}
+
+inline void* _aligned_malloc(size_t size, size_t alignment) {
+    // aligned_alloc requires the size to be a multiple of the alignment.
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+inline void _aligned_free(void* memory) {
+    std::free(memory);
+}
+
+#endif
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Bounded single-producer/single-consumer ring of slots.
+// The producer and consumer spin briefly on the opposite index and then park on a wake signal,
+// so the steady-state handoff is two uncontended atomic stores and no kernel transition.
+// After requestStop() the producer is refused, while the consumer keeps draining until empty.
+template <class T>
+class SpscRingBuffer {
+public:
+    explicit SpscRingBuffer(size_t capacity)
+        : capacity_(capacity > 0 ? capacity : 1)
+        , limit_(capacity_)
+        , slots_(capacity_)
+    {}
+
+    ~SpscRingBuffer(void) {}
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    // Producer only. Blocks while the ring is full. Returns false (leaving item untouched) once stop was requested.
+    bool push(T& item) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+
+        if (tail - producerCachedHead_ >= limit_) {
+            producerCachedHead_ = head_.load(std::memory_order_acquire);
+            if (tail - producerCachedHead_ >= limit_) {
+                if (!waitForSpace(tail)) {
+                    return false;
+                }
+            }
+        }
+
+        if (stopRequested_.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        slots_[tail % capacity_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_seq_cst);
+        wake(consumerParked_, consumerSignal_);
+        return true;
+    }
+
+    // Consumer only. Blocks while the ring is empty. Returns false once stop was requested and the ring is drained.
+    bool pop(T& item) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+
+        if (head == consumerCachedTail_) {
+            consumerCachedTail_ = tail_.load(std::memory_order_acquire);
+            if (head == consumerCachedTail_) {
+                if (!waitForData(head)) {
+                    return false;
+                }
+            }
+        }
+
+        item = std::move(slots_[head % capacity_]);
+        head_.store(head + 1, std::memory_order_seq_cst);
+        wake(producerParked_, producerSignal_);
+        return true;
+    }
+
+    // Consumer only. Returns false immediately when the ring is empty.
+    bool tryPop(T& item) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+
+        if (head == consumerCachedTail_) {
+            consumerCachedTail_ = tail_.load(std::memory_order_acquire);
+            if (head == consumerCachedTail_) {
+                return false;
+            }
+        }
+
+        item = std::move(slots_[head % capacity_]);
+        head_.store(head + 1, std::memory_order_seq_cst);
+        wake(producerParked_, producerSignal_);
+        return true;
+    }
+
+    void requestStop() {
+        stopRequested_.store(true, std::memory_order_seq_cst);
+        producerSignal_.fetch_add(1, std::memory_order_seq_cst);
+        producerSignal_.notify_all();
+        consumerSignal_.fetch_add(1, std::memory_order_seq_cst);
+        consumerSignal_.notify_all();
+    }
+
+    // Not thread-safe; only call while neither side is running.
+    void reset() {
+        for (T& slot : slots_) {
+            slot = T();
+        }
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+        producerCachedHead_ = 0;
+        consumerCachedTail_ = 0;
+        stopRequested_.store(false, std::memory_order_release);
+    }
+
+    size_t size() const {
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        const size_t head = head_.load(std::memory_order_acquire);
+        return tail - head;
+    }
+
+    size_t getCapacity() const {
+        return capacity_;
+    }
+
+    // Producer only. Lowers the number of slots the producer may fill, e.g. to follow a memory budget.
+    void setLimit(size_t limit) {
+        limit_ = limit < 1 ? 1 : (limit > capacity_ ? capacity_ : limit);
+    }
+
+    size_t getLimit() const {
+        return limit_;
+    }
+
+    bool isStopRequested() const {
+        return stopRequested_.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr size_t kCacheLineSize = 64;
+    static constexpr int kSpinIterations = 1024;
+    static constexpr int kYieldIterations = 64;
+
+    static void cpuRelax() {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    static void wake(std::atomic<bool>& parked, std::atomic<uint32_t>& signal) {
+        if (parked.load(std::memory_order_seq_cst)) {
+            signal.fetch_add(1, std::memory_order_seq_cst);
+            signal.notify_one();
+        }
+    }
+
+    // Spinning only pays off when the other side can run concurrently on another core.
+    static int spinIterations() {
+        static const int iterations = std::thread::hardware_concurrency() > 1 ? kSpinIterations : 0;
+        return iterations;
+    }
+
+    template <class Ready>
+    bool spinThenPark(std::atomic<bool>& parked, std::atomic<uint32_t>& signal, Ready ready) {
+        const int spins = spinIterations();
+        for (int i = 0; i < spins + kYieldIterations; ++i) {
+            if (ready()) {
+                return true;
+            }
+            if (i < spins) {
+                cpuRelax();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+
+        while (true) {
+            const uint32_t observed = signal.load(std::memory_order_seq_cst);
+            parked.store(true, std::memory_order_seq_cst);
+            if (ready()) {
+                parked.store(false, std::memory_order_relaxed);
+                return true;
+            }
+            signal.wait(observed, std::memory_order_seq_cst);
+            parked.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    bool waitForSpace(size_t tail) {
+        bool stopped = false;
+        spinThenPark(producerParked_, producerSignal_, [&] {
+            if (stopRequested_.load(std::memory_order_acquire)) {
+                stopped = true;
+                return true;
+            }
+            producerCachedHead_ = head_.load(std::memory_order_seq_cst);
+            return tail - producerCachedHead_ < limit_;
+        });
+        return !stopped;
+    }
+
+    bool waitForData(size_t head) {
+        bool drained = false;
+        spinThenPark(consumerParked_, consumerSignal_, [&] {
+            consumerCachedTail_ = tail_.load(std::memory_order_seq_cst);
+            if (head != consumerCachedTail_) {
+                return true;
+            }
+            if (stopRequested_.load(std::memory_order_acquire)) {
+                // Re-check after observing stop so a frame published just before it is not lost.
+                consumerCachedTail_ = tail_.load(std::memory_order_seq_cst);
+                drained = head == consumerCachedTail_;
+                return true;
+            }
+            return false;
+        });
+        return !drained;
+    }
+
+    const size_t capacity_;
+    size_t limit_;
+    std::vector<T> slots_;
+
+    alignas(kCacheLineSize) std::atomic<size_t> head_{0};
+    size_t consumerCachedTail_ = 0;
+    std::atomic<bool> consumerParked_{false};
+    std::atomic<uint32_t> consumerSignal_{0};
+
+    alignas(kCacheLineSize) std::atomic<size_t> tail_{0};
+    size_t producerCachedHead_ = 0;
+    std::atomic<bool> producerParked_{false};
+    std::atomic<uint32_t> producerSignal_{0};
+
+    alignas(kCacheLineSize) std::atomic<bool> stopRequested_{false};
+};
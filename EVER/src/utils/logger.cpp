@@ -2,7 +2,9 @@
 
 #include "util.h"
 
+#include <filesystem>
 #include <iostream>
+#include <thread>
 
 #ifndef EVER_BUILD_VERSION
 #define EVER_BUILD_VERSION "v0.0.0-LOCAL_BUILD"
@@ -30,7 +32,7 @@ bool Logger::ensureStream() {
     if (this->filestream.is_open()) {
         return true;
     }
-    this->filestream.open(AsiPath() + "\\EVER\\" TARGET_NAME ".log");
+    this->filestream.open(std::filesystem::path(AsiPath()) / "EVER" / TARGET_NAME ".log");
     if (this->filestream.is_open()) {
         std::lock_guard<std::mutex> guard(mtx);
         filestream << "Logger initialized." << "\r\n";
@@ -53,7 +55,11 @@ std::string Logger::getTimestamp() {
     time_t rawtime;
     struct tm timeinfo;
     time(&rawtime);
+#ifdef _WIN32
     localtime_s(&timeinfo, &rawtime);
+#else
+    localtime_r(&rawtime, &timeinfo);
+#endif
     strftime(buffer, 256, "[%Y-%m-%d %H:%M:%S]", &timeinfo);
     return buffer;
 }
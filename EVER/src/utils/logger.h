@@ -1,16 +1,19 @@
 #pragma once
 
-#ifndef NOMINMAX
-#define NOMINMAX
-#endif
-#include <Windows.h>
+#include "Platform.h"
+
+#include <cstring>
 #include <fstream>
 #include <functional>
 #include <iomanip>
 #include <mutex>
 #include <sstream>
 
+#ifdef _WIN32
 #define __CUSTOM_FILENAME__ (strrchr(__FILE__, '\\') ? strrchr(__FILE__, '\\') + 1 : __FILE__)
+#else
+#define __CUSTOM_FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
 
 #pragma warning(push, 0)
 enum LogLevel { LL_NON = 0, LL_ERR = 10, LL_WRN = 20, LL_NFO = 30, LL_DBG = 40, LL_TRC = 50 };
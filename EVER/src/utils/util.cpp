@@ -1,7 +1,9 @@
 #include "util.h"
 #include "logger.h"
+#include <cstdlib>
 #include <filesystem>
 
+#ifdef _WIN32
 namespace {
     void DummyFunction() {}
 }
@@ -23,4 +25,13 @@ std::string AsiPath() {
 
     const std::filesystem::path path(buffer);
     return path.parent_path().string();
-}
\ No newline at end of file
+}
+#else
+// Headless builds have no game directory; EVER_HOME points at the folder that holds EVER/ (log, presets).
+std::string AsiPath() {
+    if (const char* home = std::getenv("EVER_HOME"); home != nullptr && home[0] != '\0') {
+        return home;
+    }
+    return std::filesystem::current_path().string();
+}
+#endif
\ No newline at end of file
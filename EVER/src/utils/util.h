@@ -1,8 +1,11 @@
 #pragma once
+#ifdef _WIN32
 #include <dxgi.h>
+#endif
 #include <string>
 #include "logger.h"
 
+#ifdef _WIN32
 #define RETURN_STR(val, e)                                                                                             \
     {                                                                                                                  \
         if (val == e) {                                                                                                \
@@ -131,11 +134,12 @@ inline static std::string conv_dxgi_format_to_string(int value) {
 
     return "<UNKNOWN FORMAT>";
 }
+#endif
 
 inline void StackDump(size_t size, std::string prefix) {
     uint64_t x = 0xDEADBEEFBAADF00D;
     void** ptr = (void**)&x;
-    for (int i = 0; i < size; i++) {
+    for (size_t i = 0; i < size; i++) {
         LOG(LL_TRC, "Stack dump: ", prefix, " ", Logger::hex(i, 4), ": 0x", *(ptr + i));
     }
 }
@@ -165,13 +169,13 @@ inline std::string hexdump(void* ptr, int buflen) {
     char temp[4096];
     int i, j;
     for (i = 0; i < buflen; i += 16) {
-        sprintf_s(temp, "%06x: ", i);
+        snprintf(temp, sizeof(temp), "%06x: ", i);
         sstream << temp;
         for (j = 0; j < 16; j++) {
             if (i + j < buflen) {
-                sprintf_s(temp, "%02x ", buf[i + j]);
+                snprintf(temp, sizeof(temp), "%02x ", buf[i + j]);
             } else {
-                sprintf_s(temp, "   ");
+                snprintf(temp, sizeof(temp), "   ");
             }
             sstream << temp;
         }
@@ -179,7 +183,7 @@ inline std::string hexdump(void* ptr, int buflen) {
         sstream << " ";
         for (j = 0; j < 16; j++) {
             if (i + j < buflen) {
-                sprintf_s(temp, "%c", isprint(buf[i + j]) ? buf[i + j] : '.');
+                snprintf(temp, sizeof(temp), "%c", isprint(buf[i + j]) ? buf[i + j] : '.');
                 sstream << temp;
             }
         }
@@ -189,6 +193,7 @@ inline std::string hexdump(void* ptr, int buflen) {
     return sstream.str();
 }
 
+#ifdef _WIN32
 // https://stackoverflow.com/questions/215963/how-do-you-properly-use-widechartomultibyte
 
 // Convert a wide Unicode string to an UTF8 string
@@ -210,9 +215,52 @@ inline std::wstring utf8_decode(const std::string& str) {
     MultiByteToWideChar(CP_UTF8, 0, &str[0], static_cast<int>(str.size()), &wstrTo[0], size_needed);
     return wstrTo;
 }
+#else
+// wchar_t is UTF-32 outside Windows, so each element is one code point.
+inline std::string utf8_encode(const std::wstring& wstr) {
+    std::string strTo;
+    strTo.reserve(wstr.size());
+    for (const wchar_t ch : wstr) {
+        const uint32_t cp = static_cast<uint32_t>(ch);
+        if (cp < 0x80) {
+            strTo += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            strTo += static_cast<char>(0xC0 | (cp >> 6));
+            strTo += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            strTo += static_cast<char>(0xE0 | (cp >> 12));
+            strTo += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            strTo += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            strTo += static_cast<char>(0xF0 | (cp >> 18));
+            strTo += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            strTo += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            strTo += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+    return strTo;
+}
+
+inline std::wstring utf8_decode(const std::string& str) {
+    std::wstring wstrTo;
+    wstrTo.reserve(str.size());
+    for (size_t i = 0; i < str.size();) {
+        const uint8_t lead = static_cast<uint8_t>(str[i]);
+        const size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 1;
+        uint32_t cp = length == 1 ? lead : lead & (0x7F >> length);
+        for (size_t k = 1; k < length && i + k < str.size(); ++k) {
+            cp = (cp << 6) | (static_cast<uint8_t>(str[i + k]) & 0x3F);
+        }
+        wstrTo += static_cast<wchar_t>(cp);
+        i += length;
+    }
+    return wstrTo;
+}
+#endif
 
 std::string AsiPath();
 
+#ifdef _WIN32
 #define PERFORM_SINGLE_BYTE_PATCH(address, byte, label)                                                               \
     do {                                                                                                               \
         if ((address) != 0) {                                                                                          \
@@ -230,4 +278,5 @@ std::string AsiPath();
         }                                                                                                              \
     } while (0)
 
-#undef RETURN_STR
\ No newline at end of file
+#undef RETURN_STR
+#endif
@@ -0,0 +1,327 @@
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 26812)
+
+#include "AVFramePool.h"
+#include "logger.h"
+
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/samplefmt.h>
+}
+
+#pragma warning(pop)
+
+namespace Encoder {
+    namespace {
+        // Shells beyond this are freed on release; the encode queues never hold more than a few frames.
+        constexpr size_t kMaxFreeShells = 16;
+        // Trailing slack after each plane for SIMD readers that overrun the last row, like av_frame_get_buffer.
+        constexpr size_t kPlanePadding = 64;
+
+        // Counts pool misses: AVBufferPool only calls this when no returned buffer is available.
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+        AVBufferRef* allocatePoolBuffer(void* opaque, size_t size) {
+#else
+        AVBufferRef* allocatePoolBuffer(void* opaque, int size) {
+#endif
+            static_cast<std::atomic<uint64_t>*>(opaque)->fetch_add(1, std::memory_order_relaxed);
+            return av_buffer_alloc(size);
+        }
+
+        size_t alignUp(size_t value, size_t alignment) {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    AVFramePool::~AVFramePool() {
+        reset();
+    }
+
+    HRESULT AVFramePool::initializeVideo(int pixelFormat, int width, int height) {
+        PRE();
+        reset();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        isAudio_ = false;
+        format_ = pixelFormat;
+        width_ = width;
+        height_ = height;
+        acquired_ = 0;
+        shellAllocations_ = 0;
+        bufferAllocations_ = 0;
+        peakOutstanding_ = 0;
+
+        const AVPixelFormat format = static_cast<AVPixelFormat>(pixelFormat);
+        const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(format);
+        if (descriptor == nullptr || (descriptor->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL)) != 0) {
+            // acquireVideo falls back to av_frame_get_buffer for these.
+            LOG(LL_WRN, "AVFramePool::initializeVideo - ", name_, ": format ", pixelFormat, " is not pooled");
+            POST();
+            return E_INVALIDARG;
+        }
+
+        int linesizes[4] = {};
+        if (av_image_fill_linesizes(linesizes, format, width) < 0) {
+            LOG(LL_ERR, "AVFramePool::initializeVideo - ", name_, ": invalid geometry ", width, "x", height);
+            POST();
+            return E_INVALIDARG;
+        }
+
+        const int planes = av_pix_fmt_count_planes(format);
+        std::array<size_t, kMaxPlanes> planeBytes{};
+        for (int plane = 0; plane < planes; ++plane) {
+            linesizes_[plane] = static_cast<int>(alignUp(static_cast<size_t>(linesizes[plane]), kLinesizeAlignment));
+            const int planeHeight = (plane == 1 || plane == 2) ? -((-height) >> descriptor->log2_chroma_h) : height;
+            planeBytes[plane] = static_cast<size_t>(linesizes_[plane]) * static_cast<size_t>(planeHeight) + kPlanePadding;
+        }
+
+        const HRESULT hr = createPools(planeBytes, planes);
+        LOG(LL_DBG, "AVFramePool::initializeVideo - ", name_, ": ", av_get_pix_fmt_name(format), " ", width, "x", height,
+            " planes=", planes, " frameBytes=", frameBytes_);
+        POST();
+        return hr;
+    }
+
+    HRESULT AVFramePool::initializeAudio(int sampleFormat, int channels, int capacitySamples) {
+        PRE();
+        reset();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        isAudio_ = true;
+        format_ = sampleFormat;
+        channels_ = channels;
+        capacitySamples_ = capacitySamples;
+        acquired_ = 0;
+        shellAllocations_ = 0;
+        bufferAllocations_ = 0;
+        peakOutstanding_ = 0;
+
+        const AVSampleFormat format = static_cast<AVSampleFormat>(sampleFormat);
+        const int planes = av_sample_fmt_is_planar(format) ? channels : 1;
+        if (channels <= 0 || planes > static_cast<int>(kMaxPlanes)) {
+            LOG(LL_ERR, "AVFramePool::initializeAudio - ", name_, ": unsupported channel count ", channels);
+            POST();
+            return E_INVALIDARG;
+        }
+
+        int linesize = 0;
+        if (av_samples_get_buffer_size(&linesize, channels, capacitySamples, format, 0) < 0) {
+            LOG(LL_ERR, "AVFramePool::initializeAudio - ", name_, ": invalid capacity ", capacitySamples);
+            POST();
+            return E_INVALIDARG;
+        }
+
+        std::array<size_t, kMaxPlanes> planeBytes{};
+        for (int plane = 0; plane < planes; ++plane) {
+            planeBytes[plane] = static_cast<size_t>(linesize) + kPlanePadding;
+        }
+        linesizes_.fill(0);
+        linesizes_[0] = linesize;
+
+        const HRESULT hr = createPools(planeBytes, planes);
+        LOG(LL_DBG, "AVFramePool::initializeAudio - ", name_, ": ", av_get_sample_fmt_name(format), " channels=", channels,
+            " capacitySamples=", capacitySamples, " frameBytes=", frameBytes_);
+        POST();
+        return hr;
+    }
+
+    HRESULT AVFramePool::createPools(const std::array<size_t, kMaxPlanes>& planeBytes, int planes) {
+        planes_ = planes;
+        frameBytes_ = 0;
+        for (int plane = 0; plane < planes; ++plane) {
+            pools_[plane] = av_buffer_pool_init2(planeBytes[plane], &bufferAllocations_, allocatePoolBuffer, nullptr);
+            if (pools_[plane] == nullptr) {
+                LOG(LL_ERR, "AVFramePool::createPools - ", name_, ": failed to create buffer pool");
+                releasePools();
+                return E_OUTOFMEMORY;
+            }
+            frameBytes_ += planeBytes[plane];
+        }
+        return S_OK;
+    }
+
+    void AVFramePool::releasePools() {
+        // Buffers still referenced by outstanding frames keep their pool alive until they are unreferenced.
+        for (AVBufferPool*& pool : pools_) {
+            if (pool != nullptr) {
+                av_buffer_pool_uninit(&pool);
+            }
+        }
+        planes_ = 0;
+    }
+
+    void AVFramePool::reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (AVFrame*& shell : freeShells_) {
+            av_frame_free(&shell);
+        }
+        freeShells_.clear();
+        releasePools();
+        outstanding_ = 0;
+    }
+
+    bool AVFramePool::attachBuffers(AVFrame* frame) {
+        for (int plane = 0; plane < planes_; ++plane) {
+            frame->buf[plane] = av_buffer_pool_get(pools_[plane]);
+            if (frame->buf[plane] == nullptr) {
+                return false;
+            }
+            frame->data[plane] = frame->buf[plane]->data;
+            if (!isAudio_) {
+                frame->linesize[plane] = linesizes_[plane];
+            }
+        }
+
+        if (isAudio_) {
+            frame->linesize[0] = linesizes_[0];
+        }
+        frame->extended_data = frame->data;
+        return true;
+    }
+
+    AVFrame* AVFramePool::acquireShell() {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        AVFrame* frame = nullptr;
+        if (!freeShells_.empty()) {
+            frame = freeShells_.back();
+            freeShells_.pop_back();
+        } else {
+            frame = av_frame_alloc();
+            if (frame == nullptr) {
+                return nullptr;
+            }
+            ++shellAllocations_;
+        }
+
+        ++acquired_;
+        ++outstanding_;
+        peakOutstanding_ = (std::max)(peakOutstanding_, outstanding_);
+        return frame;
+    }
+
+    AVFrame* AVFramePool::acquireVideo() {
+        AVFrame* frame = acquireShell();
+        if (frame == nullptr) {
+            return nullptr;
+        }
+
+        bool attached = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            frame->format = format_;
+            frame->width = width_;
+            frame->height = height_;
+            attached = planes_ > 0 ? attachBuffers(frame) : av_frame_get_buffer(frame, 0) >= 0;
+        }
+
+        if (!attached) {
+            LOG(LL_ERR, "AVFramePool::acquireVideo - ", name_, ": failed to get frame buffers");
+            release(frame);
+            return nullptr;
+        }
+        return frame;
+    }
+
+    AVFrame* AVFramePool::acquireAudio(int nbSamples) {
+        if (nbSamples > capacitySamples_) {
+            // Chunk sizes come from the game and are not bounded up front; grow geometrically so this stays rare.
+            int capacity = (std::max)(capacitySamples_, 1024);
+            while (capacity < nbSamples) {
+                capacity *= 2;
+            }
+            LOG(LL_DBG, "AVFramePool::acquireAudio - ", name_, ": growing capacity to ", capacity, " samples");
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::array<size_t, kMaxPlanes> planeBytes{};
+            int linesize = 0;
+            if (av_samples_get_buffer_size(&linesize, channels_, capacity, static_cast<AVSampleFormat>(format_), 0) < 0) {
+                return nullptr;
+            }
+            const int planes = planes_ > 0 ? planes_ : (av_sample_fmt_is_planar(static_cast<AVSampleFormat>(format_)) ? channels_ : 1);
+            for (int plane = 0; plane < planes; ++plane) {
+                planeBytes[plane] = static_cast<size_t>(linesize) + kPlanePadding;
+            }
+            releasePools();
+            linesizes_[0] = linesize;
+            capacitySamples_ = capacity;
+            if (FAILED(createPools(planeBytes, planes))) {
+                return nullptr;
+            }
+        }
+
+        AVFrame* frame = acquireShell();
+        if (frame == nullptr) {
+            return nullptr;
+        }
+
+        bool attached = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            frame->format = format_;
+            frame->nb_samples = nbSamples;
+            attached = planes_ > 0 && attachBuffers(frame);
+        }
+
+        if (!attached) {
+            LOG(LL_ERR, "AVFramePool::acquireAudio - ", name_, ": failed to get frame buffers");
+            release(frame);
+            return nullptr;
+        }
+        return frame;
+    }
+
+    void AVFramePool::release(AVFrame*& frame) {
+        if (frame == nullptr) {
+            return;
+        }
+
+        // Returns the plane buffers to their pools (or to whoever else produced them, e.g. a filter graph).
+        av_frame_unref(frame);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (outstanding_ > 0) {
+                --outstanding_;
+            }
+            if (freeShells_.size() < kMaxFreeShells) {
+                freeShells_.push_back(frame);
+                frame = nullptr;
+                return;
+            }
+        }
+
+        av_frame_free(&frame);
+    }
+
+    AVFramePool::Stats AVFramePool::getStats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        Stats stats;
+        stats.acquired = acquired_;
+        stats.shellAllocations = shellAllocations_;
+        stats.bufferAllocations = bufferAllocations_.load(std::memory_order_relaxed);
+        stats.peakOutstanding = peakOutstanding_;
+        stats.frameBytes = frameBytes_;
+        return stats;
+    }
+
+    void AVFramePool::log() const {
+        const Stats stats = getStats();
+        if (stats.acquired == 0) {
+            return;
+        }
+
+        LOG(LL_NFO, "Frame pool ", name_, ": acquired=", stats.acquired,
+            " shellAllocations=", stats.shellAllocations,
+            " bufferAllocations=", stats.bufferAllocations,
+            " peakOutstanding=", stats.peakOutstanding,
+            " frameBytes=", stats.frameBytes);
+    }
+}
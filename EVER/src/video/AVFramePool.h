@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct AVFrame;
+struct AVBufferPool;
+
+namespace Encoder {
+    // Hands out AVFrames of one geometry whose planes come from AVBufferPools, and recycles the AVFrame
+    // shells themselves, so steady-state encoding allocates neither frames nor frame buffers.
+    // Frames may be released on a different thread than they were acquired on.
+    class AVFramePool {
+    public:
+        struct Stats {
+            uint64_t acquired = 0;
+            uint64_t shellAllocations = 0;
+            uint64_t bufferAllocations = 0;
+            size_t peakOutstanding = 0;
+            size_t frameBytes = 0;
+        };
+
+        explicit AVFramePool(const char* name)
+            : name_(name)
+        {}
+        ~AVFramePool();
+
+        AVFramePool(const AVFramePool&) = delete;
+        AVFramePool& operator=(const AVFramePool&) = delete;
+
+        HRESULT initializeVideo(int pixelFormat, int width, int height);
+
+        // capacitySamples is a starting size; acquireAudio grows the pool when a larger frame is asked for.
+        HRESULT initializeAudio(int sampleFormat, int channels, int capacitySamples);
+
+        // Drops the pools and free shells. Frames still outstanding stay valid until released.
+        void reset();
+
+        // Video frame of the pool geometry with writable buffers.
+        AVFrame* acquireVideo();
+
+        // Audio frame holding nbSamples; the caller sets the sample rate and channel layout.
+        AVFrame* acquireAudio(int nbSamples);
+
+        // Empty frame for av_buffersink_get_frame, av_frame_ref and similar.
+        AVFrame* acquireShell();
+
+        void release(AVFrame*& frame);
+
+        Stats getStats() const;
+
+        void log() const;
+
+    private:
+        static constexpr size_t kMaxPlanes = 8;
+        static constexpr int kLinesizeAlignment = 64;
+
+        HRESULT createPools(const std::array<size_t, kMaxPlanes>& planeBytes, int planes);
+        void releasePools();
+        bool attachBuffers(AVFrame* frame);
+
+        const char* name_;
+
+        mutable std::mutex mutex_;
+        std::vector<AVFrame*> freeShells_;
+        std::array<AVBufferPool*, kMaxPlanes> pools_{};
+        std::array<int, kMaxPlanes> linesizes_{};
+        int planes_ = 0;
+        bool isAudio_ = false;
+        int format_ = -1;
+        int width_ = 0;
+        int height_ = 0;
+        int channels_ = 0;
+        int capacitySamples_ = 0;
+
+        size_t outstanding_ = 0;
+        uint64_t acquired_ = 0;
+        uint64_t shellAllocations_ = 0;
+        std::atomic<uint64_t> bufferAllocations_ = 0;
+        size_t peakOutstanding_ = 0;
+        size_t frameBytes_ = 0;
+    };
+}
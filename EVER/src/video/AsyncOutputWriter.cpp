@@ -0,0 +1,298 @@
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 26812)
+
+#include "AsyncOutputWriter.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <system_error>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+#include <libavformat/version.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+#pragma warning(pop)
+
+namespace Encoder {
+    AsyncOutputWriter::~AsyncOutputWriter() {
+        close();
+    }
+
+    HRESULT AsyncOutputWriter::open(const std::string& url, size_t bufferBytes) {
+        PRE();
+        close();
+
+        int ret = avio_open(&file_, url.c_str(), AVIO_FLAG_WRITE | AVIO_FLAG_DIRECT);
+        if (ret < 0) {
+            LOG(LL_ERR, "AsyncOutputWriter::open - Failed to open output file, error code: ", ret);
+            POST();
+            return E_FAIL;
+        }
+
+        try {
+            for (std::vector<uint8_t>& buffer : buffers_) {
+                buffer.resize((std::max)(bufferBytes, static_cast<size_t>(kContextBufferBytes)));
+            }
+        } catch (const std::bad_alloc&) {
+            LOG(LL_ERR, "AsyncOutputWriter::open - Failed to allocate ", bufferBytes, " byte output buffers");
+            close();
+            POST();
+            return E_OUTOFMEMORY;
+        }
+
+        unsigned char* contextBuffer = static_cast<unsigned char*>(av_malloc(kContextBufferBytes));
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+        const auto onWrite = [](void* opaque, const uint8_t* data, int size) {
+#else
+        const auto onWrite = [](void* opaque, uint8_t* data, int size) {
+#endif
+            return static_cast<AsyncOutputWriter*>(opaque)->write(data, size);
+        };
+        const auto onSeek = [](void* opaque, int64_t offset, int whence) {
+            return static_cast<AsyncOutputWriter*>(opaque)->seek(offset, whence);
+        };
+        context_ = contextBuffer != nullptr
+            ? avio_alloc_context(contextBuffer, kContextBufferBytes, 1, this, nullptr, +onWrite, +onSeek)
+            : nullptr;
+        if (context_ == nullptr) {
+            av_free(contextBuffer);
+            LOG(LL_ERR, "AsyncOutputWriter::open - Failed to allocate the AVIO context");
+            close();
+            POST();
+            return E_OUTOFMEMORY;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            bufferBytes_.fill(0);
+            fillIndex_ = 0;
+            pending_.clear();
+            writing_ = false;
+            stopping_ = false;
+            failed_ = false;
+            stats_ = Stats();
+        }
+        writeLatency_.reset();
+        blockedLatency_.reset();
+
+        try {
+            writerThread_ = std::thread(&AsyncOutputWriter::writerLoop, this);
+        } catch (const std::system_error& ex) {
+            LOG(LL_ERR, "AsyncOutputWriter::open - Failed to start writer thread: ", ex.what());
+            close();
+            POST();
+            return E_FAIL;
+        }
+
+        LOG(LL_DBG, "AsyncOutputWriter::open - ", kBufferCount, " x ", buffers_[0].size(), " byte buffers for ", url);
+        POST();
+        return S_OK;
+    }
+
+    HRESULT AsyncOutputWriter::close() {
+        if (context_ != nullptr) {
+            // Pushes AVIOContext's staging buffer through write().
+            avio_flush(context_);
+        }
+
+        bool failed = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (bufferBytes_[fillIndex_] > 0 && !failed_) {
+                submitFillBuffer(lock);
+            }
+            stopping_ = true;
+            failed = failed_;
+        }
+        pendingCv_.notify_all();
+
+        if (writerThread_.joinable()) {
+            writerThread_.join();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            failed = failed || failed_;
+        }
+
+        if (file_ != nullptr) {
+            avio_closep(&file_);
+        }
+        if (context_ != nullptr) {
+            av_freep(&context_->buffer);
+            avio_context_free(&context_);
+        }
+        for (std::vector<uint8_t>& buffer : buffers_) {
+            std::vector<uint8_t>().swap(buffer);
+        }
+
+        return failed ? E_FAIL : S_OK;
+    }
+
+    void AsyncOutputWriter::attach(AVFormatContext* formatContext) {
+        formatContext->pb = context_;
+        formatContext->opaque = this;
+        defaultIoOpen_ = formatContext->io_open;
+        formatContext->io_open = [](AVFormatContext* s, AVIOContext** pb, const char* url, int flags,
+                                    AVDictionary** options) {
+            AsyncOutputWriter* writer = static_cast<AsyncOutputWriter*>(s->opaque);
+            if (FAILED(writer->flush())) {
+                return AVERROR(EIO);
+            }
+            return writer->defaultIoOpen_(s, pb, url, flags, options);
+        };
+    }
+
+    HRESULT AsyncOutputWriter::flush() {
+        if (context_ != nullptr) {
+            avio_flush(context_);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (bufferBytes_[fillIndex_] > 0 && !failed_) {
+            submitFillBuffer(lock);
+        }
+        waitUntilIdle(lock);
+        return failed_ ? E_FAIL : S_OK;
+    }
+
+    int AsyncOutputWriter::write(const uint8_t* data, int size) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (failed_) {
+            return AVERROR(EIO);
+        }
+
+        int remaining = size;
+        while (remaining > 0) {
+            std::vector<uint8_t>& buffer = buffers_[fillIndex_];
+            size_t& used = bufferBytes_[fillIndex_];
+            const size_t chunk = (std::min)(static_cast<size_t>(remaining), buffer.size() - used);
+
+            // The fill buffer is never pending, so it can be filled without holding the lock.
+            lock.unlock();
+            std::memcpy(buffer.data() + used, data, chunk);
+            lock.lock();
+
+            used += chunk;
+            data += chunk;
+            remaining -= static_cast<int>(chunk);
+            if (used == buffer.size()) {
+                submitFillBuffer(lock);
+                if (failed_) {
+                    return AVERROR(EIO);
+                }
+            }
+        }
+        return size;
+    }
+
+    int64_t AsyncOutputWriter::seek(int64_t offset, int whence) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (bufferBytes_[fillIndex_] > 0) {
+            submitFillBuffer(lock);
+        }
+        waitUntilIdle(lock);
+        if (failed_) {
+            return AVERROR(EIO);
+        }
+
+        // The writer thread is idle and nothing is pending, so file_ can be used here.
+        ++stats_.seeks;
+        if (whence & AVSEEK_SIZE) {
+            return avio_size(file_);
+        }
+        return avio_seek(file_, offset, whence & ~AVSEEK_FORCE);
+    }
+
+    void AsyncOutputWriter::submitFillBuffer(std::unique_lock<std::mutex>& lock) {
+        pending_.push_back(fillIndex_);
+        pendingCv_.notify_one();
+        fillIndex_ = (fillIndex_ + 1) % kBufferCount;
+
+        // Buffers are used round robin, so the next fill buffer is the oldest pending one.
+        if (std::find(pending_.begin(), pending_.end(), fillIndex_) == pending_.end()) {
+            return;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        idleCv_.wait(lock, [this] {
+            return failed_ || std::find(pending_.begin(), pending_.end(), fillIndex_) == pending_.end();
+        });
+        blockedLatency_.record(std::chrono::steady_clock::now() - start);
+    }
+
+    void AsyncOutputWriter::waitUntilIdle(std::unique_lock<std::mutex>& lock) {
+        if (pending_.empty() && !writing_) {
+            return;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        idleCv_.wait(lock, [this] { return failed_ || (pending_.empty() && !writing_); });
+        blockedLatency_.record(std::chrono::steady_clock::now() - start);
+    }
+
+    void AsyncOutputWriter::writerLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            pendingCv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+            if (pending_.empty()) {
+                break;
+            }
+
+            const size_t index = pending_.front();
+            const size_t bytes = bufferBytes_[index];
+            writing_ = true;
+            lock.unlock();
+
+            const auto start = std::chrono::steady_clock::now();
+            avio_write(file_, buffers_[index].data(), static_cast<int>(bytes));
+            const bool ok = file_->error >= 0;
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            writeLatency_.record(elapsed);
+
+            lock.lock();
+            if (!ok) {
+                LOG(LL_ERR, "AsyncOutputWriter::writerLoop - Failed to write ", bytes, " bytes, error code: ", file_->error);
+                failed_ = true;
+                pending_.clear();
+            } else {
+                pending_.pop_front();
+                stats_.bytesWritten += bytes;
+                ++stats_.bufferWrites;
+                stats_.writeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            }
+            bufferBytes_[index] = 0;
+            writing_ = false;
+            idleCv_.notify_all();
+        }
+    }
+
+    AsyncOutputWriter::Stats AsyncOutputWriter::getStats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    void AsyncOutputWriter::log() const {
+        const Stats stats = getStats();
+        if (stats.bufferWrites == 0) {
+            return;
+        }
+
+        const double seconds = static_cast<double>(stats.writeNs) / 1e9;
+        const LatencyHistogram::Summary write = writeLatency_.summarize();
+        const LatencyHistogram::Summary blocked = blockedLatency_.summarize();
+        LOG(LL_NFO, "Output writer: bytes=", stats.bytesWritten, " writes=", stats.bufferWrites,
+            " seeks=", stats.seeks, " throughputMBps=",
+            seconds > 0.0 ? static_cast<double>(stats.bytesWritten) / (1024.0 * 1024.0) / seconds : 0.0,
+            " maxWriteMs=", write.maxMs, " muxerBlockedMs=", blocked.meanMs * static_cast<double>(blocked.count),
+            " muxerBlockedCount=", blocked.count);
+        writeLatency_.log();
+    }
+}
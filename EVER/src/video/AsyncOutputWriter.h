@@ -0,0 +1,96 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+#include "Platform.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct AVDictionary;
+struct AVFormatContext;
+struct AVIOContext;
+
+namespace Encoder {
+    // Output AVIOContext for the muxer. Writes are copied into one of two large memory buffers; a writer thread
+    // moves each full buffer to the file, so the muxer only waits when the disk falls a whole buffer behind.
+    // Seeks, which muxers only issue to rewrite headers from the trailer, wait for every pending write first and
+    // then move the file position, so seek-back behaves exactly as with avio_open.
+    class AsyncOutputWriter {
+    public:
+        struct Stats {
+            uint64_t bytesWritten = 0;
+            uint64_t bufferWrites = 0;
+            uint64_t seeks = 0;
+            int64_t writeNs = 0;
+        };
+
+        AsyncOutputWriter() = default;
+        ~AsyncOutputWriter();
+
+        AsyncOutputWriter(const AsyncOutputWriter&) = delete;
+        AsyncOutputWriter& operator=(const AsyncOutputWriter&) = delete;
+
+        // bufferBytes is the size of each of the two buffers.
+        HRESULT open(const std::string& url, size_t bufferBytes);
+
+        // Writes out everything still buffered and closes the file. The context must no longer be used.
+        HRESULT close();
+
+        bool isOpen() const { return context_ != nullptr; }
+
+        // Sets formatContext->pb to the writer's context; clear it again before close(). Also wraps io_open so
+        // anything the muxer reopens for reading, like the mov faststart pass, sees every byte written so far.
+        void attach(AVFormatContext* formatContext);
+
+        // Blocks until everything written so far is in the file.
+        HRESULT flush();
+
+        Stats getStats() const;
+
+        void log() const;
+
+    private:
+        static constexpr size_t kBufferCount = 2;
+        // AVIOContext's own staging buffer; the muxer's small writes collect here before reaching ours.
+        static constexpr int kContextBufferBytes = 64 * 1024;
+
+        // AVIOContext callbacks, called on the muxer thread.
+        int write(const uint8_t* data, int size);
+        int64_t seek(int64_t offset, int whence);
+        // Queues the fill buffer and moves to the next one, waiting while it is still being written.
+        void submitFillBuffer(std::unique_lock<std::mutex>& lock);
+        void waitUntilIdle(std::unique_lock<std::mutex>& lock);
+        void writerLoop();
+
+        using IoOpenFunction = int (*)(AVFormatContext*, AVIOContext**, const char*, int, AVDictionary**);
+
+        AVIOContext* context_ = nullptr;
+        IoOpenFunction defaultIoOpen_ = nullptr;
+        // The actual file, opened unbuffered; only touched by the writer thread, or by seek while it is idle.
+        AVIOContext* file_ = nullptr;
+
+        std::array<std::vector<uint8_t>, kBufferCount> buffers_;
+        std::array<size_t, kBufferCount> bufferBytes_{};
+        size_t fillIndex_ = 0;
+
+        mutable std::mutex mutex_;
+        std::condition_variable pendingCv_;
+        std::condition_variable idleCv_;
+        std::deque<size_t> pending_;
+        bool writing_ = false;
+        bool stopping_ = false;
+        bool failed_ = false;
+        std::thread writerThread_;
+        Stats stats_;
+
+        LatencyHistogram writeLatency_{"output.write"};
+        LatencyHistogram blockedLatency_{"output.blocked"};
+    };
+}
@@ -0,0 +1,318 @@
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 26812)
+
+#include "ChunkedVideoEncoder.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <system_error>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+
+#pragma warning(pop)
+
+namespace Encoder {
+    ChunkedVideoEncoder::~ChunkedVideoEncoder() {
+        close();
+    }
+
+    HRESULT ChunkedVideoEncoder::open(uint32_t instances, uint32_t chunkFrames, EncoderFactory factory,
+                                      PacketSink sink, AVFramePool* framePool, bool reuseEncoders) {
+        PRE();
+        close();
+
+        chunkFrames_ = (std::max)(chunkFrames, 1u);
+        factory_ = std::move(factory);
+        sink_ = std::move(sink);
+        framePool_ = framePool;
+        reuseEncoders_ = reuseEncoders;
+        submittedFrames_ = 0;
+        failed_ = false;
+        {
+            std::lock_guard<std::mutex> lock(outputMutex_);
+            nextChunk_ = 0;
+            haveLastDts_ = false;
+            bufferedPackets_ = 0;
+            stats_ = Stats();
+        }
+        chunkOpenLatency_.reset();
+        chunkEncodeLatency_.reset();
+
+        // Room for a whole chunk plus its end marker, so the submitter can run a chunk ahead of each instance.
+        for (uint32_t i = 0; i < (std::max)(instances, 1u); ++i) {
+            workers_.push_back(std::make_unique<Worker>(chunkFrames_ + 1));
+        }
+        for (uint32_t i = 0; i < workers_.size(); ++i) {
+            try {
+                workers_[i]->thread = std::thread(&ChunkedVideoEncoder::workerLoop, this, i);
+            } catch (const std::system_error& ex) {
+                LOG(LL_ERR, "ChunkedVideoEncoder::open - Failed to start worker thread: ", ex.what());
+                close();
+                POST();
+                return E_FAIL;
+            }
+        }
+
+        LOG(LL_NFO, "ChunkedVideoEncoder::open - ", workers_.size(), " encoder instances, ", chunkFrames_,
+            " frames per chunk", reuseEncoders_ ? ", encoders kept open" : "");
+        POST();
+        return S_OK;
+    }
+
+    HRESULT ChunkedVideoEncoder::submit(AVFrame* frame) {
+        if (failed_) {
+            framePool_->release(frame);
+            return E_FAIL;
+        }
+
+        Worker& worker = *workers_[(submittedFrames_ / chunkFrames_) % workers_.size()];
+        worker.queue.enqueue(WorkItem{frame, false});
+        ++submittedFrames_;
+        if (submittedFrames_ % chunkFrames_ == 0) {
+            worker.queue.enqueue(WorkItem{nullptr, false});
+        }
+        return S_OK;
+    }
+
+    HRESULT ChunkedVideoEncoder::finish() {
+        PRE();
+        if (workers_.empty()) {
+            POST();
+            return S_OK;
+        }
+
+        // Ends the last, short chunk.
+        if (submittedFrames_ % chunkFrames_ != 0) {
+            workers_[(submittedFrames_ / chunkFrames_) % workers_.size()]->queue.enqueue(WorkItem{nullptr, false});
+        }
+        stopWorkers();
+
+        const int64_t chunks = (submittedFrames_ + chunkFrames_ - 1) / chunkFrames_;
+        bool complete;
+        {
+            std::lock_guard<std::mutex> lock(outputMutex_);
+            complete = nextChunk_ == chunks;
+        }
+        if (!complete && !failed_) {
+            LOG(LL_ERR, "ChunkedVideoEncoder::finish - Not every chunk was delivered");
+            failed_ = true;
+        }
+
+        const HRESULT hr = failed_ ? E_FAIL : S_OK;
+        log();
+        close();
+        POST();
+        return hr;
+    }
+
+    void ChunkedVideoEncoder::close() {
+        if (workers_.empty()) {
+            return;
+        }
+
+        // Workers that see the flag only release their frames.
+        failed_ = true;
+        stopWorkers();
+        workers_.clear();
+
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        for (auto& [chunk, pending] : pending_) {
+            for (AVPacket*& packet : pending.packets) {
+                av_packet_free(&packet);
+            }
+        }
+        pending_.clear();
+        bufferedPackets_ = 0;
+    }
+
+    void ChunkedVideoEncoder::stopWorkers() {
+        for (std::unique_ptr<Worker>& worker : workers_) {
+            if (worker->thread.joinable()) {
+                worker->queue.enqueue(WorkItem{nullptr, true});
+            }
+        }
+        for (std::unique_ptr<Worker>& worker : workers_) {
+            if (worker->thread.joinable()) {
+                worker->thread.join();
+            }
+        }
+    }
+
+    void ChunkedVideoEncoder::workerLoop(uint32_t index) {
+        PRE();
+        LOG(LL_DBG, "ChunkedVideoEncoder worker ", index, " started");
+
+        Worker& worker = *workers_[index];
+        AVCodecContext* context = nullptr;
+        AVPacket* packet = av_packet_alloc();
+        if (!packet) {
+            LOG(LL_ERR, "ChunkedVideoEncoder::workerLoop - Failed to allocate packet");
+            failed_ = true;
+        }
+
+        // This worker gets chunks index, index + instances, ...
+        int64_t chunk = index;
+        auto chunkStart = std::chrono::steady_clock::now();
+        for (;;) {
+            WorkItem item = worker.queue.dequeue();
+            if (item.stop) {
+                break;
+            }
+
+            if (!failed_ && !context) {
+                const auto openStart = std::chrono::steady_clock::now();
+                context = factory_();
+                chunkOpenLatency_.record(std::chrono::steady_clock::now() - openStart);
+                chunkStart = openStart;
+                if (!context) {
+                    LOG(LL_ERR, "ChunkedVideoEncoder::workerLoop - Failed to open an encoder for chunk ", chunk);
+                    failed_ = true;
+                }
+            }
+
+            if (item.frame) {
+                if (!failed_) {
+                    int ret = avcodec_send_frame(context, item.frame);
+                    if (ret < 0) {
+                        LOG(LL_ERR, "ChunkedVideoEncoder::workerLoop - Failed to send frame to encoder, error code: ", ret);
+                        failed_ = true;
+                    } else if (FAILED(drain(context, packet, chunk))) {
+                        failed_ = true;
+                    }
+                }
+                framePool_->release(item.frame);
+                continue;
+            }
+
+            // End of the chunk: flush this instance and let the next chunk start from a fresh one. A reused
+            // encoder has already returned every packet of the chunk.
+            if (!failed_) {
+                if (!reuseEncoders_) {
+                    avcodec_send_frame(context, nullptr);
+                }
+                if (FAILED(drain(context, packet, chunk))) {
+                    failed_ = true;
+                } else {
+                    chunkEncodeLatency_.record(std::chrono::steady_clock::now() - chunkStart);
+                    completeChunk(chunk);
+                }
+            }
+            if (!reuseEncoders_ || failed_) {
+                avcodec_free_context(&context);
+            }
+            chunkStart = std::chrono::steady_clock::now();
+            chunk += static_cast<int64_t>(workers_.size());
+        }
+
+        avcodec_free_context(&context);
+        av_packet_free(&packet);
+        LOG(LL_DBG, "ChunkedVideoEncoder worker ", index, " stopped");
+        POST();
+    }
+
+    HRESULT ChunkedVideoEncoder::drain(AVCodecContext* context, AVPacket* packet, int64_t chunk) {
+        for (;;) {
+            av_packet_unref(packet);
+            int ret = avcodec_receive_packet(context, packet);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                return S_OK;
+            }
+            if (ret < 0) {
+                LOG(LL_ERR, "ChunkedVideoEncoder::drain - Failed to receive packet from encoder, error code: ", ret);
+                return E_FAIL;
+            }
+            deliver(chunk, packet);
+        }
+    }
+
+    void ChunkedVideoEncoder::deliver(int64_t chunk, AVPacket* packet) {
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        if (chunk == nextChunk_) {
+            emit(packet);
+            return;
+        }
+
+        AVPacket* held = av_packet_alloc();
+        if (!held) {
+            LOG(LL_ERR, "ChunkedVideoEncoder::deliver - Failed to allocate packet");
+            failed_ = true;
+            return;
+        }
+        av_packet_move_ref(held, packet);
+        pending_[chunk].packets.push_back(held);
+        ++bufferedPackets_;
+        stats_.peakBufferedPackets = (std::max)(stats_.peakBufferedPackets, bufferedPackets_);
+    }
+
+    void ChunkedVideoEncoder::completeChunk(int64_t chunk) {
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        ++stats_.chunks;
+        if (chunk != nextChunk_) {
+            pending_[chunk].done = true;
+            return;
+        }
+
+        // Hand on every chunk that was waiting for this one, and the start of the one still being encoded.
+        ++nextChunk_;
+        for (auto it = pending_.find(nextChunk_); it != pending_.end(); it = pending_.find(nextChunk_)) {
+            for (AVPacket*& packet : it->second.packets) {
+                emit(packet);
+                av_packet_free(&packet);
+                --bufferedPackets_;
+            }
+            const bool done = it->second.done;
+            pending_.erase(it);
+            if (!done) {
+                break;
+            }
+            ++nextChunk_;
+        }
+    }
+
+    void ChunkedVideoEncoder::emit(AVPacket* packet) {
+        if (failed_) {
+            return;
+        }
+
+        // Identical encoders delay decode timestamps by the same amount, so chunks join up; guard the seam anyway,
+        // since the muxer rejects a DTS that goes backwards.
+        if (packet->dts != AV_NOPTS_VALUE) {
+            if (haveLastDts_ && packet->dts <= lastDts_) {
+                packet->dts = lastDts_ + 1;
+                if (packet->pts != AV_NOPTS_VALUE && packet->pts < packet->dts) {
+                    packet->pts = packet->dts;
+                }
+                ++stats_.dtsAdjustments;
+            }
+            lastDts_ = packet->dts;
+            haveLastDts_ = true;
+        }
+
+        ++stats_.packets;
+        if (FAILED(sink_(packet))) {
+            failed_ = true;
+        }
+    }
+
+    ChunkedVideoEncoder::Stats ChunkedVideoEncoder::getStats() const {
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        Stats stats = stats_;
+        stats.frames = static_cast<uint64_t>(submittedFrames_);
+        return stats;
+    }
+
+    void ChunkedVideoEncoder::log() const {
+        const Stats stats = getStats();
+        const LatencyHistogram::Summary open = chunkOpenLatency_.summarize();
+        LOG(LL_NFO, "Chunked video encoder: instances=", workers_.size(), " chunkFrames=", chunkFrames_,
+            " chunks=", stats.chunks, " frames=", stats.frames, " packets=", stats.packets,
+            " avgOpenMs=", open.meanMs, " peakBufferedPackets=", stats.peakBufferedPackets,
+            " dtsAdjustments=", stats.dtsAdjustments);
+        chunkEncodeLatency_.log();
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "AVFramePool.h"
+#include "LatencyHistogram.h"
+#include "Platform.h"
+#include "SafeQueue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+
+namespace Encoder {
+    // Encodes video as fixed-length chunks on several independent encoder instances, round robin. Each chunk
+    // gets a freshly opened encoder, so it is a closed run of GOPs that starts with a keyframe and references
+    // nothing outside itself. Packets are handed on in stream order, which makes the result one ordinary stream
+    // the muxer takes as is: nothing is re-encoded.
+    // For intra-only codecs that return every packet as soon as its frame is sent, chunks of one frame with
+    // reuseEncoders make the same machinery frame-parallel: each worker keeps its encoder open throughout.
+    class ChunkedVideoEncoder {
+    public:
+        // Allocates and opens an encoder set up exactly like the stream's. Called on the worker threads.
+        using EncoderFactory = std::function<AVCodecContext*()>;
+        // Gets every packet in decode order, one call at a time. The packet is only lent for the call.
+        using PacketSink = std::function<HRESULT(AVPacket*)>;
+
+        struct Stats {
+            uint64_t chunks = 0;
+            uint64_t frames = 0;
+            uint64_t packets = 0;
+            // Packets held back because an earlier chunk was still being encoded.
+            size_t peakBufferedPackets = 0;
+            uint64_t dtsAdjustments = 0;
+        };
+
+        ChunkedVideoEncoder() = default;
+        ~ChunkedVideoEncoder();
+
+        ChunkedVideoEncoder(const ChunkedVideoEncoder&) = delete;
+        ChunkedVideoEncoder& operator=(const ChunkedVideoEncoder&) = delete;
+
+        // Frames passed to submit go back to framePool once encoded.
+        HRESULT open(uint32_t instances, uint32_t chunkFrames, EncoderFactory factory, PacketSink sink,
+                     AVFramePool* framePool, bool reuseEncoders = false);
+
+        // Takes the frame. Blocks once the instance that gets it is a whole chunk behind, so at most
+        // instances * chunkFrames frames wait at any time.
+        HRESULT submit(AVFrame* frame);
+
+        // Encodes everything submitted, delivers the remaining packets and stops the workers.
+        HRESULT finish();
+
+        // Stops the workers, dropping whatever was not encoded yet.
+        void close();
+
+        bool isOpen() const { return !workers_.empty(); }
+
+        Stats getStats() const;
+
+        void log() const;
+
+    private:
+        // A frame, the end of the current chunk (no frame), or the end of the stream.
+        struct WorkItem {
+            AVFrame* frame = nullptr;
+            bool stop = false;
+        };
+
+        struct Worker {
+            explicit Worker(uint32_t capacity)
+                : queue(capacity)
+            {}
+
+            SafeQueue<WorkItem> queue;
+            std::thread thread;
+        };
+
+        // Packets of a chunk that is not next in line yet.
+        struct PendingChunk {
+            std::vector<AVPacket*> packets;
+            bool done = false;
+        };
+
+        void workerLoop(uint32_t index);
+        HRESULT drain(AVCodecContext* context, AVPacket* packet, int64_t chunk);
+        void deliver(int64_t chunk, AVPacket* packet);
+        void completeChunk(int64_t chunk);
+        // Called with outputMutex_ held.
+        void emit(AVPacket* packet);
+        void stopWorkers();
+
+        uint32_t chunkFrames_ = 0;
+        bool reuseEncoders_ = false;
+        EncoderFactory factory_;
+        PacketSink sink_;
+        AVFramePool* framePool_ = nullptr;
+        std::vector<std::unique_ptr<Worker>> workers_;
+        int64_t submittedFrames_ = 0;
+        std::atomic<bool> failed_ = false;
+
+        mutable std::mutex outputMutex_;
+        int64_t nextChunk_ = 0;
+        int64_t lastDts_ = 0;
+        bool haveLastDts_ = false;
+        std::map<int64_t, PendingChunk> pending_;
+        size_t bufferedPackets_ = 0;
+        Stats stats_;
+
+        LatencyHistogram chunkOpenLatency_{"video.chunk_open"};
+        LatencyHistogram chunkEncodeLatency_{"video.chunk_encode"};
+    };
+}
@@ -0,0 +1,225 @@
+#pragma warning(push)
+#pragma warning(disable : 26812)
+
+#include "ColorAdjust.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+}
+
+#pragma warning(pop)
+
+namespace Encoder {
+    namespace {
+        std::string trim(const std::string& value) {
+            const size_t start = value.find_first_not_of(" \t\r\n");
+            if (start == std::string::npos) {
+                return "";
+            }
+            const size_t end = value.find_last_not_of(" \t\r\n");
+            return value.substr(start, end - start + 1);
+        }
+
+        bool parseNumber(const std::string& text, double& value) {
+            if (text.empty()) {
+                return false;
+            }
+            char* end = nullptr;
+            value = std::strtod(text.c_str(), &end);
+            return end == text.c_str() + text.size();
+        }
+    }
+
+    std::string ColorAdjustment::toString() const {
+        std::ostringstream oss;
+        oss << "brightness=" << brightness << " contrast=" << contrast << " saturation=" << saturation
+            << " gamma=" << gamma;
+        return oss.str();
+    }
+
+    bool parseColorAdjustFilter(const std::string& filters, ColorAdjustment& adjustment) {
+        const std::string chain = trim(filters);
+        if (chain.find_first_of(",;[") != std::string::npos) {
+            return false;
+        }
+
+        const size_t nameEnd = chain.find('=');
+        if (trim(chain.substr(0, nameEnd)) != "eq") {
+            return false;
+        }
+
+        ColorAdjustment parsed;
+        if (nameEnd != std::string::npos) {
+            std::istringstream options(chain.substr(nameEnd + 1));
+            std::string option;
+            while (std::getline(options, option, ':')) {
+                const size_t equals = option.find('=');
+                if (equals == std::string::npos) {
+                    // Positional eq options are not emitted by the preset reader.
+                    return false;
+                }
+
+                const std::string key = trim(option.substr(0, equals));
+                double value = 0.0;
+                if (!parseNumber(trim(option.substr(equals + 1)), value)) {
+                    return false;
+                }
+
+                // Clamped to the ranges eq accepts.
+                if (key == "brightness") {
+                    parsed.brightness = std::clamp(value, -1.0, 1.0);
+                } else if (key == "contrast") {
+                    parsed.contrast = std::clamp(value, -1000.0, 1000.0);
+                } else if (key == "saturation") {
+                    parsed.saturation = std::clamp(value, 0.0, 3.0);
+                } else if (key == "gamma") {
+                    parsed.gamma = std::clamp(value, 0.1, 10.0);
+                } else {
+                    return false;
+                }
+            }
+        }
+
+        adjustment = parsed;
+        return true;
+    }
+
+    bool splitTrailingColorAdjustFilter(const std::string& filters, std::string& rest, ColorAdjustment& adjustment) {
+        const std::string chain = trim(filters);
+        if (chain.find_first_of(";[") != std::string::npos) {
+            return false;
+        }
+
+        // The last separating comma; commas inside quotes or escaped with a backslash belong to an option value.
+        size_t separator = std::string::npos;
+        bool quoted = false;
+        for (size_t i = 0; i < chain.size(); ++i) {
+            if (chain[i] == '\\') {
+                ++i;
+            } else if (chain[i] == '\'') {
+                quoted = !quoted;
+            } else if (chain[i] == ',' && !quoted) {
+                separator = i;
+            }
+        }
+        if (separator == std::string::npos || quoted) {
+            return false;
+        }
+
+        const std::string head = trim(chain.substr(0, separator));
+        ColorAdjustment parsed;
+        if (head.empty() || !parseColorAdjustFilter(chain.substr(separator + 1), parsed)) {
+            return false;
+        }
+
+        rest = head;
+        adjustment = parsed;
+        return true;
+    }
+
+    std::vector<uint16_t> buildColorAdjustLut(double brightness, double contrast, double gamma, int32_t maxCode) {
+        std::vector<uint16_t> lut(static_cast<size_t>(maxCode) + 1);
+        for (int32_t code = 0; code <= maxCode; ++code) {
+            double value = contrast * (code / static_cast<double>(maxCode) - 0.5) + 0.5 + brightness;
+            if (value <= 0.0) {
+                lut[code] = 0;
+                continue;
+            }
+            value = std::pow(value, 1.0 / gamma);
+            lut[code] = static_cast<uint16_t>(value >= 1.0 ? maxCode : static_cast<int32_t>((maxCode + 1) * value));
+        }
+        return lut;
+    }
+
+    bool YuvColorAdjuster::initialize(const ColorAdjustment& adjustment, int pixFmt) {
+        reset();
+
+        const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(pixFmt));
+        const uint64_t unsupportedFlags = AV_PIX_FMT_FLAG_BE | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM |
+                                          AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_BAYER |
+                                          AV_PIX_FMT_FLAG_FLOAT;
+        if (descriptor == nullptr || (descriptor->flags & unsupportedFlags) != 0 || descriptor->nb_components < 3) {
+            return false;
+        }
+
+        const int depth = descriptor->comp[0].depth;
+        if (depth < 8 || depth > 16) {
+            return false;
+        }
+        wide_ = depth > 8;
+        for (int i = 0; i < 3; ++i) {
+            const AVComponentDescriptor& comp = descriptor->comp[i];
+            if (comp.depth != depth || (wide_ && (comp.step % 2 != 0 || comp.offset % 2 != 0))) {
+                return false;
+            }
+            components_[i].plane = comp.plane;
+            components_[i].offset = comp.offset;
+            components_[i].step = comp.step;
+            components_[i].shift = comp.shift;
+            components_[i].log2Width = i == 0 ? 0 : descriptor->log2_chroma_w;
+            components_[i].log2Height = i == 0 ? 0 : descriptor->log2_chroma_h;
+        }
+
+        const int32_t maxCode = (1 << depth) - 1;
+        lumaLut_ = buildColorAdjustLut(adjustment.brightness, adjustment.contrast, adjustment.gamma, maxCode);
+        if (adjustment.saturation != 1.0) {
+            chromaLut_ = buildColorAdjustLut(0.0, adjustment.saturation, 1.0, maxCode);
+        }
+        return true;
+    }
+
+    void YuvColorAdjuster::reset() {
+        lumaLut_.clear();
+        chromaLut_.clear();
+    }
+
+    void YuvColorAdjuster::apply(uint8_t* const data[], const int linesize[], int width, int height) const {
+        if (!isInitialized()) {
+            return;
+        }
+        applyComponent(components_[0], lumaLut_, data, linesize, width, height);
+        if (!chromaLut_.empty()) {
+            applyComponent(components_[1], chromaLut_, data, linesize, width, height);
+            applyComponent(components_[2], chromaLut_, data, linesize, width, height);
+        }
+    }
+
+    int YuvColorAdjuster::applyToFrame(AVFrame* frame) const {
+        const int ret = av_frame_make_writable(frame);
+        if (ret < 0) {
+            return ret;
+        }
+        apply(frame->data, frame->linesize, frame->width, frame->height);
+        return 0;
+    }
+
+    void YuvColorAdjuster::applyComponent(const Component& component, const std::vector<uint16_t>& lut,
+                                          uint8_t* const data[], const int linesize[], int width, int height) const {
+        const int componentWidth = -((-width) >> component.log2Width);
+        const int componentHeight = -((-height) >> component.log2Height);
+        const uint16_t maxCode = static_cast<uint16_t>(lut.size() - 1);
+
+        for (int y = 0; y < componentHeight; ++y) {
+            uint8_t* row = data[component.plane] + static_cast<ptrdiff_t>(y) * linesize[component.plane] + component.offset;
+            if (!wide_) {
+                for (int x = 0; x < componentWidth; ++x) {
+                    uint8_t& sample = row[static_cast<ptrdiff_t>(x) * component.step];
+                    sample = static_cast<uint8_t>(lut[sample]);
+                }
+                continue;
+            }
+
+            for (int x = 0; x < componentWidth; ++x) {
+                uint16_t& sample = *reinterpret_cast<uint16_t*>(row + static_cast<ptrdiff_t>(x) * component.step);
+                const uint16_t code = (std::min)(static_cast<uint16_t>(sample >> component.shift), maxCode);
+                sample = static_cast<uint16_t>(lut[code] << component.shift);
+            }
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct AVFrame;
+
+namespace Encoder {
+    // The brightness/contrast/saturation/gamma subset of libavfilter's eq filter, with eq's defaults and ranges.
+    // The RGBA -> YUV kernels apply it during conversion so presets that only adjust colour skip the filter graph.
+    struct ColorAdjustment {
+        double brightness = 0.0;
+        double contrast = 1.0;
+        double saturation = 1.0;
+        double gamma = 1.0;
+
+        bool isIdentity() const {
+            return brightness == 0.0 && contrast == 1.0 && saturation == 1.0 && gamma == 1.0;
+        }
+
+        std::string toString() const;
+    };
+
+    // True when the whole video filter chain is a single eq filter using only named brightness, contrast,
+    // saturation and gamma options with constant values, which is what JsonPresetReader emits for colour
+    // settings. Anything else (other filters, expressions, per-channel gamma) has to stay in the filter graph.
+    bool parseColorAdjustFilter(const std::string& filters, ColorAdjustment& adjustment);
+
+    // Splits a plain comma-separated chain ending in such an eq filter into the filters before it and the
+    // adjustment, so the rest can run in the filter graph and the adjustment after it. JsonPresetReader puts the
+    // colour settings last, behind denoise, deinterlace and the like.
+    bool splitTrailingColorAdjustFilter(const std::string& filters, std::string& rest, ColorAdjustment& adjustment);
+
+    // eq's curve over code values 0..maxCode: contrast around mid-grey, then brightness, then gamma. eq runs the
+    // chroma planes through the same curve with saturation as the contrast.
+    std::vector<uint16_t> buildColorAdjustLut(double brightness, double contrast, double gamma, int32_t maxCode);
+
+    // Applies a ColorAdjustment in place to frames that are already YUV, the way eq would have, for chains whose
+    // other filters still need the filter graph.
+    class YuvColorAdjuster {
+    public:
+        // pixFmt is an AVPixelFormat; false for anything but planar or semi-planar YUV of 8 to 16 bits.
+        bool initialize(const ColorAdjustment& adjustment, int pixFmt);
+
+        void reset();
+
+        bool isInitialized() const { return !lumaLut_.empty(); }
+
+        void apply(uint8_t* const data[], const int linesize[], int width, int height) const;
+
+        // Applies the adjustment to a frame a filter graph returned, whose buffers it may still share, so it is
+        // made writable first. Returns 0 or a negative AVERROR code.
+        int applyToFrame(AVFrame* frame) const;
+
+    private:
+        struct Component {
+            int plane = 0;
+            int offset = 0;
+            int step = 0;
+            int shift = 0;
+            int log2Width = 0;
+            int log2Height = 0;
+        };
+
+        void applyComponent(const Component& component, const std::vector<uint16_t>& lut, uint8_t* const data[],
+                            const int linesize[], int width, int height) const;
+
+        Component components_[3];
+        bool wide_ = false;
+        std::vector<uint16_t> lumaLut_;
+        // Empty when saturation is neutral.
+        std::vector<uint16_t> chromaLut_;
+    };
+}
@@ -0,0 +1,82 @@
+#include "CpuFeatures.h"
+
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define EVER_CPU_FEATURES_X86 1
+#if defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace Encoder {
+    namespace {
+#ifdef EVER_CPU_FEATURES_X86
+        void queryCpuid(int leaf, int subleaf, int info[4]) {
+#if defined(_MSC_VER)
+            __cpuidex(info, leaf, subleaf);
+#else
+            unsigned int regs[4] = {};
+            __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+            for (int i = 0; i < 4; ++i) {
+                info[i] = static_cast<int>(regs[i]);
+            }
+#endif
+        }
+
+#if !defined(_MSC_VER)
+        __attribute__((target("xsave")))
+#endif
+        uint64_t readXcr0() {
+#if defined(_MSC_VER)
+            return _xgetbv(0);
+#else
+            uint32_t eax = 0;
+            uint32_t edx = 0;
+            __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+        }
+
+        CpuFeatures detectFeatures() {
+            CpuFeatures features;
+
+            int info[4] = {};
+            queryCpuid(0, 0, info);
+            const int maxLeaf = info[0];
+
+            queryCpuid(1, 0, info);
+            features.sse41 = (info[2] & (1 << 19)) != 0;
+            const bool hasOsxsave = (info[2] & (1 << 27)) != 0;
+            const bool hasAvx = (info[2] & (1 << 28)) != 0;
+            if (maxLeaf < 7 || !hasAvx || !hasOsxsave) {
+                return features;
+            }
+
+            // AVX registers are only usable when the OS saves them on context switch: XCR0 bits 1 and 2,
+            // plus 5 to 7 (opmask and upper ZMM state) for AVX-512.
+            const uint64_t xcr0 = readXcr0();
+            queryCpuid(7, 0, info);
+            if ((xcr0 & 0x6) == 0x6) {
+                features.avx2 = (info[1] & (1 << 5)) != 0;
+            }
+            if ((xcr0 & 0xE6) == 0xE6) {
+                features.avx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+            }
+            return features;
+        }
+#else
+        CpuFeatures detectFeatures() {
+            return {};
+        }
+#endif
+    }
+
+    const CpuFeatures& getCpuFeatures() {
+        static const CpuFeatures features = detectFeatures();
+        return features;
+    }
+}
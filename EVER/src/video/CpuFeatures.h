@@ -0,0 +1,14 @@
+#pragma once
+
+namespace Encoder {
+    // Instruction sets usable by the hand-written kernels: supported by the CPU and, for the AVX
+    // families, with their register state saved by the OS. Queried once.
+    struct CpuFeatures {
+        bool sse41 = false;
+        bool avx2 = false;
+        // AVX-512 F and BW, the subset the kernels use.
+        bool avx512 = false;
+    };
+
+    const CpuFeatures& getCpuFeatures();
+}
@@ -6,54 +6,222 @@
 #include "logger.h"
 #include "util.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <filesystem>
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 #pragma warning(pop)
 
 namespace Encoder {
+    namespace {
+        // Share of currently available physical memory the video queue may hold when no explicit budget is set,
+        // capped so the queue (and the frame pool behind it, which never shrinks) stays small on large machines.
+        // Deeper queues are opt-in through video_queue_budget_mb.
+        constexpr uint64_t kDefaultVideoQueueMemoryDivisor = 4;
+        constexpr uint64_t kDefaultVideoQueueBudgetCeilingBytes = 512ull * 1024ull * 1024ull;
+
+        uint64_t getDefaultVideoQueueBudgetBytes() {
+#ifdef _WIN32
+            MEMORYSTATUSEX memoryStatus{};
+            memoryStatus.dwLength = sizeof(memoryStatus);
+            if (!GlobalMemoryStatusEx(&memoryStatus) || memoryStatus.ullAvailPhys == 0) {
+                LOG(LL_WRN, "GlobalMemoryStatusEx failed; using fallback video queue budget");
+                return kDefaultVideoQueueBudgetCeilingBytes;
+            }
+            const uint64_t availableBytes = memoryStatus.ullAvailPhys;
+#else
+            const long pages = sysconf(_SC_AVPHYS_PAGES);
+            const long pageSize = sysconf(_SC_PAGESIZE);
+            if (pages <= 0 || pageSize <= 0) {
+                LOG(LL_WRN, "sysconf failed; using fallback video queue budget");
+                return kDefaultVideoQueueBudgetCeilingBytes;
+            }
+            const uint64_t availableBytes = static_cast<uint64_t>(pages) * static_cast<uint64_t>(pageSize);
+#endif
+            return (std::min)(availableBytes / kDefaultVideoQueueMemoryDivisor, kDefaultVideoQueueBudgetCeilingBytes);
+        }
+    }
+
+    void EncoderSession::updateVideoQueueLimit(size_t frameBytes) {
+        if (frameBytes == 0 || frameBytes == videoQueueFrameBytes_) {
+            return;
+        }
+
+        videoQueueFrameBytes_ = frameBytes;
+        const uint64_t budgetFrames = videoQueueBudgetBytes_ / static_cast<uint64_t>(frameBytes);
+        const size_t depthLimit = static_cast<size_t>(std::clamp<uint64_t>(budgetFrames, kMinQueuedVideoFrames, kMaxQueuedVideoFrames));
+        videoQueue_.setLimit(depthLimit);
+
+        LOG(LL_NFO, "Video queue budget: budgetBytes=", videoQueueBudgetBytes_,
+            " frameBytes=", frameBytes,
+            " depthLimit=", depthLimit);
+    }
+
     void EncoderSession::videoEncodingWorkerLoop() {
         PRE();
         LOG(LL_NFO, "EncoderSession video worker started");
 
+        // The producer only fills the ring while nothing is spilled, so every frame in the ring is older than
+        // every frame in the spool. Sampling the spool before trying the ring keeps that order on this side:
+        // a spilled frame is taken only once the ring has been seen empty after it was written.
+        QueuedVideoFrame frame;
         while (true) {
-            QueuedVideoFrame frame;
-            {
-                std::unique_lock<std::mutex> lock(videoQueueMutex_);
-                videoQueueNotEmptyCv_.wait(lock, [this] {
-                    return videoQueueStopRequested_ || !videoQueue_.empty();
-                });
-
-                if (videoQueue_.empty()) {
-                    if (videoQueueStopRequested_) {
-                        break;
+            const bool spillPending = videoSpillEnabled_ && videoFrameSpool_.hasPending();
+            if (!videoQueue_.tryPop(frame)) {
+                if (spillPending) {
+                    if (!readSpilledVideoFrame(frame)) {
+                        continue;
                     }
-                    continue;
+                } else if (!videoQueue_.pop(frame)) {
+                    break;
                 }
-
-                frame = std::move(videoQueue_.front());
-                videoQueue_.pop_front();
-                videoQueueNotFullCv_.notify_one();
             }
 
             const HRESULT hr = encodeQueuedVideoFrame(frame);
+            if (!proxyEncoder_.takeVideoFrame(frame.data, frame.rowPitch)) {
+                videoFrameBufferPool_.release(std::move(frame.data));
+            }
             if (FAILED(hr)) {
                 LOG(LL_ERR, "Video worker failed to encode queued frame index=", frame.frameIndex,
                     " hr=", Logger::hex(static_cast<uint32_t>(hr), 8));
-                std::lock_guard<std::mutex> lock(videoQueueMutex_);
                 videoWorkerFailed_ = true;
             }
         }
 
-        {
-            std::lock_guard<std::mutex> lock(videoQueueMutex_);
-            videoWorkerRunning_ = false;
+        // Frames spilled right before the stop request are still owed to the encoder.
+        while (videoSpillEnabled_ && readSpilledVideoFrame(frame)) {
+            const HRESULT hr = encodeQueuedVideoFrame(frame);
+            if (!proxyEncoder_.takeVideoFrame(frame.data, frame.rowPitch)) {
+                videoFrameBufferPool_.release(std::move(frame.data));
+            }
+            if (FAILED(hr)) {
+                LOG(LL_ERR, "Video worker failed to encode spilled frame index=", frame.frameIndex,
+                    " hr=", Logger::hex(static_cast<uint32_t>(hr), 8));
+                videoWorkerFailed_ = true;
+            }
         }
+
+        videoWorkerRunning_ = false;
+        const FrameBufferPool::Stats poolStats = videoFrameBufferPool_.getStats();
         LOG(LL_NFO, "EncoderSession video worker stopped. encodedFrames=", encodedVideoFrames_,
             " droppedFrames=", droppedVideoFrames_);
+        LOG(LL_NFO, "Video frame buffer pool: hits=", poolStats.hits,
+            " misses=", poolStats.misses,
+            " highWater=", poolStats.highWater,
+            " buffers=", poolStats.pooledBuffers,
+            " bufferBytes=", poolStats.bufferBytes);
         POST();
     }
 
+    bool EncoderSession::readSpilledVideoFrame(QueuedVideoFrame& frame) {
+        VideoFrameSpool::Record record;
+        if (!videoFrameSpool_.beginRead(record)) {
+            return false;
+        }
+
+        frame.rowPitch = record.rowPitch;
+        frame.height = record.height;
+        frame.frameIndex = record.frameIndex;
+        frame.data = videoFrameBufferPool_.acquire(record.bytes);
+
+        if (FAILED(videoFrameSpool_.completeRead(record, frame.data.data()))) {
+            LOG(LL_ERR, "Video worker lost spilled frame index=", record.frameIndex);
+            videoFrameBufferPool_.release(std::move(frame.data));
+            ++droppedVideoFrames_;
+            videoWorkerFailed_ = true;
+            return false;
+        }
+
+        return true;
+    }
+
+    void EncoderSession::audioEncodingWorkerLoop() {
+        PRE();
+        LOG(LL_NFO, "EncoderSession audio worker started");
+
+        QueuedAudioChunk chunk;
+        int64_t encodedChunks = 0;
+        while (audioQueue_.pop(chunk)) {
+            // After a failure keep draining so pooled buffers come back; writeAudioFrame reports the error.
+            if (!audioWorkerFailed_) {
+                const HRESULT hr = encodeAudioChunk(chunk.data.data(), static_cast<int32_t>(chunk.data.size()),
+                                                    chunk.presentationTime);
+                if (FAILED(hr)) {
+                    LOG(LL_ERR, "Audio worker failed to encode queued chunk pts=", chunk.presentationTime,
+                        " hr=", Logger::hex(static_cast<uint32_t>(hr), 8));
+                    audioWorkerFailed_ = true;
+                } else {
+                    ++encodedChunks;
+                }
+            }
+            audioChunkBufferPool_.release(std::move(chunk.data));
+        }
+
+        const FrameBufferPool::Stats poolStats = audioChunkBufferPool_.getStats();
+        LOG(LL_NFO, "EncoderSession audio worker stopped. encodedChunks=", encodedChunks,
+            " peakDepth=", peakAudioQueueDepth_,
+            " totalWaitMs=", static_cast<double>(audioQueueWaitNs_) / 1000000.0,
+            " poolMisses=", poolStats.misses);
+        POST();
+    }
+
+    HRESULT EncoderSession::encodeAudioChunk(BYTE* data, int32_t lengthBytes, LONGLONG presentationTime) {
+        PRE();
+        LOG(LL_TRC, "EncoderSession::encodeAudioChunk - Encoding audio chunk, bytes: ", lengthBytes, ", PTS: ", presentationTime);
+
+        audioChunk_.buffer[0] = data;
+        audioChunk_.samples = lengthBytes / audioBlockAlign_;
+
+        for (const std::unique_ptr<Output>& output : outputs_) {
+            if (output->failed) {
+                continue;
+            }
+            const HRESULT hr = output->encoder->SendAudioSampleChunk(audioChunk_);
+            if (FAILED(hr)) {
+                LOG(LL_ERR, "Failed to send audio chunk to FFmpeg ### error code: ", hr);
+                markOutputFailed(*output, "audio encoding failed");
+            } else {
+                ++output->audioChunks;
+            }
+        }
+        proxyEncoder_.sendAudioChunk(audioChunk_);
+
+        const HRESULT hr = hasLiveOutput() ? S_OK : E_FAIL;
+        POST();
+        return hr;
+    }
+
+    void EncoderSession::markOutputFailed(Output& output, const char* reason) {
+        if (!output.failed.exchange(true)) {
+            LOG(LL_ERR, "EncoderSession - Output ", output.filename, " failed (", reason, "); ",
+                hasLiveOutput() ? "the other outputs carry on" : "no output is left");
+        }
+    }
+
+    bool EncoderSession::hasLiveOutput() const {
+        return std::any_of(outputs_.begin(), outputs_.end(),
+                           [](const std::unique_ptr<Output>& output) { return !output->failed; });
+    }
+
+    void EncoderSession::logOutputStats(const Output& output, size_t index, double closeMs) const {
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - sessionStart_).count();
+        const double sendMs = static_cast<double>(output.videoSendNs) / 1000000.0;
+        LOG(LL_NFO, "Output ", index + 1, "/", outputs_.size(), ": file=", output.filename,
+            " videoFrames=", output.videoFrames,
+            " fps=", seconds > 0.0 ? static_cast<double>(output.videoFrames) / seconds : 0.0,
+            " avgSendMs=", output.videoFrames > 0 ? sendMs / static_cast<double>(output.videoFrames) : 0.0,
+            output.videoSource ? " (conversion shared)" : "",
+            " audioChunks=", output.audioChunks.load(),
+            " closeMs=", closeMs,
+            output.encoder->GetFaststartRewrites() > 0 ? " faststart=rewritten" : "",
+            " status=", output.failed ? "failed" : "ok");
+    }
+
     HRESULT EncoderSession::encodeQueuedVideoFrame(const QueuedVideoFrame& frame) {
         PRE();
         if (frame.data.empty()) {
@@ -63,10 +231,12 @@ namespace Encoder {
         }
 
         const int32_t lengthBytes = static_cast<int32_t>(frame.rowPitch * frame.height);
+        const auto encodeStart = std::chrono::steady_clock::now();
         const HRESULT hr = writeVideoFrame(const_cast<BYTE*>(frame.data.data()),
                                            lengthBytes,
                                            frame.rowPitch,
                                            frame.frameIndex);
+        videoEncodeLatency_.record(std::chrono::steady_clock::now() - encodeStart);
         if (SUCCEEDED(hr)) {
             ++encodedVideoFrames_;
         }
@@ -75,14 +245,11 @@ namespace Encoder {
     }
 
     EncoderSession::EncoderSession() 
-        : videoFrameQueue_(128), 
-        exrImageQueue_(16) {
+        : videoQueue_(kMaxQueuedVideoFrames),
+        audioQueue_(kMaxQueuedAudioChunks) {
         PRE();
         LOG(LL_NFO, "Opening encoding session: ", reinterpret_cast<uint64_t>(this));
         
-        LOG(LL_DBG, "EncoderSession: Initializing FFmpeg encoder");
-        ffmpegEncoder_ = std::make_unique<FFmpegEncoder>();
-        
         videoFrame_.buffer = nullptr;
         videoFrame_.rowsize = nullptr;
         videoFrame_.planes = 0;
@@ -103,9 +270,9 @@ namespace Encoder {
         audioChunk_.layout = FFmpeg::ChannelLayout::Stereo;
         memset(audioChunk_.format, 0, sizeof(audioChunk_.format));
 
-        videoQueueStopRequested_ = false;
         videoWorkerRunning_ = false;
         videoWorkerFailed_ = false;
+        audioWorkerFailed_ = false;
         queuedVideoFrames_ = 0;
         encodedVideoFrames_ = 0;
         submittedAudioSamples_ = 0;
@@ -143,7 +310,8 @@ namespace Encoder {
                                         uint32_t inputAlign, 
                                         bool exportOpenExr, 
                                         uint32_t openExrWidth,
-                                        uint32_t openExrHeight) {
+                                        uint32_t openExrHeight,
+                                        const EncoderSessionOptions& options) {
         PRE();
 
         LOG(LL_DBG, "EncoderSession::createContext - Starting encoder context creation");
@@ -158,8 +326,24 @@ namespace Encoder {
         ASSERT_RUNTIME(inputChannels == 1 || inputChannels == 2 || inputChannels == 6,
                     "Invalid number of audio channels. Only 1 (mono), 2 (stereo), and 6 (5.1) are supported");
 
-        LOG(LL_DBG, "EncoderSession::createContext - Setting FFmpeg configuration");
-        REQUIRE(ffmpegEncoder_->SetConfig(config), "Failed to set FFmpeg configuration");
+        if (options.traceSession) {
+            SessionTraceInfo traceInfo;
+            traceInfo.config = config;
+            traceInfo.width = width;
+            traceInfo.height = height;
+            traceInfo.inputPixelFormat = inputPixelFormat;
+            traceInfo.fpsNumerator = fpsNumerator;
+            traceInfo.fpsDenominator = fpsDenominator;
+            traceInfo.inputChannels = inputChannels;
+            traceInfo.inputSampleRate = inputSampleRate;
+            traceInfo.inputSampleFormat = inputSampleFormat;
+            traceInfo.inputAlign = inputAlign;
+            traceInfo.videoQueueBudgetMb = options.videoQueueBudgetMb;
+            traceInfo.spillVideoQueue = options.spillVideoQueue;
+            traceInfo.pixelStep = options.tracePixelStep;
+            // A missing trace only loses diagnostics, so the export goes ahead regardless.
+            LOG_IF_FAILED(sessionTrace_.open(filename + L".evertrace", traceInfo), "Failed to open session trace");
+        }
 
         FFmpeg::ChannelLayout channelLayout = FFmpeg::ChannelLayout::Stereo;
         switch (inputChannels) {
@@ -193,8 +377,6 @@ namespace Encoder {
                 .numberChannels = static_cast<int>(inputChannels),
             },
         };
-        
-        filename.copy(encoderInfo.filename, std::size(encoderInfo.filename));
 
         LOG(LL_DBG, "EncoderSession::createContext - Encoder info prepared");
         LOG(LL_DBG, "EncoderSession::createContext - Video: ", encoderInfo.video.width, "x", encoderInfo.video.height, " @ ", fpsNumerator, "/", fpsDenominator);
@@ -207,9 +389,67 @@ namespace Encoder {
             exrExporter_.initialize(exrOutputPath, openExrWidth, openExrHeight);
         }
 
-        LOG(LL_NFO, "EncoderSession::createContext - Opening FFmpeg encoder");
-        REQUIRE(ffmpegEncoder_->Open(encoderInfo), "Failed to open FFmpeg encoder");
-        LOG(LL_NFO, "FFmpeg encoder opened successfully");
+        // Every output gets its own encoder and file. One that cannot be opened is left out rather than failing the
+        // others, as long as at least one opens.
+        sessionStart_ = std::chrono::steady_clock::now();
+        outputs_.clear();
+        std::vector<EncoderOutput> requestedOutputs{EncoderOutput{config, filename}};
+        requestedOutputs.insert(requestedOutputs.end(), options.teeOutputs.begin(), options.teeOutputs.end());
+        for (const EncoderOutput& request : requestedOutputs) {
+            auto output = std::make_unique<Output>();
+            output->encoder = std::make_unique<FFmpegEncoder>();
+            output->filename = utf8_encode(request.filename);
+
+            if (request.filename.length() >= std::size(encoderInfo.filename)) {
+                LOG(LL_ERR, "EncoderSession::createContext - Filename is too long for FFmpeg encoder: ", output->filename);
+                continue;
+            }
+            FFmpeg::FFENCODERINFO outputInfo = encoderInfo;
+            request.filename.copy(outputInfo.filename, std::size(outputInfo.filename));
+
+            LOG(LL_DBG, "EncoderSession::createContext - Setting FFmpeg configuration");
+            if (FAILED(output->encoder->SetConfig(request.config))) {
+                LOG(LL_ERR, "EncoderSession::createContext - Failed to set FFmpeg configuration for ", output->filename);
+                continue;
+            }
+            output->encoder->SetThreadingPolicy(options.threading);
+            output->encoder->SetOutputBufferSize(static_cast<size_t>(options.outputBufferMb) * 1024 * 1024);
+            output->encoder->SetFaststartPolicy(options.faststartMode, options.faststartReserveMinutes);
+            output->encoder->SetSegmentPolicy(options.segments);
+
+            LOG(LL_NFO, "EncoderSession::createContext - Opening FFmpeg encoder for ", output->filename);
+            if (FAILED(output->encoder->Open(outputInfo))) {
+                LOG(LL_ERR, "EncoderSession::createContext - Failed to open FFmpeg encoder for ", output->filename);
+                continue;
+            }
+            LOG(LL_NFO, "FFmpeg encoder opened successfully");
+
+            // Each distinct output format is converted once: a later output takes the frames of the first
+            // earlier one that hands its codec the same frames.
+            for (const std::unique_ptr<Output>& source : outputs_) {
+                if (!source->videoSource && source->encoder->CanShareVideoFrames(*output->encoder)) {
+                    source->encoder->ShareVideoFramesWith(output->encoder.get());
+                    output->videoSource = source.get();
+                    LOG(LL_NFO, "EncoderSession::createContext - ", output->filename,
+                        " shares the video conversion of ", source->filename);
+                    break;
+                }
+            }
+            outputs_.push_back(std::move(output));
+        }
+
+        if (outputs_.empty()) {
+            LOG(LL_ERR, "EncoderSession::createContext - No output could be opened");
+            POST();
+            return E_FAIL;
+        }
+        LOG(LL_NFO, "EncoderSession::createContext - Writing ", outputs_.size(), " of ", requestedOutputs.size(), " outputs");
+
+        // The proxy is a convenience copy: the export goes ahead without it.
+        if (options.proxy.enabled &&
+            FAILED(proxyEncoder_.open(options.proxy, encoderInfo, inputPixelFormat, &videoFrameBufferPool_))) {
+            LOG(LL_WRN, "EncoderSession::createContext - Could not open the proxy output; exporting without it");
+        }
 
         LOG(LL_DBG, "EncoderSession::createContext - Initializing video frame structure");
         videoFrame_ = {
@@ -237,28 +477,74 @@ namespace Encoder {
         inputAudioChannels_ = static_cast<int32_t>(inputChannels);
         inputAudioSampleRate_ = static_cast<int32_t>(inputSampleRate);
 
+        // RowPitch is only known once the first frame is mapped; a tightly packed RGBA row is
+        // the expected pitch and a larger one is absorbed by the pool and the limit on the first frame.
+        const size_t estimatedFrameBytes = static_cast<size_t>(width) * 4u * static_cast<size_t>(height);
+        videoQueueBudgetBytes_ = options.videoQueueBudgetMb > 0
+            ? static_cast<uint64_t>(options.videoQueueBudgetMb) * 1024ull * 1024ull
+            : getDefaultVideoQueueBudgetBytes();
+        videoQueueFrameBytes_ = 0;
+        peakVideoQueueDepth_ = 0;
+        peakVideoQueueBytes_ = 0;
+        videoQueueWaitNs_ = 0;
+        videoQueueBlockedPushes_ = 0;
+        updateVideoQueueLimit(estimatedFrameBytes);
+
+        // Enough buffers for a typical queue, the frame being encoded, the one being captured and those the proxy holds.
+        // Deeper queues allowed by a large budget grow the pool on demand instead of committing it up front.
+        const size_t preallocatedBuffers = (std::min)(videoQueue_.getLimit(), kPreallocatedVideoFrameBuffers) + 2 +
+                                           (proxyEncoder_.isOpen() ? kProxyFrameBuffers : 0);
+        videoFrameBufferPool_.reset(estimatedFrameBytes, preallocatedBuffers);
+        videoFrameCopier_.initialize(std::clamp<size_t>(std::thread::hardware_concurrency() / 4, 1, kMaxFrameCopyLanes));
+
+        videoSpillEnabled_ = false;
+        if (options.spillVideoQueue) {
+            const std::wstring spoolPath = filename + L".ever-spool";
+            if (SUCCEEDED(videoFrameSpool_.open(spoolPath, estimatedFrameBytes))) {
+                videoSpillEnabled_ = true;
+                LOG(LL_NFO, "EncoderSession::createContext - Video queue spill enabled: ", utf8_encode(spoolPath));
+            } else {
+                LOG(LL_WRN, "EncoderSession::createContext - Could not create spool file; capture will wait for the encoder instead");
+            }
+        }
+
         isCapturing = true;
 
-        {
-            std::lock_guard<std::mutex> lock(videoQueueMutex_);
-            videoQueueStopRequested_ = false;
-            videoWorkerFailed_ = false;
-            videoWorkerRunning_ = true;
-            videoQueue_.clear();
-            queuedVideoFrames_ = 0;
-            encodedVideoFrames_ = 0;
-            droppedVideoFrames_ = 0;
-        }
+        videoQueue_.reset();
+        videoWorkerFailed_ = false;
+        videoWorkerRunning_ = true;
+        queuedVideoFrames_ = 0;
+        encodedVideoFrames_ = 0;
+        droppedVideoFrames_ = 0;
+
+        audioChunkBufferPool_.reset(kExpectedAudioChunkBytes, kPreallocatedAudioChunkBuffers);
+        audioQueue_.reset();
+        audioWorkerFailed_ = false;
+        peakAudioQueueDepth_ = 0;
+        audioQueueWaitNs_ = 0;
+
+        videoFrameCopyLatency_.reset();
+        videoEnqueueWaitLatency_.reset();
+        videoSpillWriteLatency_.reset();
+        videoEncodeLatency_.reset();
+        audioChunkCopyLatency_.reset();
+        audioEnqueueWaitLatency_.reset();
 
         try {
             videoEncodingThread_ = std::thread(&EncoderSession::videoEncodingWorkerLoop, this);
             LOG(LL_NFO, "EncoderSession::createContext - Video worker thread started");
+            audioEncodingThread_ = std::thread(&EncoderSession::audioEncodingWorkerLoop, this);
+            LOG(LL_NFO, "EncoderSession::createContext - Audio worker thread started");
         } catch (const std::exception& ex) {
             LOG(LL_ERR, "EncoderSession::createContext - Failed to start video worker thread: ", ex.what());
+            videoSpillEnabled_ = false;
+            videoFrameSpool_.close();
             POST();
             return E_FAIL;
         } catch (...) {
             LOG(LL_ERR, "EncoderSession::createContext - Failed to start video worker thread");
+            videoSpillEnabled_ = false;
+            videoFrameSpool_.close();
             POST();
             return E_FAIL;
         }
@@ -268,6 +554,7 @@ namespace Encoder {
         return S_OK;
     }
 
+#ifdef _WIN32
     HRESULT EncoderSession::enqueueExrImage(const Microsoft::WRL::ComPtr<ID3D11DeviceContext>& deviceContext,
                                         const Microsoft::WRL::ComPtr<ID3D11Texture2D>& colorTexture,
                                         const Microsoft::WRL::ComPtr<ID3D11Texture2D>& depthTexture) {
@@ -291,6 +578,22 @@ namespace Encoder {
     }
 
     HRESULT EncoderSession::enqueueVideoFrame(const D3D11_MAPPED_SUBRESOURCE& subresource) {
+        return enqueueVideoFrame(subresource.pData, static_cast<int>(subresource.RowPitch));
+    }
+#endif
+
+    HRESULT EncoderSession::enqueueVideoFrame(const void* data, int rowPitch) {
+        if (!sessionTrace_.isOpen()) {
+            return captureVideoFrame(data, rowPitch);
+        }
+
+        const SessionTraceWriter::Clock::time_point callStart = SessionTraceWriter::Clock::now();
+        const HRESULT result = captureVideoFrame(data, rowPitch);
+        sessionTrace_.recordVideoFrame(callStart, data, rowPitch, height_, result);
+        return result;
+    }
+
+    HRESULT EncoderSession::captureVideoFrame(const void* data, int rowPitch) {
         PRE();
 
         if (isBeingDeleted_) {
@@ -298,46 +601,74 @@ namespace Encoder {
             return E_FAIL;
         }
 
-        if (subresource.pData == nullptr || subresource.RowPitch <= 0 || height_ <= 0) {
+        if (data == nullptr || rowPitch <= 0 || height_ <= 0) {
             LOG(LL_ERR, "enqueueVideoFrame received invalid mapped resource");
             POST();
             return E_FAIL;
         }
 
         QueuedVideoFrame frame;
-        frame.rowPitch = static_cast<int>(subresource.RowPitch);
+        frame.rowPitch = rowPitch;
         frame.height = height_;
         frame.frameIndex = videoPts_++;
 
         const size_t frameBytes = static_cast<size_t>(frame.rowPitch) * static_cast<size_t>(frame.height);
-        frame.data.resize(frameBytes);
-        std::memcpy(frame.data.data(), subresource.pData, frameBytes);
+        updateVideoQueueLimit(frameBytes);
+
+        // Once the in-memory budget is used up, or while older frames still sit in the spool, new frames go to
+        // disk straight from the mapped texture so capture is bound by disk bandwidth rather than encoder speed.
+        if (videoSpillEnabled_ && !videoQueue_.isStopRequested() &&
+            (videoFrameSpool_.hasPending() || videoQueue_.size() >= videoQueue_.getLimit())) {
+            const auto spillStart = std::chrono::steady_clock::now();
+            const HRESULT spillHr = videoFrameSpool_.write(data, frameBytes, frame.rowPitch, frame.height, frame.frameIndex);
+            videoSpillWriteLatency_.record(std::chrono::steady_clock::now() - spillStart);
+            if (SUCCEEDED(spillHr)) {
+                ++queuedVideoFrames_;
+                LOG(LL_TRC, "Spilled video frame index=", frame.frameIndex);
+                POST();
+                return S_OK;
+            }
 
-        std::unique_lock<std::mutex> lock(videoQueueMutex_);
-        if (videoQueue_.size() >= kMaxQueuedVideoFrames) {
-            LOG(LL_DBG, "Video queue full (", videoQueue_.size(), "/", kMaxQueuedVideoFrames,
+            // Let the worker catch up on what is already on disk so the ring cannot overtake it, then keep
+            // going in memory only. The file itself is removed in finishVideo once the worker has stopped.
+            LOG(LL_WRN, "Video queue spill failed; falling back to in-memory queue");
+            videoFrameSpool_.waitUntilDrained();
+            videoSpillEnabled_ = false;
+        }
+
+        const auto copyStart = std::chrono::steady_clock::now();
+        frame.data = videoFrameBufferPool_.acquire(frameBytes);
+        videoFrameCopier_.copy(frame.data.data(), data, frameBytes);
+        videoFrameCopyLatency_.record(std::chrono::steady_clock::now() - copyStart);
+
+        const size_t depthLimit = videoQueue_.getLimit();
+        if (videoQueue_.size() >= depthLimit) {
+            LOG(LL_DBG, "Video queue full (", videoQueue_.size(), "/", depthLimit,
                 ") waiting for encoder worker...");
+            ++videoQueueBlockedPushes_;
         }
 
-        videoQueueNotFullCv_.wait(lock, [this] {
-            return videoQueueStopRequested_ || videoQueue_.size() < kMaxQueuedVideoFrames;
-        });
+        const auto pushStart = std::chrono::steady_clock::now();
+        const bool pushed = videoQueue_.push(frame);
+        const auto pushElapsed = std::chrono::steady_clock::now() - pushStart;
+        videoQueueWaitNs_ += std::chrono::duration_cast<std::chrono::nanoseconds>(pushElapsed).count();
+        videoEnqueueWaitLatency_.record(pushElapsed);
 
-        if (videoQueueStopRequested_) {
+        if (!pushed) {
             LOG(LL_WRN, "Video queue stop requested; dropping frame ", frame.frameIndex);
             ++droppedVideoFrames_;
+            videoFrameBufferPool_.release(std::move(frame.data));
             POST();
             return E_FAIL;
         }
 
-        videoQueue_.push_back(std::move(frame));
         ++queuedVideoFrames_;
         const size_t queueDepth = videoQueue_.size();
-        lock.unlock();
-        videoQueueNotEmptyCv_.notify_one();
+        peakVideoQueueDepth_ = (std::max)(peakVideoQueueDepth_, queueDepth);
+        peakVideoQueueBytes_ = (std::max)(peakVideoQueueBytes_, static_cast<uint64_t>(queueDepth) * frameBytes);
 
         LOG(LL_TRC, "Queued video frame index=", (videoPts_ - 1), " depth=", queueDepth,
-            " maxDepth=", kMaxQueuedVideoFrames);
+            " maxDepth=", depthLimit);
 
         POST();
         return S_OK;
@@ -356,14 +687,66 @@ namespace Encoder {
         videoFrame_.buffer[0] = data;
         videoFrame_.rowsize[0] = rowPitch;
 
-        LOG(LL_TRC, "EncoderSession::writeVideoFrame - Sending frame to FFmpeg encoder");
-        REQUIRE(ffmpegEncoder_->SendVideoFrame(videoFrame_), "Failed to send video frame to FFmpeg");
+        LOG(LL_TRC, "EncoderSession::writeVideoFrame - Sending frame to FFmpeg encoders");
+        for (const std::unique_ptr<Output>& output : outputs_) {
+            if (output->videoSource || !output->feedingVideo) {
+                continue;
+            }
+
+            // A failed output still converts while outputs sharing its conversion need the frames.
+            const Output* self = output.get();
+            const bool needed = !output->failed ||
+                std::any_of(outputs_.begin(), outputs_.end(), [self](const std::unique_ptr<Output>& other) {
+                    return other->videoSource == self && !other->failed;
+                });
+            if (!needed) {
+                output->feedingVideo = false;
+                continue;
+            }
+
+            const auto sendStart = std::chrono::steady_clock::now();
+            const HRESULT hr = output->encoder->SendVideoFrame(videoFrame_);
+            output->videoSendNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - sendStart).count();
+
+            if (FAILED(hr)) {
+                LOG(LL_ERR, "Failed to send video frame to FFmpeg ### error code: ", hr);
+                output->feedingVideo = false;
+            }
+            for (const std::unique_ptr<Output>& member : outputs_) {
+                if (member.get() != self && member->videoSource != self) {
+                    continue;
+                }
+                if (FAILED(hr)) {
+                    markOutputFailed(*member, member.get() == self ? "video encoding failed" : "its video source failed");
+                } else if (member->encoder->HasVideoFailed()) {
+                    markOutputFailed(*member, "video encoding failed");
+                } else if (!member->failed) {
+                    ++member->videoFrames;
+                }
+            }
+        }
 
+        const HRESULT hr = hasLiveOutput() ? S_OK : E_FAIL;
+        if (FAILED(hr)) {
+            LOG(LL_ERR, "EncoderSession::writeVideoFrame - Every output has failed");
+        }
         POST();
-        return S_OK;
+        return hr;
     }
 
     HRESULT EncoderSession::writeAudioFrame(BYTE* data, int32_t lengthBytes, LONGLONG presentationTime) {
+        if (!sessionTrace_.isOpen()) {
+            return captureAudioChunk(data, lengthBytes, presentationTime);
+        }
+
+        const SessionTraceWriter::Clock::time_point callStart = SessionTraceWriter::Clock::now();
+        const HRESULT result = captureAudioChunk(data, lengthBytes, presentationTime);
+        sessionTrace_.recordAudioChunk(callStart, lengthBytes, presentationTime, result);
+        return result;
+    }
+
+    HRESULT EncoderSession::captureAudioChunk(BYTE* data, int32_t lengthBytes, LONGLONG presentationTime) {
         PRE();
 
         if (isBeingDeleted_) {
@@ -386,12 +769,37 @@ namespace Encoder {
             return E_FAIL;
         }
 
-        audioChunk_.buffer[0] = data;
-        audioChunk_.samples = samples;
-        submittedAudioSamples_ += samples;
+        if (audioWorkerFailed_) {
+            LOG(LL_ERR, "EncoderSession::writeAudioFrame - Audio worker failed on an earlier chunk");
+            POST();
+            return E_FAIL;
+        }
+
+        // The caller's buffer (an IMFMediaBuffer lock or the pass-2 replay buffer) is only valid for this
+        // call, so the chunk is copied into a pooled buffer before it is handed to the audio worker.
+        const size_t chunkBytes = static_cast<size_t>(samples) * static_cast<size_t>(audioBlockAlign_);
+        QueuedAudioChunk chunk;
+        chunk.presentationTime = presentationTime;
+        const auto copyStart = std::chrono::steady_clock::now();
+        chunk.data = audioChunkBufferPool_.acquire(chunkBytes);
+        std::memcpy(chunk.data.data(), data, chunkBytes);
+        audioChunkCopyLatency_.record(std::chrono::steady_clock::now() - copyStart);
+
+        const auto pushStart = std::chrono::steady_clock::now();
+        const bool pushed = audioQueue_.push(chunk);
+        const auto pushElapsed = std::chrono::steady_clock::now() - pushStart;
+        audioQueueWaitNs_ += std::chrono::duration_cast<std::chrono::nanoseconds>(pushElapsed).count();
+        audioEnqueueWaitLatency_.record(pushElapsed);
+
+        if (!pushed) {
+            LOG(LL_WRN, "Audio queue stop requested; dropping chunk pts=", presentationTime);
+            audioChunkBufferPool_.release(std::move(chunk.data));
+            POST();
+            return E_FAIL;
+        }
 
-        LOG(LL_TRC, "EncoderSession::writeAudioFrame - Sending audio chunk to FFmpeg encoder");
-        REQUIRE(ffmpegEncoder_->SendAudioSampleChunk(audioChunk_), "Failed to send audio chunk to FFmpeg");
+        submittedAudioSamples_ += samples;
+        peakAudioQueueDepth_ = (std::max)(peakAudioQueueDepth_, audioQueue_.size());
 
         POST();
         return S_OK;
@@ -399,31 +807,20 @@ namespace Encoder {
 
     HRESULT EncoderSession::finishVideo() {
         PRE();
+        const SessionTraceWriter::Clock::time_point callStart = SessionTraceWriter::Clock::now();
         std::lock_guard<std::mutex> guard(finishMutex_);
 
         if (!isVideoFinished_) {
-            {
-                std::lock_guard<std::mutex> lock(videoQueueMutex_);
-                videoQueueStopRequested_ = true;
-            }
-            videoQueueNotEmptyCv_.notify_all();
-            videoQueueNotFullCv_.notify_all();
+            videoQueue_.requestStop();
 
             if (videoEncodingThread_.joinable()) {
                 LOG(LL_NFO, "Waiting for video worker to drain queued frames...");
                 videoEncodingThread_.join();
             }
 
-            if (exrEncodingThread_.joinable()) {
-                exrImageQueue_.enqueue(ExrQueueItem());
-                
-                std::unique_lock<std::mutex> lock(exrEncodingThreadMutex_);
-                while (!isExrEncodingThreadFinished_) {
-                    exrEncodingThreadFinishedCondition_.wait(lock);
-                }
-
-                exrEncodingThread_.join();
-            }
+            videoFrameCopier_.shutdown();
+            videoSpillEnabled_ = false;
+            videoFrameSpool_.close();
 
             if (videoFrame_.buffer != nullptr) {
                 delete[] videoFrame_.buffer;
@@ -439,28 +836,46 @@ namespace Encoder {
 
             if (videoWorkerFailed_) {
                 LOG(LL_ERR, "finishVideo detected video worker encoding failure");
+                sessionTrace_.recordEvent(SessionTraceEvent::FinishVideo, callStart, E_FAIL);
                 POST();
                 return E_FAIL;
             }
         }
 
+        sessionTrace_.recordEvent(SessionTraceEvent::FinishVideo, callStart, S_OK);
         POST();
         return S_OK;
     }
 
     HRESULT EncoderSession::finishAudio() {
         PRE();
+        const SessionTraceWriter::Clock::time_point callStart = SessionTraceWriter::Clock::now();
         std::lock_guard<std::mutex> guard(finishMutex_);
 
         if (!isAudioFinished_) {
+            audioQueue_.requestStop();
+
+            if (audioEncodingThread_.joinable()) {
+                LOG(LL_NFO, "Waiting for audio worker to drain queued chunks...");
+                audioEncodingThread_.join();
+            }
+
             if (audioChunk_.buffer != nullptr) {
                 delete[] audioChunk_.buffer;
                 audioChunk_.buffer = nullptr;
             }
             
             isAudioFinished_ = true;
+
+            if (audioWorkerFailed_) {
+                LOG(LL_ERR, "finishAudio detected audio worker encoding failure");
+                sessionTrace_.recordEvent(SessionTraceEvent::FinishAudio, callStart, E_FAIL);
+                POST();
+                return E_FAIL;
+            }
         }
 
+        sessionTrace_.recordEvent(SessionTraceEvent::FinishAudio, callStart, S_OK);
         POST();
         return S_OK;
     }
@@ -483,6 +898,7 @@ namespace Encoder {
 
         isCapturing = false;
         LOG(LL_NFO, "Ending encoding session...");
+        const SessionTraceWriter::Clock::time_point callStart = SessionTraceWriter::Clock::now();
 
         if (fpsNumerator_ > 0 && fpsDenominator_ > 0 && inputAudioSampleRate_ > 0) {
             const double videoDurationSec = static_cast<double>(encodedVideoFrames_) *
@@ -503,12 +919,48 @@ namespace Encoder {
             }
         }
 
-        if (ffmpegEncoder_) {
-            LOG(LL_DBG, "EncoderSession::endSession - Closing FFmpeg encoder");
-            LOG_IF_FAILED(ffmpegEncoder_->Close(true), "Failed to close FFmpeg encoder");
-        } else {
+        const double videoQueueWaitMs = static_cast<double>(videoQueueWaitNs_) / 1000000.0;
+        LOG(LL_NFO, "Video queue telemetry: budgetBytes=", videoQueueBudgetBytes_,
+            " depthLimit=", videoQueue_.getLimit(),
+            " peakDepth=", peakVideoQueueDepth_,
+            " peakBytes=", peakVideoQueueBytes_,
+            " blockedPushes=", videoQueueBlockedPushes_,
+            " totalWaitMs=", videoQueueWaitMs,
+            " avgWaitMsPerFrame=", queuedVideoFrames_ > 0 ? videoQueueWaitMs / static_cast<double>(queuedVideoFrames_) : 0.0);
+
+        const VideoFrameSpool::Stats spillStats = videoFrameSpool_.getStats();
+        if (spillStats.spilledFrames > 0) {
+            LOG(LL_NFO, "Video queue spill telemetry: spilledFrames=", spillStats.spilledFrames,
+                " spilledBytes=", spillStats.spilledBytes,
+                " peakPendingFrames=", spillStats.peakPendingFrames,
+                " peakFileBytes=", spillStats.peakFileBytes);
+        }
+
+        videoFrameCopyLatency_.log();
+        videoEnqueueWaitLatency_.log();
+        videoSpillWriteLatency_.log();
+        videoEncodeLatency_.log();
+        audioChunkCopyLatency_.log();
+        audioEnqueueWaitLatency_.log();
+
+        if (outputs_.empty()) {
             LOG(LL_DBG, "FFmpeg encoder instance was never created (audio-only mode)");
         }
+        // An output closes before those sharing its conversion, so frames it still flushes reach them.
+        for (size_t i = 0; i < outputs_.size(); ++i) {
+            Output& output = *outputs_[i];
+            LOG(LL_DBG, "EncoderSession::endSession - Closing FFmpeg encoder for ", output.filename);
+            const auto closeStart = std::chrono::steady_clock::now();
+            if (FAILED(output.encoder->Close(true))) {
+                LOG(LL_WRN, "Failed to close FFmpeg encoder for ", output.filename);
+                markOutputFailed(output, "finalizing failed");
+            }
+            logOutputStats(output, i, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - closeStart).count());
+        }
+        proxyEncoder_.close();
+
+        sessionTrace_.recordEvent(SessionTraceEvent::EndSession, callStart, S_OK);
+        sessionTrace_.close();
 
         isSessionFinished_ = true;
         endSessionCondition_.notify_all();
@@ -1,29 +1,59 @@
 #pragma once
 
-#include "SafeQueue.h"
-#include "VideoFrameTypes.h"
+#include "SpscRingBuffer.h"
+#include "FrameBufferPool.h"
+#include "LatencyHistogram.h"
+#include "SessionTrace.h"
+#include "StreamingCopy.h"
+#include "VideoFrameSpool.h"
 #include "OpenEXRExporter.h"
+#include "ProxyEncoder.h"
+#include "EncoderThreading.h"
 #include "FFmpegEncoder.h"
 #include "FFmpegTypes.h"
+#include "Platform.h"
 
-#define NOMINMAX
-#include <Windows.h>
+#ifdef _WIN32
 #include <d3d11.h>
 #include <dxgi.h>
+#include <mfidl.h>
+#include <wrl.h>
+#endif
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
-#include <deque>
 #include <future>
-#include <mfidl.h>
 #include <mutex>
 #include <string>
 #include <thread>
 #include <utility>
 #include <valarray>
 #include <vector>
-#include <wrl.h>
 
 namespace Encoder {
+    // A further file encoded from the same captured frames with its own preset.
+    struct EncoderOutput {
+        FFmpeg::FFENCODERCONFIG config;
+        std::wstring filename;
+    };
+
+    // Everything about a session beyond the captured formats. The defaults match EVER.ini's.
+    struct EncoderSessionOptions {
+        // Memory the video queue may hold; 0 picks a default from the available memory.
+        uint32_t videoQueueBudgetMb = 0;
+        bool spillVideoQueue = false;
+        bool traceSession = false;
+        uint32_t tracePixelStep = 0;
+        EncoderThreadingPolicy threading;
+        uint32_t outputBufferMb = 8;
+        FFmpeg::FaststartMode faststartMode = FFmpeg::FaststartReserve;
+        uint32_t faststartReserveMinutes = 30;
+        OutputSegmentPolicy segments;
+        std::vector<EncoderOutput> teeOutputs;
+        ProxyOutput proxy;
+    };
+
     class EncoderSession {
     public:
         EncoderSession();
@@ -45,13 +75,19 @@ namespace Encoder {
                             uint32_t inputAlign, 
                             bool exportOpenExr, 
                             uint32_t openExrWidth,
-                            uint32_t openExrHeight);
+                            uint32_t openExrHeight,
+                            const EncoderSessionOptions& options = EncoderSessionOptions());
 
+        // data holds height rows of rowPitch bytes; it only needs to stay valid for the duration of the call.
+        HRESULT enqueueVideoFrame(const void* data, int rowPitch);
+
+#ifdef _WIN32
         HRESULT enqueueVideoFrame(const D3D11_MAPPED_SUBRESOURCE& subresource);
 
         HRESULT enqueueExrImage(const Microsoft::WRL::ComPtr<ID3D11DeviceContext>& deviceContext,
                             const Microsoft::WRL::ComPtr<ID3D11Texture2D>& colorTexture,
                             const Microsoft::WRL::ComPtr<ID3D11Texture2D>& depthTexture);
+#endif
 
         HRESULT writeVideoFrame(BYTE* data, int32_t length, int rowPitch, LONGLONG presentationTime);
 
@@ -73,10 +109,41 @@ namespace Encoder {
             int64_t frameIndex = 0;
         };
 
+        struct QueuedAudioChunk {
+            std::vector<uint8_t> data;
+            LONGLONG presentationTime = 0;
+        };
+
+        HRESULT captureVideoFrame(const void* data, int rowPitch);
+        HRESULT captureAudioChunk(BYTE* data, int32_t lengthBytes, LONGLONG presentationTime);
         void videoEncodingWorkerLoop();
         HRESULT encodeQueuedVideoFrame(const QueuedVideoFrame& frame);
+        bool readSpilledVideoFrame(QueuedVideoFrame& frame);
+        void updateVideoQueueLimit(size_t frameBytes);
+        void audioEncodingWorkerLoop();
+        HRESULT encodeAudioChunk(BYTE* data, int32_t lengthBytes, LONGLONG presentationTime);
+
+        // One encoder and its file: outputs_[0] is the primary one, the rest are the tee outputs in order. Outputs
+        // that take the same frames share the conversion of the first of them, their videoSource. A failed output
+        // is only closed at the end; the others carry on.
+        struct Output {
+            std::unique_ptr<FFmpegEncoder> encoder;
+            std::string filename;
+            Output* videoSource = nullptr;
+            // Whether the video worker still passes frames to encoder; only for outputs without a videoSource.
+            bool feedingVideo = true;
+            std::atomic<bool> failed = false;
+            int64_t videoFrames = 0;
+            int64_t videoSendNs = 0;
+            std::atomic<int64_t> audioChunks = 0;
+        };
+
+        void markOutputFailed(Output& output, const char* reason);
+        bool hasLiveOutput() const;
+        void logOutputStats(const Output& output, size_t index, double closeMs) const;
 
-        std::unique_ptr<FFmpegEncoder> ffmpegEncoder_;
+        std::vector<std::unique_ptr<Output>> outputs_;
+        std::chrono::steady_clock::time_point sessionStart_;
         FFmpeg::FFVIDEOFRAME videoFrame_;
         FFmpeg::FFAUDIOCHUNK audioChunk_;
 
@@ -92,25 +159,59 @@ namespace Encoder {
         std::mutex endSessionMutex_;
         std::condition_variable endSessionCondition_;
 
-        std::mutex videoQueueMutex_;
-        std::condition_variable videoQueueNotEmptyCv_;
-        std::condition_variable videoQueueNotFullCv_;
-        std::deque<QueuedVideoFrame> videoQueue_;
+        // Ring capacity. The depth actually used follows the memory budget, which by default is small enough to
+        // keep it near the old fixed depth of 8 at 4K; only an explicit video_queue_budget_mb reaches this.
+        static constexpr size_t kMaxQueuedVideoFrames = 128;
+        static constexpr size_t kMinQueuedVideoFrames = 2;
+        static constexpr size_t kPreallocatedVideoFrameBuffers = 8;
+        SpscRingBuffer<QueuedVideoFrame> videoQueue_;
+        uint64_t videoQueueBudgetBytes_ = 0;
+        size_t videoQueueFrameBytes_ = 0;
+        size_t peakVideoQueueDepth_ = 0;
+        uint64_t peakVideoQueueBytes_ = 0;
+        int64_t videoQueueWaitNs_ = 0;
+        int64_t videoQueueBlockedPushes_ = 0;
         std::thread videoEncodingThread_;
-        bool videoQueueStopRequested_ = false;
-        bool videoWorkerRunning_ = false;
-        bool videoWorkerFailed_ = false;
-        static constexpr size_t kMaxQueuedVideoFrames = 8;
+        std::atomic<bool> videoWorkerRunning_ = false;
+        std::atomic<bool> videoWorkerFailed_ = false;
+        FrameBufferPool videoFrameBufferPool_;
+        // Takes frames from the video worker once the outputs are done with them; they come back through
+        // videoFrameBufferPool_. Declared after the pool so it is closed first.
+        ProxyEncoder proxyEncoder_;
+        static constexpr size_t kProxyFrameBuffers = 3;
+        // Readback copies leave the mapped staging texture on up to this many threads, render thread included.
+        static constexpr size_t kMaxFrameCopyLanes = 4;
+        StreamingCopier videoFrameCopier_;
+        VideoFrameSpool videoFrameSpool_;
+        std::atomic<bool> videoSpillEnabled_ = false;
         int64_t queuedVideoFrames_ = 0;
+
+        // Audio mirrors the video path: writeAudioFrame copies the chunk and returns, a worker encodes it.
+        static constexpr size_t kMaxQueuedAudioChunks = 256;
+        static constexpr size_t kPreallocatedAudioChunkBuffers = 16;
+        static constexpr size_t kExpectedAudioChunkBytes = 16 * 1024;
+        SpscRingBuffer<QueuedAudioChunk> audioQueue_;
+        FrameBufferPool audioChunkBufferPool_;
+        std::thread audioEncodingThread_;
+        std::atomic<bool> audioWorkerFailed_ = false;
+        size_t peakAudioQueueDepth_ = 0;
+        int64_t audioQueueWaitNs_ = 0;
+
+        // Capture-side stages; the encoder-side ones live in FFmpegEncoder. Both are logged at session end.
+        LatencyHistogram videoFrameCopyLatency_{"video.frame_copy"};
+        LatencyHistogram videoEnqueueWaitLatency_{"video.enqueue_wait"};
+        LatencyHistogram videoSpillWriteLatency_{"video.spill_write"};
+        LatencyHistogram videoEncodeLatency_{"video.encode_total"};
+        LatencyHistogram audioChunkCopyLatency_{"audio.chunk_copy"};
+        LatencyHistogram audioEnqueueWaitLatency_{"audio.enqueue_wait"};
+        // Opt-in record of every capture call, written next to the output for offline replay.
+        SessionTraceWriter sessionTrace_;
         int64_t encodedVideoFrames_ = 0;
         int64_t submittedAudioSamples_ = 0;
         int64_t droppedVideoFrames_ = 0;
         int32_t fpsNumerator_ = 0;
         int32_t fpsDenominator_ = 1;
 
-        SafeQueue<FrameQueueItem> videoFrameQueue_;
-        SafeQueue<ExrQueueItem> exrImageQueue_;
-
         std::valarray<uint16_t> motionBlurAccBuffer_;
         std::valarray<uint16_t> motionBlurTempBuffer_;
         std::valarray<uint8_t> motionBlurDestBuffer_;
@@ -118,10 +219,6 @@ namespace Encoder {
         bool exportExr_ = false;
         uint64_t exrFrameNumber_ = 0;
         OpenEXRExporter exrExporter_;
-        bool isExrEncodingThreadFinished_ = false;
-        std::condition_variable exrEncodingThreadFinishedCondition_;
-        std::mutex exrEncodingThreadMutex_;
-        std::thread exrEncodingThread_;
 
         int32_t width_ = 0;
         int32_t height_ = 0;
@@ -0,0 +1,132 @@
+#include "EncoderThreading.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace Encoder {
+    namespace {
+        // libavcodec's own cap for threads=0 on frame- and slice-threaded codecs; more mostly costs memory.
+        constexpr uint32_t kMaxGenericThreads = 16;
+        // libvpx and libaom reject more than this.
+        constexpr uint32_t kMaxLibvpxThreads = 64;
+
+        std::string trim(const std::string& value) {
+            const size_t start = value.find_first_not_of(" \t");
+            if (start == std::string::npos) {
+                return "";
+            }
+            const size_t end = value.find_last_not_of(" \t");
+            return value.substr(start, end - start + 1);
+        }
+
+        // Largest log2 tile count that keeps every tile at least minTileSize pixels, capped at maxLog2.
+        int log2Tiles(int size, int minTileSize, int maxLog2) {
+            int tiles = 0;
+            while (tiles < maxLog2 && (size >> (tiles + 1)) >= minTileSize) {
+                ++tiles;
+            }
+            return tiles;
+        }
+
+        // x265 sizes its own frame-thread count from the pool this way; using the encoder's share of the cores
+        // instead of every core keeps it from planning for threads the game is using.
+        uint32_t x265FrameThreads(uint32_t cores) {
+            if (cores >= 32) {
+                return 6;
+            }
+            if (cores >= 16) {
+                return 5;
+            }
+            if (cores >= 8) {
+                return 3;
+            }
+            return cores >= 4 ? 2 : 1;
+        }
+    }
+
+    bool isHardwareEncoder(const std::string& codecName) {
+        static const char* const suffixes[] = {"_nvenc", "_qsv", "_amf", "_vaapi", "_videotoolbox", "_mf",
+                                               "_vulkan", "_d3d12va"};
+        for (const char* suffix : suffixes) {
+            const std::string tail(suffix);
+            if (codecName.size() > tail.size() &&
+                codecName.compare(codecName.size() - tail.size(), tail.size(), tail) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string EncoderThreadingPlan::toString() const {
+        std::ostringstream oss;
+        oss << "cores=" << cores << " encoderCores=" << encoderCores;
+        if (instances > 1) {
+            oss << " instances=" << instances;
+        }
+        for (const auto& [key, value] : options) {
+            oss << " " << key << "=" << value;
+        }
+        return oss.str();
+    }
+
+    EncoderThreadingPlan planEncoderThreading(const std::string& codecName, int width, int height,
+                                              const EncoderThreadingPolicy& policy, uint32_t cores) {
+        EncoderThreadingPlan plan;
+        plan.cores = (std::max)(cores, 1u);
+        plan.hardware = isHardwareEncoder(codecName);
+        plan.instances = plan.hardware ? 1 : (std::max)(policy.parallelEncoders, 1u);
+        const uint32_t freeCores = plan.cores > policy.reservedCores ? plan.cores - policy.reservedCores : 1;
+        plan.encoderCores = (std::max)(freeCores / plan.instances, 1u);
+        if (!policy.automatic || plan.hardware) {
+            return plan;
+        }
+
+        const uint32_t n = plan.encoderCores;
+        const auto add = [&plan](const std::string& key, const std::string& value) {
+            plan.options.emplace_back(key, value);
+        };
+
+        if (codecName == "libx264") {
+            // x264 frame threads beyond one per two macroblock rows only add latency and memory.
+            const uint32_t macroblockRows = static_cast<uint32_t>((std::max)(height, 16) + 15) / 16;
+            add("threads", std::to_string((std::min)(n, (std::max)(macroblockRows / 2, 1u))));
+        } else if (codecName == "libx265") {
+            // pools sizes the WPP worker pool; dedicated lookahead threads only pay off with cores to spare.
+            std::string params = "pools=" + std::to_string(n) + ":frame-threads=" + std::to_string(x265FrameThreads(n));
+            if (n >= 16 && static_cast<int64_t>(width) * height >= 1920 * 1080) {
+                params += ":lookahead-threads=" + std::to_string((std::min)(n / 8, 4u));
+            }
+            add("x265-params", params);
+        } else if (codecName == "libvpx-vp9") {
+            // VP9 tile columns are at least 256 pixels wide; row-mt keeps threads busy inside each column.
+            add("row-mt", "1");
+            add("tile-columns", std::to_string(log2Tiles(width, 256, 6)));
+            add("threads", std::to_string((std::min)(n, kMaxLibvpxThreads)));
+        } else if (codecName == "libaom-av1") {
+            // Wider tiles than VP9's minimum: AV1 loses more efficiency per tile edge.
+            const int columns = log2Tiles(width, 512, 6);
+            add("row-mt", "1");
+            add("tile-columns", std::to_string(columns));
+            add("tile-rows", std::to_string((std::min)(log2Tiles(height, 512, 6), columns)));
+            add("threads", std::to_string((std::min)(n, kMaxLibvpxThreads)));
+        } else {
+            // Codecs without threading support ignore it; FFmpegEncoder only applies it to those that have it.
+            add("threads", std::to_string((std::min)(n, kMaxGenericThreads)));
+        }
+        return plan;
+    }
+
+    bool findEncoderOption(const std::string& options, const std::string& key, std::string& value, char separator) {
+        std::istringstream stream(options);
+        std::string token;
+        while (std::getline(stream, token, separator)) {
+            const size_t pos = token.find('=');
+            if (pos == std::string::npos || trim(token.substr(0, pos)) != key) {
+                continue;
+            }
+            value = trim(token.substr(pos + 1));
+            return true;
+        }
+        return false;
+    }
+}
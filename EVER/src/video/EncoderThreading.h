@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Encoder {
+    // How the video encoder's threads are sized when the preset leaves them unset.
+    struct EncoderThreadingPolicy {
+        // Pick threads, row-mt, tile columns and the like from the core count and resolution.
+        bool automatic = true;
+        // Cores kept free for the game's render, audio and capture threads.
+        uint32_t reservedCores = 2;
+        // Software encoder instances that each take every Nth fixed-length chunk of the video; 0 or 1 uses a single
+        // encoder for the whole stream. The encoder cores are split evenly between the instances.
+        uint32_t parallelEncoders = 0;
+        uint32_t chunkSeconds = 2;
+    };
+
+    // Options chosen for one encoder, as codec option name/value pairs. Empty for hardware encoders, which
+    // schedule their own work, and when the policy is not automatic.
+    struct EncoderThreadingPlan {
+        uint32_t cores = 0;
+        // Per encoder instance.
+        uint32_t encoderCores = 0;
+        uint32_t instances = 1;
+        bool hardware = false;
+        std::vector<std::pair<std::string, std::string>> options;
+
+        std::string toString() const;
+    };
+
+    // Pure function of its inputs so the bench tools can print what an export on another machine would use.
+    EncoderThreadingPlan planEncoderThreading(const std::string& codecName, int width, int height,
+                                              const EncoderThreadingPolicy& policy, uint32_t cores);
+
+    bool isHardwareEncoder(const std::string& codecName);
+
+    // Value of key in a '|'-separated key=value option string like FFTRACKCONFIG::options, or in a
+    // ':'-separated list such as x265-params. Returns false when the key is absent.
+    bool findEncoderOption(const std::string& options, const std::string& key, std::string& value,
+                           char separator = '|');
+}
@@ -3,11 +3,18 @@
 #pragma warning(disable : 26812)
 
 #include "FFmpegEncoder.h"
+#include "SegmentTimestamps.h"
 #include "util.h"
 
 #include <map>
 #include <sstream>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -27,8 +34,76 @@ extern "C" {
 #pragma warning(pop)
 
 namespace Encoder {
+    namespace {
+        // Copies an unopened video encoder's settings, private options included, to another context of the same
+        // codec. Fields without an AVOption are copied by hand.
+        HRESULT CopyVideoCodecSettings(AVCodecContext* target, const AVCodecContext* source) {
+            if (av_opt_copy(target, source) < 0 || av_opt_copy(target->priv_data, source->priv_data) < 0) {
+                return E_FAIL;
+            }
+            target->width = source->width;
+            target->height = source->height;
+            target->pix_fmt = source->pix_fmt;
+            target->time_base = source->time_base;
+            target->framerate = source->framerate;
+            target->sample_aspect_ratio = source->sample_aspect_ratio;
+            target->colorspace = source->colorspace;
+            target->color_primaries = source->color_primaries;
+            target->color_trc = source->color_trc;
+            target->color_range = source->color_range;
+            target->flags = source->flags;
+            target->flags2 = source->flags2;
+            return S_OK;
+        }
+
+        // Every frame is coded on its own and its packet comes back as soon as the frame is sent, so frames can
+        // go to separate encoders. FFV1 carries its range coder state over to the next frame unless every frame
+        // is a keyframe.
+        bool IsFrameParallelEncoder(const AVCodec* codec, const AVCodecContext* context) {
+            const AVCodecDescriptor* descriptor = avcodec_descriptor_get(codec->id);
+            if (!descriptor || !(descriptor->props & AV_CODEC_PROP_INTRA_ONLY) ||
+                (codec->capabilities & AV_CODEC_CAP_DELAY)) {
+                return false;
+            }
+            return codec->id != AV_CODEC_ID_FFV1 || context->gop_size == 1;
+        }
+
+        // The matrix RGB frames are converted to YUV with. Untagged output keeps swscale's default, BT.601 limited
+        // range; presets that set colorspace and color_range get what they set.
+        int ConversionColorSpace(const AVCodecContext* context) {
+            return context->colorspace == AVCOL_SPC_UNSPECIFIED ? AVCOL_SPC_BT470BG : context->colorspace;
+        }
+
+        // Reads the reserved gap back: it starts out zero, and the mp4 muxer follows it with an 8-byte free box and
+        // the mdat header. The rewrite at the trailer relies on that, and on being able to reread the file.
+        bool HasExpectedMoovGap(AVFormatContext* formatContext, int64_t pos, int64_t bytes) {
+            if (!formatContext->pb || !(formatContext->pb->seekable & AVIO_SEEKABLE_NORMAL)) {
+                return false;
+            }
+            avio_flush(formatContext->pb);
+            // Through io_open, which has the output writer write out what it holds first.
+            AVIOContext* reader = nullptr;
+            if (formatContext->io_open(formatContext, &reader, formatContext->url, AVIO_FLAG_READ, nullptr) < 0) {
+                return false;
+            }
+            unsigned char start[8] = {};
+            unsigned char end[16] = {};
+            const bool read = avio_seek(reader, pos, SEEK_SET) == pos && avio_read(reader, start, 8) == 8 &&
+                avio_seek(reader, pos + bytes, SEEK_SET) == pos + bytes && avio_read(reader, end, 16) == 16;
+            avio_closep(&reader);
+
+            static const unsigned char zeros[8] = {};
+            static const unsigned char freeBox[8] = {0, 0, 0, 8, 'f', 'r', 'e', 'e'};
+            return read && memcmp(start, zeros, 8) == 0 && memcmp(end, freeBox, 8) == 0 &&
+                memcmp(end + 12, "mdat", 4) == 0;
+        }
+    }
 
-    FFmpegEncoder::FFmpegEncoder() {
+    FFmpegEncoder::FFmpegEncoder()
+        : muxQueue_(kMuxQueueCapacity),
+          videoEncodeQueue_(kVideoEncodeQueueDepth),
+          videoFilterQueue_(kVideoFilterQueueDepth),
+          segmentFinalizeQueue_(kSegmentFinalizeQueueCapacity) {
         PRE();
         LOG(LL_NFO, "FFmpegEncoder: Constructor called");
         
@@ -51,6 +126,9 @@ namespace Encoder {
     FFmpegEncoder::~FFmpegEncoder() {
         PRE();
         LOG(LL_NFO, "FFmpegEncoder: Destructor called");
+        StopVideoEncodeStage();
+        chunkedVideoEncoder_.close();
+        StopMuxer();
         Cleanup();
         POST();
     }
@@ -108,7 +186,23 @@ namespace Encoder {
             LOG(LL_DBG, "FFmpegEncoder::Open - Audio channels: ", info_.audio.numberChannels);
         }
         
-        std::string filename = utf8_encode(outputFilename_);
+        // Rotation happens at video keyframes, so audio-only exports always go to a single file.
+        segmenting_ = info_.video.enabled && (segmentPolicy_.minutes > 0 || segmentPolicy_.sizeMb > 0);
+        segmentIndex_ = 1;
+        segmentPackets_ = 0;
+        segmentPacketBytes_ = 0;
+        segmentStartDts_ = AV_NOPTS_VALUE;
+        segmentTimestampOffset_ = 0;
+        closingSegment_ = nullptr;
+        closingSegmentOffset_ = 0;
+        finishedSegments_.clear();
+        faststartRewrites_ = 0;
+        if (segmenting_) {
+            LOG(LL_NFO, "FFmpegEncoder::Open - Starting a new file every ", segmentPolicy_.minutes, " minutes / ",
+                segmentPolicy_.sizeMb, " MB (0 = no limit)");
+        }
+
+        std::string filename = utf8_encode(segmenting_ ? SegmentFilename(segmentIndex_) : outputFilename_);
         std::string formatName = config_.format.container;
         
         LOG(LL_DBG, "FFmpegEncoder::Open - Allocating output context for format: ", formatName);
@@ -147,40 +241,75 @@ namespace Encoder {
             LOG(LL_DBG, "FFmpegEncoder::Open - Audio encoder initialized successfully");
         }
         
-        if (!(formatContext_->oformat->flags & AVFMT_NOFILE)) {
-            LOG(LL_DBG, "FFmpegEncoder::Open - Opening output file: ", filename);
-            ret = avio_open(&formatContext_->pb, filename.c_str(), AVIO_FLAG_WRITE);
-            if (ret < 0) {
-                LOG(LL_ERR, "FFmpegEncoder::Open - Failed to open output file, error code: ", ret);
-                Cleanup();
-                POST();
-                return E_FAIL;
-            }
-            LOG(LL_DBG, "FFmpegEncoder::Open - Output file opened successfully");
-        }
-        
-        AVDictionary* muxerOpts = nullptr;
-        if (config_.format.faststart && std::string(config_.format.container) == "mp4") {
-            LOG(LL_DBG, "FFmpegEncoder::Open - Setting faststart option for MP4");
-            av_dict_set(&muxerOpts, "movflags", "faststart", 0);
-        }
-        
-        LOG(LL_DBG, "FFmpegEncoder::Open - Writing file header");
-        ret = avformat_write_header(formatContext_, &muxerOpts);
-        av_dict_free(&muxerOpts);
-        if (ret < 0) {
-            LOG(LL_ERR, "FFmpegEncoder::Open - Failed to write file header, error code: ", ret);
+        if (FAILED(OpenOutputFile(formatContext_, filename))) {
             Cleanup();
             POST();
             return E_FAIL;
         }
+        if (reservedMoov_.layoutChecked) {
+            LogReservedMoovCoverage();
+        }
         
-        LOG(LL_NFO, "FFmpegEncoder::Open - File header written successfully");
         LOG(LL_DBG, "FFmpegEncoder::Open - Encoder opened and ready for encoding");
         
         isOpen_ = true;
         videoPts_ = 0;
         audioPts_ = 0;
+        videoFilterFused_ = false;
+        videoColorAdjustment_ = ColorAdjustment();
+        videoGraphColorAdjuster_.reset();
+
+        videoConvertLatency_.reset();
+        videoFilterLatency_.reset();
+        videoSendFrameLatency_.reset();
+        videoReceivePacketLatency_.reset();
+        audioSendFrameLatency_.reset();
+        audioReceivePacketLatency_.reset();
+        muxWriteLatency_.reset();
+
+        if (segmenting_) {
+            try {
+                segmentFinalizeThread_ = std::thread(&FFmpegEncoder::SegmentFinalizeLoop, this);
+            } catch (const std::exception& ex) {
+                LOG(LL_ERR, "FFmpegEncoder::Open - Failed to start segment finalizer thread: ", ex.what());
+                Cleanup();
+                isOpen_ = false;
+                POST();
+                return E_FAIL;
+            }
+        }
+
+        if (FAILED(StartMuxer())) {
+            Cleanup();
+            isOpen_ = false;
+            POST();
+            return E_FAIL;
+        }
+
+        if (videoChunkTemplate_) {
+            const double fps = videoCodecContext_->framerate.num > 0 && videoCodecContext_->framerate.den > 0
+                ? av_q2d(videoCodecContext_->framerate) : 30.0;
+            const uint32_t chunkFrames = static_cast<uint32_t>(
+                (std::max)(1.0, std::round(fps * (std::max)(threadingPolicy_.chunkSeconds, 1u))));
+            if (FAILED(chunkedVideoEncoder_.open(
+                    videoEncoderInstances_, videoFrameParallel_ ? 1 : chunkFrames, [this] { return CreateChunkEncoder(); },
+                    [this](AVPacket* packet) { return QueuePacket(packet, videoStream_); }, &videoFramePool_,
+                    videoFrameParallel_))) {
+                StopMuxer();
+                Cleanup();
+                isOpen_ = false;
+                POST();
+                return E_FAIL;
+            }
+        }
+
+        if (videoCodecContext_ && FAILED(StartVideoEncodeStage())) {
+            StopMuxer();
+            Cleanup();
+            isOpen_ = false;
+            POST();
+            return E_FAIL;
+        }
         
         POST();
         return S_OK;
@@ -235,6 +364,34 @@ namespace Encoder {
             return hr;
         }
         
+        // How many instances share the video decides how many threads each of them gets.
+        videoFrameParallel_ = false;
+        videoEncoderInstances_ = 1;
+        if (isHardwareEncoder(codec->name)) {
+            if (threadingPolicy_.parallelEncoders > 1) {
+                LOG(LL_WRN, "FFmpegEncoder::InitializeVideoEncoder - ", codec->name,
+                    " is a hardware encoder, encoding in a single instance");
+            }
+        } else if (IsFrameParallelEncoder(codec, videoCodecContext_) &&
+                   (threadingPolicy_.automatic || threadingPolicy_.parallelEncoders > 1)) {
+            videoFrameParallel_ = true;
+            EncoderThreadingPolicy singleInstance = threadingPolicy_;
+            singleInstance.parallelEncoders = 1;
+            videoEncoderInstances_ = threadingPolicy_.parallelEncoders > 1
+                ? threadingPolicy_.parallelEncoders
+                : (std::min)(planEncoderThreading(codec->name, videoCodecContext_->width, videoCodecContext_->height,
+                                                  singleInstance, std::thread::hardware_concurrency()).encoderCores,
+                             kMaxFrameParallelEncoders);
+            // The instances take the place of frame threads, which would hold packets back inside each of them.
+            videoCodecContext_->thread_type = FF_THREAD_SLICE;
+            LOG(LL_NFO, "FFmpegEncoder::InitializeVideoEncoder - ", codec->name, " is intra-only, encoding frames on ",
+                videoEncoderInstances_, " encoder instances");
+        } else if (threadingPolicy_.parallelEncoders > 1) {
+            videoEncoderInstances_ = threadingPolicy_.parallelEncoders;
+        }
+
+        ApplyEncoderThreading(codec);
+
         // If pixel format not set, use a default
         if (videoCodecContext_->pix_fmt == AV_PIX_FMT_NONE) {
             LOG(LL_WRN, "FFmpegEncoder::InitializeVideoEncoder - Pixel format not set, using default");
@@ -275,6 +432,16 @@ namespace Encoder {
             videoCodecContext_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
         }
         
+        if (videoEncoderInstances_ > 1) {
+            // Opening fills in fields the codec derives from the options, so copy the settings as they are now.
+            videoChunkTemplate_ = avcodec_alloc_context3(codec);
+            if (!videoChunkTemplate_ || FAILED(CopyVideoCodecSettings(videoChunkTemplate_, videoCodecContext_))) {
+                LOG(LL_ERR, "FFmpegEncoder::InitializeVideoEncoder - Failed to copy settings for the chunk encoders");
+                POST();
+                return E_FAIL;
+            }
+        }
+
         LOG(LL_DBG, "FFmpegEncoder::InitializeVideoEncoder - About to open codec with:");
         LOG(LL_DBG, "  Codec: ", codec->name);
         LOG(LL_DBG, "  Resolution: ", videoCodecContext_->width, "x", videoCodecContext_->height);
@@ -320,6 +487,11 @@ namespace Encoder {
         }
         
         videoStream_->time_base = videoCodecContext_->time_base;
+
+        if (videoChunkTemplate_ && FAILED(ProbeChunkEncoder())) {
+            POST();
+            return E_FAIL;
+        }
         
         LOG(LL_DBG, "FFmpegEncoder::InitializeVideoEncoder - Allocating video frame");
         videoFrame_ = av_frame_alloc();
@@ -334,6 +506,9 @@ namespace Encoder {
         videoFrame_->height = videoCodecContext_->height;
         
         LOG(LL_DBG, "FFmpegEncoder::InitializeVideoEncoder - Video frame allocated");
+
+        // Not fatal: an unpooled format falls back to per-frame buffers.
+        videoFramePool_.initializeVideo(videoCodecContext_->pix_fmt, videoCodecContext_->width, videoCodecContext_->height);
         LOG(LL_NFO, "FFmpegEncoder::InitializeVideoEncoder - Video encoder initialization complete");
         
         POST();
@@ -469,6 +644,20 @@ namespace Encoder {
         return E_FAIL;
     }
 
+    {
+        int poolChannels = 0;
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+        poolChannels = audioCodecContext_->ch_layout.nb_channels;
+#else
+        poolChannels = audioCodecContext_->channels;
+#endif
+        if (FAILED(audioFramePool_.initializeAudio(audioCodecContext_->sample_fmt, poolChannels, (std::max)(initialNbSamples, 4096)))) {
+            LOG(LL_ERR, "FFmpegEncoder::InitializeAudioEncoder - Failed to create audio frame pool");
+            POST();
+            return E_FAIL;
+        }
+    }
+
     int fifoChannels = 0;
 #if LIBAVUTIL_VERSION_MAJOR >= 57
     fifoChannels = audioCodecContext_->ch_layout.nb_channels;
@@ -489,7 +678,7 @@ namespace Encoder {
         return S_OK;
     }
 
-    HRESULT FFmpegEncoder::InitializeVideoFilterGraph(int inputPixFmtInt, int inputWidth, int inputHeight) {
+    HRESULT FFmpegEncoder::InitializeVideoFilterGraph(const char* filters, int inputPixFmtInt, int inputWidth, int inputHeight) {
         PRE();
         LOG(LL_DBG, "FFmpegEncoder::InitializeVideoFilterGraph - Initializing video filter graph");
 
@@ -511,6 +700,37 @@ namespace Encoder {
             return E_FAIL;
         }
 
+        // Must be set before the first filter is created; filters that support slice threading (hqdn3d, yadif,
+        // deband, ...) then split each frame across the graph's threads.
+        videoFilterGraph_->nb_threads = videoFilterThreads_;
+        videoFilterGraph_->thread_type = AVFILTER_THREAD_SLICE;
+
+        // Scalers the graph inserts to reach the sink format use the matrix the stream is tagged with too; untagged
+        // streams keep swscale's BT.601 default, as ConversionColorSpace does.
+        const char* scaleMatrix = nullptr;
+        switch (videoCodecContext_->colorspace) {
+        case AVCOL_SPC_BT709:
+            scaleMatrix = "bt709";
+            break;
+        case AVCOL_SPC_BT470BG:
+            scaleMatrix = "bt601";
+            break;
+        case AVCOL_SPC_SMPTE170M:
+            scaleMatrix = "smpte170m";
+            break;
+        case AVCOL_SPC_BT2020_NCL:
+            scaleMatrix = "bt2020";
+            break;
+        default:
+            break;
+        }
+        if (scaleMatrix) {
+            char scaleOptions[128];
+            snprintf(scaleOptions, sizeof(scaleOptions), "out_color_matrix=%s:out_range=%s", scaleMatrix,
+                videoCodecContext_->color_range == AVCOL_RANGE_JPEG ? "pc" : "tv");
+            videoFilterGraph_->scale_sws_opts = av_strdup(scaleOptions);
+        }
+
         char args[512];
         snprintf(args, sizeof(args),
             "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=1/1",
@@ -582,7 +802,7 @@ namespace Encoder {
         inputs->pad_idx     = 0;
         inputs->next        = nullptr;
 
-        ret = avfilter_graph_parse_ptr(videoFilterGraph_, config_.video.filters,
+        ret = avfilter_graph_parse_ptr(videoFilterGraph_, filters,
             &inputs, &outputs, nullptr);
         avfilter_inout_free(&inputs);
         avfilter_inout_free(&outputs);
@@ -628,7 +848,20 @@ namespace Encoder {
             return E_FAIL;
         }
 
-        LOG(LL_NFO, "FFmpegEncoder::InitializeVideoFilterGraph - Video filter graph initialized successfully");
+        // Not fatal: unpooled input frames fall back to av_frame_get_buffer.
+        videoFilterInputPool_.initializeVideo(static_cast<int>(inputPixFmt), inputWidth, inputHeight);
+
+        if (FAILED(StartVideoFilterStage())) {
+            avfilter_graph_free(&videoFilterGraph_);
+            videoFilterGraph_ = nullptr;
+            videoBufferSrcCtx_ = nullptr;
+            videoBufferSinkCtx_ = nullptr;
+            POST();
+            return E_FAIL;
+        }
+
+        LOG(LL_NFO, "FFmpegEncoder::InitializeVideoFilterGraph - Video filter graph initialized successfully, threads: ",
+            videoFilterThreads_ > 0 ? std::to_string(videoFilterThreads_) : std::string("auto"));
         POST();
         return S_OK;
     }
@@ -920,7 +1153,15 @@ namespace Encoder {
             
             LOG(LL_DBG, "FFmpegEncoder::ParseEncoderOptions - Setting option: ", key, " = ", value);
             
-            if (key == "_pixelFormat" || key == "_pixel_format") {
+            if (key == "_filterThreads") {
+                try {
+                    videoFilterThreads_ = std::clamp(std::stoi(value), 0, 64);
+                    LOG(LL_DBG, "FFmpegEncoder::ParseEncoderOptions - Set video filter threads: ", videoFilterThreads_);
+                    optionCount++;
+                } catch (const std::exception&) {
+                    LOG(LL_WRN, "FFmpegEncoder::ParseEncoderOptions - Invalid filter thread count: ", value);
+                }
+            } else if (key == "_pixelFormat" || key == "_pixel_format") {
                 AVPixelFormat pix_fmt = av_get_pix_fmt(value.c_str());
                 if (pix_fmt != AV_PIX_FMT_NONE) {
                     codecContext->pix_fmt = pix_fmt;
@@ -1014,229 +1255,1016 @@ namespace Encoder {
         return S_OK;
     }
 
-    HRESULT FFmpegEncoder::SendVideoFrame(const FFmpeg::FFVIDEOFRAME& frame) {
+    void FFmpegEncoder::ApplyEncoderThreading(const AVCodec* codec) {
         PRE();
-        LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame called - PTS: ", videoPts_);
-        
-        std::lock_guard<std::mutex> lock(encoderMutex_);
-        
-        if (!isOpen_ || !videoCodecContext_) {
-            LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Encoder not open or video not enabled");
-            POST();
-            return E_FAIL;
-        }
-        
-        LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame - Frame size: ", frame.width, "x", frame.height, ", planes: ", frame.planes);
-        
-        if (!packet_) {
-            packet_ = av_packet_alloc();
-            if (!packet_) {
-                LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to allocate packet");
-                POST();
-                return E_FAIL;
-            }
-        }
-        
-        AVFrame* inputFrame = av_frame_alloc();
-        if (!inputFrame) {
-            LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to allocate input frame");
-            POST();
-            return E_FAIL;
-        }
-        
-        inputFrame->width = frame.width;
-        inputFrame->height = frame.height;
-        inputFrame->pts = videoPts_++;
-        
-        AVPixelFormat inputPixelFormat = AV_PIX_FMT_NONE;
-        std::string formatStr(frame.format);
-        if (formatStr == "rgba") {
-            inputPixelFormat = AV_PIX_FMT_RGBA;
-        } else if (formatStr == "rgb") {
-            inputPixelFormat = AV_PIX_FMT_RGB24;
-        } else if (formatStr == "bgra") {
-            inputPixelFormat = AV_PIX_FMT_BGRA;
-        } else {
-            inputPixelFormat = av_get_pix_fmt(frame.format);
-        }
-        
-        if (inputPixelFormat == AV_PIX_FMT_NONE) {
-            LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Unknown pixel format: ", frame.format);
-            av_frame_free(&inputFrame);
+
+        if (!threadingPolicy_.automatic) {
+            LOG(LL_NFO, "Encoder threading: automatic mode off, using the preset's options as given");
             POST();
-            return E_FAIL;
-        }
-        
-        inputFrame->format = inputPixelFormat;
-        
-        LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame - Input pixel format: ", av_get_pix_fmt_name(inputPixelFormat));
-        LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame - Output pixel format: ", av_get_pix_fmt_name(videoCodecContext_->pix_fmt));
-        
-        for (int i = 0; i < frame.planes; i++) {
-            inputFrame->data[i] = frame.buffer[i];
-            inputFrame->linesize[i] = frame.rowsize[i];
+            return;
         }
 
-        if (strlen(config_.video.filters) > 0 && !videoFilterGraph_) {
-            LOG(LL_DBG, "FFmpegEncoder::SendVideoFrame - Initializing video filter graph");
-            HRESULT fghr = InitializeVideoFilterGraph(static_cast<int>(inputPixelFormat), frame.width, frame.height);
-            if (FAILED(fghr)) {
-                LOG(LL_WRN, "FFmpegEncoder::SendVideoFrame - Video filter graph init failed, falling back to SWS path");
+        EncoderThreadingPolicy policy = threadingPolicy_;
+        policy.parallelEncoders = videoEncoderInstances_;
+        const EncoderThreadingPlan plan = planEncoderThreading(codec->name, videoCodecContext_->width,
+                                                               videoCodecContext_->height, policy,
+                                                               std::thread::hardware_concurrency());
+        if (plan.hardware) {
+            LOG(LL_NFO, "Encoder threading: ", codec->name, " is a hardware encoder, leaving threading to the driver");
+            POST();
+            return;
+        }
+
+        const std::string presetOptions(config_.video.options);
+        const bool threadedCodec =
+            (codec->capabilities & (AV_CODEC_CAP_FRAME_THREADS | AV_CODEC_CAP_SLICE_THREADS | AV_CODEC_CAP_OTHER_THREADS)) != 0;
+
+        std::string applied;
+        for (const auto& [key, planned] : plan.options) {
+            std::string value = planned;
+            std::string presetValue;
+            if (key == "x265-params") {
+                // The preset's x265-params (keyint, level) are already set; keep them and add only what they leave unset.
+                if (findEncoderOption(presetOptions, key, presetValue)) {
+                    value = presetValue;
+                    std::istringstream params(planned);
+                    std::string param;
+                    while (std::getline(params, param, ':')) {
+                        std::string ignored;
+                        if (!findEncoderOption(presetValue, param.substr(0, param.find('=')), ignored, ':')) {
+                            value += ":" + param;
+                        }
+                    }
+                }
+            } else if (findEncoderOption(presetOptions, key, presetValue)) {
+                LOG(LL_DBG, "FFmpegEncoder::ApplyEncoderThreading - Preset sets ", key, " = ", presetValue, ", keeping it");
+                continue;
+            } else if (key == "threads" && !threadedCodec) {
+                continue;
             }
-        }
-
-        if (videoFilterGraph_) {
-            LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame - Using filter graph path");
 
-            int ret = av_buffersrc_add_frame_flags(videoBufferSrcCtx_, inputFrame, AV_BUFFERSRC_FLAG_KEEP_REF);
+            int ret = av_opt_set(videoCodecContext_->priv_data, key.c_str(), value.c_str(), 0);
+            if (ret < 0) {
+                ret = av_opt_set(videoCodecContext_, key.c_str(), value.c_str(), 0);
+            }
             if (ret < 0) {
                 char errbuf[256];
                 av_strerror(ret, errbuf, sizeof(errbuf));
-                LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to push frame into filter graph: ", errbuf);
-                av_frame_free(&inputFrame);
-                POST();
-                return E_FAIL;
+                LOG(LL_WRN, "FFmpegEncoder::ApplyEncoderThreading - Failed to set option '", key, "' to '", value, "' (", errbuf, ")");
+                continue;
             }
+            applied += " " + key + "=" + value;
+        }
 
-            while (true) {
-                AVFrame* filteredFrame = av_frame_alloc();
-                if (!filteredFrame) {
-                    LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to allocate filtered frame");
-                    av_frame_free(&inputFrame);
-                    POST();
-                    return E_FAIL;
-                }
-
-                ret = av_buffersink_get_frame(videoBufferSinkCtx_, filteredFrame);
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                    av_frame_free(&filteredFrame);
-                    break;
-                }
-                if (ret < 0) {
-                    char errbuf[256];
-                    av_strerror(ret, errbuf, sizeof(errbuf));
-                    LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to get frame from filter graph: ", errbuf);
-                    av_frame_free(&filteredFrame);
-                    av_frame_free(&inputFrame);
-                    POST();
-                    return E_FAIL;
-                }
+        LOG(LL_NFO, "Encoder threading: ", codec->name, " ", videoCodecContext_->width, "x", videoCodecContext_->height,
+            " cores=", plan.cores, " reserved=", threadingPolicy_.reservedCores, " encoderCores=", plan.encoderCores,
+            plan.instances > 1 ? " instances=" + std::to_string(plan.instances) : std::string(),
+            applied.empty() ? std::string(" (preset sets everything)") : applied);
+        POST();
+    }
 
-                HRESULT hr = EncodeVideoFrame(filteredFrame);
-                av_frame_free(&filteredFrame);
+    HRESULT FFmpegEncoder::ProbeChunkEncoder() {
+        // Opened here rather than for the first chunk, so an encoder whose headers differ between instances is
+        // found while videoCodecContext_ can still take over.
+        AVCodecContext* probe = CreateChunkEncoder();
+        if (!probe) {
+            LOG(LL_WRN, "FFmpegEncoder::ProbeChunkEncoder - Chunk encoders cannot share the stream's headers, "
+                "encoding in a single instance");
+            avcodec_free_context(&videoChunkTemplate_);
+            videoEncoderInstances_ = 1;
+            videoFrameParallel_ = false;
+            return S_OK;
+        }
 
-                if (FAILED(hr)) {
-                    LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to encode filtered frame");
-                    av_frame_free(&inputFrame);
-                    POST();
-                    return hr;
-                }
-            }
+        // The opened context would sit idle with its threads and buffers; an unopened one describes the stream.
+        AVCodecContext* settings = avcodec_alloc_context3(videoChunkTemplate_->codec);
+        if (!settings || FAILED(CopyVideoCodecSettings(settings, videoChunkTemplate_))) {
+            LOG(LL_ERR, "FFmpegEncoder::ProbeChunkEncoder - Failed to copy the video codec settings");
+            avcodec_free_context(&settings);
+            avcodec_free_context(&probe);
+            return E_FAIL;
+        }
+        avcodec_free_context(&videoCodecContext_);
+        videoCodecContext_ = settings;
+        videoChunkProbe_ = probe;
+        return S_OK;
+    }
 
-            av_frame_free(&inputFrame);
-        } else {
-            AVFrame* frameToEncode = inputFrame;
-            AVFrame* convertedFrame = nullptr;
+    AVCodecContext* FFmpegEncoder::CreateChunkEncoder() {
+        if (AVCodecContext* probe = videoChunkProbe_.exchange(nullptr)) {
+            return probe;
+        }
 
-            if (inputPixelFormat != videoCodecContext_->pix_fmt) {
-                LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame - Pixel format conversion required");
+        AVCodecContext* context = avcodec_alloc_context3(videoChunkTemplate_->codec);
+        if (!context || FAILED(CopyVideoCodecSettings(context, videoChunkTemplate_))) {
+            LOG(LL_ERR, "FFmpegEncoder::CreateChunkEncoder - Failed to set up a chunk encoder");
+            avcodec_free_context(&context);
+            return nullptr;
+        }
 
-                if (!swsContext_) {
-                    LOG(LL_DBG, "FFmpegEncoder::SendVideoFrame - Creating SWS context for pixel format conversion");
-                    swsContext_ = sws_getContext(
-                        frame.width, frame.height, inputPixelFormat,
-                        videoCodecContext_->width, videoCodecContext_->height, videoCodecContext_->pix_fmt,
-                        swsFlags_, nullptr, nullptr, nullptr);
+        int ret = avcodec_open2(context, videoChunkTemplate_->codec, nullptr);
+        if (ret < 0) {
+            LOG(LL_ERR, "FFmpegEncoder::CreateChunkEncoder - Failed to open a chunk encoder, error code: ", ret);
+            avcodec_free_context(&context);
+            return nullptr;
+        }
 
-                    if (!swsContext_) {
-                        LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to create SWS context");
-                        av_frame_free(&inputFrame);
-                        POST();
-                        return E_FAIL;
-                    }
-                }
+        // The stream carries the headers videoCodecContext_ was opened with, so every chunk must produce the same ones.
+        const AVCodecParameters* stream = videoStream_->codecpar;
+        if (context->extradata_size != stream->extradata_size ||
+            (context->extradata_size > 0 &&
+             memcmp(context->extradata, stream->extradata, context->extradata_size) != 0)) {
+            LOG(LL_ERR, "FFmpegEncoder::CreateChunkEncoder - Chunk encoder headers differ from the stream's");
+            avcodec_free_context(&context);
+            return nullptr;
+        }
+        return context;
+    }
 
-                convertedFrame = av_frame_alloc();
-                if (!convertedFrame) {
-                    LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to allocate converted frame");
-                    av_frame_free(&inputFrame);
-                    POST();
-                    return E_FAIL;
-                }
+    int64_t FFmpegEncoder::EstimateBitRate() const {
+        int64_t bitRate = 0;
+        if (videoCodecContext_) {
+            bitRate += (std::max)(videoCodecContext_->bit_rate, videoCodecContext_->rc_max_rate);
+        }
+        if (audioCodecContext_) {
+            bitRate += audioCodecContext_->bit_rate;
+        }
+        return bitRate;
+    }
 
-                convertedFrame->width = videoCodecContext_->width;
-                convertedFrame->height = videoCodecContext_->height;
-                convertedFrame->format = videoCodecContext_->pix_fmt;
-                convertedFrame->pts = inputFrame->pts;
+    Mp4IndexCounts FFmpegEncoder::ProjectIndexCounts(double seconds) const {
+        Mp4IndexCounts counts;
+        if (videoCodecContext_ && videoCodecContext_->framerate.num > 0 && videoCodecContext_->framerate.den > 0) {
+            counts.videoSamples = static_cast<int64_t>(av_q2d(videoCodecContext_->framerate) * seconds);
+            counts.keyframes = videoCodecContext_->gop_size > 0
+                ? counts.videoSamples / videoCodecContext_->gop_size + 1
+                : counts.videoSamples;
+            // Reordered frames change pts - dts from one frame to the next; libx264 leaves max_b_frames at -1.
+            counts.offsetRuns = videoCodecContext_->max_b_frames != 0 || videoCodecContext_->has_b_frames > 0
+                ? counts.videoSamples
+                : 1;
+            // Each skipped frame breaks the run of equal durations; allow one a second.
+            counts.durationRuns = static_cast<int64_t>(seconds);
+        }
+        if (audioCodecContext_) {
+            const int frameSize = audioCodecContext_->frame_size > 0 ? audioCodecContext_->frame_size : 1024;
+            counts.audioSamples = static_cast<int64_t>(audioCodecContext_->sample_rate * seconds / frameSize);
+            ++counts.durationRuns;
+        }
 
-                int ret = av_frame_get_buffer(convertedFrame, 0);
-                if (ret < 0) {
-                    LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to allocate converted frame buffer, error code: ", ret);
-                    av_frame_free(&inputFrame);
-                    av_frame_free(&convertedFrame);
-                    POST();
-                    return E_FAIL;
-                }
+        // Without a target rate, assume every video sample may fill a chunk of its own.
+        const int64_t bitRate = EstimateBitRate();
+        counts.bytes = bitRate > 0 ? static_cast<int64_t>(bitRate / 8.0 * seconds)
+                                   : counts.videoSamples * kMp4MaxChunkBytes;
+        return counts;
+    }
 
-                ret = sws_scale(swsContext_, inputFrame->data, inputFrame->linesize, 0, frame.height,
-                               convertedFrame->data, convertedFrame->linesize);
+    int64_t FFmpegEncoder::EstimateReservedMoovBytes() const {
+        // A time-limited segment runs at most one GOP past its limit, which the extra minute covers.
+        uint32_t minutes = faststartReserveMinutes_;
+        if (segmenting_ && segmentPolicy_.minutes > 0) {
+            minutes = (std::min)(minutes, segmentPolicy_.minutes + 1);
+        }
+        // moov_size is an int option.
+        return (std::min)(estimateMp4IndexBytes(ProjectIndexCounts(60.0 * minutes)), static_cast<int64_t>(INT32_MAX));
+    }
 
-                if (ret < 0) {
-                    LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Pixel format conversion failed, error code: ", ret);
-                    av_frame_free(&inputFrame);
-                    av_frame_free(&convertedFrame);
-                    POST();
-                    return E_FAIL;
-                }
+    void FFmpegEncoder::LogReservedMoovCoverage() const {
+        // Segments cut by time alone are covered by construction.
+        if (segmenting_ && segmentPolicy_.minutes > 0 && segmentPolicy_.minutes < faststartReserveMinutes_) {
+            return;
+        }
 
-                LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame - Pixel format conversion completed");
-                frameToEncode = convertedFrame;
+        const int64_t bitRate = EstimateBitRate();
+        if (segmenting_ && segmentPolicy_.sizeMb > 0 && bitRate > 0) {
+            const double seconds = static_cast<double>(segmentPolicy_.sizeMb) * 1024 * 1024 * 8 / bitRate;
+            if (estimateMp4IndexBytes(ProjectIndexCounts(seconds)) > reservedMoov_.bytes) {
+                LOG(LL_WRN, "FFmpegEncoder::Open - ", segmentPolicy_.sizeMb, " MB segments run about ",
+                    static_cast<int>(seconds / 60.0), " minutes, longer than the ", faststartReserveMinutes_,
+                    " minutes the MP4 index is reserved for; each will be rewritten when it is finished");
             }
+            return;
+        }
+        LOG(LL_NFO, "FFmpegEncoder::Open - The reserved MP4 index covers ", faststartReserveMinutes_,
+            " minutes; a longer file is rewritten when it is finished, which takes time in proportion to its size");
+    }
 
-            HRESULT hr = EncodeVideoFrame(frameToEncode);
-
-            av_frame_free(&inputFrame);
-            if (convertedFrame) {
-                av_frame_free(&convertedFrame);
+    HRESULT FFmpegEncoder::OpenOutputFile(AVFormatContext* formatContext, const std::string& filename) {
+        PRE();
+        int ret = 0;
+        if (!(formatContext->oformat->flags & AVFMT_NOFILE)) {
+            LOG(LL_DBG, "FFmpegEncoder::OpenOutputFile - Opening output file: ", filename);
+            if (outputBufferBytes_ > 0) {
+                outputWriter_ = std::make_unique<AsyncOutputWriter>();
+                ret = SUCCEEDED(outputWriter_->open(filename, outputBufferBytes_)) ? 0 : AVERROR(EIO);
+                if (ret == 0) {
+                    outputWriter_->attach(formatContext);
+                }
+            } else {
+                outputWriter_.reset();
+                ret = avio_open(&formatContext->pb, filename.c_str(), AVIO_FLAG_WRITE);
             }
-
-            if (FAILED(hr)) {
-                LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to encode video frame");
+            if (ret < 0) {
+                LOG(LL_ERR, "FFmpegEncoder::OpenOutputFile - Failed to open output file, error code: ", ret);
                 POST();
-                return hr;
+                return E_FAIL;
             }
+            LOG(LL_DBG, "FFmpegEncoder::OpenOutputFile - Output file opened successfully");
         }
-
-        LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame - Frame encoded successfully");
-
-        POST();
-        return S_OK;
-    }
-
-    HRESULT FFmpegEncoder::SendAudioSampleChunk(const FFmpeg::FFAUDIOCHUNK& chunk) {
-        PRE();
-        LOG(LL_TRC, "FFmpegEncoder::SendAudioSampleChunk called - Samples: ", chunk.samples, ", PTS: ", audioPts_);
-        
-        std::lock_guard<std::mutex> lock(encoderMutex_);
         
-        if (!isOpen_ || !audioCodecContext_) {
-            LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Encoder not open or audio not enabled");
-            POST();
-            return E_FAIL;
-        }
+        AVDictionary* muxerOpts = nullptr;
+        reservedMoov_ = ReservedMoov();
+        fileIndexCounter_ = Mp4IndexCounter();
+        reservedMoovOutgrown_ = false;
+        if (config_.format.faststart && std::string(config_.format.container) == "mp4") {
+            switch (faststartMode_) {
+            case FFmpeg::FaststartFragmented:
+                LOG(LL_NFO, "FFmpegEncoder::OpenOutputFile - Writing fragmented MP4 for faststart");
+                av_dict_set(&muxerOpts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+                break;
+            case FFmpeg::FaststartReserve:
+                reservedMoov_.bytes = EstimateReservedMoovBytes();
+                LOG(LL_NFO, "FFmpegEncoder::OpenOutputFile - Reserving ", reservedMoov_.bytes, " bytes for the MP4 index");
+                av_dict_set_int(&muxerOpts, "moov_size", reservedMoov_.bytes, 0);
+                break;
+            default:
+                LOG(LL_DBG, "FFmpegEncoder::OpenOutputFile - Setting faststart option for MP4");
+                av_dict_set(&muxerOpts, "movflags", "faststart", 0);
+                break;
+            }
+        }
+        
+        LOG(LL_DBG, "FFmpegEncoder::OpenOutputFile - Writing file header");
+        ret = avformat_write_header(formatContext, &muxerOpts);
+        av_dict_free(&muxerOpts);
+        if (ret < 0) {
+            LOG(LL_ERR, "FFmpegEncoder::OpenOutputFile - Failed to write file header, error code: ", ret);
+            POST();
+            return E_FAIL;
+        }
+        
+        LOG(LL_NFO, "FFmpegEncoder::OpenOutputFile - File header written successfully");
+        if (reservedMoov_.bytes > 0) {
+            reservedMoov_.pos = avio_tell(formatContext->pb) - kMdatHeaderBytes - reservedMoov_.bytes;
+            reservedMoov_.layoutChecked = HasExpectedMoovGap(formatContext, reservedMoov_.pos, reservedMoov_.bytes);
+            if (!reservedMoov_.layoutChecked) {
+                LOG(LL_WRN, "FFmpegEncoder::OpenOutputFile - The reserved MP4 index is not where expected; a file "
+                    "that outgrows it cannot be rewritten");
+            }
+        }
+        POST();
+        return S_OK;
+    }
+
+    HRESULT FFmpegEncoder::WriteTrailer(AVFormatContext* formatContext, const ReservedMoov& reservedMoov,
+                                        const Mp4IndexCounts& index) {
+        PRE();
+        // The muxer writes a too-large index over the start of the media data, so check the bound first and fall
+        // back to the rewrite: the index goes in front of the gap and everything after it is shifted along.
+        const int64_t indexBytes = estimateMp4IndexBytes(index);
+        if (reservedMoov.bytes > 0 && indexBytes > reservedMoov.bytes && !reservedMoov.layoutChecked) {
+            LOG(LL_ERR, "FFmpegEncoder::WriteTrailer - An index of up to ", indexBytes, " bytes may not fit the ",
+                reservedMoov.bytes, " reserved, and the file cannot be rewritten; writing the trailer as is");
+        } else if (reservedMoov.bytes > 0 && indexBytes > reservedMoov.bytes) {
+            LOG(LL_WRN, "FFmpegEncoder::WriteTrailer - An index of up to ", indexBytes, " bytes may not fit the ",
+                reservedMoov.bytes, " reserved, rewriting the file to put it first");
+            // Labelled a free box before the shift, so readers step over the gap wherever it ends up.
+            const int64_t end = avio_tell(formatContext->pb);
+            avio_seek(formatContext->pb, reservedMoov.pos, SEEK_SET);
+            avio_wb32(formatContext->pb, static_cast<unsigned int>(reservedMoov.bytes));
+            avio_write(formatContext->pb, reinterpret_cast<const unsigned char*>("free"), 4);
+            avio_seek(formatContext->pb, end, SEEK_SET);
+            // The output is seekable and not fragmented, as the layout check made sure, which is what the muxer
+            // requires of faststart when it is set at open.
+            av_opt_set_int(formatContext->priv_data, "moov_size", 0, 0);
+            av_opt_set(formatContext->priv_data, "movflags", "+faststart", 0);
+            ++faststartRewrites_;
+        }
+
+        LOG(LL_DBG, "FFmpegEncoder::WriteTrailer - Writing file trailer");
+        const auto trailerStart = std::chrono::steady_clock::now();
+        int ret = av_write_trailer(formatContext);
+        if (ret < 0) {
+            LOG(LL_ERR, "FFmpegEncoder::WriteTrailer - Failed to write file trailer, error code: ", ret);
+            POST();
+            return E_FAIL;
+        }
+
+        LOG(LL_NFO, "FFmpegEncoder::WriteTrailer - File trailer written in ",
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - trailerStart).count(),
+            " ms");
+        POST();
+        return S_OK;
+    }
+
+    std::wstring FFmpegEncoder::SegmentFilename(int index) const {
+        const std::filesystem::path output(outputFilename_);
+        std::wostringstream name;
+        name << output.stem().wstring() << L"_" << std::setw(3) << std::setfill(L'0') << index
+             << output.extension().wstring();
+        return (output.parent_path() / name.str()).wstring();
+    }
+
+    bool FFmpegEncoder::SegmentIsFull(const AVPacket* pkt) const {
+        if (segmentPolicy_.minutes > 0 &&
+            static_cast<double>(pkt->dts - segmentStartDts_) * av_q2d(videoStream_->time_base) >= segmentPolicy_.minutes * 60.0) {
+            return true;
+        }
+        return segmentPolicy_.sizeMb > 0 && segmentPacketBytes_ >= static_cast<int64_t>(segmentPolicy_.sizeMb) * 1024 * 1024;
+    }
+
+    HRESULT FFmpegEncoder::StartNextSegment(int64_t cutDts) {
+        PRE();
+        const std::wstring filename = SegmentFilename(segmentIndex_ + 1);
+        const std::string filenameUtf8 = utf8_encode(filename);
+
+        AVFormatContext* next = nullptr;
+        int ret = avformat_alloc_output_context2(&next, nullptr, config_.format.container, filenameUtf8.c_str());
+        if (ret < 0 || !next) {
+            LOG(LL_ERR, "FFmpegEncoder::StartNextSegment - Failed to allocate output context, error code: ", ret);
+            POST();
+            return E_FAIL;
+        }
+
+        // Same streams with the same parameters, so every segment decodes like the first.
+        for (unsigned int i = 0; i < formatContext_->nb_streams; ++i) {
+            const AVStream* source = formatContext_->streams[i];
+            AVStream* stream = avformat_new_stream(next, nullptr);
+            if (!stream || avcodec_parameters_copy(stream->codecpar, source->codecpar) < 0) {
+                LOG(LL_ERR, "FFmpegEncoder::StartNextSegment - Failed to copy stream ", i);
+                avformat_free_context(next);
+                POST();
+                return E_FAIL;
+            }
+            stream->id = source->id;
+            stream->time_base = source->time_base;
+            stream->avg_frame_rate = source->avg_frame_rate;
+            stream->sample_aspect_ratio = source->sample_aspect_ratio;
+        }
+        av_dict_copy(&next->metadata, formatContext_->metadata, 0);
+
+        FinishedSegment* finished = new FinishedSegment();
+        finished->formatContext = formatContext_;
+        finished->writer = std::move(outputWriter_);
+        finished->filename = SegmentFilename(segmentIndex_);
+        finished->reservedMoov = reservedMoov_;
+        finished->index = fileIndexCounter_;
+        finished->freeContext = segmentIndex_ > 1;
+        if (segmentIndex_ == 1) {
+            firstFormatContext_ = formatContext_;
+        }
+
+        // Without audio nothing more can arrive for the old file, so it is queued before the new header and its
+        // trailer overlaps with it. Otherwise it waits for the audio to pass the cut.
+        formatContext_ = nullptr;
+        FinishClosingSegment();
+        if (audioStream_) {
+            closingSegment_ = finished;
+            closingSegmentOffset_ = segmentTimestampOffset_;
+        } else {
+            segmentFinalizeQueue_.enqueue(finished);
+        }
+
+        if (FAILED(OpenOutputFile(next, filenameUtf8))) {
+            if (outputWriter_) {
+                next->pb = nullptr;
+                outputWriter_->close();
+            } else if (next->pb) {
+                avio_closep(&next->pb);
+            }
+            avformat_free_context(next);
+            POST();
+            return E_FAIL;
+        }
+
+        formatContext_ = next;
+        ++segmentIndex_;
+        segmentPackets_ = 0;
+        segmentPacketBytes_ = 0;
+        segmentStartDts_ = cutDts;
+        segmentTimestampOffset_ = cutDts;
+        LOG(LL_NFO, "FFmpegEncoder::StartNextSegment - Continuing in ", filenameUtf8);
+        POST();
+        return S_OK;
+    }
+
+    void FFmpegEncoder::ShiftIntoSegment(AVPacket* pkt, const AVFormatContext* target, int64_t offset) const {
+        // Packets arrive in the first segment's time bases; the muxer of a later file may have picked others.
+        const AVStream* source = pkt->stream_index == videoStream_->index ? videoStream_ : audioStream_;
+        pkt->pts = shiftIntoSegment(pkt->pts, source->time_base, offset, videoStream_->time_base);
+        pkt->dts = shiftIntoSegment(pkt->dts, source->time_base, offset, videoStream_->time_base);
+        av_packet_rescale_ts(pkt, source->time_base, target->streams[pkt->stream_index]->time_base);
+    }
+
+    HRESULT FFmpegEncoder::WriteLateAudioPacket(AVPacket* pkt) {
+        ShiftIntoSegment(pkt, closingSegment_->formatContext, closingSegmentOffset_);
+        int ret = av_interleaved_write_frame(closingSegment_->formatContext, pkt);
+        if (ret < 0) {
+            LOG(LL_ERR, "FFmpegEncoder::WriteLateAudioPacket - Failed to write packet, error code: ", ret);
+            return E_FAIL;
+        }
+        ++writtenPackets_;
+        CountIndexedPacket(closingSegment_->index, pkt);
+        return S_OK;
+    }
+
+    void FFmpegEncoder::CountIndexedPacket(Mp4IndexCounter& counter, const AVPacket* pkt) const {
+        counter.add(pkt->stream_index == videoStream_->index, (pkt->flags & AV_PKT_FLAG_KEY) != 0,
+                    pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts, pkt->dts, pkt->size);
+    }
+
+    void FFmpegEncoder::FinishClosingSegment() {
+        if (closingSegment_) {
+            segmentFinalizeQueue_.enqueue(closingSegment_);
+            closingSegment_ = nullptr;
+        }
+    }
+
+    void FFmpegEncoder::SegmentFinalizeLoop() {
+        PRE();
+        LOG(LL_DBG, "FFmpegEncoder segment finalizer thread started");
+
+        while (FinishedSegment* segment = segmentFinalizeQueue_.dequeue()) {
+            const std::string filename = utf8_encode(segment->filename);
+            const auto start = std::chrono::steady_clock::now();
+            HRESULT hr = WriteTrailer(segment->formatContext, segment->reservedMoov, segment->index.counts());
+            if (segment->writer) {
+                segment->formatContext->pb = nullptr;
+                if (FAILED(segment->writer->close())) {
+                    hr = E_FAIL;
+                }
+                segment->writer->log();
+            } else if (segment->formatContext->pb && !(segment->formatContext->oformat->flags & AVFMT_NOFILE)) {
+                avio_closep(&segment->formatContext->pb);
+            }
+            if (segment->freeContext) {
+                avformat_free_context(segment->formatContext);
+            }
+
+            if (SUCCEEDED(hr)) {
+                LOG(LL_NFO, "FFmpegEncoder::SegmentFinalizeLoop - Finished ", filename, " in ",
+                    std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(),
+                    " ms");
+                {
+                    std::lock_guard<std::mutex> lock(segmentListMutex_);
+                    finishedSegments_.push_back(segment->filename);
+                }
+                WriteSegmentManifest();
+            } else {
+                LOG(LL_ERR, "FFmpegEncoder::SegmentFinalizeLoop - Failed to finish ", filename);
+            }
+            delete segment;
+        }
+
+        LOG(LL_DBG, "FFmpegEncoder segment finalizer thread stopped");
+        POST();
+    }
+
+    void FFmpegEncoder::StopSegmentFinalizer() {
+        if (!segmentFinalizeThread_.joinable()) {
+            return;
+        }
+
+        PRE();
+        segmentFinalizeQueue_.enqueue(nullptr);
+        segmentFinalizeThread_.join();
+        POST();
+    }
+
+    void FFmpegEncoder::WriteSegmentManifest() {
+        if (!segmentPolicy_.manifest) {
+            return;
+        }
+
+        // Rewritten after every segment, so an export that dies part way still lists what was finished.
+        const std::filesystem::path output(outputFilename_);
+        const std::filesystem::path manifestPath = output.parent_path() / (output.stem().wstring() + L".ffconcat");
+        std::lock_guard<std::mutex> lock(segmentListMutex_);
+        std::ofstream manifest(manifestPath, std::ios::trunc);
+        if (!manifest) {
+            LOG(LL_ERR, "FFmpegEncoder::WriteSegmentManifest - Failed to write ", manifestPath.string());
+            return;
+        }
+
+        manifest << "ffconcat version 1.0\n";
+        for (const std::wstring& segment : finishedSegments_) {
+            std::string name = utf8_encode(std::filesystem::path(segment).filename().wstring());
+            // ffconcat quoting: a quote closes the string, an escaped quote, then reopens it.
+            for (size_t pos = name.find('\''); pos != std::string::npos; pos = name.find('\'', pos + 4)) {
+                name.replace(pos, 1, "'\\''");
+            }
+            manifest << "file '" << name << "'\n";
+        }
+    }
+
+    HRESULT FFmpegEncoder::SendVideoFrame(const FFmpeg::FFVIDEOFRAME& frame) {
+        PRE();
+        LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame called - PTS: ", videoPts_);
+        
+        std::lock_guard<std::mutex> lock(videoSubmitMutex_);
+        
+        if (!isOpen_ || !videoCodecContext_) {
+            LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Encoder not open or video not enabled");
+            POST();
+            return E_FAIL;
+        }
+
+        // Followers still need the converted frames after this encoder's own encode has failed.
+        if (videoFilterFailed_ || (videoEncodeFailed_ && videoFrameFollowers_.empty())) {
+            LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Video ", videoFilterFailed_ ? "filter" : "encode",
+                " stage failed on an earlier frame");
+            POST();
+            return E_FAIL;
+        }
+        
+        LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame - Frame size: ", frame.width, "x", frame.height, ", planes: ", frame.planes);
+        
+        // Wraps the caller's planes without copying them; only the shell comes from the pool.
+        AVFrame* inputFrame = videoFramePool_.acquireShell();
+        if (!inputFrame) {
+            LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to allocate input frame");
+            POST();
+            return E_FAIL;
+        }
+        
+        inputFrame->width = frame.width;
+        inputFrame->height = frame.height;
+        inputFrame->pts = videoPts_++;
+        
+        AVPixelFormat inputPixelFormat = AV_PIX_FMT_NONE;
+        std::string formatStr(frame.format);
+        if (formatStr == "rgba") {
+            inputPixelFormat = AV_PIX_FMT_RGBA;
+        } else if (formatStr == "rgb") {
+            inputPixelFormat = AV_PIX_FMT_RGB24;
+        } else if (formatStr == "bgra") {
+            inputPixelFormat = AV_PIX_FMT_BGRA;
+        } else {
+            inputPixelFormat = av_get_pix_fmt(frame.format);
+        }
+        
+        if (inputPixelFormat == AV_PIX_FMT_NONE) {
+            LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Unknown pixel format: ", frame.format);
+            videoFramePool_.release(inputFrame);
+            POST();
+            return E_FAIL;
+        }
+        
+        inputFrame->format = inputPixelFormat;
+        
+        LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame - Input pixel format: ", av_get_pix_fmt_name(inputPixelFormat));
+        LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame - Output pixel format: ", av_get_pix_fmt_name(videoCodecContext_->pix_fmt));
+        
+        for (int i = 0; i < frame.planes; i++) {
+            inputFrame->data[i] = frame.buffer[i];
+            inputFrame->linesize[i] = frame.rowsize[i];
+        }
+
+        if (strlen(config_.video.filters) > 0 && !videoFilterGraph_ && !videoFilterFused_) {
+            // A lone eq filter is folded into the RGBA -> YUV kernels, saving the graph's conversion and extra pass.
+            ColorAdjustment adjustment;
+            if (parseColorAdjustFilter(config_.video.filters, adjustment) &&
+                frame.width == videoCodecContext_->width && frame.height == videoCodecContext_->height &&
+                RgbaToYuvConverter::isSupported(inputPixelFormat, videoCodecContext_->pix_fmt,
+                                                ConversionColorSpace(videoCodecContext_))) {
+                videoFilterFused_ = true;
+                videoColorAdjustment_ = adjustment;
+                LOG(LL_NFO, "FFmpegEncoder::SendVideoFrame - Applying video filters during pixel format conversion: ",
+                    config_.video.filters);
+            } else {
+                // A trailing eq is taken off the chain and applied in place to the graph's output, saving eq's own
+                // pass and output frame inside the graph.
+                std::string graphFilters = config_.video.filters;
+                std::string otherFilters;
+                videoGraphColorAdjuster_.reset();
+                if (splitTrailingColorAdjustFilter(config_.video.filters, otherFilters, adjustment) &&
+                    videoGraphColorAdjuster_.initialize(adjustment, videoCodecContext_->pix_fmt)) {
+                    graphFilters = otherFilters;
+                    LOG(LL_NFO, "FFmpegEncoder::SendVideoFrame - Applying colour adjustment after the filter graph: ",
+                        adjustment.toString());
+                }
+
+                LOG(LL_DBG, "FFmpegEncoder::SendVideoFrame - Initializing video filter graph");
+                HRESULT fghr = InitializeVideoFilterGraph(graphFilters.c_str(), static_cast<int>(inputPixelFormat),
+                                                          frame.width, frame.height);
+                if (FAILED(fghr)) {
+                    videoGraphColorAdjuster_.reset();
+                    LOG(LL_WRN, "FFmpegEncoder::SendVideoFrame - Video filter graph init failed, falling back to SWS path");
+                }
+            }
+        }
+
+        if (videoFilterGraph_) {
+            LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame - Using filter graph path");
+
+            // The caller's buffer is only valid until we return, so the filter stage gets a pooled copy.
+            AVFrame* filterInput = videoFilterInputPool_.acquireVideo();
+            const int ret = !filterInput ? AVERROR(ENOMEM) : av_frame_copy(filterInput, inputFrame);
+            if (ret < 0) {
+                LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to copy frame for the filter stage, error code: ", ret);
+                videoFilterInputPool_.release(filterInput);
+                videoFramePool_.release(inputFrame);
+                POST();
+                return E_FAIL;
+            }
+            filterInput->pts = inputFrame->pts;
+            videoFramePool_.release(inputFrame);
+
+            if (!videoFilterQueue_.push(filterInput)) {
+                LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Video filter stage is stopped");
+                videoFilterInputPool_.release(filterInput);
+                POST();
+                return E_FAIL;
+            }
+        } else {
+            AVFrame* frameToEncode = nullptr;
+
+            if (inputPixelFormat != videoCodecContext_->pix_fmt) {
+                LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame - Pixel format conversion required");
+
+                if (!videoConverter_.isInitialized()) {
+                    LOG(LL_DBG, "FFmpegEncoder::SendVideoFrame - Creating band converter for pixel format conversion");
+                    const size_t bandCount = std::clamp<size_t>(std::thread::hardware_concurrency() / 4, 1, kMaxConversionBands);
+                    HRESULT converterHr = videoConverter_.initialize(
+                        frame.width, frame.height, inputPixelFormat,
+                        videoCodecContext_->width, videoCodecContext_->height, videoCodecContext_->pix_fmt,
+                        swsFlags_, bandCount, ConversionColorSpace(videoCodecContext_),
+                        videoCodecContext_->color_range == AVCOL_RANGE_JPEG,
+                        videoFilterFused_ ? videoColorAdjustment_ : ColorAdjustment());
+
+                    if (FAILED(converterHr)) {
+                        LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to create pixel format converter");
+                        videoFramePool_.release(inputFrame);
+                        POST();
+                        return E_FAIL;
+                    }
+                }
+
+                frameToEncode = videoFramePool_.acquireVideo();
+                if (!frameToEncode) {
+                    LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to allocate converted frame");
+                    videoFramePool_.release(inputFrame);
+                    POST();
+                    return E_FAIL;
+                }
+                frameToEncode->pts = inputFrame->pts;
+
+                const auto convertStart = std::chrono::steady_clock::now();
+                HRESULT convertHr = videoConverter_.convert(inputFrame->data, inputFrame->linesize, frameToEncode);
+                const auto convertElapsed = std::chrono::steady_clock::now() - convertStart;
+                videoConvertNs_ += std::chrono::duration_cast<std::chrono::nanoseconds>(convertElapsed).count();
+                videoConvertLatency_.record(convertElapsed);
+
+                if (FAILED(convertHr)) {
+                    LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Pixel format conversion failed");
+                    videoFramePool_.release(inputFrame);
+                    videoFramePool_.release(frameToEncode);
+                    POST();
+                    return E_FAIL;
+                }
+
+                ++convertedVideoFrames_;
+                LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame - Pixel format conversion completed");
+            } else {
+                // The caller's buffer is only valid until we return, so the frame is copied into a pooled one.
+                // Referencing a non refcounted frame also copies it, into fresh buffers; that covers input
+                // whose geometry differs from the pool's.
+                const bool pooledGeometry = frame.width == videoCodecContext_->width && frame.height == videoCodecContext_->height;
+                frameToEncode = pooledGeometry ? videoFramePool_.acquireVideo() : videoFramePool_.acquireShell();
+                const int ret = !frameToEncode ? AVERROR(ENOMEM)
+                                : pooledGeometry ? av_frame_copy(frameToEncode, inputFrame)
+                                                 : av_frame_ref(frameToEncode, inputFrame);
+                if (ret < 0) {
+                    LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to copy input frame, error code: ", ret);
+                    videoFramePool_.release(inputFrame);
+                    videoFramePool_.release(frameToEncode);
+                    POST();
+                    return E_FAIL;
+                }
+                frameToEncode->pts = inputFrame->pts;
+            }
+
+            videoFramePool_.release(inputFrame);
+
+            HRESULT hr = SubmitVideoFrame(frameToEncode);
+            if (FAILED(hr)) {
+                LOG(LL_ERR, "FFmpegEncoder::SendVideoFrame - Failed to queue video frame for encoding");
+                POST();
+                return hr;
+            }
+        }
+
+        LOG(LL_TRC, "FFmpegEncoder::SendVideoFrame - Frame queued for encoding");
+
+        POST();
+        return S_OK;
+    }
+
+    HRESULT FFmpegEncoder::SubmitVideoFrame(AVFrame* frame) {
+        ForwardVideoFrame(frame);
+        if (!videoEncodeQueue_.push(frame)) {
+            LOG(LL_ERR, "FFmpegEncoder::SubmitVideoFrame - Video encode stage is stopped");
+            videoFramePool_.release(frame);
+            return E_FAIL;
+        }
+        return S_OK;
+    }
+
+    void FFmpegEncoder::ForwardVideoFrame(const AVFrame* frame) {
+        for (auto it = videoFrameFollowers_.begin(); it != videoFrameFollowers_.end();) {
+            if (FAILED((*it)->SendSharedVideoFrame(frame))) {
+                LOG(LL_WRN, "FFmpegEncoder::ForwardVideoFrame - An encoder sharing these frames stopped taking them");
+                it = videoFrameFollowers_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    bool FFmpegEncoder::CanShareVideoFrames(const FFmpegEncoder& other) const {
+        const AVCodecContext* ours = videoCodecContext_;
+        const AVCodecContext* theirs = other.videoCodecContext_;
+        return ours && theirs &&
+               ours->width == theirs->width && ours->height == theirs->height &&
+               ours->pix_fmt == theirs->pix_fmt &&
+               ours->colorspace == theirs->colorspace && ours->color_range == theirs->color_range &&
+               av_cmp_q(ours->time_base, theirs->time_base) == 0 &&
+               swsFlags_ == other.swsFlags_ &&
+               strcmp(config_.video.filters, other.config_.video.filters) == 0;
+    }
+
+    void FFmpegEncoder::ShareVideoFramesWith(FFmpegEncoder* follower) {
+        std::lock_guard<std::mutex> lock(videoSubmitMutex_);
+        videoFrameFollowers_.push_back(follower);
+    }
+
+    HRESULT FFmpegEncoder::SendSharedVideoFrame(const AVFrame* frame) {
+        std::lock_guard<std::mutex> lock(videoSubmitMutex_);
+        if (!isOpen_ || !videoCodecContext_ || videoEncodeFailed_) {
+            return E_FAIL;
+        }
+
+        // The frame keeps the sharing encoder's timestamp, which is in the same time base.
+        AVFrame* sharedFrame = videoFramePool_.acquireShell();
+        const int ret = !sharedFrame ? AVERROR(ENOMEM) : av_frame_ref(sharedFrame, frame);
+        if (ret < 0) {
+            LOG(LL_ERR, "FFmpegEncoder::SendSharedVideoFrame - Failed to reference shared frame, error code: ", ret);
+            videoFramePool_.release(sharedFrame);
+            return E_FAIL;
+        }
+        return SubmitVideoFrame(sharedFrame);
+    }
+
+    void FFmpegEncoder::SkipVideoFrames(int64_t count) {
+        std::lock_guard<std::mutex> lock(videoSubmitMutex_);
+        if (count > 0) {
+            videoPts_ += count;
+        }
+    }
+
+    HRESULT FFmpegEncoder::StartVideoFilterStage() {
+        PRE();
+        videoFilterQueue_.reset();
+        videoFilterFailed_ = false;
+        filteredVideoFrames_ = 0;
+        videoFilterNs_ = 0;
+
+        try {
+            videoFilterThread_ = std::thread(&FFmpegEncoder::VideoFilterLoop, this);
+        } catch (const std::exception& ex) {
+            LOG(LL_ERR, "FFmpegEncoder::StartVideoFilterStage - Failed to start video filter thread: ", ex.what());
+            POST();
+            return E_FAIL;
+        }
+
+        POST();
+        return S_OK;
+    }
+
+    void FFmpegEncoder::StopVideoFilterStage() {
+        if (!videoFilterThread_.joinable()) {
+            return;
+        }
+
+        PRE();
+        videoFilterQueue_.requestStop();
+        videoFilterThread_.join();
+
+        const double filterMs = static_cast<double>(videoFilterNs_) / 1000000.0;
+        LOG(LL_NFO, "Video filter stage: threads=", videoFilterThreads_ > 0 ? std::to_string(videoFilterThreads_) : std::string("auto"),
+            " filteredFrames=", filteredVideoFrames_,
+            " avgFilterMs=", filteredVideoFrames_ > 0 ? filterMs / static_cast<double>(filteredVideoFrames_) : 0.0);
+
+        if (videoFilterFailed_) {
+            LOG(LL_ERR, "FFmpegEncoder::StopVideoFilterStage - Video filter stage reported a failure");
+        }
+        POST();
+    }
+
+    void FFmpegEncoder::VideoFilterLoop() {
+        PRE();
+        LOG(LL_DBG, "FFmpegEncoder video filter thread started");
+
+        AVFrame* frame = nullptr;
+        while (videoFilterQueue_.pop(frame)) {
+            // After a failure keep draining so queued frames are still returned to the pool.
+            if (!videoFilterFailed_ && FAILED(FilterVideoFrame(frame))) {
+                LOG(LL_ERR, "FFmpegEncoder::VideoFilterLoop - Failed to filter video frame, PTS: ", frame->pts);
+                videoFilterFailed_ = true;
+            }
+            videoFilterInputPool_.release(frame);
+        }
+
+        LOG(LL_DBG, "FFmpegEncoder video filter thread stopped");
+        POST();
+    }
+
+    HRESULT FFmpegEncoder::AdjustFilteredVideoFrame(AVFrame* frame) {
+        if (!videoGraphColorAdjuster_.isInitialized()) {
+            return S_OK;
+        }
+        const int ret = videoGraphColorAdjuster_.applyToFrame(frame);
+        if (ret < 0) {
+            LOG(LL_ERR, "FFmpegEncoder::AdjustFilteredVideoFrame - Failed to make filtered frame writable, error code: ", ret);
+            return E_FAIL;
+        }
+        return S_OK;
+    }
+
+    HRESULT FFmpegEncoder::FilterVideoFrame(AVFrame* frame) {
+        const auto filterStart = std::chrono::steady_clock::now();
+
+        // Without KEEP_REF the graph takes over the pooled buffers, which return to the pool once filtered.
+        int ret = av_buffersrc_add_frame_flags(videoBufferSrcCtx_, frame, 0);
+        if (ret < 0) {
+            char errbuf[256];
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            LOG(LL_ERR, "FFmpegEncoder::FilterVideoFrame - Failed to push frame into filter graph: ", errbuf);
+            return E_FAIL;
+        }
+
+        videoFilterOutput_.clear();
+        HRESULT hr = S_OK;
+        while (true) {
+            AVFrame* filteredFrame = videoFramePool_.acquireShell();
+            if (!filteredFrame) {
+                LOG(LL_ERR, "FFmpegEncoder::FilterVideoFrame - Failed to allocate filtered frame");
+                hr = E_FAIL;
+                break;
+            }
+
+            ret = av_buffersink_get_frame(videoBufferSinkCtx_, filteredFrame);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                videoFramePool_.release(filteredFrame);
+                break;
+            }
+            if (ret < 0) {
+                char errbuf[256];
+                av_strerror(ret, errbuf, sizeof(errbuf));
+                LOG(LL_ERR, "FFmpegEncoder::FilterVideoFrame - Failed to get frame from filter graph: ", errbuf);
+                videoFramePool_.release(filteredFrame);
+                hr = E_FAIL;
+                break;
+            }
+            if (FAILED(AdjustFilteredVideoFrame(filteredFrame))) {
+                videoFramePool_.release(filteredFrame);
+                hr = E_FAIL;
+                break;
+            }
+            videoFilterOutput_.push_back(filteredFrame);
+        }
+
+        // Timed before the hand-off so a busy encoder does not show up as filter time.
+        const auto filterElapsed = std::chrono::steady_clock::now() - filterStart;
+        videoFilterNs_ += std::chrono::duration_cast<std::chrono::nanoseconds>(filterElapsed).count();
+        videoFilterLatency_.record(filterElapsed);
+        ++filteredVideoFrames_;
+
+        for (AVFrame* filteredFrame : videoFilterOutput_) {
+            if (FAILED(hr)) {
+                videoFramePool_.release(filteredFrame);
+            } else if (FAILED(SubmitVideoFrame(filteredFrame))) {
+                LOG(LL_ERR, "FFmpegEncoder::FilterVideoFrame - Failed to queue filtered frame");
+                hr = E_FAIL;
+            }
+        }
+        videoFilterOutput_.clear();
+        return hr;
+    }
+
+    HRESULT FFmpegEncoder::StartVideoEncodeStage() {
+        PRE();
+        if (!videoPacket_) {
+            videoPacket_ = av_packet_alloc();
+            if (!videoPacket_) {
+                LOG(LL_ERR, "FFmpegEncoder::StartVideoEncodeStage - Failed to allocate packet");
+                POST();
+                return E_FAIL;
+            }
+        }
+
+        videoEncodeQueue_.reset();
+        videoEncodeFailed_ = false;
+        videoFilterFailed_ = false;
+        convertedVideoFrames_ = 0;
+        videoConvertNs_ = 0;
+        stageEncodedVideoFrames_ = 0;
+        videoEncodeNs_ = 0;
+
+        try {
+            videoEncodeThread_ = std::thread(&FFmpegEncoder::VideoEncodeLoop, this);
+        } catch (const std::exception& ex) {
+            LOG(LL_ERR, "FFmpegEncoder::StartVideoEncodeStage - Failed to start video encode thread: ", ex.what());
+            POST();
+            return E_FAIL;
+        }
+
+        POST();
+        return S_OK;
+    }
+
+    void FFmpegEncoder::StopVideoEncodeStage() {
+        // Filtered frames still in flight feed the encode queue, so the filter stage drains first.
+        StopVideoFilterStage();
+
+        if (!videoEncodeThread_.joinable()) {
+            return;
+        }
+
+        PRE();
+        videoEncodeQueue_.requestStop();
+        videoEncodeThread_.join();
+
+        const double convertMs = static_cast<double>(videoConvertNs_) / 1000000.0;
+        const double encodeMs = static_cast<double>(videoEncodeNs_) / 1000000.0;
+        LOG(LL_NFO, "Video conversion stage: kernel=", videoConverter_.getKernelName(),
+            " bands=", videoConverter_.getBandCount(),
+            " convertedFrames=", convertedVideoFrames_,
+            " avgConvertMs=", convertedVideoFrames_ > 0 ? convertMs / static_cast<double>(convertedVideoFrames_) : 0.0,
+            " encodedFrames=", stageEncodedVideoFrames_,
+            " avgEncodeMs=", stageEncodedVideoFrames_ > 0 ? encodeMs / static_cast<double>(stageEncodedVideoFrames_) : 0.0);
+
+        if (videoEncodeFailed_) {
+            LOG(LL_ERR, "FFmpegEncoder::StopVideoEncodeStage - Video encode stage reported a failure");
+        }
+        POST();
+    }
+
+    void FFmpegEncoder::VideoEncodeLoop() {
+        PRE();
+        LOG(LL_DBG, "FFmpegEncoder video encode thread started");
+
+        AVFrame* frame = nullptr;
+        while (videoEncodeQueue_.pop(frame)) {
+            // After a failure keep draining so queued frames are still freed.
+            if (!videoEncodeFailed_) {
+                const auto encodeStart = std::chrono::steady_clock::now();
+                HRESULT hr;
+                {
+                    std::lock_guard<std::mutex> lock(videoEncodeMutex_);
+                    hr = EncodeVideoFrame(frame);
+                }
+                videoEncodeNs_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - encodeStart).count();
+
+                if (FAILED(hr)) {
+                    LOG(LL_ERR, "FFmpegEncoder::VideoEncodeLoop - Failed to encode video frame, PTS: ", frame->pts);
+                    videoEncodeFailed_ = true;
+                } else {
+                    ++stageEncodedVideoFrames_;
+                }
+            }
+            videoFramePool_.release(frame);
+        }
+
+        LOG(LL_DBG, "FFmpegEncoder video encode thread stopped");
+        POST();
+    }
+
+    HRESULT FFmpegEncoder::SendAudioSampleChunk(const FFmpeg::FFAUDIOCHUNK& chunk) {
+        PRE();
+        LOG(LL_TRC, "FFmpegEncoder::SendAudioSampleChunk called - Samples: ", chunk.samples, ", PTS: ", audioPts_);
+        
+        std::lock_guard<std::mutex> lock(audioEncodeMutex_);
+        
+        if (!isOpen_ || !audioCodecContext_) {
+            LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Encoder not open or audio not enabled");
+            POST();
+            return E_FAIL;
+        }
         
         LOG(LL_TRC, "FFmpegEncoder::SendAudioSampleChunk - Block size: ", chunk.blockSize, ", planes: ", chunk.planes, ", rate: ", chunk.sampleRate);
         
-        if (!packet_) {
-            packet_ = av_packet_alloc();
-            if (!packet_) {
+        if (!audioPacket_) {
+            audioPacket_ = av_packet_alloc();
+            if (!audioPacket_) {
                 LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to allocate packet");
                 POST();
                 return E_FAIL;
             }
         }
         
-        AVFrame* inputFrame = av_frame_alloc();
+        AVFrame* inputFrame = audioFramePool_.acquireShell();
         if (!inputFrame) {
             LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to allocate input frame");
             POST();
@@ -1304,7 +2332,7 @@ namespace Encoder {
             1);
         if (fillRet < 0) {
             LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - avcodec_fill_audio_frame failed, error code: ", fillRet);
-            av_frame_free(&inputFrame);
+            audioFramePool_.release(inputFrame);
             POST();
             return E_FAIL;
         }
@@ -1334,12 +2362,12 @@ namespace Encoder {
                 char errbuf[256];
                 av_strerror(ret, errbuf, sizeof(errbuf));
                 LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to push frame into audio filter graph: ", errbuf);
-                av_frame_free(&inputFrame);
+                audioFramePool_.release(inputFrame);
                 POST();
                 return E_FAIL;
             }
 
-            AVFrame* filteredFrame = av_frame_alloc();
+            AVFrame* filteredFrame = audioFramePool_.acquireShell();
             while (filteredFrame) {
                 ret = av_buffersink_get_frame(audioBufferSinkCtx_, filteredFrame);
                 if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
@@ -1349,8 +2377,8 @@ namespace Encoder {
                     char errbuf[256];
                     av_strerror(ret, errbuf, sizeof(errbuf));
                     LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to get frame from audio filter graph: ", errbuf);
-                    av_frame_free(&filteredFrame);
-                    av_frame_free(&inputFrame);
+                    audioFramePool_.release(filteredFrame);
+                    audioFramePool_.release(inputFrame);
                     POST();
                     return E_FAIL;
                 }
@@ -1361,8 +2389,8 @@ namespace Encoder {
                 int fifoRealloc = av_audio_fifo_realloc(audioFifo_, av_audio_fifo_size(audioFifo_) + fgSamples);
                 if (fifoRealloc < 0) {
                     LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to realloc audio FIFO (filter path), error code: ", fifoRealloc);
-                    av_frame_free(&filteredFrame);
-                    av_frame_free(&inputFrame);
+                    audioFramePool_.release(filteredFrame);
+                    audioFramePool_.release(inputFrame);
                     POST();
                     return E_FAIL;
                 }
@@ -1370,15 +2398,15 @@ namespace Encoder {
                 int fifoWrite = av_audio_fifo_write(audioFifo_, (void**)filteredFrame->data, fgSamples);
                 if (fifoWrite < fgSamples) {
                     LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to write filtered samples to FIFO, wrote: ", fifoWrite);
-                    av_frame_free(&filteredFrame);
-                    av_frame_free(&inputFrame);
+                    audioFramePool_.release(filteredFrame);
+                    audioFramePool_.release(inputFrame);
                     POST();
                     return E_FAIL;
                 }
 
                 av_frame_unref(filteredFrame);
             }
-            av_frame_free(&filteredFrame);
+            audioFramePool_.release(filteredFrame);
         } else {
             if (needsConversion) {
                 LOG(LL_TRC, "FFmpegEncoder::SendAudioSampleChunk - Sample format conversion required");
@@ -1401,7 +2429,7 @@ namespace Encoder {
 
                     if (ret < 0 || !swrContext_) {
                         LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to allocate SWR context");
-                        av_frame_free(&inputFrame);
+                        audioFramePool_.release(inputFrame);
                         POST();
                         return E_FAIL;
                     }
@@ -1409,23 +2437,21 @@ namespace Encoder {
                     ret = swr_init(swrContext_);
                     if (ret < 0) {
                         LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to initialize SWR context, error code: ", ret);
-                        av_frame_free(&inputFrame);
+                        audioFramePool_.release(inputFrame);
                         POST();
                         return E_FAIL;
                     }
                 }
 
-                convertedFrame = av_frame_alloc();
+                convertedFrame = audioFramePool_.acquireAudio(chunk.samples);
                 if (!convertedFrame) {
                     LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to allocate converted frame");
-                    av_frame_free(&inputFrame);
+                    audioFramePool_.release(inputFrame);
                     POST();
                     return E_FAIL;
                 }
 
-                convertedFrame->nb_samples = chunk.samples;
                 convertedFrame->sample_rate = audioCodecContext_->sample_rate;
-                convertedFrame->format = audioCodecContext_->sample_fmt;
                 convertedFrame->pts = inputFrame->pts;
 
 #if LIBAVUTIL_VERSION_MAJOR >= 57
@@ -1435,22 +2461,13 @@ namespace Encoder {
                 convertedFrame->channels = audioCodecContext_->channels;
 #endif
 
-                int ret = av_frame_get_buffer(convertedFrame, 0);
-                if (ret < 0) {
-                    LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to allocate converted frame buffer, error code: ", ret);
-                    av_frame_free(&inputFrame);
-                    av_frame_free(&convertedFrame);
-                    POST();
-                    return E_FAIL;
-                }
-
-                ret = swr_convert(swrContext_, convertedFrame->data, chunk.samples,
+                int ret = swr_convert(swrContext_, convertedFrame->data, chunk.samples,
                                  (const uint8_t**)inputFrame->data, chunk.samples);
 
                 if (ret < 0) {
                     LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Sample format conversion failed, error code: ", ret);
-                    av_frame_free(&inputFrame);
-                    av_frame_free(&convertedFrame);
+                    audioFramePool_.release(inputFrame);
+                    audioFramePool_.release(convertedFrame);
                     POST();
                     return E_FAIL;
                 }
@@ -1465,8 +2482,8 @@ namespace Encoder {
             int fifoRealloc = av_audio_fifo_realloc(audioFifo_, av_audio_fifo_size(audioFifo_) + producedSamples);
             if (fifoRealloc < 0) {
                 LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to realloc audio FIFO, error code: ", fifoRealloc);
-                av_frame_free(&inputFrame);
-                if (convertedFrame) av_frame_free(&convertedFrame);
+                audioFramePool_.release(inputFrame);
+                audioFramePool_.release(convertedFrame);
                 POST();
                 return E_FAIL;
             }
@@ -1474,8 +2491,8 @@ namespace Encoder {
             int fifoWrite = av_audio_fifo_write(audioFifo_, (void**)frameToEncode->data, producedSamples);
             if (fifoWrite < producedSamples) {
                 LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to write samples into FIFO, wrote: ", fifoWrite);
-                av_frame_free(&inputFrame);
-                if (convertedFrame) av_frame_free(&convertedFrame);
+                audioFramePool_.release(inputFrame);
+                audioFramePool_.release(convertedFrame);
                 POST();
                 return E_FAIL;
             }
@@ -1483,62 +2500,50 @@ namespace Encoder {
 
         int targetFrameSize = audioCodecContext_->frame_size > 0 ? audioCodecContext_->frame_size : producedSamples;
         while (audioFifo_ && av_audio_fifo_size(audioFifo_) >= targetFrameSize && targetFrameSize > 0) {
-            if (targetFrameSize > audioFrame_->nb_samples) {
-                av_frame_unref(audioFrame_);
-                audioFrame_->format = audioCodecContext_->sample_fmt;
-                audioFrame_->sample_rate = audioCodecContext_->sample_rate;
-#if LIBAVUTIL_VERSION_MAJOR >= 57
-                av_channel_layout_copy(&audioFrame_->ch_layout, &audioCodecContext_->ch_layout);
-#else
-                audioFrame_->channel_layout = audioCodecContext_->channel_layout;
-                audioFrame_->channels = audioCodecContext_->channels;
-#endif
-                audioFrame_->nb_samples = targetFrameSize;
-                int bufRet = av_frame_get_buffer(audioFrame_, 0);
-                if (bufRet < 0) {
-                    LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to allocate audio frame buffer, error code: ", bufRet);
-                    av_frame_free(&inputFrame);
-                    if (convertedFrame) av_frame_free(&convertedFrame);
-                    POST();
-                    return E_FAIL;
-                }
-            }
-
-            int writable = av_frame_make_writable(audioFrame_);
-            if (writable < 0) {
-                LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Frame not writable, error code: ", writable);
-                av_frame_free(&inputFrame);
-                if (convertedFrame) av_frame_free(&convertedFrame);
+            // A fresh pooled frame per encode: the encoder may keep a reference to the previous one, which made
+            // reusing a single frame reallocate its buffer in av_frame_make_writable.
+            AVFrame* encodeFrame = audioFramePool_.acquireAudio(targetFrameSize);
+            if (!encodeFrame) {
+                LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to allocate audio frame buffer");
+                audioFramePool_.release(inputFrame);
+                audioFramePool_.release(convertedFrame);
                 POST();
                 return E_FAIL;
             }
+            encodeFrame->sample_rate = audioCodecContext_->sample_rate;
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+            av_channel_layout_copy(&encodeFrame->ch_layout, &audioCodecContext_->ch_layout);
+#else
+            encodeFrame->channel_layout = audioCodecContext_->channel_layout;
+            encodeFrame->channels = audioCodecContext_->channels;
+#endif
 
-            int readRet = av_audio_fifo_read(audioFifo_, (void**)audioFrame_->data, targetFrameSize);
+            int readRet = av_audio_fifo_read(audioFifo_, (void**)encodeFrame->data, targetFrameSize);
             if (readRet < targetFrameSize) {
                 LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to read from FIFO, read: ", readRet);
-                av_frame_free(&inputFrame);
-                if (convertedFrame) av_frame_free(&convertedFrame);
+                audioFramePool_.release(encodeFrame);
+                audioFramePool_.release(inputFrame);
+                audioFramePool_.release(convertedFrame);
                 POST();
                 return E_FAIL;
             }
 
-            audioFrame_->pts = audioPts_;
+            encodeFrame->pts = audioPts_;
             audioPts_ += targetFrameSize;
 
-            HRESULT hr = EncodeAudioFrame(audioFrame_);
+            HRESULT hr = EncodeAudioFrame(encodeFrame);
+            audioFramePool_.release(encodeFrame);
             if (FAILED(hr)) {
                 LOG(LL_ERR, "FFmpegEncoder::SendAudioSampleChunk - Failed to encode audio frame");
-                av_frame_free(&inputFrame);
-                if (convertedFrame) av_frame_free(&convertedFrame);
+                audioFramePool_.release(inputFrame);
+                audioFramePool_.release(convertedFrame);
                 POST();
                 return hr;
             }
         }
 
-        av_frame_free(&inputFrame);
-        if (convertedFrame) {
-            av_frame_free(&convertedFrame);
-        }
+        audioFramePool_.release(inputFrame);
+        audioFramePool_.release(convertedFrame);
 
         LOG(LL_TRC, "FFmpegEncoder::SendAudioSampleChunk - Audio chunk accepted into FIFO");
 
@@ -1548,9 +2553,25 @@ namespace Encoder {
 
     HRESULT FFmpegEncoder::EncodeVideoFrame(AVFrame* frame) {
         PRE();
+        if (chunkedVideoEncoder_.isOpen()) {
+            // The chunk encoders hold on to frames for a while, so they get their own reference.
+            AVFrame* chunkFrame = videoFramePool_.acquireShell();
+            if (!chunkFrame || av_frame_ref(chunkFrame, frame) < 0) {
+                LOG(LL_ERR, "FFmpegEncoder::EncodeVideoFrame - Failed to reference frame for the chunk encoders");
+                videoFramePool_.release(chunkFrame);
+                POST();
+                return E_FAIL;
+            }
+            HRESULT hr = chunkedVideoEncoder_.submit(chunkFrame);
+            POST();
+            return hr;
+        }
+
         LOG(LL_TRC, "FFmpegEncoder::EncodeVideoFrame - Sending frame to encoder");
         
+        auto stageStart = std::chrono::steady_clock::now();
         int ret = avcodec_send_frame(videoCodecContext_, frame);
+        videoSendFrameLatency_.record(std::chrono::steady_clock::now() - stageStart);
         if (ret < 0) {
             LOG(LL_ERR, "FFmpegEncoder::EncodeVideoFrame - Failed to send frame to encoder, error code: ", ret);
             POST();
@@ -1558,8 +2579,10 @@ namespace Encoder {
         }
         
         while (ret >= 0) {
-            av_packet_unref(packet_);
-            ret = avcodec_receive_packet(videoCodecContext_, packet_);
+            av_packet_unref(videoPacket_);
+            stageStart = std::chrono::steady_clock::now();
+            ret = avcodec_receive_packet(videoCodecContext_, videoPacket_);
+            videoReceivePacketLatency_.record(std::chrono::steady_clock::now() - stageStart);
             
             if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
                 LOG(LL_TRC, "FFmpegEncoder::EncodeVideoFrame - No more packets available (EAGAIN/EOF)");
@@ -1570,9 +2593,9 @@ namespace Encoder {
                 return E_FAIL;
             }
             
-            LOG(LL_TRC, "FFmpegEncoder::EncodeVideoFrame - Received packet, size: ", packet_->size, " bytes");
+            LOG(LL_TRC, "FFmpegEncoder::EncodeVideoFrame - Received packet, size: ", videoPacket_->size, " bytes");
             
-            HRESULT hr = WritePacket(packet_, videoStream_);
+            HRESULT hr = QueuePacket(videoPacket_, videoStream_);
             if (FAILED(hr)) {
                 LOG(LL_ERR, "FFmpegEncoder::EncodeVideoFrame - Failed to write packet");
                 POST();
@@ -1588,7 +2611,9 @@ namespace Encoder {
         PRE();
         LOG(LL_TRC, "FFmpegEncoder::EncodeAudioFrame - Sending frame to encoder");
         
+        auto stageStart = std::chrono::steady_clock::now();
         int ret = avcodec_send_frame(audioCodecContext_, frame);
+        audioSendFrameLatency_.record(std::chrono::steady_clock::now() - stageStart);
         if (ret < 0) {
             LOG(LL_ERR, "FFmpegEncoder::EncodeAudioFrame - Failed to send frame to encoder, error code: ", ret);
             POST();
@@ -1596,8 +2621,10 @@ namespace Encoder {
         }
         
         while (ret >= 0) {
-            av_packet_unref(packet_);
-            ret = avcodec_receive_packet(audioCodecContext_, packet_);
+            av_packet_unref(audioPacket_);
+            stageStart = std::chrono::steady_clock::now();
+            ret = avcodec_receive_packet(audioCodecContext_, audioPacket_);
+            audioReceivePacketLatency_.record(std::chrono::steady_clock::now() - stageStart);
             
             if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
                 LOG(LL_TRC, "FFmpegEncoder::EncodeAudioFrame - No more packets available (EAGAIN/EOF)");
@@ -1608,9 +2635,9 @@ namespace Encoder {
                 return E_FAIL;
             }
             
-            LOG(LL_TRC, "FFmpegEncoder::EncodeAudioFrame - Received packet, size: ", packet_->size, " bytes");
+            LOG(LL_TRC, "FFmpegEncoder::EncodeAudioFrame - Received packet, size: ", audioPacket_->size, " bytes");
             
-            HRESULT hr = WritePacket(packet_, audioStream_);
+            HRESULT hr = QueuePacket(audioPacket_, audioStream_);
             if (FAILED(hr)) {
                 LOG(LL_ERR, "FFmpegEncoder::EncodeAudioFrame - Failed to write packet");
                 POST();
@@ -1622,34 +2649,140 @@ namespace Encoder {
         return S_OK;
     }
 
-    HRESULT FFmpegEncoder::WritePacket(AVPacket* pkt, AVStream* stream) {
+    HRESULT FFmpegEncoder::QueuePacket(AVPacket* pkt, AVStream* stream) {
         PRE();
-        LOG(LL_TRC, "FFmpegEncoder::WritePacket - Writing packet to stream ", stream->index);
+        LOG(LL_TRC, "FFmpegEncoder::QueuePacket - Queueing packet for stream ", stream->index);
+
+        if (muxerFailed_) {
+            LOG(LL_ERR, "FFmpegEncoder::QueuePacket - Muxer failed on an earlier packet");
+            POST();
+            return E_FAIL;
+        }
         
         AVCodecContext* codecCtx = (stream->index == videoStream_->index) ? videoCodecContext_ : audioCodecContext_;
         av_packet_rescale_ts(pkt, codecCtx->time_base, stream->time_base);
         pkt->stream_index = stream->index;
         
-        LOG(LL_TRC, "FFmpegEncoder::WritePacket - PTS: ", pkt->pts, ", DTS: ", pkt->dts, ", duration: ", pkt->duration);
-        
-        int ret = av_interleaved_write_frame(formatContext_, pkt);
-        if (ret < 0) {
-            LOG(LL_ERR, "FFmpegEncoder::WritePacket - Failed to write packet, error code: ", ret);
+        LOG(LL_TRC, "FFmpegEncoder::QueuePacket - PTS: ", pkt->pts, ", DTS: ", pkt->dts, ", duration: ", pkt->duration);
+
+        AVPacket* queuedPacket = av_packet_alloc();
+        if (!queuedPacket) {
+            LOG(LL_ERR, "FFmpegEncoder::QueuePacket - Failed to allocate queued packet");
             POST();
             return E_FAIL;
         }
+
+        // Hands the payload over without copying; the encoder's packet is left blank for the next receive.
+        av_packet_move_ref(queuedPacket, pkt);
+        muxQueue_.enqueue(queuedPacket);
         
-        LOG(LL_TRC, "FFmpegEncoder::WritePacket - Packet written successfully");
-        
         POST();
         return S_OK;
     }
 
+    HRESULT FFmpegEncoder::StartMuxer() {
+        PRE();
+        muxerFailed_ = false;
+        writtenPackets_ = 0;
+
+        try {
+            muxerThread_ = std::thread(&FFmpegEncoder::MuxerLoop, this);
+        } catch (const std::exception& ex) {
+            LOG(LL_ERR, "FFmpegEncoder::StartMuxer - Failed to start muxer thread: ", ex.what());
+            POST();
+            return E_FAIL;
+        }
+
+        POST();
+        return S_OK;
+    }
+
+    void FFmpegEncoder::StopMuxer() {
+        if (!muxerThread_.joinable()) {
+            return;
+        }
+
+        PRE();
+        muxQueue_.enqueue(nullptr);
+        muxerThread_.join();
+
+        LOG(LL_DBG, "FFmpegEncoder::StopMuxer - Muxer stopped after ", writtenPackets_, " packets");
+        if (muxerFailed_) {
+            LOG(LL_ERR, "FFmpegEncoder::StopMuxer - Muxer reported a write failure");
+        }
+        POST();
+    }
+
+    void FFmpegEncoder::MuxerLoop() {
+        PRE();
+        LOG(LL_DBG, "FFmpegEncoder muxer thread started");
+
+        // A null packet marks the end of the stream. After a failure keep draining so queued packets are freed.
+        while (AVPacket* pkt = muxQueue_.dequeue()) {
+            if (!muxerFailed_ && segmenting_ && pkt->stream_index == videoStream_->index) {
+                if (segmentStartDts_ == AV_NOPTS_VALUE) {
+                    segmentStartDts_ = pkt->dts;
+                } else if ((pkt->flags & AV_PKT_FLAG_KEY) && segmentPackets_ > 0 && SegmentIsFull(pkt) &&
+                           FAILED(StartNextSegment(pkt->dts))) {
+                    muxerFailed_ = true;
+                }
+            }
+            if (!muxerFailed_ && closingSegment_ && pkt->stream_index == audioStream_->index) {
+                if (isBeforeSegmentCut(pkt->pts, pkt->dts, audioStream_->time_base, segmentStartDts_,
+                                       videoStream_->time_base)) {
+                    if (FAILED(WriteLateAudioPacket(pkt))) {
+                        muxerFailed_ = true;
+                    }
+                    av_packet_free(&pkt);
+                    continue;
+                }
+                FinishClosingSegment();
+            }
+            if (!muxerFailed_) {
+                const int size = pkt->size;
+                if (segmentIndex_ > 1) {
+                    ShiftIntoSegment(pkt, formatContext_, segmentTimestampOffset_);
+                }
+                // The muxer takes the packet over, so it is counted first.
+                if (reservedMoov_.bytes > 0) {
+                    CountIndexedPacket(fileIndexCounter_, pkt);
+                }
+                const auto writeStart = std::chrono::steady_clock::now();
+                int ret = av_interleaved_write_frame(formatContext_, pkt);
+                muxWriteLatency_.record(std::chrono::steady_clock::now() - writeStart);
+                if (ret < 0) {
+                    LOG(LL_ERR, "FFmpegEncoder::MuxerLoop - Failed to write packet, error code: ", ret);
+                    muxerFailed_ = true;
+                } else {
+                    ++writtenPackets_;
+                    ++segmentPackets_;
+                    segmentPacketBytes_ += size;
+                    if (!reservedMoovOutgrown_ && reservedMoov_.bytes > 0 &&
+                        estimateMp4IndexBytes(fileIndexCounter_.counts()) > reservedMoov_.bytes) {
+                        reservedMoovOutgrown_ = true;
+                        LOG(LL_WRN, "FFmpegEncoder::MuxerLoop - The file has outgrown its reserved MP4 index and "
+                            "will be rewritten when it is finished; raise faststart_reserve_minutes to avoid it");
+                    }
+                }
+            }
+            av_packet_free(&pkt);
+        }
+        FinishClosingSegment();
+
+        LOG(LL_DBG, "FFmpegEncoder muxer thread stopped");
+        POST();
+    }
+
     HRESULT FFmpegEncoder::Close(BOOL finalize) {
         PRE();
         LOG(LL_NFO, "FFmpegEncoder::Close called, finalize: ", finalize ? "true" : "false");
         
+        // Let the encode stage finish every queued frame before the codec is flushed.
+        std::lock_guard<std::mutex> submitLock(videoSubmitMutex_);
+        StopVideoEncodeStage();
+
         std::lock_guard<std::mutex> lock(encoderMutex_);
+        std::scoped_lock codecLock(videoEncodeMutex_, audioEncodeMutex_);
         
         if (!isOpen_) {
             LOG(LL_WRN, "FFmpegEncoder::Close - Encoder not open");
@@ -1671,9 +2804,12 @@ namespace Encoder {
                         if (fgRet == AVERROR_EOF || fgRet == AVERROR(EAGAIN)) {
                             break;
                         }
-                        if (fgRet < 0) {
+                        // Filters that hold frames back, like a delaying one ahead of the adjustment, return them
+                        // here, so they take the same adjustment as in FilterVideoFrame.
+                        if (fgRet < 0 || FAILED(AdjustFilteredVideoFrame(filteredFrame))) {
                             break;
                         }
+                        ForwardVideoFrame(filteredFrame);
                         EncodeVideoFrame(filteredFrame);
                         av_frame_unref(filteredFrame);
                     }
@@ -1681,23 +2817,29 @@ namespace Encoder {
                     LOG(LL_DBG, "FFmpegEncoder::Close - Video filter graph drained");
                 }
 
-                avcodec_send_frame(videoCodecContext_, nullptr);
-                
-                while (true) {
-                    if (!packet_) {
-                        packet_ = av_packet_alloc();
+                if (chunkedVideoEncoder_.isOpen()) {
+                    if (FAILED(chunkedVideoEncoder_.finish())) {
+                        LOG(LL_ERR, "FFmpegEncoder::Close - Error flushing the chunk encoders");
                     }
-                    av_packet_unref(packet_);
+                } else {
+                    avcodec_send_frame(videoCodecContext_, nullptr);
+                
+                    while (true) {
+                        if (!videoPacket_) {
+                            videoPacket_ = av_packet_alloc();
+                        }
+                        av_packet_unref(videoPacket_);
                     
-                    int ret = avcodec_receive_packet(videoCodecContext_, packet_);
-                    if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN)) {
-                        break;
-                    } else if (ret < 0) {
-                        LOG(LL_ERR, "FFmpegEncoder::Close - Error flushing video encoder, error code: ", ret);
-                        break;
-                    }
+                        int ret = avcodec_receive_packet(videoCodecContext_, videoPacket_);
+                        if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN)) {
+                            break;
+                        } else if (ret < 0) {
+                            LOG(LL_ERR, "FFmpegEncoder::Close - Error flushing video encoder, error code: ", ret);
+                            break;
+                        }
                     
-                    WritePacket(packet_, videoStream_);
+                        QueuePacket(videoPacket_, videoStream_);
+                    }
                 }
                 LOG(LL_DBG, "FFmpegEncoder::Close - Video encoder flushed");
             }
@@ -1777,12 +2919,12 @@ namespace Encoder {
                 avcodec_send_frame(audioCodecContext_, nullptr);
                 
                 while (true) {
-                    if (!packet_) {
-                        packet_ = av_packet_alloc();
+                    if (!audioPacket_) {
+                        audioPacket_ = av_packet_alloc();
                     }
-                    av_packet_unref(packet_);
+                    av_packet_unref(audioPacket_);
                     
-                    int ret = avcodec_receive_packet(audioCodecContext_, packet_);
+                    int ret = avcodec_receive_packet(audioCodecContext_, audioPacket_);
                     if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN)) {
                         break;
                     } else if (ret < 0) {
@@ -1790,26 +2932,52 @@ namespace Encoder {
                         break;
                     }
                     
-                    WritePacket(packet_, audioStream_);
+                    QueuePacket(audioPacket_, audioStream_);
                 }
                 LOG(LL_DBG, "FFmpegEncoder::Close - Audio encoder flushed");
             }
             
-            if (formatContext_) {
-                LOG(LL_DBG, "FFmpegEncoder::Close - Writing file trailer");
-                int ret = av_write_trailer(formatContext_);
-                if (ret < 0) {
-                    LOG(LL_ERR, "FFmpegEncoder::Close - Failed to write file trailer, error code: ", ret);
-                } else {
-                    LOG(LL_DBG, "FFmpegEncoder::Close - File trailer written successfully");
-                }
+            // Every packet must reach the file before the trailer (and any moov rewrite) is written.
+            StopMuxer();
+
+            const bool trailerWritten = formatContext_ &&
+                SUCCEEDED(WriteTrailer(formatContext_, reservedMoov_, fileIndexCounter_.counts()));
+            // Earlier segments come first in the manifest.
+            StopSegmentFinalizer();
+            if (trailerWritten && segmenting_) {
+                std::lock_guard<std::mutex> segmentLock(segmentListMutex_);
+                finishedSegments_.push_back(SegmentFilename(segmentIndex_));
             }
         } else {
             LOG(LL_NFO, "FFmpegEncoder::Close - Aborting encoding (finalize=false)");
-        }
-        
+            // The chunk encoders queue packets until they stop, so they go before the muxer.
+            chunkedVideoEncoder_.close();
+            StopMuxer();
+        }
+        
+        videoConvertLatency_.log();
+        videoFilterLatency_.log();
+        videoSendFrameLatency_.log();
+        videoReceivePacketLatency_.log();
+        audioSendFrameLatency_.log();
+        audioReceivePacketLatency_.log();
+        muxWriteLatency_.log();
+        videoFramePool_.log();
+        videoFilterInputPool_.log();
+        audioFramePool_.log();
+
+        // Cleanup also waits for segments still being finished in the background.
         Cleanup();
         isOpen_ = false;
+        // After Cleanup, which writes out the last buffers.
+        if (outputWriter_) {
+            outputWriter_->log();
+        }
+        if (segmenting_) {
+            WriteSegmentManifest();
+            LOG(LL_NFO, "FFmpegEncoder::Close - Export written to ", finishedSegments_.size(), " of ", segmentIndex_,
+                " segments");
+        }
         
         LOG(LL_NFO, "FFmpegEncoder::Close - Encoder closed successfully");
         
@@ -1849,17 +3017,34 @@ namespace Encoder {
             LOG(LL_DBG, "FFmpegEncoder::Cleanup - Audio frame freed");
         }
 
+        videoFramePool_.reset();
+        videoFilterInputPool_.reset();
+        audioFramePool_.reset();
+        videoFrameFollowers_.clear();
+
         if (audioFifo_) {
             av_audio_fifo_free(audioFifo_);
             audioFifo_ = nullptr;
             LOG(LL_DBG, "FFmpegEncoder::Cleanup - Audio FIFO freed");
         }
         
-        if (packet_) {
-            av_packet_free(&packet_);
-            LOG(LL_DBG, "FFmpegEncoder::Cleanup - Packet freed");
+        if (videoPacket_) {
+            av_packet_free(&videoPacket_);
+            LOG(LL_DBG, "FFmpegEncoder::Cleanup - Video packet freed");
+        }
+
+        if (audioPacket_) {
+            av_packet_free(&audioPacket_);
+            LOG(LL_DBG, "FFmpegEncoder::Cleanup - Audio packet freed");
         }
         
+        chunkedVideoEncoder_.close();
+        if (videoChunkTemplate_) {
+            avcodec_free_context(&videoChunkTemplate_);
+        }
+        AVCodecContext* chunkProbe = videoChunkProbe_.exchange(nullptr);
+        avcodec_free_context(&chunkProbe);
+
         if (videoCodecContext_) {
             avcodec_free_context(&videoCodecContext_);
             LOG(LL_DBG, "FFmpegEncoder::Cleanup - Video codec context freed");
@@ -1870,10 +3055,9 @@ namespace Encoder {
             LOG(LL_DBG, "FFmpegEncoder::Cleanup - Audio codec context freed");
         }
         
-        if (swsContext_) {
-            sws_freeContext(swsContext_);
-            swsContext_ = nullptr;
-            LOG(LL_DBG, "FFmpegEncoder::Cleanup - SWS context freed");
+        if (videoConverter_.isInitialized()) {
+            videoConverter_.shutdown();
+            LOG(LL_DBG, "FFmpegEncoder::Cleanup - Video converter freed");
         }
         
         if (swrContext_) {
@@ -1897,8 +3081,21 @@ namespace Encoder {
             LOG(LL_DBG, "FFmpegEncoder::Cleanup - Audio filter graph freed");
         }
         
+        StopSegmentFinalizer();
+        if (firstFormatContext_) {
+            // Its file was closed by the segment finalizer.
+            avformat_free_context(firstFormatContext_);
+            firstFormatContext_ = nullptr;
+        }
+
         if (formatContext_) {
-            if (formatContext_->pb && !(formatContext_->oformat->flags & AVFMT_NOFILE)) {
+            if (outputWriter_ && outputWriter_->isOpen()) {
+                formatContext_->pb = nullptr;
+                if (FAILED(outputWriter_->close())) {
+                    LOG(LL_ERR, "FFmpegEncoder::Cleanup - Failed to write the end of the output file");
+                }
+                LOG(LL_DBG, "FFmpegEncoder::Cleanup - Output file closed");
+            } else if (formatContext_->pb && !(formatContext_->oformat->flags & AVFMT_NOFILE)) {
                 avio_closep(&formatContext_->pb);
                 LOG(LL_DBG, "FFmpegEncoder::Cleanup - Output file closed");
             }
@@ -1,14 +1,28 @@
 #pragma once
 
+#include "AVFramePool.h"
+#include "AsyncOutputWriter.h"
+#include "ChunkedVideoEncoder.h"
+#include "ColorAdjust.h"
+#include "EncoderThreading.h"
 #include "FFmpegTypes.h"
+#include "LatencyHistogram.h"
+#include "Mp4IndexEstimate.h"
+#include "Platform.h"
+#include "SafeQueue.h"
+#include "SpscRingBuffer.h"
+#include "VideoConverter.h"
 #include "logger.h"
 
+#include <atomic>
 #include <string>
 #include <memory>
 #include <mutex>
-#include <Windows.h>
+#include <thread>
+#include <vector>
 
 struct AVFormatContext;
+struct AVCodec;
 struct AVCodecContext;
 struct AVStream;
 struct AVFrame;
@@ -20,6 +34,15 @@ struct AVFilterGraph;
 struct AVFilterContext;
 
 namespace Encoder {
+    // When the export rotates to a new output file. With both limits 0 it is written to a single file.
+    struct OutputSegmentPolicy {
+        // Start a new file at the first keyframe after this many minutes, or after this many MB of packets.
+        uint32_t minutes = 0;
+        uint32_t sizeMb = 0;
+        // Write an ffconcat list of the finished files next to them.
+        bool manifest = true;
+    };
+
     class FFmpegEncoder {
     public:
         FFmpegEncoder();
@@ -30,6 +53,24 @@ namespace Encoder {
 
         HRESULT SetConfig(const FFmpeg::FFENCODERCONFIG& config);
 
+        // Also decides whether video is encoded in parallel chunks. Takes effect at the next Open.
+        void SetThreadingPolicy(const EncoderThreadingPolicy& policy) { threadingPolicy_ = policy; }
+
+        // Size of each of the two output write buffers; 0 writes through avio_open's small buffer on the muxer
+        // thread instead. Takes effect at the next Open.
+        void SetOutputBufferSize(size_t bytes) { outputBufferBytes_ = bytes; }
+
+        // How MP4 presets with format.faststart put the index first. Reserve sizes the gap for reserveMinutes of
+        // output. Takes effect at the next Open.
+        void SetFaststartPolicy(FFmpeg::FaststartMode mode, uint32_t reserveMinutes) {
+            faststartMode_ = mode;
+            faststartReserveMinutes_ = reserveMinutes;
+        }
+
+        // Segments are named <name>_001.<ext>, <name>_002.<ext>, ... after the output file. Takes effect at the
+        // next Open.
+        void SetSegmentPolicy(const OutputSegmentPolicy& policy) { segmentPolicy_ = policy; }
+
         HRESULT Open(const FFmpeg::FFENCODERINFO& info);
 
         HRESULT SendVideoFrame(const FFmpeg::FFVIDEOFRAME& frame);
@@ -44,18 +85,41 @@ namespace Encoder {
 
         BOOL IsAudioActive() const { return audioCodecContext_ != nullptr; }
 
+        // Set once the video encode or filter stage has given up.
+        BOOL HasVideoFailed() const { return videoEncodeFailed_ || videoFilterFailed_; }
+
+        // Whether other takes exactly the frames this encoder hands its codec: same video filters, output size,
+        // pixel format, colour parameters and time base. Both must be open.
+        bool CanShareVideoFrames(const FFmpegEncoder& other) const;
+
+        // Every frame this encoder converts or filters also goes to follower, by reference, so the conversion runs
+        // once for both. Frames keep flowing to followers after this encoder's own encode fails. Call before the
+        // first frame, and close the follower after this encoder.
+        void ShareVideoFramesWith(FFmpegEncoder* follower);
+
+        // A frame ready for the codec, from the encoder sharing its frames with this one.
+        HRESULT SendSharedVideoFrame(const AVFrame* frame);
+
+        // Advances the video timestamp past count frames that will never be sent, leaving a gap in the stream
+        // instead of pulling later frames earlier against the audio.
+        void SkipVideoFrames(int64_t count);
+
+        // How many of the files written so far outgrew their reserved MP4 index and were rewritten to put it first
+        // instead. Final once Close returns.
+        int GetFaststartRewrites() const { return faststartRewrites_; }
+
     private:
         FFmpeg::FFENCODERCONFIG config_;
         FFmpeg::FFENCODERINFO info_;
         bool configSet_ = false;
-        bool isOpen_ = false;
+        EncoderThreadingPolicy threadingPolicy_;
+        std::atomic<bool> isOpen_ = false;
 
         AVFormatContext* formatContext_ = nullptr;
         AVCodecContext* videoCodecContext_ = nullptr;
         AVCodecContext* audioCodecContext_ = nullptr;
         AVStream* videoStream_ = nullptr;
         AVStream* audioStream_ = nullptr;
-        SwsContext* swsContext_ = nullptr;
         SwrContext* swrContext_ = nullptr;
         AVAudioFifo* audioFifo_ = nullptr;
 
@@ -71,23 +135,179 @@ namespace Encoder {
 
         AVFrame* videoFrame_ = nullptr;
         AVFrame* audioFrame_ = nullptr;
-        AVPacket* packet_ = nullptr;
+        AVPacket* videoPacket_ = nullptr;
+        AVPacket* audioPacket_ = nullptr;
 
         int64_t videoPts_ = 0;
         int64_t audioPts_ = 0;
 
+        // encoderMutex_ guards open/close and configuration; each codec has its own lock so audio never
+        // waits behind a video encode. Close takes all of them, always in this order.
         std::mutex encoderMutex_;
+        std::mutex videoEncodeMutex_;
+        std::mutex audioEncodeMutex_;
+
+        // Both encoders hand finished packets to a single muxer thread, which owns every write to
+        // formatContext_ between the header and the trailer. A null packet stops it.
+        static constexpr uint32_t kMuxQueueCapacity = 256;
+        SafeQueue<AVPacket*> muxQueue_;
+        std::thread muxerThread_;
+        std::atomic<bool> muxerFailed_ = false;
+        int64_t writtenPackets_ = 0;
+
+        LatencyHistogram videoConvertLatency_{"video.convert"};
+        LatencyHistogram videoFilterLatency_{"video.filter"};
+        LatencyHistogram videoSendFrameLatency_{"video.send_frame"};
+        LatencyHistogram videoReceivePacketLatency_{"video.receive_packet"};
+        LatencyHistogram audioSendFrameLatency_{"audio.send_frame"};
+        LatencyHistogram audioReceivePacketLatency_{"audio.receive_packet"};
+        LatencyHistogram muxWriteLatency_{"mux.write"};
+
+        // Encoder input frames; video frames are acquired on the submitting thread and released by the encode thread.
+        AVFramePool videoFramePool_{"video.frames"};
+        AVFramePool audioFramePool_{"audio.frames"};
+
+        // Conversion runs on the submitting thread (plus band helpers) while a dedicated thread encodes,
+        // so frame N+1 is converted while frame N is in the codec. Queued frames are owned by the queue.
+        static constexpr size_t kVideoEncodeQueueDepth = 2;
+        static constexpr size_t kMaxConversionBands = 4;
+        VideoConverter videoConverter_;
+        // Set on the first frame when the whole video filter chain is a colour adjustment the converter applies.
+        bool videoFilterFused_ = false;
+        ColorAdjustment videoColorAdjustment_;
+        // A colour adjustment that ended a longer chain: the rest runs in the graph and this is applied to its output.
+        YuvColorAdjuster videoGraphColorAdjuster_;
+        SpscRingBuffer<AVFrame*> videoEncodeQueue_;
+        std::thread videoEncodeThread_;
+        std::atomic<bool> videoEncodeFailed_ = false;
+        std::mutex videoSubmitMutex_;
+        int64_t convertedVideoFrames_ = 0;
+        int64_t videoConvertNs_ = 0;
+        int64_t stageEncodedVideoFrames_ = 0;
+        int64_t videoEncodeNs_ = 0;
+        // Encoders fed by ShareVideoFramesWith. Only the thread that submits to the encode stage touches it.
+        std::vector<FFmpegEncoder*> videoFrameFollowers_;
+
+        // Parallel chunk encoding (EncoderThreadingPolicy::parallelEncoders), or frame-parallel encoding, which
+        // intra-only codecs get automatically. Frames go to chunkedVideoEncoder_, whose instances are opened from
+        // videoChunkTemplate_: a copy of videoCodecContext_'s settings taken just before it was opened for the
+        // stream parameters. Open probes one instance against those; when it matches, the probe becomes the first
+        // chunk's encoder and videoCodecContext_ is swapped for an unopened copy of the settings.
+        static constexpr uint32_t kMaxFrameParallelEncoders = 32;
+        uint32_t videoEncoderInstances_ = 1;
+        bool videoFrameParallel_ = false;
+        AVCodecContext* videoChunkTemplate_ = nullptr;
+        std::atomic<AVCodecContext*> videoChunkProbe_ = nullptr;
+        ChunkedVideoEncoder chunkedVideoEncoder_;
+
+        // With a video filter graph, frames are copied into pooled input frames and filtered on their own thread,
+        // so capture, filtering and encoding overlap. The graph itself slices heavy filters over
+        // videoFilterThreads_ threads (_filterThreads option, 0 lets libavfilter pick one per core).
+        static constexpr size_t kVideoFilterQueueDepth = 2;
+        int videoFilterThreads_ = 0;
+        AVFramePool videoFilterInputPool_{"video.filter_input"};
+        SpscRingBuffer<AVFrame*> videoFilterQueue_;
+        std::thread videoFilterThread_;
+        std::atomic<bool> videoFilterFailed_ = false;
+        std::vector<AVFrame*> videoFilterOutput_;
+        int64_t filteredVideoFrames_ = 0;
+        int64_t videoFilterNs_ = 0;
 
         std::wstring outputFilename_;
+        size_t outputBufferBytes_ = 8 * 1024 * 1024;
+        // Writer of the current output file; null when outputBufferBytes_ is 0.
+        std::unique_ptr<AsyncOutputWriter> outputWriter_;
+
+        // Reserved moov space. Where the muxer puts the gap is not part of its API, so the layout is read back
+        // after the header, and the trailer only writes into the gap when it was as expected.
+        struct ReservedMoov {
+            int64_t bytes = 0;
+            int64_t pos = 0;
+            bool layoutChecked = false;
+        };
+        // The mp4 muxer follows the reserved gap with an 8-byte free box and the 8-byte mdat header.
+        static constexpr int64_t kMdatHeaderBytes = 16;
+        FFmpeg::FaststartMode faststartMode_ = FFmpeg::FaststartReserve;
+        uint32_t faststartReserveMinutes_ = 30;
+        ReservedMoov reservedMoov_;
+        // What the current file's index has to hold so far, checked against reservedMoov_ as packets are muxed.
+        Mp4IndexCounter fileIndexCounter_;
+        bool reservedMoovOutgrown_ = false;
+        std::atomic<int> faststartRewrites_ = 0;
+
+        // A segment the muxer has moved on from, waiting for its trailer.
+        struct FinishedSegment {
+            AVFormatContext* formatContext = nullptr;
+            std::unique_ptr<AsyncOutputWriter> writer;
+            std::wstring filename;
+            ReservedMoov reservedMoov;
+            Mp4IndexCounter index;
+            // The first segment's context also owns videoStream_ and audioStream_, so Cleanup frees it.
+            bool freeContext = true;
+        };
+
+        // Segmented output. The muxer thread rotates formatContext_ to a new file at a video keyframe and queues
+        // the old one for segmentFinalizeThread_, so only the last segment is finalized by Close. Timestamps in
+        // later segments start at the keyframe's DTS. A null segment stops the thread.
+        // The old file stays open as closingSegment_ until the first audio packet at or after the cut, taking the
+        // audio packets that start before it.
+        static constexpr uint32_t kSegmentFinalizeQueueCapacity = 4;
+        OutputSegmentPolicy segmentPolicy_;
+        bool segmenting_ = false;
+        int segmentIndex_ = 0;
+        int64_t segmentPackets_ = 0;
+        int64_t segmentPacketBytes_ = 0;
+        int64_t segmentStartDts_ = 0;
+        int64_t segmentTimestampOffset_ = 0;
+        FinishedSegment* closingSegment_ = nullptr;
+        int64_t closingSegmentOffset_ = 0;
+        AVFormatContext* firstFormatContext_ = nullptr;
+        SafeQueue<FinishedSegment*> segmentFinalizeQueue_;
+        std::thread segmentFinalizeThread_;
+        std::mutex segmentListMutex_;
+        std::vector<std::wstring> finishedSegments_;
 
         HRESULT InitializeVideoEncoder();
         HRESULT InitializeAudioEncoder();
-        HRESULT InitializeVideoFilterGraph(int inputPixFmt, int inputWidth, int inputHeight);
+        HRESULT InitializeVideoFilterGraph(const char* filters, int inputPixFmt, int inputWidth, int inputHeight);
         HRESULT InitializeAudioFilterGraph(int inputSampleFmt, int inputSampleRate, int inputNbChannels);
         HRESULT ParseEncoderOptions(const char* optionsString, AVCodecContext* codecContext);
+        void ApplyEncoderThreading(const AVCodec* codec);
+        HRESULT ProbeChunkEncoder();
+        AVCodecContext* CreateChunkEncoder();
         HRESULT EncodeVideoFrame(AVFrame* frame);
+        HRESULT StartVideoEncodeStage();
+        void StopVideoEncodeStage();
+        void VideoEncodeLoop();
+        HRESULT SubmitVideoFrame(AVFrame* frame);
+        void ForwardVideoFrame(const AVFrame* frame);
+        HRESULT StartVideoFilterStage();
+        void StopVideoFilterStage();
+        void VideoFilterLoop();
+        HRESULT AdjustFilteredVideoFrame(AVFrame* frame);
+        HRESULT FilterVideoFrame(AVFrame* frame);
         HRESULT EncodeAudioFrame(AVFrame* frame);
-        HRESULT WritePacket(AVPacket* pkt, AVStream* stream);
+        HRESULT QueuePacket(AVPacket* pkt, AVStream* stream);
+        int64_t EstimateBitRate() const;
+        Mp4IndexCounts ProjectIndexCounts(double seconds) const;
+        int64_t EstimateReservedMoovBytes() const;
+        void LogReservedMoovCoverage() const;
+        HRESULT OpenOutputFile(AVFormatContext* formatContext, const std::string& filename);
+        HRESULT WriteTrailer(AVFormatContext* formatContext, const ReservedMoov& reservedMoov,
+                             const Mp4IndexCounts& index);
+        void CountIndexedPacket(Mp4IndexCounter& counter, const AVPacket* pkt) const;
+        std::wstring SegmentFilename(int index) const;
+        bool SegmentIsFull(const AVPacket* pkt) const;
+        HRESULT StartNextSegment(int64_t cutDts);
+        void ShiftIntoSegment(AVPacket* pkt, const AVFormatContext* target, int64_t offset) const;
+        HRESULT WriteLateAudioPacket(AVPacket* pkt);
+        void FinishClosingSegment();
+        void SegmentFinalizeLoop();
+        void StopSegmentFinalizer();
+        void WriteSegmentManifest();
+        HRESULT StartMuxer();
+        void StopMuxer();
+        void MuxerLoop();
         void Cleanup();
 
         std::string GetOptionValue(const std::string& options, const std::string& key, const std::string& defaultValue = "");
@@ -1,7 +1,8 @@
 #pragma once
 
+#include "Platform.h"
+
 #include <cstring>
-#include <Windows.h>
 
 namespace FFmpeg {
 
@@ -35,6 +36,13 @@ namespace FFmpeg {
         bt2020_NCL = 4
     } ColorSpace;
 
+    // How an MP4 with format.faststart gets its index (moov) in front of the media data.
+    typedef enum {
+        FaststartRewrite = 0,   // moov written at the end, then the whole file is shifted to make room for it
+        FaststartReserve = 1,   // space reserved after the header and filled in by the trailer
+        FaststartFragmented = 2 // fragmented MP4: an empty moov up front and an index per keyframe fragment
+    } FaststartMode;
+
     typedef struct {
         CHAR encoder[16];
         CHAR options[8192];
@@ -0,0 +1,79 @@
+#include "FrameBufferPool.h"
+#include "logger.h"
+
+#include <algorithm>
+
+namespace Encoder {
+    void FrameBufferPool::reset(size_t bufferBytes, size_t bufferCount) {
+        PRE();
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        freeBuffers_.clear();
+        freeBuffers_.reserve(bufferCount);
+        bufferBytes_ = bufferBytes;
+        outstanding_ = 0;
+        highWater_ = 0;
+        hits_ = 0;
+        misses_ = 0;
+
+        for (size_t i = 0; i < bufferCount; ++i) {
+            freeBuffers_.emplace_back(bufferBytes);
+        }
+
+        LOG(LL_DBG, "FrameBufferPool::reset - Preallocated ", bufferCount, " buffers of ", bufferBytes, " bytes");
+        POST();
+    }
+
+    std::vector<uint8_t> FrameBufferPool::acquire(size_t bytes) {
+        std::vector<uint8_t> buffer;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            // Prefer the most recently returned buffer: it is the most likely to still be cache/TLB warm.
+            if (!freeBuffers_.empty()) {
+                buffer = std::move(freeBuffers_.back());
+                freeBuffers_.pop_back();
+            }
+
+            if (buffer.capacity() >= bytes) {
+                ++hits_;
+            } else {
+                ++misses_;
+                bufferBytes_ = (std::max)(bufferBytes_, bytes);
+            }
+
+            ++outstanding_;
+            highWater_ = (std::max)(highWater_, outstanding_);
+        }
+
+        // Grows (and zero-fills) only on a miss; a recycled buffer of sufficient capacity is reused as-is.
+        buffer.resize(bytes);
+        return buffer;
+    }
+
+    void FrameBufferPool::release(std::vector<uint8_t>&& buffer) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (outstanding_ > 0) {
+            --outstanding_;
+        }
+
+        if (buffer.capacity() == 0) {
+            return;
+        }
+
+        freeBuffers_.push_back(std::move(buffer));
+    }
+
+    FrameBufferPool::Stats FrameBufferPool::getStats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        Stats stats;
+        stats.hits = hits_;
+        stats.misses = misses_;
+        stats.highWater = highWater_;
+        stats.pooledBuffers = freeBuffers_.size() + outstanding_;
+        stats.bufferBytes = bufferBytes_;
+        return stats;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace Encoder {
+    // Recycles the large per-frame readback buffers handed from the render thread to the
+    // video encoding worker, so steady-state capture does not allocate (or page-fault) per frame.
+    class FrameBufferPool {
+    public:
+        struct Stats {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            size_t highWater = 0;
+            size_t pooledBuffers = 0;
+            size_t bufferBytes = 0;
+        };
+
+        FrameBufferPool() = default;
+        ~FrameBufferPool() = default;
+
+        FrameBufferPool(const FrameBufferPool&) = delete;
+        FrameBufferPool& operator=(const FrameBufferPool&) = delete;
+
+        void reset(size_t bufferBytes, size_t bufferCount);
+
+        std::vector<uint8_t> acquire(size_t bytes);
+
+        void release(std::vector<uint8_t>&& buffer);
+
+        Stats getStats() const;
+
+    private:
+        mutable std::mutex mutex_;
+        std::vector<std::vector<uint8_t>> freeBuffers_;
+        size_t bufferBytes_ = 0;
+        size_t outstanding_ = 0;
+        size_t highWater_ = 0;
+        uint64_t hits_ = 0;
+        uint64_t misses_ = 0;
+    };
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace Encoder {
+    // What the index (moov) of one MP4 file has to describe.
+    struct Mp4IndexCounts {
+        int64_t videoSamples = 0;
+        int64_t audioSamples = 0;
+        int64_t keyframes = 0;
+        // Runs of equal sample durations (one stts entry each) and of equal pts - dts offsets (one ctts entry each).
+        int64_t durationRuns = 0;
+        int64_t offsetRuns = 0;
+        int64_t bytes = 0;
+    };
+
+    // Movie and track headers, sample descriptions, edit lists and metadata: the part of the index that does not
+    // grow with the file.
+    constexpr int64_t kMp4IndexFixedBytes = 64 * 1024;
+    // The mp4 muxer merges a track's adjacent samples into chunks of under 1 MiB.
+    constexpr int64_t kMp4MaxChunkBytes = 1024 * 1024;
+
+    // An upper bound of the index size: stsz 4 B and sdtp 1 B per sample, stss 4 B per keyframe, 8 B per stts and
+    // ctts entry, and co64 8 B plus a 12 B stsc entry per chunk. Chunks are what dominates: interleaved by
+    // timestamp, the tracks can only alternate about twice per sample of the rarer one.
+    inline int64_t estimateMp4IndexBytes(const Mp4IndexCounts& counts) {
+        const int64_t samples = counts.videoSamples + counts.audioSamples;
+        int64_t chunks = samples;
+        if (counts.videoSamples > 0 && counts.audioSamples > 0) {
+            const int64_t alternations = 2 * (std::min)(counts.videoSamples, counts.audioSamples) + 2;
+            chunks = (std::min)(samples, alternations + 2 * counts.bytes / kMp4MaxChunkBytes);
+        }
+        // Every track's last sample can add one more stts entry.
+        const int64_t tableEntries = counts.durationRuns + counts.offsetRuns + 2;
+        return kMp4IndexFixedBytes + samples * 5 + counts.keyframes * 4 + tableEntries * 8 + chunks * 20;
+    }
+
+    // Keeps Mp4IndexCounts for the packets of one file as they are muxed. Timestamps are in the stream's time base.
+    class Mp4IndexCounter {
+    public:
+        void add(bool video, bool keyframe, int64_t pts, int64_t dts, int64_t bytes) {
+            Track& track = tracks_[video ? 0 : 1];
+            ++(video ? counts_.videoSamples : counts_.audioSamples);
+            if (video && keyframe) {
+                ++counts_.keyframes;
+            }
+            counts_.bytes += bytes;
+
+            if (track.lastDts != kUnset) {
+                const int64_t duration = dts - track.lastDts;
+                if (duration != track.lastDuration) {
+                    ++counts_.durationRuns;
+                    track.lastDuration = duration;
+                }
+            }
+            track.lastDts = dts;
+
+            const int64_t offset = pts - dts;
+            if (video && offset != track.lastOffset) {
+                ++counts_.offsetRuns;
+                track.lastOffset = offset;
+            }
+        }
+
+        const Mp4IndexCounts& counts() const { return counts_; }
+
+    private:
+        static constexpr int64_t kUnset = (std::numeric_limits<int64_t>::min)();
+
+        struct Track {
+            int64_t lastDts = kUnset;
+            int64_t lastDuration = kUnset;
+            int64_t lastOffset = kUnset;
+        };
+
+        Track tracks_[2];
+        Mp4IndexCounts counts_;
+    };
+}
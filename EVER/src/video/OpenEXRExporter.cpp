@@ -2,11 +2,6 @@
 #pragma warning(disable : 4244)
 #pragma warning(disable : 26812)
 
-#define NOMINMAX
-#include <Windows.h>
-#undef min
-#undef max
-
 #include "OpenEXRExporter.h"
 #include "logger.h"
 
@@ -36,24 +31,9 @@ namespace Encoder {
         POST();
     }
 
-    HRESULT OpenEXRExporter::exportFrame(const Microsoft::WRL::ComPtr<ID3D11DeviceContext>& deviceContext,
-                                        const Microsoft::WRL::ComPtr<ID3D11Texture2D>& colorTexture,
-                                        const Microsoft::WRL::ComPtr<ID3D11Texture2D>& depthTexture,
-                                        uint64_t frameNumber) {
+    HRESULT OpenEXRExporter::writeFrame(const void* colorData, const void* depthData, uint64_t frameNumber) {
         PRE();
 
-        D3D11_MAPPED_SUBRESOURCE mappedColor = {nullptr};
-        D3D11_MAPPED_SUBRESOURCE mappedDepth = {nullptr};
-
-        if (colorTexture) {
-            REQUIRE(deviceContext->Map(colorTexture.Get(), 0, D3D11_MAP::D3D11_MAP_READ, 0, &mappedColor), 
-                    "Failed to map color texture for EXR export");
-        }
-        if (depthTexture) {
-            REQUIRE(deviceContext->Map(depthTexture.Get(), 0, D3D11_MAP::D3D11_MAP_READ, 0, &mappedDepth),
-                    "Failed to map depth texture for EXR export");
-        }
-
         struct RGBA {
             half r;
             half g;
@@ -68,13 +48,13 @@ namespace Encoder {
         Imf::Header header(width_, height_);
         Imf::FrameBuffer framebuffer;
 
-        if (mappedColor.pData != nullptr) {
+        if (colorData != nullptr) {
             LOG_CALL(LL_DBG, header.channels().insert("R", Imf::Channel(Imf::HALF)));
             LOG_CALL(LL_DBG, header.channels().insert("G", Imf::Channel(Imf::HALF)));
             LOG_CALL(LL_DBG, header.channels().insert("B", Imf::Channel(Imf::HALF)));
             LOG_CALL(LL_DBG, header.channels().insert("SubsurfaceScatter", Imf::Channel(Imf::HALF)));
             
-            const auto colorArray = static_cast<RGBA*>(mappedColor.pData);
+            const auto colorArray = static_cast<RGBA*>(const_cast<void*>(colorData));
 
             LOG_CALL(LL_DBG, framebuffer.insert("R", Imf::Slice(Imf::HALF, 
                 reinterpret_cast<char*>(&colorArray[0].r),
@@ -93,10 +73,10 @@ namespace Encoder {
                 sizeof(RGBA), sizeof(RGBA) * width_)));
         }
 
-        if (mappedDepth.pData != nullptr) {
+        if (depthData != nullptr) {
             LOG_CALL(LL_DBG, header.channels().insert("depth.Z", Imf::Channel(Imf::FLOAT)));
             
-            const auto depthArray = static_cast<Depth*>(mappedDepth.pData);
+            const auto depthArray = static_cast<Depth*>(const_cast<void*>(depthData));
 
             LOG_CALL(LL_DBG, framebuffer.insert("depth.Z", Imf::Slice(Imf::FLOAT, 
                 reinterpret_cast<char*>(&depthArray[0].depth),
@@ -104,14 +84,42 @@ namespace Encoder {
         }
 
         std::stringstream filenameStream;
-        filenameStream << outputPath_ << "\\frame." 
+        filenameStream << "frame." 
                     << std::setw(5) << std::setfill('0') << frameNumber 
                     << ".exr";
+        const std::string filename = (std::filesystem::path(outputPath_) / filenameStream.str()).string();
 
-        Imf::OutputFile file(filenameStream.str().c_str(), header);
+        Imf::OutputFile file(filename.c_str(), header);
         LOG_CALL(LL_DBG, file.setFrameBuffer(framebuffer));
         LOG_CALL(LL_DBG, file.writePixels(height_));
 
+        LOG(LL_NFO, "Exported EXR frame: ", frameNumber);
+
+        POST();
+        return S_OK;
+    }
+
+#ifdef _WIN32
+    HRESULT OpenEXRExporter::exportFrame(const Microsoft::WRL::ComPtr<ID3D11DeviceContext>& deviceContext,
+                                        const Microsoft::WRL::ComPtr<ID3D11Texture2D>& colorTexture,
+                                        const Microsoft::WRL::ComPtr<ID3D11Texture2D>& depthTexture,
+                                        uint64_t frameNumber) {
+        PRE();
+
+        D3D11_MAPPED_SUBRESOURCE mappedColor = {nullptr};
+        D3D11_MAPPED_SUBRESOURCE mappedDepth = {nullptr};
+
+        if (colorTexture) {
+            REQUIRE(deviceContext->Map(colorTexture.Get(), 0, D3D11_MAP::D3D11_MAP_READ, 0, &mappedColor), 
+                    "Failed to map color texture for EXR export");
+        }
+        if (depthTexture) {
+            REQUIRE(deviceContext->Map(depthTexture.Get(), 0, D3D11_MAP::D3D11_MAP_READ, 0, &mappedDepth),
+                    "Failed to map depth texture for EXR export");
+        }
+
+        const HRESULT hr = writeFrame(mappedColor.pData, mappedDepth.pData, frameNumber);
+
         if (colorTexture) {
             LOG_CALL(LL_DBG, deviceContext->Unmap(colorTexture.Get(), 0));
         }
@@ -120,9 +128,8 @@ namespace Encoder {
             LOG_CALL(LL_DBG, deviceContext->Unmap(depthTexture.Get(), 0));
         }
 
-        LOG(LL_NFO, "Exported EXR frame: ", frameNumber);
-
         POST();
-        return S_OK;
+        return hr;
     }
+#endif
 }
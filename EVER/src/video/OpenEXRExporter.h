@@ -1,7 +1,11 @@
 #pragma once
 
+#include "Platform.h"
+
+#ifdef _WIN32
 #include <d3d11.h>
 #include <wrl/client.h>
+#endif
 #include <cstdint>
 #include <string>
 
@@ -13,10 +17,15 @@ namespace Encoder {
 
         void initialize(const std::string& outputPath, int32_t width, int32_t height);
 
+        // colorData is width*height RGBA half texels, depthData width*height float depths; either may be null.
+        HRESULT writeFrame(const void* colorData, const void* depthData, uint64_t frameNumber);
+
+#ifdef _WIN32
         HRESULT exportFrame(const Microsoft::WRL::ComPtr<ID3D11DeviceContext>& deviceContext,
                         const Microsoft::WRL::ComPtr<ID3D11Texture2D>& colorTexture,
                         const Microsoft::WRL::ComPtr<ID3D11Texture2D>& depthTexture,
                         uint64_t frameNumber);
+#endif
 
         const std::string& getOutputPath() const { return outputPath_; }
 
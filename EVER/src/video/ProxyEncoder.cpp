@@ -0,0 +1,294 @@
+#include "ProxyEncoder.h"
+#include "logger.h"
+#include "util.h"
+
+#include <algorithm>
+#include <chrono>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace Encoder {
+    namespace {
+        constexpr int kBytesPerPixel = 4;
+
+        // Only the calling thread: the proxy's codec threads keep their normal priority, but are fed from here.
+        void lowerCurrentThreadPriority() {
+#ifdef _WIN32
+            if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL)) {
+                LOG(LL_WRN, "ProxyEncoder - Failed to lower the worker's priority: ", GetLastError());
+            }
+#elif defined(__linux__)
+            if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10) != 0) {
+                LOG(LL_WRN, "ProxyEncoder - Failed to lower the worker's priority");
+            }
+#endif
+        }
+
+        int evenDown(int64_t value) {
+            return static_cast<int>((std::max)(value & ~int64_t{1}, int64_t{2}));
+        }
+    }
+
+    ProxyEncoder::~ProxyEncoder() {
+        close();
+    }
+
+    HRESULT ProxyEncoder::open(const ProxyOutput& proxy, const FFmpeg::FFENCODERINFO& exportInfo,
+                               const std::string& inputPixelFormat, FrameBufferPool* framePool) {
+        PRE();
+        filename_ = utf8_encode(proxy.filename);
+
+        if (inputPixelFormat != "rgba" && inputPixelFormat != "bgra") {
+            LOG(LL_ERR, "ProxyEncoder::open - Unsupported input pixel format: ", inputPixelFormat);
+            POST();
+            return E_INVALIDARG;
+        }
+        if (proxy.filename.length() >= std::size(exportInfo.filename)) {
+            LOG(LL_ERR, "ProxyEncoder::open - Filename is too long for FFmpeg encoder: ", filename_);
+            POST();
+            return E_INVALIDARG;
+        }
+
+        const int sourceWidth = exportInfo.video.width;
+        const int sourceHeight = exportInfo.video.height;
+        const int height = evenDown((std::min)(static_cast<int64_t>(proxy.height), static_cast<int64_t>(sourceHeight)));
+        const int width = evenDown(static_cast<int64_t>(sourceWidth) * height / (std::max)(sourceHeight, 1));
+        if (FAILED(downscaler_.initialize(sourceWidth, sourceHeight, width, height))) {
+            POST();
+            return E_INVALIDARG;
+        }
+
+        FFmpeg::FFENCODERINFO info = exportInfo;
+        info.video.width = width;
+        info.video.height = height;
+        std::fill(std::begin(info.filename), std::end(info.filename), L'\0');
+        proxy.filename.copy(info.filename, std::size(info.filename));
+
+        // The preset's own thread options are kept so the proxy stays a light load next to the export.
+        EncoderThreadingPolicy threading;
+        threading.automatic = false;
+        if (FAILED(encoder_.SetConfig(proxy.config))) {
+            LOG(LL_ERR, "ProxyEncoder::open - Failed to set FFmpeg configuration for ", filename_);
+            POST();
+            return E_FAIL;
+        }
+        encoder_.SetThreadingPolicy(threading);
+        if (FAILED(encoder_.Open(info))) {
+            LOG(LL_ERR, "ProxyEncoder::open - Failed to open FFmpeg encoder for ", filename_);
+            POST();
+            return E_FAIL;
+        }
+
+        inputPixelFormat_ = inputPixelFormat;
+        proxyFrame_.assign(static_cast<size_t>(width) * kBytesPerPixel * height, 0);
+        audioBufferPool_.reset(kExpectedAudioChunkBytes, kPreallocatedAudioChunkBuffers);
+        items_.clear();
+        pendingVideoFrames_ = 0;
+        pendingAudioChunks_ = 0;
+        stopping_ = false;
+        failed_ = false;
+        offeredFrames_ = 0;
+        droppedFrames_ = 0;
+        nextFrameIndex_ = 0;
+        encodedFrames_ = 0;
+        scaleNs_ = 0;
+        framePool_ = framePool;
+
+        try {
+            workerThread_ = std::thread(&ProxyEncoder::workerLoop, this);
+        } catch (const std::exception& ex) {
+            LOG(LL_ERR, "ProxyEncoder::open - Failed to start proxy worker thread: ", ex.what());
+            encoder_.Close(false);
+            framePool_ = nullptr;
+            POST();
+            return E_FAIL;
+        }
+
+        LOG(LL_NFO, "ProxyEncoder::open - Writing ", width, "x", height, " proxy to ", filename_);
+        POST();
+        return S_OK;
+    }
+
+    bool ProxyEncoder::takeVideoFrame(std::vector<uint8_t>& data, int rowPitch) {
+        if (!isOpen()) {
+            return false;
+        }
+
+        int64_t frameIndex = 0;
+        int64_t dropped = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            frameIndex = offeredFrames_++;
+            if (failed_ || stopping_) {
+                return false;
+            }
+            if (pendingVideoFrames_ >= kMaxPendingVideoFrames) {
+                dropped = ++droppedFrames_;
+            } else {
+                Item item;
+                item.data = std::move(data);
+                item.rowPitch = rowPitch;
+                item.frameIndex = frameIndex;
+                items_.push_back(std::move(item));
+                ++pendingVideoFrames_;
+            }
+        }
+
+        if (dropped == 1) {
+            LOG(LL_WRN, "ProxyEncoder - Proxy encoding is behind the capture; dropping proxy frames until it catches up");
+        }
+        if (dropped > 0) {
+            LOG(LL_DBG, "ProxyEncoder - Dropped proxy frame ", frameIndex, " (", dropped, " so far)");
+            return false;
+        }
+        itemsAvailable_.notify_one();
+        return true;
+    }
+
+    void ProxyEncoder::sendAudioChunk(const FFmpeg::FFAUDIOCHUNK& chunk) {
+        if (!isOpen() || failed_) {
+            return;
+        }
+
+        Item item;
+        item.audio = true;
+        item.audioChunk = chunk;
+        item.audioChunk.buffer = nullptr;
+        const size_t bytes = static_cast<size_t>(chunk.samples) * static_cast<size_t>(chunk.blockSize);
+        item.data = audioBufferPool_.acquire(bytes);
+        std::copy_n(chunk.buffer[0], bytes, item.data.data());
+
+        bool overLimit = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            overLimit = pendingAudioChunks_ >= kMaxPendingAudioChunks;
+            if (stopping_ || overLimit) {
+                audioBufferPool_.release(std::move(item.data));
+            } else {
+                items_.push_back(std::move(item));
+                ++pendingAudioChunks_;
+            }
+        }
+        if (overLimit) {
+            markFailed("audio backlog over limit");
+            return;
+        }
+        itemsAvailable_.notify_one();
+    }
+
+    void ProxyEncoder::workerLoop() {
+        PRE();
+        lowerCurrentThreadPriority();
+        LOG(LL_NFO, "ProxyEncoder worker started");
+
+        while (true) {
+            Item item;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                itemsAvailable_.wait(lock, [this] { return stopping_ || !items_.empty(); });
+                if (items_.empty()) {
+                    break;
+                }
+                item = std::move(items_.front());
+                items_.pop_front();
+                if (item.audio) {
+                    --pendingAudioChunks_;
+                } else {
+                    --pendingVideoFrames_;
+                }
+            }
+
+            if (item.audio) {
+                if (!failed_) {
+                    encodeAudio(item);
+                }
+                audioBufferPool_.release(std::move(item.data));
+            } else {
+                if (!failed_) {
+                    encodeVideo(item);
+                }
+                framePool_->release(std::move(item.data));
+            }
+        }
+
+        LOG(LL_NFO, "ProxyEncoder worker stopped");
+        POST();
+    }
+
+    void ProxyEncoder::encodeVideo(const Item& item) {
+        const auto scaleStart = std::chrono::steady_clock::now();
+        downscaler_.scale(item.data.data(), item.rowPitch, proxyFrame_.data(),
+                          downscaler_.getDestinationWidth() * kBytesPerPixel);
+        scaleNs_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - scaleStart).count();
+
+        encoder_.SkipVideoFrames(item.frameIndex - nextFrameIndex_);
+        nextFrameIndex_ = item.frameIndex + 1;
+
+        BYTE* plane = proxyFrame_.data();
+        int rowSize = downscaler_.getDestinationWidth() * kBytesPerPixel;
+        FFmpeg::FFVIDEOFRAME frame{
+            .buffer = &plane,
+            .rowsize = &rowSize,
+            .planes = 1,
+            .width = downscaler_.getDestinationWidth(),
+            .height = downscaler_.getDestinationHeight(),
+            .pass = 1,
+        };
+        inputPixelFormat_.copy(frame.format, std::size(frame.format));
+
+        if (FAILED(encoder_.SendVideoFrame(frame))) {
+            markFailed("video encoding failed");
+            return;
+        }
+        ++encodedFrames_;
+    }
+
+    void ProxyEncoder::encodeAudio(Item& item) {
+        BYTE* plane = item.data.data();
+        item.audioChunk.buffer = &plane;
+        if (FAILED(encoder_.SendAudioSampleChunk(item.audioChunk))) {
+            markFailed("audio encoding failed");
+        }
+        item.audioChunk.buffer = nullptr;
+    }
+
+    void ProxyEncoder::markFailed(const char* reason) {
+        if (!failed_.exchange(true)) {
+            LOG(LL_ERR, "ProxyEncoder - Proxy ", filename_, " failed (", reason, "); the export carries on without it");
+        }
+    }
+
+    void ProxyEncoder::close() {
+        PRE();
+        if (!isOpen()) {
+            POST();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        itemsAvailable_.notify_all();
+        if (workerThread_.joinable()) {
+            workerThread_.join();
+        }
+
+        if (FAILED(encoder_.Close(true))) {
+            markFailed("finalizing failed");
+        }
+        LOG(LL_NFO, "Proxy: file=", filename_,
+            " size=", downscaler_.getDestinationWidth(), "x", downscaler_.getDestinationHeight(),
+            " frames=", encodedFrames_,
+            " dropped=", droppedFrames_, "/", offeredFrames_,
+            " avgScaleMs=", encodedFrames_ > 0 ? static_cast<double>(scaleNs_) / 1000000.0 / static_cast<double>(encodedFrames_) : 0.0,
+            " kernel=", downscaler_.getKernelName(),
+            " status=", failed_ ? "failed" : "ok");
+        framePool_ = nullptr;
+        POST();
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "FFmpegEncoder.h"
+#include "FFmpegTypes.h"
+#include "FrameBufferPool.h"
+#include "RgbaDownscaler.h"
+#include "Platform.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Encoder {
+    // A small edit-friendly copy of the export, written next to it.
+    struct ProxyOutput {
+        bool enabled = false;
+        FFmpeg::FFENCODERCONFIG config;
+        std::wstring filename;
+        // Capped at the export's height; the width follows the export's aspect ratio.
+        uint32_t height = 540;
+    };
+
+    // Encodes the proxy on its own below-normal priority thread. Captured frames are box-downscaled there and
+    // sent to a separate FFmpegEncoder. The export never waits on the proxy: a frame arriving while the proxy
+    // is still behind on earlier ones is dropped, leaving a gap in the proxy's timestamps so audio stays in sync.
+    // Audio cannot be dropped that way, so a proxy that falls too far behind on it is given up instead.
+    class ProxyEncoder {
+    public:
+        ProxyEncoder() = default;
+        ~ProxyEncoder();
+
+        ProxyEncoder(const ProxyEncoder&) = delete;
+        ProxyEncoder& operator=(const ProxyEncoder&) = delete;
+
+        // exportInfo describes the captured frames; inputPixelFormat must be rgba or bgra. Video buffers taken
+        // by takeVideoFrame go back to framePool.
+        HRESULT open(const ProxyOutput& proxy, const FFmpeg::FFENCODERINFO& exportInfo,
+                     const std::string& inputPixelFormat, FrameBufferPool* framePool);
+
+        bool isOpen() const { return framePool_ != nullptr; }
+
+        // Takes data, height rows of rowPitch bytes, when the proxy has room for it. Returns false, leaving data
+        // with the caller, when the frame is dropped or the proxy is closed or failed. Call once per captured frame.
+        bool takeVideoFrame(std::vector<uint8_t>& data, int rowPitch);
+
+        // Copies the chunk. Chunks are not dropped; past kMaxPendingAudioChunks waiting ones the proxy fails.
+        void sendAudioChunk(const FFmpeg::FFAUDIOCHUNK& chunk);
+
+        // Encodes whatever is queued and finalizes the file.
+        void close();
+
+    private:
+        struct Item {
+            bool audio = false;
+            std::vector<uint8_t> data;
+            int rowPitch = 0;
+            // Position of the frame among every captured frame, dropped ones included.
+            int64_t frameIndex = 0;
+            // Format of an audio item; its buffer is set when it is encoded.
+            FFmpeg::FFAUDIOCHUNK audioChunk{};
+        };
+
+        static constexpr size_t kMaxPendingVideoFrames = 2;
+        // The depth of the session's own audio queue.
+        static constexpr size_t kMaxPendingAudioChunks = 256;
+        static constexpr size_t kExpectedAudioChunkBytes = 16 * 1024;
+        static constexpr size_t kPreallocatedAudioChunkBuffers = 8;
+
+        void workerLoop();
+        void encodeVideo(const Item& item);
+        void encodeAudio(Item& item);
+        void markFailed(const char* reason);
+
+        FFmpegEncoder encoder_;
+        RgbaDownscaler downscaler_;
+        FrameBufferPool* framePool_ = nullptr;
+        FrameBufferPool audioBufferPool_;
+        std::string filename_;
+
+        std::string inputPixelFormat_;
+        std::vector<uint8_t> proxyFrame_;
+
+        std::mutex mutex_;
+        std::condition_variable itemsAvailable_;
+        std::deque<Item> items_;
+        size_t pendingVideoFrames_ = 0;
+        size_t pendingAudioChunks_ = 0;
+        bool stopping_ = false;
+        std::atomic<bool> failed_ = false;
+        std::thread workerThread_;
+
+        int64_t offeredFrames_ = 0;
+        int64_t droppedFrames_ = 0;
+        // Worker side only.
+        int64_t nextFrameIndex_ = 0;
+        int64_t encodedFrames_ = 0;
+        int64_t scaleNs_ = 0;
+    };
+}
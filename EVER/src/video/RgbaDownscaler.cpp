@@ -0,0 +1,127 @@
+#include "RgbaDownscaler.h"
+#include "logger.h"
+
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <emmintrin.h>
+#define EVER_DOWNSCALER_SSE2 1
+#endif
+
+namespace Encoder {
+    namespace {
+        constexpr int kBytesPerPixel = 4;
+        constexpr int kReciprocalShift = 24;
+
+        // Edges of count blocks spread as evenly as possible over size units.
+        std::vector<int> blockEdges(int size, int count) {
+            std::vector<int> edges(static_cast<size_t>(count) + 1);
+            for (int i = 0; i <= count; ++i) {
+                edges[i] = static_cast<int>(static_cast<int64_t>(i) * size / count);
+            }
+            return edges;
+        }
+    }
+
+    HRESULT RgbaDownscaler::initialize(int sourceWidth, int sourceHeight, int destinationWidth, int destinationHeight) {
+        PRE();
+        destinationWidth_ = 0;
+        destinationHeight_ = 0;
+
+        if (sourceWidth <= 0 || sourceHeight <= 0 || destinationWidth <= 0 || destinationHeight <= 0 ||
+            destinationWidth > sourceWidth || destinationHeight > sourceHeight ||
+            static_cast<int64_t>(destinationHeight) * kMaxBlockRows < sourceHeight) {
+            LOG(LL_ERR, "RgbaDownscaler::initialize - Cannot scale ", sourceWidth, "x", sourceHeight, " to ",
+                destinationWidth, "x", destinationHeight);
+            POST();
+            return E_INVALIDARG;
+        }
+
+        sourceWidth_ = sourceWidth;
+        sourceHeight_ = sourceHeight;
+        columnEdges_ = blockEdges(sourceWidth, destinationWidth);
+        rowEdges_ = blockEdges(sourceHeight, destinationHeight);
+        rowSums_.assign(static_cast<size_t>(sourceWidth) * kBytesPerPixel, 0);
+
+        const int maxColumns = (sourceWidth + destinationWidth - 1) / destinationWidth;
+        const int maxRows = (sourceHeight + destinationHeight - 1) / destinationHeight;
+        reciprocals_.assign(static_cast<size_t>(maxColumns) * maxRows + 1, 0);
+        for (size_t area = 1; area < reciprocals_.size(); ++area) {
+            reciprocals_[area] = static_cast<uint32_t>(((1ull << kReciprocalShift) + area / 2) / area);
+        }
+
+        destinationWidth_ = destinationWidth;
+        destinationHeight_ = destinationHeight;
+        LOG(LL_DBG, "RgbaDownscaler::initialize - ", sourceWidth, "x", sourceHeight, " -> ", destinationWidth, "x",
+            destinationHeight, " kernel=", getKernelName());
+        POST();
+        return S_OK;
+    }
+
+    const char* RgbaDownscaler::getKernelName() const {
+#ifdef EVER_DOWNSCALER_SSE2
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    void RgbaDownscaler::sumRows(const uint8_t* source, int sourcePitch, int firstRow, int rows) {
+        const int bytes = sourceWidth_ * kBytesPerPixel;
+        const uint8_t* first = source + static_cast<ptrdiff_t>(firstRow) * sourcePitch;
+        uint16_t* sums = rowSums_.data();
+
+        int i = 0;
+#ifdef EVER_DOWNSCALER_SSE2
+        // 16 bytes of every row at a time, widened to 16-bit lanes and kept in registers until the block is summed.
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= bytes; i += 16) {
+            __m128i low = zero;
+            __m128i high = zero;
+            const uint8_t* row = first + i;
+            for (int r = 0; r < rows; ++r, row += sourcePitch) {
+                const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row));
+                low = _mm_add_epi16(low, _mm_unpacklo_epi8(pixels, zero));
+                high = _mm_add_epi16(high, _mm_unpackhi_epi8(pixels, zero));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i), low);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i + 8), high);
+        }
+#endif
+        for (; i < bytes; ++i) {
+            uint32_t sum = 0;
+            const uint8_t* row = first + i;
+            for (int r = 0; r < rows; ++r, row += sourcePitch) {
+                sum += *row;
+            }
+            sums[i] = static_cast<uint16_t>(sum);
+        }
+    }
+
+    void RgbaDownscaler::scale(const uint8_t* source, int sourcePitch, uint8_t* destination, int destinationPitch) {
+        for (int y = 0; y < destinationHeight_; ++y) {
+            const int rows = rowEdges_[y + 1] - rowEdges_[y];
+            sumRows(source, sourcePitch, rowEdges_[y], rows);
+
+            uint8_t* out = destination + static_cast<ptrdiff_t>(y) * destinationPitch;
+            for (int x = 0; x < destinationWidth_; ++x) {
+                const int firstColumn = columnEdges_[x];
+                const int columns = columnEdges_[x + 1] - firstColumn;
+                const uint64_t reciprocal = reciprocals_[static_cast<size_t>(columns) * rows];
+
+                const uint16_t* sums = rowSums_.data() + static_cast<size_t>(firstColumn) * kBytesPerPixel;
+                uint32_t channels[kBytesPerPixel] = {};
+                for (int c = 0; c < columns; ++c, sums += kBytesPerPixel) {
+                    channels[0] += sums[0];
+                    channels[1] += sums[1];
+                    channels[2] += sums[2];
+                    channels[3] += sums[3];
+                }
+                for (int k = 0; k < kBytesPerPixel; ++k) {
+                    const uint64_t value = (channels[k] * reciprocal + (1ull << (kReciprocalShift - 1))) >> kReciprocalShift;
+                    out[x * kBytesPerPixel + k] = static_cast<uint8_t>((std::min)(value, uint64_t{255}));
+                }
+            }
+        }
+    }
+}
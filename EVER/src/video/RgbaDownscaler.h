@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Encoder {
+    // Shrinks 4-byte-per-pixel frames (RGBA, BGRA, ...) by averaging the block of source pixels under each
+    // destination pixel, a box filter. Sizes need not divide evenly: blocks then differ by at most one row or
+    // column. The row sums, which touch every source pixel, use SSE2 on x64; the rest is scalar.
+    class RgbaDownscaler {
+    public:
+        // The destination may not be larger than the source, nor more than 257 times smaller in height, so the
+        // 16-bit row sums cannot overflow.
+        HRESULT initialize(int sourceWidth, int sourceHeight, int destinationWidth, int destinationHeight);
+
+        bool isInitialized() const { return destinationWidth_ > 0; }
+
+        // Not thread safe: every call shares the row sum buffer.
+        void scale(const uint8_t* source, int sourcePitch, uint8_t* destination, int destinationPitch);
+
+        int getDestinationWidth() const { return destinationWidth_; }
+
+        int getDestinationHeight() const { return destinationHeight_; }
+
+        const char* getKernelName() const;
+
+    private:
+        static constexpr int kMaxBlockRows = 257;
+
+        void sumRows(const uint8_t* source, int sourcePitch, int firstRow, int rows);
+
+        int sourceWidth_ = 0;
+        int sourceHeight_ = 0;
+        int destinationWidth_ = 0;
+        int destinationHeight_ = 0;
+        // Block edges: destination column x covers source columns [columnEdges_[x], columnEdges_[x + 1]).
+        std::vector<int> columnEdges_;
+        std::vector<int> rowEdges_;
+        // Per-channel sums of the current block's rows, one entry per source byte.
+        std::vector<uint16_t> rowSums_;
+        // 2^24 / block area, rounded, indexed by area.
+        std::vector<uint32_t> reciprocals_;
+    };
+}
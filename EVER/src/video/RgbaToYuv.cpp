@@ -0,0 +1,251 @@
+#pragma warning(push)
+#pragma warning(disable : 26812)
+
+#include "RgbaToYuvKernels.h"
+#include "CpuFeatures.h"
+
+#include <cmath>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+#pragma warning(pop)
+
+namespace Encoder {
+    namespace {
+        RgbaToYuvKernel detectKernel() {
+            const CpuFeatures& features = getCpuFeatures();
+            if (features.avx512) {
+                return RgbaToYuvKernel::Avx512;
+            }
+            if (features.avx2) {
+                return RgbaToYuvKernel::Avx2;
+            }
+            if (features.sse41) {
+                return RgbaToYuvKernel::Sse41;
+            }
+            return RgbaToYuvKernel::Scalar;
+        }
+
+        bool getLayout(int dstPixFmt, YuvLayout& layout, int& bitDepth) {
+            switch (static_cast<AVPixelFormat>(dstPixFmt)) {
+            case AV_PIX_FMT_YUV420P:
+                layout = YuvLayout::Yuv420p;
+                bitDepth = 8;
+                return true;
+            case AV_PIX_FMT_NV12:
+                layout = YuvLayout::Nv12;
+                bitDepth = 8;
+                return true;
+            case AV_PIX_FMT_P010LE:
+                layout = YuvLayout::P010;
+                bitDepth = 10;
+                return true;
+            case AV_PIX_FMT_YUV422P10LE:
+                layout = YuvLayout::Yuv422p10;
+                bitDepth = 10;
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // Luma weights of red and blue; green is the remainder.
+        bool getLumaWeights(int colorSpace, double& kr, double& kb) {
+            switch (static_cast<AVColorSpace>(colorSpace)) {
+            case AVCOL_SPC_BT709:
+                kr = 0.2126;
+                kb = 0.0722;
+                return true;
+            case AVCOL_SPC_BT470BG:
+            case AVCOL_SPC_SMPTE170M:
+                kr = 0.299;
+                kb = 0.114;
+                return true;
+            case AVCOL_SPC_BT2020_NCL:
+                kr = 0.2627;
+                kb = 0.0593;
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        int16_t toFixed(double value, int shift) {
+            return static_cast<int16_t>(std::lround(value * static_cast<double>(1 << shift)));
+        }
+
+        void setWeights(int16_t c02[2], int16_t c13[2], bool bgra, int16_t r, int16_t g, int16_t b) {
+            c02[0] = bgra ? b : r;
+            c02[1] = bgra ? r : b;
+            c13[0] = g;
+            c13[1] = 0;
+        }
+    }
+
+    RgbaToYuvRowsFunction getRgbaToYuvRowsScalar(YuvLayout layout) {
+        switch (layout) {
+        case YuvLayout::Yuv420p:
+            return &convertRowsScalarEntry<YuvLayout::Yuv420p>;
+        case YuvLayout::Nv12:
+            return &convertRowsScalarEntry<YuvLayout::Nv12>;
+        case YuvLayout::P010:
+            return &convertRowsScalarEntry<YuvLayout::P010>;
+        case YuvLayout::Yuv422p10:
+            return &convertRowsScalarEntry<YuvLayout::Yuv422p10>;
+        }
+        return nullptr;
+    }
+
+    RgbaToYuvKernel getRgbaToYuvKernel() {
+        static const RgbaToYuvKernel kernel = detectKernel();
+        return kernel;
+    }
+
+    const char* getRgbaToYuvKernelName(RgbaToYuvKernel kernel) {
+        switch (kernel) {
+        case RgbaToYuvKernel::Avx512:
+            return "avx512";
+        case RgbaToYuvKernel::Avx2:
+            return "avx2";
+        case RgbaToYuvKernel::Sse41:
+            return "sse4.1";
+        default:
+            return "scalar";
+        }
+    }
+
+    bool isRgbaToYuvKernelAvailable(RgbaToYuvKernel kernel) {
+        return static_cast<int>(kernel) <= static_cast<int>(getRgbaToYuvKernel());
+    }
+
+    bool RgbaToYuvConverter::isSupported(int srcPixFmt, int dstPixFmt, int colorSpace) {
+        YuvLayout layout;
+        int bitDepth = 0;
+        double kr = 0.0;
+        double kb = 0.0;
+        return (srcPixFmt == AV_PIX_FMT_RGBA || srcPixFmt == AV_PIX_FMT_BGRA) &&
+               getLayout(dstPixFmt, layout, bitDepth) && getLumaWeights(colorSpace, kr, kb);
+    }
+
+    bool RgbaToYuvConverter::initialize(int srcPixFmt, int dstPixFmt, int colorSpace, bool fullRange,
+                                        const ColorAdjustment& adjustment, RgbaToYuvKernel kernel) {
+        rows_ = nullptr;
+        lumaLut_.clear();
+
+        int bitDepth = 0;
+        double kr = 0.0;
+        double kb = 0.0;
+        if (!isSupported(srcPixFmt, dstPixFmt, colorSpace) || !isRgbaToYuvKernelAvailable(kernel) ||
+            !getLayout(dstPixFmt, layout_, bitDepth) || !getLumaWeights(colorSpace, kr, kb)) {
+            return false;
+        }
+
+        switch (kernel) {
+        case RgbaToYuvKernel::Avx512:
+            rows_ = getRgbaToYuvRowsAvx512(layout_);
+            break;
+        case RgbaToYuvKernel::Avx2:
+            rows_ = getRgbaToYuvRowsAvx2(layout_);
+            break;
+        case RgbaToYuvKernel::Sse41:
+            rows_ = getRgbaToYuvRowsSse41(layout_);
+            break;
+        default:
+            rows_ = getRgbaToYuvRowsScalar(layout_);
+            break;
+        }
+        if (rows_ == nullptr) {
+            return false;
+        }
+        kernel_ = kernel;
+
+        // 15 fractional bits at 8-bit output, fewer at higher depths so every weight still fits in int16.
+        const int shift = 15 - (bitDepth - 8);
+        const int32_t maxCode = (1 << bitDepth) - 1;
+        const double yScale = (fullRange ? maxCode : 219 << (bitDepth - 8)) / 255.0;
+        const double cScale = (fullRange ? maxCode : 224 << (bitDepth - 8)) / 255.0 * adjustment.saturation;
+
+        // Saturation above 1 can push the largest chroma weight (0.5 * cScale) past int16; drop precision instead.
+        int chromaShift = shift;
+        while (chromaShift > 8 && 0.5 * cScale * static_cast<double>(1 << chromaShift) > 32767.0) {
+            --chromaShift;
+        }
+
+        // Green takes the rounding remainder so white lands exactly on the top code and grey has zero chroma.
+        const int16_t yR = toFixed(kr * yScale, shift);
+        const int16_t yB = toFixed(kb * yScale, shift);
+        const int16_t yG = static_cast<int16_t>(toFixed(yScale, shift) - yR - yB);
+        const int16_t uR = toFixed(-0.5 * kr / (1.0 - kb) * cScale, chromaShift);
+        const int16_t uB = toFixed(0.5 * cScale, chromaShift);
+        const int16_t uG = static_cast<int16_t>(-uR - uB);
+        const int16_t vR = toFixed(0.5 * cScale, chromaShift);
+        const int16_t vB = toFixed(-0.5 * kb / (1.0 - kr) * cScale, chromaShift);
+        const int16_t vG = static_cast<int16_t>(-vR - vB);
+
+        const bool bgra = srcPixFmt == AV_PIX_FMT_BGRA;
+        coefficients_ = RgbaToYuvCoefficients();
+        setWeights(coefficients_.y02, coefficients_.y13, bgra, yR, yG, yB);
+        setWeights(coefficients_.u02, coefficients_.u13, bgra, uR, uG, uB);
+        setWeights(coefficients_.v02, coefficients_.v13, bgra, vR, vG, vB);
+
+        const int32_t yOffset = fullRange ? 0 : 16 << (bitDepth - 8);
+        const int32_t cOffset = 128 << (bitDepth - 8);
+        const int chromaSamplesLog2 = layout_ == YuvLayout::Yuv422p10 ? 1 : 2;
+        coefficients_.yShift = shift;
+        coefficients_.yBias = (yOffset << shift) + (1 << (shift - 1));
+        coefficients_.cShift = chromaShift + chromaSamplesLog2;
+        coefficients_.cBias = (cOffset << coefficients_.cShift) + (1 << (coefficients_.cShift - 1));
+        coefficients_.maxCode = maxCode;
+
+        // Same curve as eq's luma LUT, evaluated on code values at the output bit depth.
+        if (adjustment.brightness != 0.0 || adjustment.contrast != 1.0 || adjustment.gamma != 1.0) {
+            lumaLut_ = buildColorAdjustLut(adjustment.brightness, adjustment.contrast, adjustment.gamma, maxCode);
+            lumaStoreShift_ = layout_ == YuvLayout::P010 ? 6 : 0;
+        }
+        return true;
+    }
+
+    void RgbaToYuvConverter::applyLumaLut(uint8_t* row, int width) const {
+        if (layout_ == YuvLayout::Yuv420p || layout_ == YuvLayout::Nv12) {
+            for (int x = 0; x < width; ++x) {
+                row[x] = static_cast<uint8_t>(lumaLut_[row[x]]);
+            }
+            return;
+        }
+
+        uint16_t* samples = reinterpret_cast<uint16_t*>(row);
+        for (int x = 0; x < width; ++x) {
+            samples[x] = static_cast<uint16_t>(lumaLut_[samples[x] >> lumaStoreShift_] << lumaStoreShift_);
+        }
+    }
+
+    void RgbaToYuvConverter::convert(const uint8_t* src, int srcLinesize, int width, int height,
+                                     uint8_t* const dst[], const int dstLinesize[]) const {
+        const bool twoRows = layout_ != YuvLayout::Yuv422p10;
+        const bool semiPlanar = layout_ == YuvLayout::Nv12 || layout_ == YuvLayout::P010;
+
+        YuvRows rows;
+        rows.width = width;
+        for (int y = 0; y < height; y += twoRows ? 2 : 1) {
+            const bool hasSecondRow = twoRows && y + 1 < height;
+            const int chromaRow = twoRows ? y / 2 : y;
+
+            rows.src0 = src + static_cast<ptrdiff_t>(y) * srcLinesize;
+            rows.src1 = hasSecondRow ? rows.src0 + srcLinesize : rows.src0;
+            rows.y0 = dst[0] + static_cast<ptrdiff_t>(y) * dstLinesize[0];
+            rows.y1 = hasSecondRow ? rows.y0 + dstLinesize[0] : nullptr;
+            rows.u = dst[1] + static_cast<ptrdiff_t>(chromaRow) * dstLinesize[1];
+            rows.v = semiPlanar ? nullptr : dst[2] + static_cast<ptrdiff_t>(chromaRow) * dstLinesize[2];
+            rows_(rows, coefficients_);
+
+            if (!lumaLut_.empty()) {
+                applyLumaLut(rows.y0, width);
+                if (rows.y1 != nullptr) {
+                    applyLumaLut(rows.y1, width);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "ColorAdjust.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Encoder {
+    // Ordered by capability: a kernel can run on any CPU that supports the detected one.
+    enum class RgbaToYuvKernel {
+        Scalar,
+        Sse41,
+        Avx2,
+        Avx512,
+    };
+
+    // Best kernel for this CPU, chosen once from CPUID.
+    RgbaToYuvKernel getRgbaToYuvKernel();
+
+    const char* getRgbaToYuvKernelName(RgbaToYuvKernel kernel);
+
+    bool isRgbaToYuvKernelAvailable(RgbaToYuvKernel kernel);
+
+    // Destination layouts with a hand-written path. The kernels for each live in RgbaToYuv<Isa>.cpp,
+    // compiled with that instruction set enabled.
+    enum class YuvLayout {
+        Yuv420p,
+        Nv12,
+        P010,
+        Yuv422p10,
+    };
+
+    // Fixed-point matrix for one colorspace, range and bit depth. Coefficients are int16 pairs laid out for
+    // _mm_madd_epi16 against the (byte 0, byte 2) and (byte 1, byte 3) halves of each 32-bit pixel, so RGBA
+    // and BGRA only differ in the order of the pairs and alpha always gets a zero weight.
+    struct RgbaToYuvCoefficients {
+        int16_t y02[2] = {};
+        int16_t y13[2] = {};
+        int16_t u02[2] = {};
+        int16_t u13[2] = {};
+        int16_t v02[2] = {};
+        int16_t v13[2] = {};
+        // Offset and rounding folded into one addend: (offset << shift) + half.
+        int32_t yBias = 0;
+        int32_t yShift = 0;
+        // Chroma is the sum over the 2 (4:2:2) or 4 (4:2:0) source pixels, so its shift includes the average.
+        int32_t cBias = 0;
+        int32_t cShift = 0;
+        int32_t maxCode = 255;
+    };
+
+    // One output row pair (4:2:0) or row (4:2:2). For 4:2:0, src1 == src0 and y1 == nullptr on an odd last row.
+    // Semi-planar layouts write interleaved chroma to u and ignore v.
+    struct YuvRows {
+        const uint8_t* src0 = nullptr;
+        const uint8_t* src1 = nullptr;
+        uint8_t* y0 = nullptr;
+        uint8_t* y1 = nullptr;
+        uint8_t* u = nullptr;
+        uint8_t* v = nullptr;
+        int width = 0;
+    };
+
+    using RgbaToYuvRowsFunction = void (*)(const YuvRows& rows, const RgbaToYuvCoefficients& coefficients);
+
+    // Converts RGBA8/BGRA8 to the YuvLayout formats without swscale. Conversion is stateless after initialize,
+    // so VideoConverter bands share one instance across threads.
+    // A ColorAdjustment is fused in: saturation scales the chroma weights and brightness, contrast and gamma
+    // go through a luma LUT applied to each row pair while it is still in cache.
+    class RgbaToYuvConverter {
+    public:
+        // True when initialize would accept this pixel format pair and colorspace (AVPixelFormat/AVColorSpace).
+        static bool isSupported(int srcPixFmt, int dstPixFmt, int colorSpace);
+
+        bool initialize(int srcPixFmt, int dstPixFmt, int colorSpace, bool fullRange,
+                        const ColorAdjustment& adjustment = ColorAdjustment(),
+                        RgbaToYuvKernel kernel = getRgbaToYuvKernel());
+
+        bool isInitialized() const { return rows_ != nullptr; }
+
+        RgbaToYuvKernel getKernel() const { return kernel_; }
+
+        // Converts rows [0, height) of a band; dst points at the band's first row of each plane.
+        // 4:2:0 bands must start on an even row.
+        void convert(const uint8_t* src, int srcLinesize, int width, int height,
+                     uint8_t* const dst[], const int dstLinesize[]) const;
+
+    private:
+        void applyLumaLut(uint8_t* row, int width) const;
+
+        RgbaToYuvRowsFunction rows_ = nullptr;
+        RgbaToYuvCoefficients coefficients_;
+        RgbaToYuvKernel kernel_ = RgbaToYuvKernel::Scalar;
+        YuvLayout layout_ = YuvLayout::Yuv420p;
+        // Indexed by luma code; empty when brightness, contrast and gamma are neutral.
+        std::vector<uint16_t> lumaLut_;
+        int lumaStoreShift_ = 0;
+    };
+}
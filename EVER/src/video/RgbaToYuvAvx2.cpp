@@ -0,0 +1,55 @@
+#include "RgbaToYuvKernels.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+
+namespace Encoder {
+    namespace {
+        struct Avx2 {
+            using V = __m256i;
+            static constexpr int kPixels = 8;
+
+            static V load(const uint8_t* source) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)); }
+            static V set1(int32_t value) { return _mm256_set1_epi32(value); }
+            static V pair(const int16_t coefficients[2]) {
+                return _mm256_set1_epi32(static_cast<int32_t>(static_cast<uint16_t>(coefficients[0]) |
+                                                              (static_cast<uint32_t>(static_cast<uint16_t>(coefficients[1])) << 16)));
+            }
+            static V andv(V a, V b) { return _mm256_and_si256(a, b); }
+            static V add(V a, V b) { return _mm256_add_epi32(a, b); }
+            static V madd16(V a, V b) { return _mm256_madd_epi16(a, b); }
+            static V srli8(V a) { return _mm256_srli_epi32(a, 8); }
+            static V sra(V a, int count) { return _mm256_sra_epi32(a, _mm_cvtsi32_si128(count)); }
+            static V sll(V a, int count) { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(count)); }
+            static V clamp(V a, V maxCode) { return _mm256_min_epi32(_mm256_max_epi32(a, _mm256_setzero_si256()), maxCode); }
+
+            // hadd works within 128-bit lanes; the permute restores pixel order across them.
+            static V pairSum(V a, V b) {
+                return _mm256_permute4x64_epi64(_mm256_hadd_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+            }
+
+            static void store8(uint8_t* destination, V a) {
+                const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(destination), _mm_packus_epi16(words, words));
+            }
+            static void store16(uint8_t* destination, V a) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(destination),
+                                 _mm_packus_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1)));
+            }
+            static void store32(uint8_t* destination, V a) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination), a);
+            }
+        };
+    }
+
+    RgbaToYuvRowsFunction getRgbaToYuvRowsAvx2(YuvLayout layout) {
+        return selectVectorRows<Avx2>(layout);
+    }
+}
+#else
+namespace Encoder {
+    RgbaToYuvRowsFunction getRgbaToYuvRowsAvx2(YuvLayout) {
+        return nullptr;
+    }
+}
+#endif
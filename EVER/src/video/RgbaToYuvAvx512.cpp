@@ -0,0 +1,57 @@
+#include "RgbaToYuvKernels.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+
+namespace Encoder {
+    namespace {
+        // AVX-512 F for the 32-bit lane operations, BW for vpmaddwd on 512-bit vectors.
+        struct Avx512 {
+            using V = __m512i;
+            static constexpr int kPixels = 16;
+
+            static V load(const uint8_t* source) { return _mm512_loadu_si512(source); }
+            static V set1(int32_t value) { return _mm512_set1_epi32(value); }
+            static V pair(const int16_t coefficients[2]) {
+                return _mm512_set1_epi32(static_cast<int32_t>(static_cast<uint16_t>(coefficients[0]) |
+                                                              (static_cast<uint32_t>(static_cast<uint16_t>(coefficients[1])) << 16)));
+            }
+            static V andv(V a, V b) { return _mm512_and_si512(a, b); }
+            static V add(V a, V b) { return _mm512_add_epi32(a, b); }
+            static V madd16(V a, V b) { return _mm512_madd_epi16(a, b); }
+            static V srli8(V a) { return _mm512_srli_epi32(a, 8); }
+            static V sra(V a, int count) { return _mm512_sra_epi32(a, _mm_cvtsi32_si128(count)); }
+            static V sll(V a, int count) { return _mm512_sll_epi32(a, _mm_cvtsi32_si128(count)); }
+            static V clamp(V a, V maxCode) { return _mm512_min_epi32(_mm512_max_epi32(a, _mm512_setzero_si512()), maxCode); }
+
+            // No horizontal add at this width: gather even and odd lanes of a:b and add them.
+            static V pairSum(V a, V b) {
+                const V even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+                const V odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+                return _mm512_add_epi32(_mm512_permutex2var_epi32(a, even, b), _mm512_permutex2var_epi32(a, odd, b));
+            }
+
+            // Lanes are already clamped, so the truncating down-converts are exact.
+            static void store8(uint8_t* destination, V a) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm512_cvtepi32_epi8(a));
+            }
+            static void store16(uint8_t* destination, V a) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination), _mm512_cvtepi32_epi16(a));
+            }
+            static void store32(uint8_t* destination, V a) {
+                _mm512_storeu_si512(destination, a);
+            }
+        };
+    }
+
+    RgbaToYuvRowsFunction getRgbaToYuvRowsAvx512(YuvLayout layout) {
+        return selectVectorRows<Avx512>(layout);
+    }
+}
+#else
+namespace Encoder {
+    RgbaToYuvRowsFunction getRgbaToYuvRowsAvx512(YuvLayout) {
+        return nullptr;
+    }
+}
+#endif
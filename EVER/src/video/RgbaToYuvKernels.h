@@ -0,0 +1,233 @@
+#pragma once
+
+// Shared body of the RGBA -> YUV row kernels. Included only by RgbaToYuv.cpp and the RgbaToYuv<Isa>.cpp files,
+// each of which is compiled with its own instruction set; everything below has internal linkage so no
+// AVX-512 copy of a helper can be picked by the linker for the scalar path.
+
+#include "RgbaToYuv.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace Encoder {
+    RgbaToYuvRowsFunction getRgbaToYuvRowsScalar(YuvLayout layout);
+    RgbaToYuvRowsFunction getRgbaToYuvRowsSse41(YuvLayout layout);
+    RgbaToYuvRowsFunction getRgbaToYuvRowsAvx2(YuvLayout layout);
+    RgbaToYuvRowsFunction getRgbaToYuvRowsAvx512(YuvLayout layout);
+
+    namespace {
+        template <YuvLayout Layout>
+        struct YuvLayoutTraits;
+
+        template <>
+        struct YuvLayoutTraits<YuvLayout::Yuv420p> {
+            static constexpr bool kTwoRows = true;
+            static constexpr bool kSemiPlanar = false;
+            static constexpr bool kWide = false;
+            static constexpr int kStoreShift = 0;
+        };
+
+        template <>
+        struct YuvLayoutTraits<YuvLayout::Nv12> {
+            static constexpr bool kTwoRows = true;
+            static constexpr bool kSemiPlanar = true;
+            static constexpr bool kWide = false;
+            static constexpr int kStoreShift = 0;
+        };
+
+        // 10 bits in the high bits of each 16-bit sample.
+        template <>
+        struct YuvLayoutTraits<YuvLayout::P010> {
+            static constexpr bool kTwoRows = true;
+            static constexpr bool kSemiPlanar = true;
+            static constexpr bool kWide = true;
+            static constexpr int kStoreShift = 6;
+        };
+
+        template <>
+        struct YuvLayoutTraits<YuvLayout::Yuv422p10> {
+            static constexpr bool kTwoRows = false;
+            static constexpr bool kSemiPlanar = false;
+            static constexpr bool kWide = true;
+            static constexpr int kStoreShift = 0;
+        };
+
+        inline int32_t dotPixel(const uint8_t* pixel, const int16_t c02[2], const int16_t c13[2]) {
+            return pixel[0] * c02[0] + pixel[2] * c02[1] + pixel[1] * c13[0] + pixel[3] * c13[1];
+        }
+
+        inline int32_t clampCode(int32_t value, int32_t maxCode) {
+            return value < 0 ? 0 : (value > maxCode ? maxCode : value);
+        }
+
+        template <bool Wide>
+        inline void storeSample(uint8_t* plane, int index, uint32_t value) {
+            if constexpr (Wide) {
+                const uint16_t sample = static_cast<uint16_t>(value);
+                std::memcpy(plane + static_cast<size_t>(index) * 2, &sample, sizeof(sample));
+            } else {
+                plane[index] = static_cast<uint8_t>(value);
+            }
+        }
+
+        // Scalar reference, also used for the columns left over after the vector loop. Integer math matches the
+        // vector kernels exactly: the SIMD paths sum channel values before the multiply, which is the same sum.
+        template <YuvLayout Layout>
+        void convertRowsScalar(const YuvRows& rows, const RgbaToYuvCoefficients& c, int startX) {
+            using Traits = YuvLayoutTraits<Layout>;
+
+            for (int x = startX; x < rows.width; x += 2) {
+                const int x1 = x + 1 < rows.width ? x + 1 : x;
+                const uint8_t* p00 = rows.src0 + static_cast<size_t>(x) * 4;
+                const uint8_t* p01 = rows.src0 + static_cast<size_t>(x1) * 4;
+
+                storeSample<Traits::kWide>(rows.y0, x, clampCode((dotPixel(p00, c.y02, c.y13) + c.yBias) >> c.yShift, c.maxCode) << Traits::kStoreShift);
+                if (x1 != x) {
+                    storeSample<Traits::kWide>(rows.y0, x1, clampCode((dotPixel(p01, c.y02, c.y13) + c.yBias) >> c.yShift, c.maxCode) << Traits::kStoreShift);
+                }
+
+                int32_t u = dotPixel(p00, c.u02, c.u13) + dotPixel(p01, c.u02, c.u13);
+                int32_t v = dotPixel(p00, c.v02, c.v13) + dotPixel(p01, c.v02, c.v13);
+
+                if constexpr (Traits::kTwoRows) {
+                    const uint8_t* p10 = rows.src1 + static_cast<size_t>(x) * 4;
+                    const uint8_t* p11 = rows.src1 + static_cast<size_t>(x1) * 4;
+                    if (rows.y1 != nullptr) {
+                        storeSample<Traits::kWide>(rows.y1, x, clampCode((dotPixel(p10, c.y02, c.y13) + c.yBias) >> c.yShift, c.maxCode) << Traits::kStoreShift);
+                        if (x1 != x) {
+                            storeSample<Traits::kWide>(rows.y1, x1, clampCode((dotPixel(p11, c.y02, c.y13) + c.yBias) >> c.yShift, c.maxCode) << Traits::kStoreShift);
+                        }
+                    }
+                    u += dotPixel(p10, c.u02, c.u13) + dotPixel(p11, c.u02, c.u13);
+                    v += dotPixel(p10, c.v02, c.v13) + dotPixel(p11, c.v02, c.v13);
+                }
+
+                const uint32_t uCode = static_cast<uint32_t>(clampCode((u + c.cBias) >> c.cShift, c.maxCode)) << Traits::kStoreShift;
+                const uint32_t vCode = static_cast<uint32_t>(clampCode((v + c.cBias) >> c.cShift, c.maxCode)) << Traits::kStoreShift;
+                const int chromaX = x / 2;
+                if constexpr (Traits::kSemiPlanar) {
+                    storeSample<Traits::kWide>(rows.u, chromaX * 2, uCode);
+                    storeSample<Traits::kWide>(rows.u, chromaX * 2 + 1, vCode);
+                } else {
+                    storeSample<Traits::kWide>(rows.u, chromaX, uCode);
+                    storeSample<Traits::kWide>(rows.v, chromaX, vCode);
+                }
+            }
+        }
+
+        // Vector body over an instruction set wrapper Isa, which provides 32-bit-lane operations on a vector of
+        // Isa::kPixels pixels: load, set1, pair, andv, add, madd16, srli8, sra, sll, clamp, pairSum (in-order sums of
+        // adjacent lanes of two vectors) and store8/store16/store32 (narrowing stores of every lane).
+        // Each step consumes 2 * kPixels pixels from each source row.
+        template <typename Isa, YuvLayout Layout>
+        void convertRowsVector(const YuvRows& rows, const RgbaToYuvCoefficients& c) {
+            using Traits = YuvLayoutTraits<Layout>;
+            using V = typename Isa::V;
+            constexpr int kStep = Isa::kPixels * 2;
+
+            const V byteMask = Isa::set1(0x00FF00FF);
+            const V y02 = Isa::pair(c.y02);
+            const V y13 = Isa::pair(c.y13);
+            const V u02 = Isa::pair(c.u02);
+            const V u13 = Isa::pair(c.u13);
+            const V v02 = Isa::pair(c.v02);
+            const V v13 = Isa::pair(c.v13);
+            const V yBias = Isa::set1(c.yBias);
+            const V cBias = Isa::set1(c.cBias);
+            const V maxCode = Isa::set1(c.maxCode);
+
+            const auto luma = [&](V rb, V ga) {
+                const V sum = Isa::add(Isa::add(Isa::madd16(rb, y02), Isa::madd16(ga, y13)), yBias);
+                return Isa::sll(Isa::clamp(Isa::sra(sum, c.yShift), maxCode), Traits::kStoreShift);
+            };
+            const auto storeLuma = [&](uint8_t* plane, int x, V value) {
+                if constexpr (Traits::kWide) {
+                    Isa::store16(plane + static_cast<size_t>(x) * 2, value);
+                } else {
+                    Isa::store8(plane + x, value);
+                }
+            };
+
+            int x = 0;
+            for (; x + kStep <= rows.width; x += kStep) {
+                const uint8_t* s0 = rows.src0 + static_cast<size_t>(x) * 4;
+                const V p0a = Isa::load(s0);
+                const V p0b = Isa::load(s0 + Isa::kPixels * 4);
+
+                // (byte 0, byte 2) and (byte 1, byte 3) of every pixel as 16-bit halves.
+                V rbA = Isa::andv(p0a, byteMask);
+                V gaA = Isa::andv(Isa::srli8(p0a), byteMask);
+                V rbB = Isa::andv(p0b, byteMask);
+                V gaB = Isa::andv(Isa::srli8(p0b), byteMask);
+
+                storeLuma(rows.y0, x, luma(rbA, gaA));
+                storeLuma(rows.y0, x + Isa::kPixels, luma(rbB, gaB));
+
+                if constexpr (Traits::kTwoRows) {
+                    const uint8_t* s1 = rows.src1 + static_cast<size_t>(x) * 4;
+                    const V p1a = Isa::load(s1);
+                    const V p1b = Isa::load(s1 + Isa::kPixels * 4);
+                    const V rb1A = Isa::andv(p1a, byteMask);
+                    const V ga1A = Isa::andv(Isa::srli8(p1a), byteMask);
+                    const V rb1B = Isa::andv(p1b, byteMask);
+                    const V ga1B = Isa::andv(Isa::srli8(p1b), byteMask);
+
+                    if (rows.y1 != nullptr) {
+                        storeLuma(rows.y1, x, luma(rb1A, ga1A));
+                        storeLuma(rows.y1, x + Isa::kPixels, luma(rb1B, ga1B));
+                    }
+
+                    // Channel sums of two 8-bit values still fit the signed 16-bit madd inputs.
+                    rbA = Isa::add(rbA, rb1A);
+                    gaA = Isa::add(gaA, ga1A);
+                    rbB = Isa::add(rbB, rb1B);
+                    gaB = Isa::add(gaB, ga1B);
+                }
+
+                const V uA = Isa::add(Isa::madd16(rbA, u02), Isa::madd16(gaA, u13));
+                const V uB = Isa::add(Isa::madd16(rbB, u02), Isa::madd16(gaB, u13));
+                const V vA = Isa::add(Isa::madd16(rbA, v02), Isa::madd16(gaA, v13));
+                const V vB = Isa::add(Isa::madd16(rbB, v02), Isa::madd16(gaB, v13));
+
+                const V u = Isa::clamp(Isa::sra(Isa::add(Isa::pairSum(uA, uB), cBias), c.cShift), maxCode);
+                const V v = Isa::clamp(Isa::sra(Isa::add(Isa::pairSum(vA, vB), cBias), c.cShift), maxCode);
+
+                const int chromaX = x / 2;
+                if constexpr (Traits::kSemiPlanar && Traits::kWide) {
+                    Isa::store32(rows.u + static_cast<size_t>(chromaX) * 4,
+                                 Isa::add(Isa::sll(u, Traits::kStoreShift), Isa::sll(v, 16 + Traits::kStoreShift)));
+                } else if constexpr (Traits::kSemiPlanar) {
+                    Isa::store16(rows.u + static_cast<size_t>(chromaX) * 2, Isa::add(u, Isa::sll(v, 8)));
+                } else if constexpr (Traits::kWide) {
+                    Isa::store16(rows.u + static_cast<size_t>(chromaX) * 2, u);
+                    Isa::store16(rows.v + static_cast<size_t>(chromaX) * 2, v);
+                } else {
+                    Isa::store8(rows.u + chromaX, u);
+                    Isa::store8(rows.v + chromaX, v);
+                }
+            }
+
+            convertRowsScalar<Layout>(rows, c, x);
+        }
+
+        template <YuvLayout Layout>
+        void convertRowsScalarEntry(const YuvRows& rows, const RgbaToYuvCoefficients& coefficients) {
+            convertRowsScalar<Layout>(rows, coefficients, 0);
+        }
+
+        template <typename Isa>
+        RgbaToYuvRowsFunction selectVectorRows(YuvLayout layout) {
+            switch (layout) {
+            case YuvLayout::Yuv420p:
+                return &convertRowsVector<Isa, YuvLayout::Yuv420p>;
+            case YuvLayout::Nv12:
+                return &convertRowsVector<Isa, YuvLayout::Nv12>;
+            case YuvLayout::P010:
+                return &convertRowsVector<Isa, YuvLayout::P010>;
+            case YuvLayout::Yuv422p10:
+                return &convertRowsVector<Isa, YuvLayout::Yuv422p10>;
+            }
+            return nullptr;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#include "RgbaToYuvKernels.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+
+namespace Encoder {
+    namespace {
+        struct Sse41 {
+            using V = __m128i;
+            static constexpr int kPixels = 4;
+
+            static V load(const uint8_t* source) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(source)); }
+            static V set1(int32_t value) { return _mm_set1_epi32(value); }
+            static V pair(const int16_t coefficients[2]) {
+                return _mm_set1_epi32(static_cast<int32_t>(static_cast<uint16_t>(coefficients[0]) |
+                                                           (static_cast<uint32_t>(static_cast<uint16_t>(coefficients[1])) << 16)));
+            }
+            static V andv(V a, V b) { return _mm_and_si128(a, b); }
+            static V add(V a, V b) { return _mm_add_epi32(a, b); }
+            static V madd16(V a, V b) { return _mm_madd_epi16(a, b); }
+            static V srli8(V a) { return _mm_srli_epi32(a, 8); }
+            static V sra(V a, int count) { return _mm_sra_epi32(a, _mm_cvtsi32_si128(count)); }
+            static V sll(V a, int count) { return _mm_sll_epi32(a, _mm_cvtsi32_si128(count)); }
+            static V clamp(V a, V maxCode) { return _mm_min_epi32(_mm_max_epi32(a, _mm_setzero_si128()), maxCode); }
+            static V pairSum(V a, V b) { return _mm_hadd_epi32(a, b); }
+
+            static void store8(uint8_t* destination, V a) {
+                const __m128i words = _mm_packus_epi32(a, a);
+                const int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+                std::memcpy(destination, &bytes, sizeof(bytes));
+            }
+            static void store16(uint8_t* destination, V a) {
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(destination), _mm_packus_epi32(a, a));
+            }
+            static void store32(uint8_t* destination, V a) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), a);
+            }
+        };
+    }
+
+    RgbaToYuvRowsFunction getRgbaToYuvRowsSse41(YuvLayout layout) {
+        return selectVectorRows<Sse41>(layout);
+    }
+}
+#else
+namespace Encoder {
+    RgbaToYuvRowsFunction getRgbaToYuvRowsSse41(YuvLayout) {
+        return nullptr;
+    }
+}
+#endif
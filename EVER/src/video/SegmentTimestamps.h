@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/mathematics.h>
+}
+
+namespace Encoder {
+    // Segments are cut at a video keyframe, but audio is encoded on its own and reaches the muxer interleaved
+    // by arrival, so packets starting before the cut can still turn up after it. They belong at the end of the
+    // previous segment; shifted into the next one their timestamps would go negative.
+    inline bool isBeforeSegmentCut(int64_t pts, int64_t dts, AVRational timeBase, int64_t cutDts,
+                                   AVRational cutTimeBase) {
+        const int64_t timestamp = pts != AV_NOPTS_VALUE ? pts : dts;
+        return timestamp != AV_NOPTS_VALUE && av_compare_ts(timestamp, timeBase, cutDts, cutTimeBase) < 0;
+    }
+
+    // A timestamp in timeBase made relative to a segment starting at offset, given in offsetTimeBase.
+    inline int64_t shiftIntoSegment(int64_t timestamp, AVRational timeBase, int64_t offset,
+                                    AVRational offsetTimeBase) {
+        if (timestamp == AV_NOPTS_VALUE) {
+            return timestamp;
+        }
+        return timestamp - av_rescale_q(offset, offsetTimeBase, timeBase);
+    }
+}
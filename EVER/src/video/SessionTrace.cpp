@@ -0,0 +1,242 @@
+#include "SessionTrace.h"
+#include "logger.h"
+#include "util.h"
+
+#include <cstring>
+#include <filesystem>
+#include <type_traits>
+
+namespace Encoder {
+    namespace {
+        constexpr char kTraceMagic[8] = {'E', 'V', 'E', 'R', 'T', 'R', 'C', '1'};
+        constexpr uint32_t kTraceVersion = 1;
+        constexpr size_t kTraceFileBufferBytes = 1024 * 1024;
+        // Guards the reader against corrupt size fields.
+        constexpr uint32_t kMaxTraceStringBytes = 256;
+        constexpr uint64_t kMaxTracePixelBytes = 256ull * 1024ull * 1024ull;
+
+        template <typename T>
+        void writeValue(std::ofstream& file, const T& value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        void writeString(std::ofstream& file, const std::string& value) {
+            writeValue(file, static_cast<uint32_t>(value.size()));
+            file.write(value.data(), static_cast<std::streamsize>(value.size()));
+        }
+
+        template <typename T>
+        bool readValue(std::ifstream& file, T& value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+        }
+
+        bool readString(std::ifstream& file, std::string& value) {
+            uint32_t size = 0;
+            if (!readValue(file, size) || size > kMaxTraceStringBytes) {
+                return false;
+            }
+            value.resize(size);
+            return size == 0 || static_cast<bool>(file.read(value.data(), size));
+        }
+    }
+
+    SessionTraceWriter::~SessionTraceWriter() {
+        close();
+    }
+
+    HRESULT SessionTraceWriter::open(const std::wstring& path, const SessionTraceInfo& info) {
+        PRE();
+        close();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // The buffer must be installed before the file is opened to take effect everywhere.
+        fileBuffer_.resize(kTraceFileBufferBytes);
+        file_.rdbuf()->pubsetbuf(fileBuffer_.data(), static_cast<std::streamsize>(fileBuffer_.size()));
+        file_.open(std::filesystem::path(path), std::ios::binary | std::ios::trunc);
+        if (!file_.is_open()) {
+            LOG(LL_ERR, "SessionTraceWriter::open - Failed to create trace file: ", utf8_encode(path));
+            POST();
+            return E_FAIL;
+        }
+
+        file_.write(kTraceMagic, sizeof(kTraceMagic));
+        writeValue(file_, kTraceVersion);
+        writeValue(file_, static_cast<uint32_t>(sizeof(info.config)));
+        writeValue(file_, info.config);
+        writeValue(file_, info.width);
+        writeValue(file_, info.height);
+        writeString(file_, info.inputPixelFormat);
+        writeValue(file_, info.fpsNumerator);
+        writeValue(file_, info.fpsDenominator);
+        writeValue(file_, info.inputChannels);
+        writeValue(file_, info.inputSampleRate);
+        writeString(file_, info.inputSampleFormat);
+        writeValue(file_, info.inputAlign);
+        writeValue(file_, info.videoQueueBudgetMb);
+        writeValue(file_, static_cast<uint8_t>(info.spillVideoQueue ? 1 : 0));
+        writeValue(file_, info.pixelStep);
+
+        origin_ = Clock::now();
+        width_ = info.width;
+        pixelStep_ = info.pixelStep;
+        records_ = 0;
+        isOpen_ = true;
+
+        LOG(LL_NFO, "SessionTraceWriter::open - Tracing session to ", utf8_encode(path), " pixelStep=", pixelStep_);
+        POST();
+        return S_OK;
+    }
+
+    void SessionTraceWriter::close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!isOpen_) {
+            return;
+        }
+
+        file_.close();
+        isOpen_ = false;
+        LOG(LL_NFO, "SessionTraceWriter::close - Trace closed after ", records_, " records");
+    }
+
+    void SessionTraceWriter::writeHeader(SessionTraceEvent event, Clock::time_point start, HRESULT result) {
+        const Clock::time_point end = Clock::now();
+        writeValue(file_, static_cast<uint8_t>(event));
+        writeValue(file_, static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(start - origin_).count()));
+        writeValue(file_, static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+        writeValue(file_, static_cast<int32_t>(result));
+        ++records_;
+    }
+
+    void SessionTraceWriter::recordVideoFrame(Clock::time_point start, const void* data, int rowPitch, int32_t height,
+                                              HRESULT result) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!isOpen_) {
+            return;
+        }
+
+        writeHeader(SessionTraceEvent::VideoFrame, start, result);
+        writeValue(file_, static_cast<int32_t>(rowPitch));
+        writeValue(file_, height);
+
+        if (pixelStep_ == 0 || data == nullptr || height <= 0) {
+            writeValue(file_, uint32_t{0});
+            writeValue(file_, uint32_t{0});
+            return;
+        }
+
+        // Nearest-neighbour subsample of the RGBA frame; enough to keep the encoder's content-dependent cost.
+        const uint32_t pixelWidth = (width_ + pixelStep_ - 1) / pixelStep_;
+        const uint32_t pixelHeight = (static_cast<uint32_t>(height) + pixelStep_ - 1) / pixelStep_;
+        pixelScratch_.resize(static_cast<size_t>(pixelWidth) * pixelHeight * 4u);
+
+        const uint8_t* source = static_cast<const uint8_t*>(data);
+        uint8_t* destination = pixelScratch_.data();
+        for (uint32_t y = 0; y < pixelHeight; ++y) {
+            const uint8_t* row = source + static_cast<size_t>(y) * pixelStep_ * static_cast<size_t>(rowPitch);
+            for (uint32_t x = 0; x < pixelWidth; ++x) {
+                std::memcpy(destination, row + static_cast<size_t>(x) * pixelStep_ * 4u, 4);
+                destination += 4;
+            }
+        }
+
+        writeValue(file_, pixelWidth);
+        writeValue(file_, pixelHeight);
+        file_.write(reinterpret_cast<const char*>(pixelScratch_.data()), static_cast<std::streamsize>(pixelScratch_.size()));
+    }
+
+    void SessionTraceWriter::recordAudioChunk(Clock::time_point start, int32_t length, LONGLONG presentationTime,
+                                              HRESULT result) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!isOpen_) {
+            return;
+        }
+
+        writeHeader(SessionTraceEvent::AudioChunk, start, result);
+        writeValue(file_, length);
+        writeValue(file_, static_cast<int64_t>(presentationTime));
+    }
+
+    void SessionTraceWriter::recordEvent(SessionTraceEvent event, Clock::time_point start, HRESULT result) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!isOpen_) {
+            return;
+        }
+
+        writeHeader(event, start, result);
+    }
+
+    HRESULT SessionTraceReader::open(const std::string& path) {
+        file_.open(std::filesystem::path(path), std::ios::binary);
+        if (!file_.is_open()) {
+            return E_FAIL;
+        }
+
+        char magic[sizeof(kTraceMagic)] = {};
+        uint32_t version = 0;
+        uint32_t configBytes = 0;
+        if (!file_.read(magic, sizeof(magic)) || std::memcmp(magic, kTraceMagic, sizeof(magic)) != 0 ||
+            !readValue(file_, version) || version != kTraceVersion || !readValue(file_, configBytes) ||
+            configBytes != sizeof(info_.config)) {
+            return E_INVALIDARG;
+        }
+
+        uint8_t spill = 0;
+        if (!readValue(file_, info_.config) || !readValue(file_, info_.width) || !readValue(file_, info_.height) ||
+            !readString(file_, info_.inputPixelFormat) || !readValue(file_, info_.fpsNumerator) ||
+            !readValue(file_, info_.fpsDenominator) || !readValue(file_, info_.inputChannels) ||
+            !readValue(file_, info_.inputSampleRate) || !readString(file_, info_.inputSampleFormat) ||
+            !readValue(file_, info_.inputAlign) || !readValue(file_, info_.videoQueueBudgetMb) ||
+            !readValue(file_, spill) || !readValue(file_, info_.pixelStep)) {
+            return E_INVALIDARG;
+        }
+        info_.spillVideoQueue = spill != 0;
+
+        return S_OK;
+    }
+
+    bool SessionTraceReader::next(SessionTraceRecord& record) {
+        uint8_t event = 0;
+        int32_t result = 0;
+        if (!readValue(file_, event) || !readValue(file_, record.timestampNs) || !readValue(file_, record.durationNs) ||
+            !readValue(file_, result)) {
+            return false;
+        }
+        record.event = static_cast<SessionTraceEvent>(event);
+        record.result = static_cast<HRESULT>(result);
+
+        switch (record.event) {
+        case SessionTraceEvent::VideoFrame: {
+            if (!readValue(file_, record.rowPitch) || !readValue(file_, record.height) ||
+                !readValue(file_, record.pixelWidth) || !readValue(file_, record.pixelHeight)) {
+                return false;
+            }
+
+            const uint64_t pixelBytes = static_cast<uint64_t>(record.pixelWidth) * record.pixelHeight * 4u;
+            if (pixelBytes > kMaxTracePixelBytes) {
+                return false;
+            }
+            record.pixels.resize(static_cast<size_t>(pixelBytes));
+            return pixelBytes == 0 ||
+                   static_cast<bool>(file_.read(reinterpret_cast<char*>(record.pixels.data()),
+                                                static_cast<std::streamsize>(pixelBytes)));
+        }
+        case SessionTraceEvent::AudioChunk: {
+            int64_t presentationTime = 0;
+            if (!readValue(file_, record.length) || !readValue(file_, presentationTime)) {
+                return false;
+            }
+            record.presentationTime = static_cast<LONGLONG>(presentationTime);
+            return true;
+        }
+        case SessionTraceEvent::FinishAudio:
+        case SessionTraceEvent::FinishVideo:
+        case SessionTraceEvent::EndSession:
+            return true;
+        default:
+            return false;
+        }
+    }
+}
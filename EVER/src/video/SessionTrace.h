@@ -0,0 +1,112 @@
+#pragma once
+
+#include "FFmpegTypes.h"
+#include "Platform.h"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Encoder {
+    // Compact binary trace of the calls an export makes into EncoderSession: when each frame and audio chunk
+    // arrived, how large it was and how long the call blocked the caller. Video frames can carry a subsampled
+    // copy of their pixels; audio payloads are not stored. replay_trace feeds a trace back into a session.
+    enum class SessionTraceEvent : uint8_t {
+        VideoFrame = 1,
+        AudioChunk = 2,
+        FinishAudio = 3,
+        FinishVideo = 4,
+        EndSession = 5,
+    };
+
+    struct SessionTraceInfo {
+        FFmpeg::FFENCODERCONFIG config{};
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::string inputPixelFormat;
+        uint32_t fpsNumerator = 0;
+        uint32_t fpsDenominator = 1;
+        uint32_t inputChannels = 0;
+        uint32_t inputSampleRate = 0;
+        std::string inputSampleFormat;
+        uint32_t inputAlign = 0;
+        uint32_t videoQueueBudgetMb = 0;
+        bool spillVideoQueue = false;
+        // Keep every pixelStep-th pixel on both axes; 0 records no pixels.
+        uint32_t pixelStep = 0;
+    };
+
+    struct SessionTraceRecord {
+        SessionTraceEvent event = SessionTraceEvent::VideoFrame;
+        int64_t timestampNs = 0;
+        int64_t durationNs = 0;
+        HRESULT result = S_OK;
+
+        // VideoFrame
+        int32_t rowPitch = 0;
+        int32_t height = 0;
+        uint32_t pixelWidth = 0;
+        uint32_t pixelHeight = 0;
+        std::vector<uint8_t> pixels;
+
+        // AudioChunk
+        int32_t length = 0;
+        LONGLONG presentationTime = 0;
+    };
+
+    class SessionTraceWriter {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        SessionTraceWriter() = default;
+        ~SessionTraceWriter();
+
+        SessionTraceWriter(const SessionTraceWriter&) = delete;
+        SessionTraceWriter& operator=(const SessionTraceWriter&) = delete;
+
+        HRESULT open(const std::wstring& path, const SessionTraceInfo& info);
+
+        void close();
+
+        bool isOpen() const {
+            return isOpen_;
+        }
+
+        // Called after the traced call returns; data must still be valid.
+        void recordVideoFrame(Clock::time_point start, const void* data, int rowPitch, int32_t height, HRESULT result);
+        void recordAudioChunk(Clock::time_point start, int32_t length, LONGLONG presentationTime, HRESULT result);
+        void recordEvent(SessionTraceEvent event, Clock::time_point start, HRESULT result);
+
+    private:
+        void writeHeader(SessionTraceEvent event, Clock::time_point start, HRESULT result);
+
+        std::mutex mutex_;
+        std::ofstream file_;
+        std::vector<char> fileBuffer_;
+        std::vector<uint8_t> pixelScratch_;
+        Clock::time_point origin_;
+        uint32_t width_ = 0;
+        uint32_t pixelStep_ = 0;
+        uint64_t records_ = 0;
+        bool isOpen_ = false;
+    };
+
+    class SessionTraceReader {
+    public:
+        HRESULT open(const std::string& path);
+
+        const SessionTraceInfo& getInfo() const {
+            return info_;
+        }
+
+        // Returns false at the end of the trace or on a truncated record.
+        bool next(SessionTraceRecord& record);
+
+    private:
+        std::ifstream file_;
+        SessionTraceInfo info_;
+    };
+}
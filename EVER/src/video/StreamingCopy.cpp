@@ -0,0 +1,262 @@
+#include "StreamingCopy.h"
+#include "CpuFeatures.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define EVER_STREAMING_COPY_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define EVER_TARGET(features)
+#else
+#define EVER_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+namespace Encoder {
+    namespace {
+#ifdef EVER_STREAMING_COPY_X86
+        StreamingCopyKernel detectKernel() {
+            const CpuFeatures& features = getCpuFeatures();
+            if (features.avx2) {
+                return StreamingCopyKernel::Avx2;
+            }
+            if (features.sse41) {
+                return StreamingCopyKernel::Sse41;
+            }
+            return StreamingCopyKernel::Memcpy;
+        }
+
+        // MOVNTDQA needs an aligned source address, so an unaligned head goes through memcpy first.
+        size_t copyUnalignedHead(uint8_t*& destination, const uint8_t*& source, size_t& bytes, size_t alignment) {
+            const size_t misalignment = reinterpret_cast<uintptr_t>(source) & (alignment - 1);
+            const size_t head = (std::min)(misalignment == 0 ? 0 : alignment - misalignment, bytes);
+            if (head != 0) {
+                std::memcpy(destination, source, head);
+                destination += head;
+                source += head;
+                bytes -= head;
+            }
+            return head;
+        }
+
+        EVER_TARGET("sse4.1")
+        void copySse41(uint8_t* destination, const uint8_t* source, size_t bytes) {
+            copyUnalignedHead(destination, source, bytes, 16);
+
+            const size_t blocks = bytes / 64;
+            const bool alignedDestination = (reinterpret_cast<uintptr_t>(destination) & 15) == 0;
+            for (size_t i = 0; i < blocks; ++i) {
+                __m128i* src = const_cast<__m128i*>(reinterpret_cast<const __m128i*>(source));
+                const __m128i v0 = _mm_stream_load_si128(src + 0);
+                const __m128i v1 = _mm_stream_load_si128(src + 1);
+                const __m128i v2 = _mm_stream_load_si128(src + 2);
+                const __m128i v3 = _mm_stream_load_si128(src + 3);
+
+                __m128i* dst = reinterpret_cast<__m128i*>(destination);
+                if (alignedDestination) {
+                    _mm_stream_si128(dst + 0, v0);
+                    _mm_stream_si128(dst + 1, v1);
+                    _mm_stream_si128(dst + 2, v2);
+                    _mm_stream_si128(dst + 3, v3);
+                } else {
+                    _mm_storeu_si128(dst + 0, v0);
+                    _mm_storeu_si128(dst + 1, v1);
+                    _mm_storeu_si128(dst + 2, v2);
+                    _mm_storeu_si128(dst + 3, v3);
+                }
+
+                source += 64;
+                destination += 64;
+            }
+
+            const size_t tail = bytes - blocks * 64;
+            if (tail != 0) {
+                std::memcpy(destination, source, tail);
+            }
+            _mm_sfence();
+        }
+
+        EVER_TARGET("avx2")
+        void copyAvx2(uint8_t* destination, const uint8_t* source, size_t bytes) {
+            copyUnalignedHead(destination, source, bytes, 32);
+
+            const size_t blocks = bytes / 128;
+            const bool alignedDestination = (reinterpret_cast<uintptr_t>(destination) & 31) == 0;
+            for (size_t i = 0; i < blocks; ++i) {
+                const __m256i* src = reinterpret_cast<const __m256i*>(source);
+                const __m256i v0 = _mm256_stream_load_si256(src + 0);
+                const __m256i v1 = _mm256_stream_load_si256(src + 1);
+                const __m256i v2 = _mm256_stream_load_si256(src + 2);
+                const __m256i v3 = _mm256_stream_load_si256(src + 3);
+
+                __m256i* dst = reinterpret_cast<__m256i*>(destination);
+                if (alignedDestination) {
+                    _mm256_stream_si256(dst + 0, v0);
+                    _mm256_stream_si256(dst + 1, v1);
+                    _mm256_stream_si256(dst + 2, v2);
+                    _mm256_stream_si256(dst + 3, v3);
+                } else {
+                    _mm256_storeu_si256(dst + 0, v0);
+                    _mm256_storeu_si256(dst + 1, v1);
+                    _mm256_storeu_si256(dst + 2, v2);
+                    _mm256_storeu_si256(dst + 3, v3);
+                }
+
+                source += 128;
+                destination += 128;
+            }
+
+            const size_t tail = bytes - blocks * 128;
+            if (tail != 0) {
+                std::memcpy(destination, source, tail);
+            }
+            _mm_sfence();
+        }
+#else
+        StreamingCopyKernel detectKernel() {
+            return StreamingCopyKernel::Memcpy;
+        }
+#endif
+    }
+
+    StreamingCopyKernel getStreamingCopyKernel() {
+        static const StreamingCopyKernel kernel = detectKernel();
+        return kernel;
+    }
+
+    const char* getStreamingCopyKernelName(StreamingCopyKernel kernel) {
+        switch (kernel) {
+        case StreamingCopyKernel::Avx2:
+            return "avx2";
+        case StreamingCopyKernel::Sse41:
+            return "sse4.1";
+        default:
+            return "memcpy";
+        }
+    }
+
+    void streamingCopy(void* destination, const void* source, size_t bytes) {
+        uint8_t* dst = static_cast<uint8_t*>(destination);
+        const uint8_t* src = static_cast<const uint8_t*>(source);
+
+        switch (getStreamingCopyKernel()) {
+#ifdef EVER_STREAMING_COPY_X86
+        case StreamingCopyKernel::Avx2:
+            copyAvx2(dst, src, bytes);
+            break;
+        case StreamingCopyKernel::Sse41:
+            copySse41(dst, src, bytes);
+            break;
+#endif
+        default:
+            std::memcpy(dst, src, bytes);
+            break;
+        }
+    }
+
+    StreamingCopier::~StreamingCopier() {
+        shutdown();
+    }
+
+    void StreamingCopier::initialize(size_t laneCount) {
+        PRE();
+        shutdown();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            generation_ = 0;
+            pendingLanes_ = 0;
+            stopping_ = false;
+        }
+
+        try {
+            for (size_t lane = 1; lane < laneCount; ++lane) {
+                workers_.emplace_back(&StreamingCopier::workerLoop, this, lane);
+            }
+        } catch (const std::exception& ex) {
+            // Fewer lanes only makes large copies slower, so keep whatever helpers did start.
+            LOG(LL_WRN, "StreamingCopier::initialize - Failed to start copy helper: ", ex.what());
+        }
+
+        LOG(LL_NFO, "StreamingCopier::initialize - Using ", getStreamingCopyKernelName(getStreamingCopyKernel()),
+            " kernel on ", getLaneCount(), " lane(s)");
+        POST();
+    }
+
+    void StreamingCopier::shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        workCondition_.notify_all();
+
+        for (std::thread& worker : workers_) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        workers_.clear();
+    }
+
+    void StreamingCopier::copy(void* destination, const void* source, size_t bytes) {
+        if (workers_.empty() || bytes < kMinParallelBytes) {
+            streamingCopy(destination, source, bytes);
+            return;
+        }
+
+        const size_t lanes = getLaneCount();
+        const size_t chunkBytes = ((bytes + lanes - 1) / lanes + kChunkAlignment - 1) / kChunkAlignment * kChunkAlignment;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            destination_ = static_cast<uint8_t*>(destination);
+            source_ = static_cast<const uint8_t*>(source);
+            bytes_ = bytes;
+            chunkBytes_ = chunkBytes;
+            pendingLanes_ = workers_.size();
+            ++generation_;
+        }
+        workCondition_.notify_all();
+
+        copyLane(0);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        doneCondition_.wait(lock, [this] { return pendingLanes_ == 0; });
+        destination_ = nullptr;
+        source_ = nullptr;
+        bytes_ = 0;
+    }
+
+    void StreamingCopier::workerLoop(size_t lane) {
+        uint64_t seenGeneration = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        while (true) {
+            workCondition_.wait(lock, [&] { return stopping_ || generation_ != seenGeneration; });
+            if (stopping_) {
+                return;
+            }
+            seenGeneration = generation_;
+
+            lock.unlock();
+            copyLane(lane);
+            lock.lock();
+
+            if (--pendingLanes_ == 0) {
+                doneCondition_.notify_one();
+            }
+        }
+    }
+
+    void StreamingCopier::copyLane(size_t lane) {
+        const size_t offset = lane * chunkBytes_;
+        if (offset >= bytes_) {
+            return;
+        }
+
+        streamingCopy(destination_ + offset, source_ + offset, (std::min)(chunkBytes_, bytes_ - offset));
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Encoder {
+    enum class StreamingCopyKernel {
+        Memcpy,
+        Sse41,
+        Avx2,
+    };
+
+    // Kernel chosen once from CPUID; AVX2 and SSE4.1 use non-temporal (MOVNTDQA) loads, which are the only
+    // loads that read write-combined or uncached memory such as a mapped staging texture at full speed.
+    StreamingCopyKernel getStreamingCopyKernel();
+
+    const char* getStreamingCopyKernelName(StreamingCopyKernel kernel);
+
+    // Copies with the dispatched kernel on the calling thread. Stores are non-temporal too, so a large
+    // frame copy does not evict the game's working set from the cache on its way to the encoder queue.
+    void streamingCopy(void* destination, const void* source, size_t bytes);
+
+    // Same copy, with large buffers split into page-aligned chunks across persistent helper threads.
+    // Chunk 0 runs on the calling thread, matching VideoConverter's band scheduling.
+    class StreamingCopier {
+    public:
+        StreamingCopier() = default;
+        ~StreamingCopier();
+
+        StreamingCopier(const StreamingCopier&) = delete;
+        StreamingCopier& operator=(const StreamingCopier&) = delete;
+
+        // laneCount includes the calling thread; 1 disables the helpers.
+        void initialize(size_t laneCount);
+
+        void shutdown();
+
+        void copy(void* destination, const void* source, size_t bytes);
+
+        size_t getLaneCount() const { return workers_.size() + 1; }
+
+    private:
+        // Below this a single streaming copy finishes before helper threads would even wake up.
+        static constexpr size_t kMinParallelBytes = 4 * 1024 * 1024;
+        static constexpr size_t kChunkAlignment = 4096;
+
+        void workerLoop(size_t lane);
+        void copyLane(size_t lane);
+
+        std::vector<std::thread> workers_;
+        std::mutex mutex_;
+        std::condition_variable workCondition_;
+        std::condition_variable doneCondition_;
+        uint64_t generation_ = 0;
+        size_t pendingLanes_ = 0;
+        bool stopping_ = false;
+
+        uint8_t* destination_ = nullptr;
+        const uint8_t* source_ = nullptr;
+        size_t bytes_ = 0;
+        size_t chunkBytes_ = 0;
+    };
+}
@@ -0,0 +1,249 @@
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 26812)
+
+#include "VideoConverter.h"
+#include "logger.h"
+
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+#pragma warning(pop)
+
+namespace Encoder {
+    namespace {
+        int getChromaShift(AVPixelFormat format) {
+            const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(format);
+            return descriptor ? descriptor->log2_chroma_h : 0;
+        }
+
+        // Planes 1 and 2 carry chroma (U/V, or interleaved UV for NV12); plane 3 is full-height alpha.
+        int getPlaneRowOffset(int plane, int row, int chromaShift) {
+            return (plane == 1 || plane == 2) ? (row >> chromaShift) : row;
+        }
+    }
+
+    VideoConverter::~VideoConverter() {
+        shutdown();
+    }
+
+    HRESULT VideoConverter::initialize(int srcWidth, int srcHeight, int srcPixFmt,
+                                       int dstWidth, int dstHeight, int dstPixFmt,
+                                       int swsFlags, size_t bandCount, int colorSpace, bool fullRange,
+                                       const ColorAdjustment& adjustment) {
+        PRE();
+        shutdown();
+
+        const AVPixelFormat srcFormat = static_cast<AVPixelFormat>(srcPixFmt);
+        const AVPixelFormat dstFormat = static_cast<AVPixelFormat>(dstPixFmt);
+
+        srcPlanes_ = av_pix_fmt_count_planes(srcFormat);
+        dstPlanes_ = av_pix_fmt_count_planes(dstFormat);
+        srcChromaShift_ = getChromaShift(srcFormat);
+        dstChromaShift_ = getChromaShift(dstFormat);
+
+        if (srcPlanes_ <= 0 || dstPlanes_ <= 0) {
+            LOG(LL_ERR, "VideoConverter::initialize - Unsupported pixel format pair ", srcPixFmt, " -> ", dstPixFmt);
+            POST();
+            return E_FAIL;
+        }
+
+        const bool scaling = srcWidth != dstWidth || srcHeight != dstHeight;
+        if (scaling) {
+            bandCount = 1;
+        }
+        srcWidth_ = srcWidth;
+
+        // The scalar kernel is slower than swscale's own SIMD paths, so it is only used to fuse a colour
+        // adjustment, where it still saves the filter graph's extra pass.
+        const bool useKernel = !scaling && (getRgbaToYuvKernel() != RgbaToYuvKernel::Scalar || !adjustment.isIdentity()) &&
+                               rgbaToYuv_.initialize(srcPixFmt, dstPixFmt, colorSpace, fullRange, adjustment);
+        if (!useKernel && !adjustment.isIdentity()) {
+            LOG(LL_ERR, "VideoConverter::initialize - Colour adjustment needs an RGBA/BGRA to YUV conversion without scaling");
+            POST();
+            return E_INVALIDARG;
+        }
+
+        // swscale converts RGB with the BT.601 matrix unless told otherwise; match what the stream is tagged with.
+        const AVPixFmtDescriptor* srcDescriptor = av_pix_fmt_desc_get(srcFormat);
+        const AVPixFmtDescriptor* dstDescriptor = av_pix_fmt_desc_get(dstFormat);
+        const bool rgbToYuv = srcDescriptor && dstDescriptor && (srcDescriptor->flags & AV_PIX_FMT_FLAG_RGB) &&
+                              !(dstDescriptor->flags & AV_PIX_FMT_FLAG_RGB);
+        bandCount = std::clamp<size_t>(bandCount, 1, (std::max)(1, srcHeight / kMinBandRows));
+
+        // Band boundaries must fall on a chroma row of both formats so no band shares a subsampled row.
+        const int rowAlignment = (std::max)(kBandRowAlignment, 1 << (std::max)(srcChromaShift_, dstChromaShift_));
+        int bandRows = (srcHeight + static_cast<int>(bandCount) - 1) / static_cast<int>(bandCount);
+        bandRows = (bandRows + rowAlignment - 1) / rowAlignment * rowAlignment;
+
+        for (int y = 0; y < srcHeight; y += bandRows) {
+            Band band;
+            band.srcY = y;
+            band.dstY = y;
+            band.srcHeight = (std::min)(bandRows, srcHeight - y);
+
+            if (useKernel) {
+                bands_.push_back(band);
+                continue;
+            }
+
+            const int bandDstHeight = scaling ? dstHeight : band.srcHeight;
+            band.context = sws_getContext(srcWidth, band.srcHeight, srcFormat,
+                                          dstWidth, bandDstHeight, dstFormat,
+                                          swsFlags, nullptr, nullptr, nullptr);
+            if (!band.context) {
+                LOG(LL_ERR, "VideoConverter::initialize - Failed to create SWS context for band at row ", y);
+                bands_.push_back(band);
+                shutdown();
+                POST();
+                return E_FAIL;
+            }
+
+            if (rgbToYuv) {
+                const int* table = sws_getCoefficients(colorSpace);
+                sws_setColorspaceDetails(band.context, sws_getCoefficients(SWS_CS_DEFAULT), 1,
+                                         table, fullRange ? 1 : 0, 0, 1 << 16, 1 << 16);
+            }
+
+            bands_.push_back(band);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            generation_ = 0;
+            pendingBands_ = 0;
+            failed_ = false;
+            stopping_ = false;
+        }
+
+        try {
+            for (size_t i = 1; i < bands_.size(); ++i) {
+                workers_.emplace_back(&VideoConverter::workerLoop, this, i);
+            }
+        } catch (const std::exception& ex) {
+            LOG(LL_ERR, "VideoConverter::initialize - Failed to start band worker: ", ex.what());
+            shutdown();
+            POST();
+            return E_FAIL;
+        }
+
+        LOG(LL_NFO, "VideoConverter::initialize - ", srcWidth, "x", srcHeight, " ",
+            av_get_pix_fmt_name(srcFormat), " -> ", dstWidth, "x", dstHeight, " ",
+            av_get_pix_fmt_name(dstFormat), " in ", bands_.size(), " band(s) of ", bandRows, " rows using ",
+            getKernelName());
+        if (!adjustment.isIdentity()) {
+            LOG(LL_NFO, "VideoConverter::initialize - Fused colour adjustment: ", adjustment.toString());
+        }
+        POST();
+        return S_OK;
+    }
+
+    void VideoConverter::shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        workCondition_.notify_all();
+
+        for (std::thread& worker : workers_) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        workers_.clear();
+
+        for (Band& band : bands_) {
+            if (band.context) {
+                sws_freeContext(band.context);
+                band.context = nullptr;
+            }
+        }
+        bands_.clear();
+        rgbaToYuv_ = RgbaToYuvConverter();
+    }
+
+    const char* VideoConverter::getKernelName() const {
+        return rgbaToYuv_.isInitialized() ? getRgbaToYuvKernelName(rgbaToYuv_.getKernel()) : "swscale";
+    }
+
+    HRESULT VideoConverter::convert(const uint8_t* const srcData[], const int srcLinesize[], AVFrame* dst) {
+        if (bands_.empty() || dst == nullptr) {
+            LOG(LL_ERR, "VideoConverter::convert - Converter not initialized");
+            return E_FAIL;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            srcData_ = srcData;
+            srcLinesize_ = srcLinesize;
+            dst_ = dst;
+            failed_ = false;
+            pendingBands_ = bands_.size() - 1;
+            ++generation_;
+        }
+        workCondition_.notify_all();
+
+        const bool firstBandOk = convertBand(0);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        doneCondition_.wait(lock, [this] { return pendingBands_ == 0; });
+        srcData_ = nullptr;
+        srcLinesize_ = nullptr;
+        dst_ = nullptr;
+
+        if (!firstBandOk || failed_) {
+            LOG(LL_ERR, "VideoConverter::convert - Pixel format conversion failed");
+            return E_FAIL;
+        }
+        return S_OK;
+    }
+
+    void VideoConverter::workerLoop(size_t bandIndex) {
+        uint64_t seenGeneration = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        while (true) {
+            workCondition_.wait(lock, [&] { return stopping_ || generation_ != seenGeneration; });
+            if (stopping_) {
+                return;
+            }
+            seenGeneration = generation_;
+
+            lock.unlock();
+            const bool ok = convertBand(bandIndex);
+            lock.lock();
+
+            if (!ok) {
+                failed_ = true;
+            }
+            if (--pendingBands_ == 0) {
+                doneCondition_.notify_one();
+            }
+        }
+    }
+
+    bool VideoConverter::convertBand(size_t bandIndex) {
+        const Band& band = bands_[bandIndex];
+
+        const uint8_t* src[4] = {};
+        uint8_t* dst[4] = {};
+        for (int plane = 0; plane < srcPlanes_ && plane < 4; ++plane) {
+            src[plane] = srcData_[plane] + static_cast<ptrdiff_t>(getPlaneRowOffset(plane, band.srcY, srcChromaShift_)) * srcLinesize_[plane];
+        }
+        for (int plane = 0; plane < dstPlanes_ && plane < 4; ++plane) {
+            dst[plane] = dst_->data[plane] + static_cast<ptrdiff_t>(getPlaneRowOffset(plane, band.dstY, dstChromaShift_)) * dst_->linesize[plane];
+        }
+
+        if (rgbaToYuv_.isInitialized()) {
+            rgbaToYuv_.convert(src[0], srcLinesize_[0], srcWidth_, band.srcHeight, dst, dst_->linesize);
+            return true;
+        }
+
+        return sws_scale(band.context, src, srcLinesize_, 0, band.srcHeight, dst, dst_->linesize) > 0;
+    }
+}
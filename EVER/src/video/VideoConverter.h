@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Platform.h"
+#include "RgbaToYuv.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct AVFrame;
+struct SwsContext;
+
+namespace Encoder {
+    // Pixel format conversion split into horizontal bands, each with its own SwsContext.
+    // Band 0 runs on the calling thread and the rest on persistent helper threads, so one frame
+    // is converted in roughly 1/N of the single-context time without per-frame thread creation.
+    // Scaling conversions use a single band: a resampling filter needs rows from neighbouring bands.
+    // RGBA/BGRA to yuv420p, nv12, p010 and yuv422p10le without scaling goes through the RgbaToYuv kernels
+    // instead of swscale, with the same banding. Only that path can apply a ColorAdjustment.
+    class VideoConverter {
+    public:
+        VideoConverter() = default;
+        ~VideoConverter();
+
+        VideoConverter(const VideoConverter&) = delete;
+        VideoConverter& operator=(const VideoConverter&) = delete;
+
+        HRESULT initialize(int srcWidth, int srcHeight, int srcPixFmt,
+                           int dstWidth, int dstHeight, int dstPixFmt,
+                           int swsFlags, size_t bandCount, int colorSpace, bool fullRange,
+                           const ColorAdjustment& adjustment = ColorAdjustment());
+
+        // dst must already own buffers of the destination size and format.
+        HRESULT convert(const uint8_t* const srcData[], const int srcLinesize[], AVFrame* dst);
+
+        void shutdown();
+
+        bool isInitialized() const { return !bands_.empty(); }
+
+        size_t getBandCount() const { return bands_.size(); }
+
+        // "swscale" when the conversion is not handled by an RgbaToYuv kernel.
+        const char* getKernelName() const;
+
+    private:
+        static constexpr int kMinBandRows = 64;
+        static constexpr int kBandRowAlignment = 16;
+
+        struct Band {
+            SwsContext* context = nullptr;
+            int srcY = 0;
+            int dstY = 0;
+            int srcHeight = 0;
+        };
+
+        void workerLoop(size_t bandIndex);
+        bool convertBand(size_t bandIndex);
+
+        std::vector<Band> bands_;
+        std::vector<std::thread> workers_;
+        RgbaToYuvConverter rgbaToYuv_;
+        int srcWidth_ = 0;
+        int srcPlanes_ = 0;
+        int dstPlanes_ = 0;
+        int srcChromaShift_ = 0;
+        int dstChromaShift_ = 0;
+
+        std::mutex mutex_;
+        std::condition_variable workCondition_;
+        std::condition_variable doneCondition_;
+        uint64_t generation_ = 0;
+        size_t pendingBands_ = 0;
+        bool failed_ = false;
+        bool stopping_ = false;
+
+        const uint8_t* const* srcData_ = nullptr;
+        const int* srcLinesize_ = nullptr;
+        AVFrame* dst_ = nullptr;
+    };
+}
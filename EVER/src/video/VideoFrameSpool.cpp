@@ -0,0 +1,339 @@
+#include "VideoFrameSpool.h"
+#include "StreamingCopy.h"
+#include "logger.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Encoder {
+    VideoFrameSpool::~VideoFrameSpool() {
+        close();
+    }
+
+    bool VideoFrameSpool::ensureStaging(uint8_t*& buffer, size_t& capacity, size_t bytes) {
+        if (buffer != nullptr && capacity >= bytes) {
+            return true;
+        }
+
+        if (buffer != nullptr) {
+            _aligned_free(buffer);
+            buffer = nullptr;
+            capacity = 0;
+        }
+
+        buffer = static_cast<uint8_t*>(_aligned_malloc(bytes, kSectorAlignment));
+        if (buffer == nullptr) {
+            return false;
+        }
+
+        capacity = bytes;
+        return true;
+    }
+
+    HRESULT VideoFrameSpool::open(const std::wstring& path, size_t frameBytesHint) {
+        PRE();
+        close();
+
+        path_ = path;
+
+        if (FAILED(openFile())) {
+            close();
+            POST();
+            return E_FAIL;
+        }
+
+        const size_t stagingBytes = alignUp((std::max)(frameBytesHint, kSectorAlignment));
+        if (!ensureStaging(writeStaging_, writeStagingBytes_, stagingBytes) ||
+            !ensureStaging(readStaging_, readStagingBytes_, stagingBytes)) {
+            LOG(LL_ERR, "VideoFrameSpool::open - Failed to allocate aligned staging buffers");
+            close();
+            POST();
+            return E_OUTOFMEMORY;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.clear();
+            writeOffset_ = 0;
+            readInFlight_ = false;
+            stats_ = Stats();
+        }
+
+        LOG(LL_NFO, "VideoFrameSpool::open - Spool file ready: ", utf8_encode(path_));
+        POST();
+        return S_OK;
+    }
+
+    void VideoFrameSpool::close() {
+        closeFile();
+
+        if (writeStaging_ != nullptr) {
+            _aligned_free(writeStaging_);
+            writeStaging_ = nullptr;
+            writeStagingBytes_ = 0;
+        }
+
+        if (readStaging_ != nullptr) {
+            _aligned_free(readStaging_);
+            readStaging_ = nullptr;
+            readStagingBytes_ = 0;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.clear();
+            readInFlight_ = false;
+        }
+        drainedCv_.notify_all();
+    }
+
+    bool VideoFrameSpool::hasPending() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return !pending_.empty();
+    }
+
+    HRESULT VideoFrameSpool::write(const void* data, size_t bytes, int rowPitch, int32_t height, int64_t frameIndex) {
+        if (!isOpen()) {
+            return E_FAIL;
+        }
+
+        const size_t alignedBytes = alignUp(bytes);
+        if (!ensureStaging(writeStaging_, writeStagingBytes_, alignedBytes)) {
+            LOG(LL_ERR, "VideoFrameSpool::write - Failed to grow aligned staging buffer to ", alignedBytes, " bytes");
+            return E_OUTOFMEMORY;
+        }
+
+        // data is usually the mapped staging texture itself.
+        streamingCopy(writeStaging_, data, bytes);
+
+        Record record;
+        record.bytes = bytes;
+        record.rowPitch = rowPitch;
+        record.height = height;
+        record.frameIndex = frameIndex;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            // Once the consumer has caught up completely the file is reused from the start,
+            // so the spool only grows as large as the longest backlog.
+            if (pending_.empty() && !readInFlight_) {
+                writeOffset_ = 0;
+            }
+            record.offset = writeOffset_;
+            writeOffset_ += alignedBytes;
+        }
+
+        if (!writeAt(writeStaging_, alignedBytes, record.offset)) {
+            const DWORD err = getLastFileError();
+            LOG(LL_ERR, "VideoFrameSpool::write - Failed to write frame ", frameIndex, " to spool: ",
+                Logger::hex(err, 8));
+            return E_FAIL;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back(record);
+            ++stats_.spilledFrames;
+            stats_.spilledBytes += bytes;
+            stats_.peakPendingFrames = (std::max)(stats_.peakPendingFrames, pending_.size());
+            stats_.peakFileBytes = (std::max)(stats_.peakFileBytes, writeOffset_);
+        }
+
+        return S_OK;
+    }
+
+    void VideoFrameSpool::waitUntilDrained() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        drainedCv_.wait(lock, [this] { return pending_.empty(); });
+    }
+
+    bool VideoFrameSpool::beginRead(Record& record) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_.empty()) {
+            return false;
+        }
+
+        record = pending_.front();
+        pending_.pop_front();
+        readInFlight_ = true;
+
+        if (pending_.empty()) {
+            drainedCv_.notify_all();
+        }
+        return true;
+    }
+
+    HRESULT VideoFrameSpool::completeRead(const Record& record, uint8_t* destination) {
+        HRESULT hr = S_OK;
+        const size_t alignedBytes = alignUp(record.bytes);
+
+        if (!isOpen() || !ensureStaging(readStaging_, readStagingBytes_, alignedBytes)) {
+            LOG(LL_ERR, "VideoFrameSpool::completeRead - Spool not readable for frame ", record.frameIndex);
+            hr = E_FAIL;
+        } else {
+            if (!readAt(readStaging_, alignedBytes, record.bytes, record.offset)) {
+                const DWORD err = getLastFileError();
+                LOG(LL_ERR, "VideoFrameSpool::completeRead - Failed to read frame ", record.frameIndex,
+                    " from spool: ", Logger::hex(err, 8));
+                hr = E_FAIL;
+            } else {
+                std::memcpy(destination, readStaging_, record.bytes);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            readInFlight_ = false;
+        }
+        return hr;
+    }
+
+    VideoFrameSpool::Stats VideoFrameSpool::getStats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+#ifdef _WIN32
+    HRESULT VideoFrameSpool::openFile() {
+        // Unbuffered I/O keeps multi-gigabyte spills out of the system file cache, which would otherwise
+        // compete with the game for the very memory the in-memory budget is protecting.
+        writeHandle_ = CreateFileW(path_.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                   CREATE_ALWAYS,
+                                   FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_NO_BUFFERING | FILE_FLAG_DELETE_ON_CLOSE |
+                                       FILE_FLAG_SEQUENTIAL_SCAN,
+                                   nullptr);
+        if (writeHandle_ == INVALID_HANDLE_VALUE) {
+            const DWORD err = ::GetLastError();
+            LOG(LL_ERR, "VideoFrameSpool::open - Failed to create spool file ", utf8_encode(path_), ": ",
+                Logger::hex(err, 8));
+            return E_FAIL;
+        }
+
+        readHandle_ = CreateFileW(path_.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (readHandle_ == INVALID_HANDLE_VALUE) {
+            const DWORD err = ::GetLastError();
+            LOG(LL_ERR, "VideoFrameSpool::open - Failed to open spool file for reading: ", Logger::hex(err, 8));
+            return E_FAIL;
+        }
+
+        return S_OK;
+    }
+
+    void VideoFrameSpool::closeFile() {
+        if (readHandle_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(readHandle_);
+            readHandle_ = INVALID_HANDLE_VALUE;
+        }
+
+        // Closing the last handle deletes the file (FILE_FLAG_DELETE_ON_CLOSE).
+        if (writeHandle_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(writeHandle_);
+            writeHandle_ = INVALID_HANDLE_VALUE;
+            LOG(LL_DBG, "VideoFrameSpool::close - Spool file removed: ", utf8_encode(path_));
+        }
+    }
+
+    bool VideoFrameSpool::isOpen() const {
+        return writeHandle_ != INVALID_HANDLE_VALUE;
+    }
+
+    bool VideoFrameSpool::writeAt(const uint8_t* data, size_t bytes, uint64_t offset) {
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFFull);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD written = 0;
+        return WriteFile(writeHandle_, data, static_cast<DWORD>(bytes), &written, &overlapped) && written == bytes;
+    }
+
+    bool VideoFrameSpool::readAt(uint8_t* data, size_t bytes, size_t minimumBytes, uint64_t offset) {
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFFull);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD read = 0;
+        return ReadFile(readHandle_, data, static_cast<DWORD>(bytes), &read, &overlapped) && read >= minimumBytes;
+    }
+
+    DWORD VideoFrameSpool::getLastFileError() {
+        return ::GetLastError();
+    }
+#else
+    HRESULT VideoFrameSpool::openFile() {
+        const std::string path = utf8_encode(path_);
+        const int flags = O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC;
+#ifdef O_DIRECT
+        // Same reason as FILE_FLAG_NO_BUFFERING; tmpfs and some other filesystems refuse it.
+        fileDescriptor_ = ::open(path.c_str(), flags | O_DIRECT, 0600);
+        if (fileDescriptor_ < 0 && errno == EINVAL) {
+            fileDescriptor_ = ::open(path.c_str(), flags, 0600);
+        }
+#else
+        fileDescriptor_ = ::open(path.c_str(), flags, 0600);
+#endif
+        if (fileDescriptor_ < 0) {
+            LOG(LL_ERR, "VideoFrameSpool::open - Failed to create spool file ", path, ": ",
+                Logger::hex(getLastFileError(), 8));
+            return E_FAIL;
+        }
+
+        // Unlinking right away gives the delete-on-close behaviour of the Windows spool.
+        ::unlink(path.c_str());
+        return S_OK;
+    }
+
+    void VideoFrameSpool::closeFile() {
+        if (fileDescriptor_ >= 0) {
+            ::close(fileDescriptor_);
+            fileDescriptor_ = -1;
+            LOG(LL_DBG, "VideoFrameSpool::close - Spool file removed: ", utf8_encode(path_));
+        }
+    }
+
+    bool VideoFrameSpool::isOpen() const {
+        return fileDescriptor_ >= 0;
+    }
+
+    bool VideoFrameSpool::writeAt(const uint8_t* data, size_t bytes, uint64_t offset) {
+        size_t done = 0;
+        while (done < bytes) {
+            const ssize_t written = ::pwrite(fileDescriptor_, data + done, bytes - done, static_cast<off_t>(offset + done));
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+            done += static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    bool VideoFrameSpool::readAt(uint8_t* data, size_t bytes, size_t minimumBytes, uint64_t offset) {
+        size_t done = 0;
+        while (done < bytes) {
+            const ssize_t read = ::pread(fileDescriptor_, data + done, bytes - done, static_cast<off_t>(offset + done));
+            if (read < 0 && errno == EINTR) {
+                continue;
+            }
+            if (read <= 0) {
+                break;
+            }
+            done += static_cast<size_t>(read);
+        }
+        return done >= minimumBytes;
+    }
+
+    DWORD VideoFrameSpool::getLastFileError() {
+        return static_cast<DWORD>(errno);
+    }
+#endif
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+namespace Encoder {
+    // Sequential on-disk overflow for captured frames when the encoder falls behind the in-memory queue budget.
+    // One producer appends whole frames with large sector-aligned unbuffered writes, one consumer reads them
+    // back in FIFO order. The file is opened delete-on-close, so it disappears on close() and on process exit.
+    class VideoFrameSpool {
+    public:
+        struct Record {
+            uint64_t offset = 0;
+            size_t bytes = 0;
+            int rowPitch = 0;
+            int32_t height = 0;
+            int64_t frameIndex = 0;
+        };
+
+        struct Stats {
+            uint64_t spilledFrames = 0;
+            uint64_t spilledBytes = 0;
+            size_t peakPendingFrames = 0;
+            uint64_t peakFileBytes = 0;
+        };
+
+        VideoFrameSpool() = default;
+        ~VideoFrameSpool();
+
+        VideoFrameSpool(const VideoFrameSpool&) = delete;
+        VideoFrameSpool& operator=(const VideoFrameSpool&) = delete;
+
+        HRESULT open(const std::wstring& path, size_t frameBytesHint);
+
+        void close();
+
+        bool isOpen() const;
+
+        bool hasPending() const;
+
+        // Producer side.
+        HRESULT write(const void* data, size_t bytes, int rowPitch, int32_t height, int64_t frameIndex);
+
+        // Blocks until the consumer has taken every spilled frame.
+        void waitUntilDrained();
+
+        // Consumer side: takes the oldest record, then reads its pixels into destination (record.bytes long).
+        bool beginRead(Record& record);
+        HRESULT completeRead(const Record& record, uint8_t* destination);
+
+        Stats getStats() const;
+
+    private:
+        static constexpr size_t kSectorAlignment = 4096;
+
+        static size_t alignUp(size_t value) {
+            return (value + kSectorAlignment - 1) & ~(kSectorAlignment - 1);
+        }
+
+        static bool ensureStaging(uint8_t*& buffer, size_t& capacity, size_t bytes);
+
+        // Platform file access; offsets and lengths are always sector multiples.
+        HRESULT openFile();
+        void closeFile();
+        bool writeAt(const uint8_t* data, size_t bytes, uint64_t offset);
+        bool readAt(uint8_t* data, size_t bytes, size_t minimumBytes, uint64_t offset);
+        static DWORD getLastFileError();
+
+        std::wstring path_;
+#ifdef _WIN32
+        HANDLE writeHandle_ = INVALID_HANDLE_VALUE;
+        HANDLE readHandle_ = INVALID_HANDLE_VALUE;
+#else
+        int fileDescriptor_ = -1;
+#endif
+
+        uint8_t* writeStaging_ = nullptr;
+        size_t writeStagingBytes_ = 0;
+        uint8_t* readStaging_ = nullptr;
+        size_t readStagingBytes_ = 0;
+
+        mutable std::mutex mutex_;
+        std::condition_variable drainedCv_;
+        std::deque<Record> pending_;
+        uint64_t writeOffset_ = 0;
+        bool readInFlight_ = false;
+        Stats stats_;
+    };
+}